@@ -18,7 +18,100 @@ namespace NrfBLESampleWinform
         FN_ON_DISCONNECTED,
         FN_ON_FAILED,
         FN_ON_DATA_RECEIVED,
-        FN_ON_DATA_SENT
+        FN_ON_DATA_SENT,
+        FN_ON_PHY_UPDATED,
+        FN_ON_DATA_BATCH_RECEIVED,
+        FN_ON_AUTH_KEY_REQUEST,
+        FN_ON_RECOVERED,
+        FN_ON_RECONNECTED
+    }
+
+    public enum LogLevel
+    {
+        LOG_TRACE,
+        LOG_DEBUG,
+        LOG_INFO,
+        LOG_WARNING,
+        LOG_ERROR,
+        LOG_FATAL
+    }
+
+    public enum AuthKeyRequest
+    {
+        AUTH_KEY_REQUEST_PASSKEY,
+        AUTH_KEY_REQUEST_NUMERIC_COMPARISON
+    }
+
+    public enum ConnParamProfile
+    {
+        CONN_PARAM_DEFAULT,
+        CONN_PARAM_LOW_LATENCY,
+        CONN_PARAM_THROUGHPUT,
+        CONN_PARAM_POWER_SAVING
+    }
+
+    public enum ConnParamPolicy
+    {
+        CONN_PARAM_POLICY_ACCEPT,
+        CONN_PARAM_POLICY_REJECT,
+        CONN_PARAM_POLICY_PROFILE
+    }
+
+    public enum SetupPhase
+    {
+        SETUP_PHASE_ADV,
+        SETUP_PHASE_CONNECT,
+        SETUP_PHASE_AUTH,
+        SETUP_PHASE_SERVICE_DISC,
+        SETUP_PHASE_CHAR_DISC,
+        SETUP_PHASE_DESC_DISC,
+        SETUP_PHASE_REPORT_REF,
+        SETUP_PHASE_CCCD,
+        SETUP_PHASE_COUNT
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct SetupStep
+    {
+        public SetupPhase Phase;
+        public ushort Handle;
+        public uint StartUs;
+        public uint DurationUs;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct SetupTiming
+    {
+        public uint SetupUs;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = (int)SetupPhase.SETUP_PHASE_COUNT)]
+        public uint[] PhaseUs;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = (int)SetupPhase.SETUP_PHASE_COUNT)]
+        public uint[] PhaseMaxUs;
+        [MarshalAs(UnmanagedType.ByValArray, SizeConst = (int)SetupPhase.SETUP_PHASE_COUNT)]
+        public ushort[] PhaseCount;
+    }
+
+    [StructLayout(LayoutKind.Sequential)]
+    public struct StartupTiming
+    {
+        public uint PrepareUs;
+        public uint KeypairUs;
+        public uint OpenUs;
+        public uint ConfigUs;
+        public uint EnableUs;
+        public uint VersionUs;
+        public uint TotalUs;
+    }
+
+    [StructLayout(LayoutKind.Sequential, CharSet = CharSet.Ansi)]
+    public struct DongleDesc
+    {
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 64)]
+        public string Port;
+        [MarshalAs(UnmanagedType.ByValTStr, SizeConst = 64)]
+        public string SerialNumber;
+        public ushort VendorId;
+        public ushort ProductId;
     }
 
     [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
@@ -66,17 +159,116 @@ namespace NrfBLESampleWinform
         [MarshalAs(UnmanagedType.LPArray, SizeConst = 256)]byte[] data, 
         ushort len);
 
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void FnOnPhyUpdated(byte txPhy, byte rxPhy);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void FnOnDataBatchReceived(
+        ushort count,
+        [MarshalAs(UnmanagedType.LPArray, SizeParamIndex = 0)]ushort[] handles,
+        [MarshalAs(UnmanagedType.LPArray, SizeParamIndex = 0)]ushort[] lens,
+        IntPtr data);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void FnOnAuthKeyRequest(
+        ushort connHandle,
+        AuthKeyRequest request,
+        [MarshalAs(UnmanagedType.LPStr)]string passkey);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void FnOnRecovered(uint errorCode, uint recoveryMs);
+
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    public delegate void FnOnReconnected(
+        byte addr_type,
+        [MarshalAs(UnmanagedType.LPArray, SizeConst = 6)]byte[] addr,
+        uint errorCode,
+        uint outageMs);
+
     public class NrfBLELibrary
     {
         public const int DATA_BUFFER_SIZE = 256;
         public const int BLE_GAP_ADDR_LEN = 6;
+        public const uint GATT_STATUS_ERROR_BASE = 0xC000;
 
         [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "callback_add")]
         public static extern uint CallbackAdd(FnCallbackId fnId, IntPtr fnPtr);
 
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "log_level_set")]
+        public static extern uint LogLevelSet(LogLevel level);
+
         [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_init")]
         public static extern uint DongleInit(string serialPort, uint baudRate);
 
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_init_ex")]
+        public static extern uint DongleInitEx(string serialPort, uint baudRate, bool flowControl, uint retransmissionInterval, uint responseTimeout);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_init_async")]
+        public static extern uint DongleInitAsync(string serialPort, uint baudRate);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_init_wait")]
+        public static extern uint DongleInitWait(uint timeout, ref StartupTiming timing);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "startup_timing_get")]
+        public static extern uint StartupTimingGet(ref StartupTiming timing);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "setup_timing_get")]
+        public static extern uint SetupTimingGet(ref SetupTiming timing, [Out] SetupStep[] steps, ref ushort len);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_enumerate")]
+        public static extern uint DongleEnumerate([In, Out] DongleDesc[] descs, ref uint count);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_probe")]
+        public static extern uint DongleProbe(DongleDesc[] descs, uint count, uint baudRate, [Out] uint[] results);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_init_auto")]
+        public static extern uint DongleInitAuto(uint baudRate, string serialNumber, StringBuilder port);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "link_benchmark")]
+        public static extern uint LinkBenchmark(uint iterations, uint duration, ref float rttAvgUs, ref float rttMaxUs, ref float eventsPerSec);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "recovery_set")]
+        public static extern uint RecoverySet(bool enable, byte attempts, uint interval);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "recovery_stats_get")]
+        public static extern uint RecoveryStatsGet(ref uint recoveries, ref uint failures, ref uint reopenMs, ref uint resumeMs);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "reconnect_set")]
+        public static extern uint ReconnectSet(bool enable, byte attempts, uint backoffMin, uint backoffMax);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "reconnect_peer_set")]
+        public static extern uint ReconnectPeerSet(byte[] addr, bool enable);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "reconnect_stats_get")]
+        public static extern uint ReconnectStatsGet(byte[] addr, ref uint outages, ref uint failures, ref uint lastOutageMs, ref uint maxOutageMs);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_init_simulated")]
+        public static extern uint DongleInitSimulated(ushort peripherals, uint advInterval, uint notifyInterval, ushort notifyLen, uint latencyUs, uint seed);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "simulator_stats_get")]
+        public static extern uint SimulatorStatsGet(ref uint events, ref uint advReports, ref uint notifications, ref ulong notifiedBytes);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "simulator_disconnect")]
+        public static extern uint SimulatorDisconnect(byte reason);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "simulator_transport_error")]
+        public static extern uint SimulatorTransportError();
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "event_record_start")]
+        public static extern uint EventRecordStart(string path);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "event_record_stop")]
+        public static extern uint EventRecordStop(ref uint events, ref ulong bytes);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "event_replay")]
+        public static extern uint EventReplay(string path, float speed, ref uint events, ref float eventsPerSec);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "event_replay_stats_get")]
+        public static extern uint EventReplayStatsGet(ushort[] evtIds, uint[] counts, float[] avgUs, float[] maxUs, ref ushort len);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "stack_config_set")]
+        public static extern uint StackConfigSet(float eventLength, bool connEvtExt, byte writeCmdTxQueueSize, byte hvnTxQueueSize, byte connCount);
+
         [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "keypair_init")]
         public static extern uint KeypairInit(bool renew);
 
@@ -97,6 +289,16 @@ namespace NrfBLESampleWinform
         public static extern uint AuthStart(bool bond, bool keypress, byte ioCaps, 
             [MarshalAs(UnmanagedType.LPStr, SizeConst = 6)]string passkey);
 
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "auth_key_reply")]
+        public static extern uint AuthKeyReply(ushort connHandle,
+            [MarshalAs(UnmanagedType.LPStr, SizeConst = 6)]string passkey);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "auth_numeric_reply")]
+        public static extern uint AuthNumericReply(ushort connHandle, bool match);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "auth_key_timeout_set")]
+        public static extern uint AuthKeyTimeoutSet(uint timeout);
+
         [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "service_discovery_start")]
         public static extern uint ServiceDiscoveryStart(ushort uuid, byte type);
 
@@ -132,12 +334,66 @@ namespace NrfBLESampleWinform
         public static extern uint DataWriteByReportRef(byte[] reportRef,
             [MarshalAs(UnmanagedType.LPArray, SizeConst = DATA_BUFFER_SIZE)]byte[] data, ushort len, ushort timeout);
 
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "data_read_multiple")]
+        public static extern uint DataReadMultiple(ushort[] handles, ushort[] lens, ushort count);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "data_read_by_uuid")]
+        public static extern uint DataReadByUuid(ushort uuid, byte type, ushort startHandle, ushort endHandle);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "phy_set_preference")]
+        public static extern uint PhySetPreference(byte txPhys, byte rxPhys);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "phy_get")]
+        public static extern uint PhyGet(ref byte txPhy, ref byte rxPhy);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "conn_param_profile_set")]
+        public static extern uint ConnParamProfileSet(ConnParamProfile profile);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "conn_param_policy_set")]
+        public static extern uint ConnParamPolicySet(ConnParamPolicy policy);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "conn_param_get")]
+        public static extern uint ConnParamGet(ref float interval, ref ushort latency, ref ushort timeout);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "ecc_benchmark")]
+        public static extern uint EccBenchmark(byte backend, uint iterations, ref float keygenOps, ref float ecdhOps);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "ecc_selftest")]
+        public static extern uint EccSelftest(byte backend, uint iterations, ref float pairingUs);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "rng_benchmark")]
+        public static extern uint RngBenchmark(uint requestSize, uint totalSize, ref float bytesPerSec);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "ecc_valid_public_key_batch")]
+        public static extern uint EccValidPublicKeyBatch(byte[] pks, uint count, byte[] results, byte threads, ref float opsPerSec);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "ecc_shared_secret_batch")]
+        public static extern uint EccSharedSecretBatch(byte[] sks, uint skCount, byte[] pks, uint count, byte[] secrets, byte[] results, byte threads, ref float opsPerSec);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "oob_peer_set")]
+        public static extern uint OobPeerSet(byte[] addr, byte[] random, byte[] confirm);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "oob_tk_set")]
+        public static extern uint OobTkSet(byte[] addr, byte[] tk);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "oob_own_get")]
+        public static extern uint OobOwnGet(byte[] addr, byte[] random, byte[] confirm);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "oob_clear")]
+        public static extern uint OobClear(byte[] addr);
+
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "oob_confirm_compute")]
+        public static extern uint OobConfirmCompute(byte[] pk, byte[] random, byte[] confirm);
+
         [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_disconnect")]
         public static extern uint DongleDisconnect();
 
         [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_reset")]
         public static extern uint DongleReset();
 
+        [DllImport("nrf_ble_library.dll", CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi, EntryPoint = "dongle_shutdown")]
+        public static extern uint DongleShutdown(uint timeout, ref uint elapsedMs);
+
     }
 
 
@@ -0,0 +1,408 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+
+#include "security.h"
+#include "rng.h"
+#include "irk.h"
+#include "aes.h"
+#if defined(NRF_BLE_BENCH_SIMULATED)
+#include "dongle.h"
+#endif
+
+// host side hot paths of nrf_ble_library measured without dongle, run by perf or valgrind on Linux,
+// crypto is linked from nrf_ble_security, connection flow runs against simulated backend of the library
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static double elapsed_us(bench_clock_t::time_point start)
+{
+	return std::chrono::duration<double, std::micro>(bench_clock_t::now() - start).count();
+}
+
+void bench_ecc(uint32_t iterations)
+{
+	printf("[bench] ecc backend in build: %s\n", ecc_backend_name());
+	for (uint8_t backend = ECC_BACKEND_UECC; backend <= ECC_BACKEND_P256_64; backend++) {
+		float keygen_ops = 0, ecdh_ops = 0, pairing_us = 0;
+		if (ecc_p256_benchmark(backend, iterations, &keygen_ops, &ecdh_ops) != 1) {
+			printf("[bench] ecc backend:%d not supported\n", backend);
+			continue;
+		}
+		int ret = ecc_p256_selftest(backend, iterations, &pairing_us);
+		printf("[bench] ecc backend:%d keygen:%.1f ops/s ecdh:%.1f ops/s selftest:%s pairing crypto:%.1f us\n",
+			backend, keygen_ops, ecdh_ops, ret == 1 ? "pass" : "FAIL", pairing_us);
+	}
+
+	// provisioning line validates peer keys in batches
+	std::vector<uint8_t> pks(iterations * ECC_P256_PK_LEN);
+	std::vector<uint8_t> results(iterations);
+	ecc_keypair_t keypair;
+	for (uint32_t i = 0; i < iterations; i++) {
+		ecc_keypair_generate(&keypair);
+		memcpy(&pks[i * ECC_P256_PK_LEN], keypair.pk, ECC_P256_PK_LEN);
+	}
+	ecc_keypair_clear(&keypair);
+	float ops_per_sec = 0;
+	int valid = ecc_p256_valid_public_key_batch(pks.data(), iterations, results.data(), 0, &ops_per_sec);
+	printf("[bench] ecc batch validation: %d/%d valid, %.1f ops/s\n", valid, iterations, ops_per_sec);
+	ecc_pool_stop();
+}
+
+void bench_rng()
+{
+	uint32_t request_sizes[] = { 16, 32, 64, 1024 };
+	for (auto request_size : request_sizes) {
+		float bytes_per_sec = 0;
+		int ret = rng_throughput(request_size, 4 * 1024 * 1024, &bytes_per_sec);
+		printf("[bench] rng request:%d bytes %s %.1f MB/s\n", request_size, ret == 1 ? "ok" : "FAIL", bytes_per_sec / (1024 * 1024));
+	}
+}
+
+void bench_aes(uint32_t iterations)
+{
+	uint8_t k[AES_BLOCK_LEN] = { 0 };
+	uint8_t m[64] = { 0 };
+	uint8_t mac[AES_BLOCK_LEN] = { 0 };
+	rng_fill(k, sizeof(k));
+	rng_fill(m, sizeof(m));
+	aes_key_t key;
+	aes_expand_key(&key, k);
+
+	auto start = bench_clock_t::now();
+	for (uint32_t i = 0; i < iterations * 100; i++)
+		aes_encrypt(&key, mac, mac);
+	double block_us = elapsed_us(start) / (iterations * 100);
+
+	// f4 of LESC OOB confirm is a CMAC of 65 bytes
+	start = bench_clock_t::now();
+	for (uint32_t i = 0; i < iterations * 100; i++)
+		aes_cmac(k, m, sizeof(m), mac);
+	double cmac_us = elapsed_us(start) / (iterations * 100);
+	printf("[bench] aes block:%.3f us cmac(64 bytes):%.3f us\n", block_us, cmac_us);
+	secure_zero(&key, sizeof(key));
+}
+
+void bench_irk(uint32_t iterations)
+{
+	// RPA of the last bonded peer is the worst case of a table scan
+	const uint32_t bonds = 32;
+	uint8_t irk[IRK_LEN] = { 0 };
+	irk_table_clear();
+	for (uint32_t i = 0; i < bonds; i++) {
+		rng_fill(irk, sizeof(irk));
+		irk_table_add(i, irk);
+	}
+
+	// prand with 0b01 in two most significant bits, hash = ah(irk, prand)
+	std::vector<std::vector<uint8_t>> addrs;
+	uint8_t irk_be[IRK_LEN];
+	for (int i = 0; i < IRK_LEN; i++)
+		irk_be[i] = irk[IRK_LEN - 1 - i];
+	aes_key_t key;
+	aes_expand_key(&key, irk_be);
+	for (uint32_t i = 0; i < iterations; i++) {
+		uint8_t addr[6] = { 0 };
+		uint8_t block[AES_BLOCK_LEN] = { 0 };
+		rng_fill(&addr[3], 3);
+		addr[5] = (addr[5] & 0x3F) | 0x40;
+		block[13] = addr[5];
+		block[14] = addr[4];
+		block[15] = addr[3];
+		aes_encrypt(&key, block, block);
+		addr[0] = block[15];
+		addr[1] = block[14];
+		addr[2] = block[13];
+		addrs.push_back(std::vector<uint8_t>(addr, addr + 6));
+	}
+	secure_zero(&key, sizeof(key));
+	secure_zero(irk, sizeof(irk));
+	secure_zero(irk_be, sizeof(irk_be));
+
+	uint32_t resolved = 0;
+	uint64_t id = 0;
+	auto start = bench_clock_t::now();
+	for (auto& addr : addrs)
+		resolved += irk_resolve(addr.data(), &id);
+	double miss_us = elapsed_us(start) / iterations;
+
+	// advertising reports repeat the same address until it rotates
+	start = bench_clock_t::now();
+	for (auto& addr : addrs)
+		irk_resolve(addr.data(), &id);
+	double hit_us = elapsed_us(start) / iterations;
+	printf("[bench] irk resolve %d bonds: %d/%d resolved, uncached:%.3f us cached:%.3f us\n",
+		bonds, resolved, iterations, miss_us, hit_us);
+	irk_table_clear();
+}
+
+#if defined(NRF_BLE_BENCH_SIMULATED)
+
+#define BENCH_TRACE_PATH "nrf_ble_benchmark.trace"
+
+static std::atomic<uint32_t> m_received(0);
+static std::atomic<uint64_t> m_received_bytes(0);
+static std::atomic<bool> m_recovered(false);
+static std::atomic<bool> m_reconnected(false);
+static uint8_t m_connected_addr[6] = { 0 };
+
+void on_bench_data_received(uint16_t handle, uint8_t *data, uint16_t len)
+{
+	m_received++;
+	m_received_bytes += len;
+}
+
+void on_bench_recovered(uint32_t error_code, uint32_t recovery_ms)
+{
+	printf("[bench] recovered code:%d in %d ms\n", error_code, recovery_ms);
+	m_recovered = true;
+}
+
+void on_bench_connected(uint8_t addr_type, uint8_t *addr)
+{
+	memcpy(m_connected_addr, addr, sizeof(m_connected_addr));
+}
+
+void on_bench_reconnected(uint8_t addr_type, uint8_t *addr, uint32_t error_code, uint32_t outage_ms)
+{
+	printf("[bench] reconnected code:%d outage %d ms\n", error_code, outage_ms);
+	m_reconnected = true;
+}
+
+void print_latency(const char *name, std::vector<double> &samples)
+{
+	if (samples.empty()) {
+		printf("[bench] %s: no samples\n", name);
+		return;
+	}
+	std::sort(samples.begin(), samples.end());
+	double sum = 0;
+	for (auto us : samples)
+		sum += us;
+	printf("[bench] %s: avg:%.1f us p50:%.1f us p99:%.1f us max:%.1f us in %d\n", name, sum / samples.size(),
+		samples[samples.size() / 2], samples[samples.size() * 99 / 100], samples.back(), (int)samples.size());
+}
+
+// handlers of captured events without simulator, as fast as possible
+void bench_replay(const char *path)
+{
+	uint32_t events = 0;
+	float events_per_sec = 0;
+	uint32_t error_code = event_replay(path, 0, &events, &events_per_sec);
+	printf("[bench] replay code:%d events:%d %.1f events/s\n", error_code, events, events_per_sec);
+	if (error_code == 0) {
+		uint16_t evt_ids[64] = { 0 };
+		uint32_t counts[64] = { 0 };
+		float avg_us[64] = { 0 }, max_us[64] = { 0 };
+		uint16_t len = 64;
+		event_replay_stats_get(evt_ids, counts, avg_us, max_us, &len);
+		for (uint16_t i = 0; i < len; i++)
+			printf("[bench] replay evt:0x%02x count:%d avg:%.2f us max:%.1f us\n", evt_ids[i], counts[i], avg_us[i], max_us[i]);
+	}
+	dongle_reset();
+}
+
+// connection setup, notification throughput and GATT round trips of library on simulated links
+uint32_t bench_simulated(uint32_t iterations, uint32_t seconds, uint16_t peripherals, uint32_t notify_interval, uint16_t notify_len, uint32_t latency_us)
+{
+	log_level_set(LOG_WARNING);
+	callback_add(FN_ON_DATA_RECEIVED, (void*)&on_bench_data_received);
+	callback_add(FN_ON_RECOVERED, (void*)&on_bench_recovered);
+	callback_add(FN_ON_CONNECTED, (void*)&on_bench_connected);
+	callback_add(FN_ON_RECONNECTED, (void*)&on_bench_reconnected);
+
+	uint32_t error_code = dongle_init_simulated(peripherals, 100, notify_interval, notify_len, latency_us, 1);
+	if (error_code != 0) {
+		printf("[bench] simulated init failed, code:%d\n", error_code);
+		return error_code;
+	}
+	// host preparation overlaps backend open, total below the sum of phases
+	startup_timing_t timing = { 0 };
+	startup_timing_get(&timing);
+	printf("[bench] startup total:%.1f ms host:%.1f ms transport:%.1f ms (prepare:%.1f key pair:%.1f open:%.1f config:%.1f enable:%.1f version:%.1f)\n",
+		timing.total_us / 1000.0, (timing.prepare_us + timing.keypair_us) / 1000.0,
+		(timing.open_us + timing.config_us + timing.enable_us + timing.version_us) / 1000.0,
+		timing.prepare_us / 1000.0, timing.keypair_us / 1000.0, timing.open_us / 1000.0,
+		timing.config_us / 1000.0, timing.enable_us / 1000.0, timing.version_us / 1000.0);
+
+	// transport bound measurement as on dongle, reports of simulated peripherals only
+	float rtt_avg = 0, rtt_max = 0, events_per_sec = 0;
+	error_code = link_benchmark(iterations, 500, &rtt_avg, &rtt_max, &events_per_sec);
+	printf("[bench] link code:%d rtt avg:%.1f us max:%.1f us events:%.1f/s\n", error_code, rtt_avg, rtt_max, events_per_sec);
+
+	// captured session is replayed without simulator afterwards
+	event_record_start(BENCH_TRACE_PATH);
+
+	// scan, connect, LESC pairing, discovery and CCCD writes
+	auto start = bench_clock_t::now();
+	error_code = device_find(NULL, -60, "123456", 10000);
+	printf("[bench] device find code:%d setup:%.1f ms\n", error_code, elapsed_us(start) / 1000);
+	if (error_code != 0) {
+		event_record_stop(NULL, NULL);
+		dongle_reset();
+		return error_code;
+	}
+
+	// where the setup time goes, slowest phase first to look at
+	static const char *phase_names[SETUP_PHASE_COUNT] = {
+		"adv", "connect", "auth", "service disc", "char disc", "desc disc", "report ref", "cccd" };
+	setup_timing_t setup = { 0 };
+	uint16_t steps = 0;
+	setup_timing_get(&setup, NULL, &steps);
+	printf("[bench] setup phases: %.1f ms in %d steps\n", setup.setup_us / 1000.0, steps);
+	for (int i = 0; i < SETUP_PHASE_COUNT; i++) {
+		if (setup.phase_count[i] > 0)
+			printf("[bench]   %s: %dx %.1f ms max:%.1f ms\n", phase_names[i], setup.phase_count[i],
+				setup.phase_us[i] / 1000.0, setup.phase_max_us[i] / 1000.0);
+	}
+
+	uint16_t handles[16] = { 0 };
+	uint8_t refs[32] = { 0 };
+	uint16_t count = 16;
+	report_char_list(handles, refs, &count);
+	uint16_t input_handle = 0, output_handle = 0;
+	for (uint16_t i = 0; i < count; i++) {
+		if (refs[i * 2 + 1] == 1 && input_handle == 0)
+			input_handle = handles[i];
+		if (refs[i * 2 + 1] == 2 && output_handle == 0)
+			output_handle = handles[i];
+	}
+
+	uint32_t events = 0, adv_reports = 0, notifications = 0;
+	uint64_t notified_bytes = 0;
+	simulator_stats_get(&events, NULL, &notifications, &notified_bytes);
+	uint32_t base_events = events, base_notifications = notifications;
+	m_received = 0;
+	m_received_bytes = 0;
+	start = bench_clock_t::now();
+	std::this_thread::sleep_for(std::chrono::seconds(seconds));
+	double elapsed_s = elapsed_us(start) / 1000000;
+	simulator_stats_get(&events, &adv_reports, &notifications, &notified_bytes);
+	printf("[bench] notifications: generated:%d delivered:%d %.1f/s %.1f KB/s, events:%.1f/s\n",
+		notifications - base_notifications, (uint32_t)m_received, m_received / elapsed_s,
+		m_received_bytes / elapsed_s / 1024, (events - base_events) / elapsed_s);
+
+	std::vector<double> samples;
+	uint8_t data[512] = { 0 };
+	for (uint32_t i = 0; i < iterations && input_handle != 0; i++) {
+		uint16_t len = sizeof(data);
+		start = bench_clock_t::now();
+		if (data_read(input_handle, data, &len, 2000) == 0)
+			samples.push_back(elapsed_us(start));
+	}
+	print_latency("read round trip", samples);
+
+	// error response of peer is returned as GATT status, 0x0101 invalid handle
+	uint16_t len = sizeof(data);
+	error_code = data_read(0xFFFF, data, &len, 2000);
+	printf("[bench] read error code:0x%x %s\n", error_code, error_code == GATT_STATUS_ERROR_BASE + 0x0101 ? "ok" : "FAIL");
+
+	samples.clear();
+	for (uint32_t i = 0; i < iterations && output_handle != 0; i++) {
+		data[0] = (uint8_t)i;
+		start = bench_clock_t::now();
+		if (data_write(output_handle, data, 1, 2000) == 0)
+			samples.push_back(elapsed_us(start));
+	}
+	print_latency("write round trip", samples);
+
+	// input report is not writable, 0x0103 write not permitted, by a write and by the first part of a prepared write
+	uint32_t write_code = data_write(input_handle, data, 1, 2000);
+	uint32_t long_write_code = data_write(input_handle, data, sizeof(data), 2000);
+	printf("[bench] write error code:0x%x long write error code:0x%x %s\n", write_code, long_write_code,
+		write_code == GATT_STATUS_ERROR_BASE + 0x0103 && long_write_code == GATT_STATUS_ERROR_BASE + 0x0103 ? "ok" : "FAIL");
+
+	// serial transport fails, adapter is reopened and the link resumed by stored LTK and cached GATT data
+	m_recovered = false;
+	simulator_transport_error();
+	for (int i = 0; i < 300 && !m_recovered; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	uint32_t recoveries = 0, failures = 0, reopen_ms = 0, resume_ms = 0;
+	recovery_stats_get(&recoveries, &failures, &reopen_ms, &resume_ms);
+	m_received = 0;
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	printf("[bench] recovery: %d ok %d failed, reopen:%d ms resume:%d ms, notifications after:%d\n",
+		recoveries, failures, reopen_ms, resume_ms, (uint32_t)m_received);
+
+	// trace ends here, reconnection below enables services from GATT cache which replay has no event of
+	uint32_t recorded = 0;
+	uint64_t trace_bytes = 0;
+	event_record_stop(&recorded, &trace_bytes);
+	printf("[bench] trace: %d events in %llu bytes\n", recorded, (unsigned long long)trace_bytes);
+
+	// supervision timeout of the link, peer is connected again directly and resumed without discovery
+	reconnect_set(true, 5, 50, 1000);
+	reconnect_peer_set(m_connected_addr, true);
+	m_reconnected = false;
+	simulator_disconnect(0x08);
+	for (int i = 0; i < 300 && !m_reconnected; i++)
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+	uint32_t outages = 0, outage_failures = 0, last_outage_ms = 0, max_outage_ms = 0;
+	reconnect_stats_get(m_connected_addr, &outages, &outage_failures, &last_outage_ms, &max_outage_ms);
+	m_received = 0;
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	printf("[bench] reconnect: %d outages %d failed, last:%d ms max:%d ms, notifications after:%d\n",
+		outages, outage_failures, last_outage_ms, max_outage_ms, (uint32_t)m_received);
+	reconnect_set(false, 5, 50, 1000);
+
+	// disconnect and close bounded by disconnected event instead of a fixed wait
+	uint32_t shutdown_ms = 0;
+	error_code = dongle_shutdown(1000, &shutdown_ms);
+	printf("[bench] shutdown code:%d in %d ms\n", error_code, shutdown_ms);
+
+	bench_replay(BENCH_TRACE_PATH);
+	remove(BENCH_TRACE_PATH);
+	return 0;
+}
+
+#endif
+
+void print_usage()
+{
+	printf("[bench] usage: nrf_ble_benchmark [iterations] [seconds] [peripherals] [notify_interval] [notify_len] [latency_us]\n" \
+		"    iterations      :Crypto operations and GATT round trips of each measurement, default 200\n" \
+		"    seconds         :Duration of notification throughput on simulated link, default 3\n" \
+		"    peripherals     :Simulated peripherals advertising, default 8\n" \
+		"    notify_interval :Notification interval(ms) of each enabled CCCD, default 1\n" \
+		"    notify_len      :Input report length, default 64\n" \
+		"    latency_us      :Simulated link latency of each request, default 500\n");
+}
+
+int main(int argc, char * argv[])
+{
+	if (argc > 1 && (strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "help") == 0)) {
+		print_usage();
+		return 0;
+	}
+
+	uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 10) : 200;
+	uint32_t seconds = argc > 2 ? strtoul(argv[2], NULL, 10) : 3;
+	if (iterations == 0) {
+		print_usage();
+		return 1;
+	}
+
+	ecc_init();
+	bench_ecc(iterations);
+	bench_rng();
+	bench_aes(iterations);
+	bench_irk(iterations);
+
+#if defined(NRF_BLE_BENCH_SIMULATED)
+	uint16_t peripherals = argc > 3 ? (uint16_t)strtoul(argv[3], NULL, 10) : 8;
+	uint32_t notify_interval = argc > 4 ? strtoul(argv[4], NULL, 10) : 1;
+	uint16_t notify_len = argc > 5 ? (uint16_t)strtoul(argv[5], NULL, 10) : 64;
+	uint32_t latency_us = argc > 6 ? strtoul(argv[6], NULL, 10) : 500;
+	if (bench_simulated(iterations, seconds, peripherals, notify_interval, notify_len, latency_us) != 0)
+		return 1;
+#else
+	(void)seconds;
+	printf("[bench] built without nrf-ble-driver, simulated connection benchmark skipped\n");
+#endif
+	return 0;
+}
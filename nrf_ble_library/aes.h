@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+
+// AES-128 block encryption and AES-CMAC of bluetooth security functions,
+// all bytes are in big-endian as the spec, callers convert from SoftDevice little-endian
+
+#define AES_BLOCK_LEN 16
+
+/* expanded encryption key, 11 round keys */
+typedef struct _aes_key_t {
+	uint8_t rk[176];
+} aes_key_t;
+
+void aes_expand_key(aes_key_t* key, const uint8_t k[AES_BLOCK_LEN]);
+void aes_encrypt(const aes_key_t* key, const uint8_t in[AES_BLOCK_LEN], uint8_t out[AES_BLOCK_LEN]);
+// RFC 4493 AES-CMAC of message m with len bytes
+void aes_cmac(const uint8_t k[AES_BLOCK_LEN], const uint8_t* m, uint32_t len, uint8_t mac[AES_BLOCK_LEN]);
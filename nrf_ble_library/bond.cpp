@@ -0,0 +1,548 @@
+#include "bond.h"
+#include "security.h"
+#include "platform.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+/*
+file layout: "NBLB" magic, u16 version, then entries appended in order,
+entry: u8 type, u64 addr_num, u32 payload length, payload, u32 crc32 of all previous fields,
+loading replays entries and stops at the first truncated or corrupted one
+*/
+#define BOND_MAGIC "NBLB"
+#define BOND_VERSION 1
+#define BOND_BAD_SUFFIX ".bad"
+#define BOND_HEADER_LEN 6
+#define BOND_ENTRY_HEADER_LEN 13 /* type, addr_num, length */
+#define BOND_ENTRY_OVERHEAD 17 /* header and crc32 */
+#define BOND_PAYLOAD_MAX 0x10000
+/* rewrite the file when stale entries are more than live ones and this count */
+#define BOND_COMPACT_THRESHOLD 32
+
+typedef enum _bond_entry_type_t {
+	BOND_ENTRY_PUT = 1,
+	BOND_ENTRY_DELETE,
+	BOND_ENTRY_LOCAL_KEY
+} bond_entry_type_t;
+
+typedef std::vector<uint8_t> bond_entry_t;
+
+static std::mutex m_bond_mtx;
+static std::condition_variable m_bond_cond;
+static std::map<uint64_t, bond_data_t> m_bonds;
+static uint8_t m_local_sk[BOND_SK_LEN] = { 0 };
+static uint8_t m_local_pk[BOND_PK_LEN] = { 0 };
+static bool m_local_key_stored = false;
+static std::string m_bond_path;
+static FILE* m_bond_file = NULL;
+static std::deque<bond_entry_t> m_bond_pending;
+static uint32_t m_bond_entries = 0; /* entries in file, compared with live records */
+static bool m_bond_writing = false; /* writer thread is writing taken entries or compacting */
+static bool m_bond_compact_needed = false; /* tail of an interrupted write to cut, or over threshold at open */
+static bool m_bond_running = false;
+static bool m_bond_active = false; /* writer thread alive */
+
+static uint32_t crc32(const uint8_t* data, size_t len) {
+	uint32_t crc = 0xFFFFFFFF;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i];
+		for (int j = 0; j < 8; j++)
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+	}
+	return ~crc;
+}
+
+/* little endian field writer and reader */
+
+static void put_u8(bond_entry_t& buf, uint8_t v) {
+	buf.push_back(v);
+}
+
+static void put_u16(bond_entry_t& buf, uint16_t v) {
+	buf.push_back((uint8_t)v);
+	buf.push_back((uint8_t)(v >> 8));
+}
+
+static void put_u32(bond_entry_t& buf, uint32_t v) {
+	for (int i = 0; i < 4; i++)
+		buf.push_back((uint8_t)(v >> (i * 8)));
+}
+
+static void put_u64(bond_entry_t& buf, uint64_t v) {
+	for (int i = 0; i < 8; i++)
+		buf.push_back((uint8_t)(v >> (i * 8)));
+}
+
+static void put_bytes(bond_entry_t& buf, const uint8_t* p, size_t len) {
+	buf.insert(buf.end(), p, p + len);
+}
+
+typedef struct _bond_reader_t {
+	const uint8_t* p;
+	size_t len;
+	size_t pos;
+	bool ok;
+} bond_reader_t;
+
+static const uint8_t* get_bytes(bond_reader_t& rd, size_t len) {
+	if (!rd.ok || rd.pos + len > rd.len) {
+		rd.ok = false;
+		return NULL;
+	}
+	const uint8_t* p = &rd.p[rd.pos];
+	rd.pos += len;
+	return p;
+}
+
+static void get_copy(bond_reader_t& rd, uint8_t* dst, size_t len) {
+	const uint8_t* p = get_bytes(rd, len);
+	if (p != NULL)
+		memcpy(dst, p, len);
+}
+
+static uint8_t get_u8(bond_reader_t& rd) {
+	const uint8_t* p = get_bytes(rd, 1);
+	return p != NULL ? p[0] : 0;
+}
+
+static uint16_t get_u16(bond_reader_t& rd) {
+	const uint8_t* p = get_bytes(rd, 2);
+	return p != NULL ? (uint16_t)(p[0] | (p[1] << 8)) : 0;
+}
+
+static uint32_t get_u32(bond_reader_t& rd) {
+	const uint8_t* p = get_bytes(rd, 4);
+	uint32_t v = 0;
+	for (int i = 0; p != NULL && i < 4; i++)
+		v |= (uint32_t)p[i] << (i * 8);
+	return v;
+}
+
+static uint64_t get_u64(bond_reader_t& rd) {
+	const uint8_t* p = get_bytes(rd, 8);
+	uint64_t v = 0;
+	for (int i = 0; p != NULL && i < 8; i++)
+		v |= (uint64_t)p[i] << (i * 8);
+	return v;
+}
+
+static void put_enc_key(bond_entry_t& buf, const bond_enc_key_t& key) {
+	put_bytes(buf, key.ltk, BOND_KEY_LEN);
+	put_u8(buf, key.ltk_len);
+	put_u8(buf, key.auth);
+	put_u8(buf, key.lesc);
+	put_u16(buf, key.ediv);
+	put_bytes(buf, key.rand, BOND_RAND_LEN);
+}
+
+static void get_enc_key(bond_reader_t& rd, bond_enc_key_t& key) {
+	get_copy(rd, key.ltk, BOND_KEY_LEN);
+	key.ltk_len = get_u8(rd);
+	key.auth = get_u8(rd);
+	key.lesc = get_u8(rd);
+	key.ediv = get_u16(rd);
+	get_copy(rd, key.rand, BOND_RAND_LEN);
+}
+
+static void put_bond_data(bond_entry_t& buf, const bond_data_t& data) {
+	put_u8(buf, data.flags);
+	put_u8(buf, data.addr_type);
+	put_bytes(buf, data.addr, BOND_ADDR_LEN);
+	put_enc_key(buf, data.own_enc);
+	put_enc_key(buf, data.peer_enc);
+	put_bytes(buf, data.peer_irk, BOND_KEY_LEN);
+	put_u8(buf, data.peer_id_addr_type);
+	put_bytes(buf, data.peer_id_addr, BOND_ADDR_LEN);
+	put_bytes(buf, data.peer_csrk, BOND_KEY_LEN);
+	put_bytes(buf, data.own_pk, BOND_PK_LEN);
+	put_bytes(buf, data.peer_pk, BOND_PK_LEN);
+	put_u16(buf, (uint16_t)data.gatt.size());
+	put_bytes(buf, data.gatt.data(), data.gatt.size());
+}
+
+static bool get_bond_data(bond_reader_t& rd, bond_data_t& data) {
+	data.flags = get_u8(rd);
+	data.addr_type = get_u8(rd);
+	get_copy(rd, data.addr, BOND_ADDR_LEN);
+	get_enc_key(rd, data.own_enc);
+	get_enc_key(rd, data.peer_enc);
+	get_copy(rd, data.peer_irk, BOND_KEY_LEN);
+	data.peer_id_addr_type = get_u8(rd);
+	get_copy(rd, data.peer_id_addr, BOND_ADDR_LEN);
+	get_copy(rd, data.peer_csrk, BOND_KEY_LEN);
+	get_copy(rd, data.own_pk, BOND_PK_LEN);
+	get_copy(rd, data.peer_pk, BOND_PK_LEN);
+	uint16_t gatt_len = get_u16(rd);
+	const uint8_t* gatt = get_bytes(rd, gatt_len);
+	if (gatt != NULL)
+		data.gatt.assign(gatt, gatt + gatt_len);
+	return rd.ok;
+}
+
+static bond_entry_t make_entry(bond_entry_type_t type, uint64_t addr_num, const bond_entry_t& payload) {
+	bond_entry_t entry;
+	entry.reserve(BOND_ENTRY_OVERHEAD + payload.size());
+	put_u8(entry, (uint8_t)type);
+	put_u64(entry, addr_num);
+	put_u32(entry, (uint32_t)payload.size());
+	put_bytes(entry, payload.data(), payload.size());
+	put_u32(entry, crc32(entry.data(), entry.size()));
+	return entry;
+}
+
+static bond_entry_t make_local_key_entry() {
+	bond_entry_t payload;
+	put_bytes(payload, m_local_sk, BOND_SK_LEN);
+	put_bytes(payload, m_local_pk, BOND_PK_LEN);
+	bond_entry_t entry = make_entry(BOND_ENTRY_LOCAL_KEY, 0, payload);
+	secure_zero(payload.data(), payload.size());
+	return entry;
+}
+
+static void wipe_entry(bond_entry_t& entry) {
+	secure_zero(entry.data(), entry.size());
+}
+
+// replay file entries into memory, return file length of valid entries or -1 if not a bond file
+static long bond_load(FILE* f) {
+	uint8_t header[BOND_HEADER_LEN];
+	if (fread(header, 1, BOND_HEADER_LEN, f) != BOND_HEADER_LEN)
+		return -1;
+	if (memcmp(header, BOND_MAGIC, 4) != 0 || (header[4] | (header[5] << 8)) != BOND_VERSION)
+		return -1;
+
+	long valid_len = BOND_HEADER_LEN;
+	bond_entry_t entry;
+	while (true) {
+		entry.resize(BOND_ENTRY_HEADER_LEN);
+		if (fread(entry.data(), 1, BOND_ENTRY_HEADER_LEN, f) != BOND_ENTRY_HEADER_LEN)
+			break;
+		bond_reader_t rd = { entry.data(), entry.size(), 0, true };
+		uint8_t type = get_u8(rd);
+		uint64_t addr_num = get_u64(rd);
+		uint32_t len = get_u32(rd);
+		if (len > BOND_PAYLOAD_MAX)
+			break;
+		entry.resize(BOND_ENTRY_OVERHEAD + len);
+		if (fread(&entry[BOND_ENTRY_HEADER_LEN], 1, len + 4, f) != len + 4)
+			break;
+		rd = { entry.data(), entry.size(), BOND_ENTRY_HEADER_LEN + len, true };
+		if (get_u32(rd) != crc32(entry.data(), BOND_ENTRY_HEADER_LEN + len))
+			break;
+
+		rd = { entry.data(), BOND_ENTRY_HEADER_LEN + len, BOND_ENTRY_HEADER_LEN, true };
+		if (type == BOND_ENTRY_PUT) {
+			bond_data_t data;
+			if (!get_bond_data(rd, data))
+				break;
+			m_bonds[addr_num] = data;
+		}
+		else if (type == BOND_ENTRY_DELETE) {
+			m_bonds.erase(addr_num);
+		}
+		else if (type == BOND_ENTRY_LOCAL_KEY) {
+			get_copy(rd, m_local_sk, BOND_SK_LEN);
+			get_copy(rd, m_local_pk, BOND_PK_LEN);
+			if (!rd.ok)
+				break;
+			m_local_key_stored = true;
+		}
+		else {
+			break;
+		}
+		wipe_entry(entry);
+		m_bond_entries++;
+		valid_len += (long)(BOND_ENTRY_OVERHEAD + len);
+	}
+	wipe_entry(entry);
+	return valid_len;
+}
+
+static bool bond_replace_file(const std::string& from, const std::string& to) {
+#if defined(_WIN32)
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+// rewrite live records into a new file then replace the log, called by writer thread holding m_bond_mtx by lck,
+// records are taken under the lock and written without it, so bond_get/bond_put do not wait for disk I/O
+static bool bond_compact(std::unique_lock<std::mutex>& lck) {
+	m_bond_compact_needed = false;
+	bond_entry_t buf;
+	put_bytes(buf, (const uint8_t*)BOND_MAGIC, 4);
+	put_u16(buf, BOND_VERSION);
+	uint32_t entries = 0;
+	if (m_local_key_stored) {
+		bond_entry_t entry = make_local_key_entry();
+		put_bytes(buf, entry.data(), entry.size());
+		wipe_entry(entry);
+		entries++;
+	}
+	for (auto& bond : m_bonds) {
+		bond_entry_t payload;
+		put_bond_data(payload, bond.second);
+		bond_entry_t entry = make_entry(BOND_ENTRY_PUT, bond.first, payload);
+		put_bytes(buf, entry.data(), entry.size());
+		wipe_entry(payload);
+		wipe_entry(entry);
+		entries++;
+	}
+	// pending entries are already in the snapshot, appended to the old log only if compaction fails
+	std::deque<bond_entry_t> pending;
+	pending.swap(m_bond_pending);
+	std::string path = m_bond_path;
+	m_bond_writing = true;
+	lck.unlock();
+
+	// m_bond_file is only touched by writer thread while the store is open
+	std::string tmp_path = path + ".tmp";
+	FILE* f = NULL;
+	bool ok = fopen_s(&f, tmp_path.c_str(), "wb") == 0 && f != NULL;
+	if (ok) {
+		ok = fwrite(buf.data(), 1, buf.size(), f) == buf.size();
+		ok = fflush(f) == 0 && ok;
+		fclose(f);
+	}
+	wipe_entry(buf);
+
+	if (m_bond_file != NULL) {
+		fclose(m_bond_file);
+		m_bond_file = NULL;
+	}
+	if (ok)
+		ok = bond_replace_file(tmp_path, path);
+	if (!ok)
+		remove(tmp_path.c_str());
+	fopen_s(&m_bond_file, path.c_str(), "ab");
+	for (auto& entry : pending) {
+		if (!ok && m_bond_file != NULL)
+			fwrite(entry.data(), 1, entry.size(), m_bond_file);
+		wipe_entry(entry);
+	}
+	if (!ok && m_bond_file != NULL)
+		fflush(m_bond_file);
+
+	lck.lock();
+	m_bond_entries = ok ? entries : m_bond_entries + (uint32_t)pending.size();
+	m_bond_writing = false;
+	return ok;
+}
+
+static bool bond_need_compact() {
+	uint32_t live = (uint32_t)m_bonds.size() + (m_local_key_stored ? 1 : 0);
+	return m_bond_entries > live * 2 + BOND_COMPACT_THRESHOLD;
+}
+
+static void bond_writer() {
+	std::unique_lock<std::mutex> lck(m_bond_mtx);
+	while (m_bond_running || !m_bond_pending.empty() || m_bond_compact_needed) {
+		if (m_bond_pending.empty() && !m_bond_compact_needed) {
+			m_bond_cond.wait(lck);
+			continue;
+		}
+
+		// pending entries are written by compaction, or appended to the old log if it failed
+		if (m_bond_compact_needed || bond_need_compact()) {
+			bond_compact(lck);
+			m_bond_cond.notify_all();
+			continue;
+		}
+
+		// write without lock, callers keep updating records meanwhile
+		std::deque<bond_entry_t> entries;
+		entries.swap(m_bond_pending);
+		m_bond_writing = true;
+		FILE* f = m_bond_file;
+		lck.unlock();
+		for (auto& entry : entries) {
+			if (f != NULL)
+				fwrite(entry.data(), 1, entry.size(), f);
+			wipe_entry(entry);
+		}
+		if (f != NULL)
+			fflush(f);
+		lck.lock();
+		m_bond_entries += (uint32_t)entries.size();
+		m_bond_writing = false;
+		m_bond_cond.notify_all();
+	}
+	m_bond_active = false;
+	m_bond_cond.notify_all();
+}
+
+static void bond_enqueue(bond_entry_t&& entry) {
+	m_bond_pending.push_back(std::move(entry));
+	m_bond_cond.notify_all();
+}
+
+int bond_store_open(const char* path) {
+	if (path == NULL)
+		return 0;
+
+	std::lock_guard<std::mutex> lck(m_bond_mtx);
+	if (m_bond_active)
+		return 1;
+
+	m_bonds.clear();
+	m_local_key_stored = false;
+	m_bond_entries = 0;
+	m_bond_path = path;
+
+	FILE* f = NULL;
+	std::string tmp_path = m_bond_path + ".tmp";
+	if (fopen_s(&f, m_bond_path.c_str(), "rb") != 0 || f == NULL) {
+		// interrupted compaction, the new file was written but not renamed yet
+		if (bond_replace_file(tmp_path, m_bond_path))
+			fopen_s(&f, m_bond_path.c_str(), "rb");
+	}
+
+	long valid_len = -1;
+	bool truncated = false;
+	bool existed = f != NULL;
+	if (existed) {
+		valid_len = bond_load(f);
+		fseek(f, 0, SEEK_END);
+		long file_len = ftell(f);
+		fclose(f);
+		// tail of an interrupted write, appending after it would be unreadable
+		truncated = valid_len >= 0 && valid_len < file_len;
+	}
+
+	if (valid_len < 0 && existed) {
+		// unrecognized file or other BOND_VERSION, kept as .bad for recovery instead of being overwritten
+		if (!bond_replace_file(m_bond_path, m_bond_path + BOND_BAD_SUFFIX))
+			return 0;
+	}
+
+	if (valid_len < 0) {
+		// new log
+		if (fopen_s(&f, m_bond_path.c_str(), "wb") != 0 || f == NULL)
+			return 0;
+		bond_entry_t header;
+		put_bytes(header, (const uint8_t*)BOND_MAGIC, 4);
+		put_u16(header, BOND_VERSION);
+		fwrite(header.data(), 1, header.size(), f);
+		fclose(f);
+	}
+
+	if (fopen_s(&m_bond_file, m_bond_path.c_str(), "ab") != 0 || m_bond_file == NULL)
+		return 0;
+	// compacted by writer thread before anything is appended
+	m_bond_compact_needed = truncated || bond_need_compact();
+
+	m_bond_running = true;
+	m_bond_active = true;
+	// detached, since joining a thread from DLL unload may dead lock, bond_store_close waits for it instead
+	std::thread(bond_writer).detach();
+	return 1;
+}
+
+void bond_store_flush() {
+	std::unique_lock<std::mutex> lck(m_bond_mtx);
+	m_bond_cond.wait(lck, [] { return !m_bond_active || (m_bond_pending.empty() && !m_bond_writing && !m_bond_compact_needed); });
+}
+
+void bond_store_close() {
+	std::unique_lock<std::mutex> lck(m_bond_mtx);
+	m_bond_running = false;
+	m_bond_cond.notify_all();
+	m_bond_cond.wait(lck, [] { return !m_bond_active; });
+
+	if (m_bond_file != NULL) {
+		fclose(m_bond_file);
+		m_bond_file = NULL;
+	}
+	secure_zero(m_local_sk, sizeof(m_local_sk));
+	for (auto& bond : m_bonds) {
+		secure_zero(&bond.second.own_enc, sizeof(bond_enc_key_t));
+		secure_zero(&bond.second.peer_enc, sizeof(bond_enc_key_t));
+		secure_zero(bond.second.peer_irk, BOND_KEY_LEN);
+		secure_zero(bond.second.peer_csrk, BOND_KEY_LEN);
+	}
+	m_bonds.clear();
+	m_local_key_stored = false;
+}
+
+int bond_get(uint64_t addr_num, bond_data_t* data) {
+	if (data == NULL)
+		return 0;
+
+	std::lock_guard<std::mutex> lck(m_bond_mtx);
+	auto it = m_bonds.find(addr_num);
+	if (it == m_bonds.end())
+		return 0;
+	*data = it->second;
+	return 1;
+}
+
+int bond_put(uint64_t addr_num, const bond_data_t* data) {
+	if (data == NULL || data->gatt.size() > BOND_PAYLOAD_MAX / 2)
+		return 0;
+
+	bond_entry_t payload;
+	put_bond_data(payload, *data);
+	bond_entry_t entry = make_entry(BOND_ENTRY_PUT, addr_num, payload);
+	wipe_entry(payload);
+
+	std::lock_guard<std::mutex> lck(m_bond_mtx);
+	m_bonds[addr_num] = *data;
+	if (m_bond_active)
+		bond_enqueue(std::move(entry));
+	return 1;
+}
+
+int bond_delete(uint64_t addr_num) {
+	std::lock_guard<std::mutex> lck(m_bond_mtx);
+	if (m_bonds.erase(addr_num) == 0)
+		return 0;
+	if (m_bond_active)
+		bond_enqueue(make_entry(BOND_ENTRY_DELETE, addr_num, bond_entry_t()));
+	return 1;
+}
+
+uint32_t bond_list(uint64_t* addr_nums, uint32_t max) {
+	std::lock_guard<std::mutex> lck(m_bond_mtx);
+	uint32_t i = 0;
+	for (auto& bond : m_bonds) {
+		if (addr_nums != NULL && i < max)
+			addr_nums[i] = bond.first;
+		i++;
+	}
+	return i;
+}
+
+int bond_local_key_get(uint8_t* sk, uint8_t* pk) {
+	std::lock_guard<std::mutex> lck(m_bond_mtx);
+	if (!m_local_key_stored)
+		return 0;
+	if (sk != NULL)
+		memcpy(sk, m_local_sk, BOND_SK_LEN);
+	if (pk != NULL)
+		memcpy(pk, m_local_pk, BOND_PK_LEN);
+	return 1;
+}
+
+void bond_local_key_set(const uint8_t* sk, const uint8_t* pk) {
+	if (sk == NULL || pk == NULL)
+		return;
+
+	std::lock_guard<std::mutex> lck(m_bond_mtx);
+	memcpy(m_local_sk, sk, BOND_SK_LEN);
+	memcpy(m_local_pk, pk, BOND_PK_LEN);
+	m_local_key_stored = true;
+	if (m_bond_active)
+		bond_enqueue(make_local_key_entry());
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+
+// bond store of all peers and own static key pair in one append-only log file,
+// records are loaded into memory at open, updates are written by a background thread
+
+#define BOND_KEY_LEN 16 /*BLE_GAP_SEC_KEY_LEN*/
+#define BOND_RAND_LEN 8 /*BLE_GAP_SEC_RAND_LEN*/
+#define BOND_ADDR_LEN 6 /*BLE_GAP_ADDR_LEN*/
+#define BOND_SK_LEN 32 /*BLE_GAP_LESC_P256_SK_LEN*/
+#define BOND_PK_LEN 64 /*BLE_GAP_LESC_P256_PK_LEN*/
+
+/* keys present in bond_data_t */
+#define BOND_FLAG_OWN_ENC  0x01
+#define BOND_FLAG_PEER_ENC 0x02
+#define BOND_FLAG_PEER_ID  0x04
+#define BOND_FLAG_PEER_SIGN 0x08
+
+/* encryption key and master identification, as ble_gap_enc_key_t */
+typedef struct _bond_enc_key_t {
+	uint8_t ltk[BOND_KEY_LEN];
+	uint8_t ltk_len;
+	uint8_t auth; /* authenticated by MITM protection */
+	uint8_t lesc; /* generated by LE secure connections */
+	uint16_t ediv;
+	uint8_t rand[BOND_RAND_LEN];
+} bond_enc_key_t;
+
+typedef struct _bond_data_t {
+	uint8_t flags = 0; /* BOND_FLAG_* */
+	uint8_t addr_type = 0; /* peer address of the connection */
+	uint8_t addr[BOND_ADDR_LEN] = { 0 };
+	bond_enc_key_t own_enc = {};
+	bond_enc_key_t peer_enc = {};
+	uint8_t peer_irk[BOND_KEY_LEN] = { 0 };
+	uint8_t peer_id_addr_type = 0; /* identity address distributed with IRK */
+	uint8_t peer_id_addr[BOND_ADDR_LEN] = { 0 };
+	uint8_t peer_csrk[BOND_KEY_LEN] = { 0 };
+	uint8_t own_pk[BOND_PK_LEN] = { 0 }; /* LESC public keys of the last pairing */
+	uint8_t peer_pk[BOND_PK_LEN] = { 0 };
+	std::vector<uint8_t> gatt; /* cached GATT data, layout decided by caller */
+} bond_data_t;
+
+// open store file and load records, compact it if the log grows, return 0 on failure,
+// an unrecognized file or of other version is renamed to <path>.bad and a new store is started
+int bond_store_open(const char* path);
+// write pending records and stop background thread
+void bond_store_close();
+// wait until pending records are written
+void bond_store_flush();
+
+// copy record of peer address(refer to convert_ble_address_to_uint64), return 1 if found
+int bond_get(uint64_t addr_num, bond_data_t* data);
+// insert or replace record of peer address
+int bond_put(uint64_t addr_num, const bond_data_t* data);
+// remove record of peer address, return 1 if existed
+int bond_delete(uint64_t addr_num);
+// peer addresses of all records, up to max, return total count
+uint32_t bond_list(uint64_t* addr_nums, uint32_t max);
+
+// own static key pair, return 1 if stored
+int bond_local_key_get(uint8_t* sk, uint8_t* pk);
+void bond_local_key_set(const uint8_t* sk, const uint8_t* pk);
@@ -1,8 +1,11 @@
 #include "dongle.h"
+#include "platform.h"
 #include "ble.h"
 //for nrf-ble-driver library compiling runtime library config /MT[d] or /MD[d],
 //macro refer to https://docs.microsoft.com/en-us/cpp/preprocessor/predefined-macros?view=msvc-160
-#if defined(_DLL) && !defined(_DEBUG)
+//other compilers link nrf-ble-driver by build system, see CMakeLists.txt
+#if !defined(_MSC_VER)
+#elif defined(_DLL) && !defined(_DEBUG)
 // NOTICE: nordic offical static lib only support /MD
 #if NRF_SD_BLE_API >= 6
 #pragma comment(lib, "nrf-ble-driver-sd_api_v6-mt-static-4_1_4.lib")
@@ -19,19 +22,35 @@
 #endif
 #include "sd_rpc.h"
 #include "security.h"
+#include "rng.h"
+#include "bond.h"
+#include "irk.h"
+#include "sd_api.h"
+#include "simulator.h"
+#include "trace.h"
 
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+#endif
 
+#include <array>
 #include <vector>
 #include <map>
 #include <string>
 #include <algorithm>
 #include <condition_variable>
 #include <mutex>
+#include <thread>
+#include <atomic>
 #include <time.h>
 #include <chrono>
+#include <future>
+#include <functional>
 
 typedef struct _addr_t
 {
@@ -47,6 +66,14 @@ typedef struct _data_t
 	uint16_t len; /**< Length of data. */
 } data_t;
 
+/* dynamically sized buffer for long attribute value,
+allocates at least DATA_BUFFER_SIZE for callers expecting fixed size buffer */
+typedef struct _value_t
+{
+	std::vector<uint8_t> p_data; /**< Data buffer. */
+	uint16_t len = 0; /**< Length of data. */
+} value_t;
+
 enum _uint_ms
 {
 	UNIT_0_625_MS = 625,  /**< Number of microseconds in 0.625 milliseconds. */
@@ -65,6 +92,25 @@ enum _uint_ms
 #define SLAVE_LATENCY                   0                                /**< Slave Latency in number of connection events. */
 #define CONNECTION_SUPERVISION_TIMEOUT  MSEC_TO_UNITS(4000, UNIT_10_MS)  /**< Determines supervision time-out in units of 10 milliseconds. */
 
+#if NRF_SD_BLE_API < 5
+#define ATT_MTU_DEFAULT                 GATT_MTU_SIZE_DEFAULT
+#else
+#define ATT_MTU_DEFAULT                 BLE_GATT_ATT_MTU_DEFAULT
+#endif
+#define ATT_VALUE_MAX_LEN               512      /**< Maximum length of attribute value. */
+
+// GAP config default values from nordic_uart_client example
+#define NRF_SDH_BLE_GAP_EVENT_LENGTH    8/*320*/ /**< Connection event length in units of 1.25 milliseconds. */
+#define NRF_SDH_BLE_GATT_MAX_MTU_SIZE   247
+#define NRF_SDH_BLE_GAP_DATA_LENGTH     251
+#define NRF_SDH_BLE_QUEUE_SIZE          10       /**< Default write command and notification tx queue size. */
+
+// rough SoftDevice RAM usage for stack_config_set() validation
+#define SD_RAM_LINK_CONTEXT             1200     /**< Link layer, GATT and security context per connection. */
+#define SD_RAM_LL_BUFFER                (NRF_SDH_BLE_GAP_DATA_LENGTH + 20) /**< Link layer packet buffer. */
+#define SD_RAM_QUEUE_ENTRY              (NRF_SDH_BLE_GATT_MAX_MTU_SIZE + 8) /**< Queued ATT packet. */
+#define SD_RAM_BUDGET                   0x8000   /**< RAM left to BLE configuration by connectivity firmware. */
+
 // service
 #define BLE_UUID_BATTERY_SRV 0x180F
 #define BLE_UUID_HID_SRV 0x1812
@@ -93,7 +139,8 @@ static bool        m_connection_is_in_progress = false;
 static bool        m_is_connected = false; /* peripheral address has been connected(BLE_GAP_EVT_DISCONNECTED) */
 static char        m_passkey[6] = { '1', '2', '3', '4', '5', '6' }; /* default fixed passkey for auth request(BLE_GAP_EVT_AUTH_KEY_REQUEST) */
 static bool	       m_is_authenticated = false; /* peripheral address has been authenticated(BLE_GAP_EVT_AUTH_STATUS) */
-static uint8_t     m_connected_devices = 0; /* number of connected devices */
+static bool	       m_is_encrypting = false; /* encrypting with stored LTK, wait for BLE_GAP_EVT_CONN_SEC_UPDATE */
+static std::atomic<uint8_t> m_connected_devices{ 0 }; /* number of connected devices, changed under m_mtx_find */
 static uint16_t    m_connection_handle = 0;
 static uint16_t    m_service_start_handle = 0;
 static uint16_t    m_service_end_handle = 0;
@@ -102,6 +149,7 @@ static uint16_t    m_device_name_handle = 0;
 static uint16_t    m_battery_level_handle = 0;
 static bool        m_is_service_enabled = false;
 static adapter_t * m_adapter = NULL;
+static const sd_api_t * m_sd = &sd_api_driver; /* backend of SoftDevice calls, dongle or simulator */
 
 /* Callback functions from caller */
 static std::map<fn_callback_id_t, std::vector<void*>> m_callback_fn_list;
@@ -110,6 +158,7 @@ static std::map<fn_callback_id_t, std::vector<void*>> m_callback_fn_list;
 typedef struct _adv_data_t {
 	ble_gap_evt_adv_report_t adv_report; /*adv report as device identity*/
 	std::map<uint8_t, data_t> type_data_list; /*BLE_GAP_AD_TYPE_DEFINITIONS, data*/
+	std::chrono::steady_clock::time_point first_seen; /*arrival of the first report since scan start*/
 } adv_data_t;
 
 /* Advertising data key pair by address */
@@ -118,15 +167,34 @@ static std::map<uint64_t, adv_data_t> m_adv_list; /*addr, adv data*/
 /* Paired device data */
 typedef struct _pair_data_t {
 	ble_gap_evt_adv_report_t adv_report; /*adv report as device identity*/
-	uint8_t own_pk[ECC_P256_PK_LEN] = { 0 }; //TODO: error gets the same pubkey from uecc
+	uint8_t own_pk[ECC_P256_PK_LEN] = { 0 }; /*ephemeral public key of the last pairing*/
+	uint8_t own_sk[ECC_P256_SK_LEN] = { 0 }; /*ephemeral private key of the last pairing, not stored*/
 	uint8_t peer_pk[ECC_P256_PK_LEN] = { 0 };
 	bool is_paired = false;
+	bool is_bonding = false; /*bond negotiated by both sides in the current pairing*/
 } pair_data_t;
 
 static uint64_t m_pair_addr_num = 0;
 // store pair data for individual peer
 static std::map<uint64_t, pair_data_t> m_pair_list; /*addr, dev data*/
 
+#define OOB_FLAG_OWN  0x01 /* own key pair reserved and OOB data handed to caller */
+#define OOB_FLAG_PEER 0x02 /* LESC OOB data received from peer */
+#define OOB_FLAG_TK   0x04 /* legacy pairing temporary key */
+/* OOB data exchanged by caller before pairing */
+typedef struct _oob_data_t {
+	uint8_t flags = 0; /* OOB_FLAG_* */
+	uint8_t own_sk[ECC_P256_SK_LEN] = { 0 };
+	uint8_t own_pk[ECC_P256_PK_LEN] = { 0 };
+	ble_gap_lesc_oob_data_t own = { 0 };
+	ble_gap_lesc_oob_data_t peer = { 0 };
+	uint8_t tk[BLE_GAP_SEC_KEY_LEN] = { 0 };
+} oob_data_t;
+
+// set by caller thread, used by event thread while pairing
+static std::mutex m_mtx_oob;
+static std::map<uint64_t, oob_data_t> m_oob_list; /*addr, oob data*/
+
 /* Discovered characteristic data structure */
 typedef struct _dev_char_t {
 	uint16_t handle = 0; /* ble_gattc_char_t::handle_value */
@@ -147,9 +215,27 @@ static std::vector<dev_char_t> m_char_list;
 static uint32_t m_char_idx = 0; // discover procedure index
 
 /* Data buffer for hvx */
-static std::map <uint16_t, data_t> m_read_data; /* handle, p_data, data_len */
+static std::map <uint16_t, value_t> m_read_data; /* handle, p_data, data_len */
 /* Data buffer to write */
-static std::map<uint16_t, data_t> m_write_data; /* handle, p_data, data_len */
+static std::map<uint16_t, value_t> m_write_data; /* handle, p_data, data_len */
+/* ATT MTU of the current connection, updated from exchange MTU response */
+static uint16_t m_att_mtu = ATT_MTU_DEFAULT;
+/* Handle of long attribute value reading by Read Blob requests, 0 for none */
+static uint16_t m_read_long_handle = 0;
+/* GATT status of the last read by handle, a long read failed partway keeps the parts read before as value */
+static std::map<uint16_t, uint16_t> m_read_status; /* handle, BLE_GATT_STATUS */
+/* GATT status of the last write by handle, including a prepared write failed or cancelled partway */
+static std::map<uint16_t, uint16_t> m_write_status; /* handle, BLE_GATT_STATUS */
+/* Handle and offset of queued prepared writes in progress, 0 for none */
+static uint16_t m_prep_write_handle = 0;
+static uint16_t m_prep_write_offset = 0;
+/* Batched read in progress by data_read_multiple() or data_read_by_uuid(), values concatenated in handle order */
+static bool m_batch_reading = false;
+static std::vector<uint16_t> m_batch_handles;
+static std::vector<uint16_t> m_batch_lens;
+static std::vector<uint8_t> m_batch_data;
+static ble_uuid_t m_batch_uuid = { 0 };
+static uint16_t m_batch_end_handle = 0;
 #define _TRACE
 static char m_log_msg[4096] = { 0 };
 #ifdef _TRACE
@@ -214,6 +300,54 @@ static ble_gap_conn_params_t m_connection_param =
 	(uint16_t)CONNECTION_SUPERVISION_TIMEOUT
 };
 
+/* SoftDevice configuration applied by ble_cfg_set() in dongle_init(), refer to stack_config_set() */
+typedef struct _stack_config_t
+{
+	uint16_t event_length;            /**< Connection event length in units of 1.25 milliseconds. */
+	bool     conn_evt_ext;            /**< Extend connection event while packets are pending. */
+	uint8_t  write_cmd_tx_queue_size; /**< Queued write without response per connection. */
+	uint8_t  hvn_tx_queue_size;       /**< Queued notification per connection. */
+	uint8_t  conn_count;              /**< Concurrent connections. */
+} stack_config_t;
+
+static stack_config_t m_stack_config =
+{
+	(uint16_t)NRF_SDH_BLE_GAP_EVENT_LENGTH,
+	false,
+	(uint8_t)NRF_SDH_BLE_QUEUE_SIZE,
+	(uint8_t)NRF_SDH_BLE_QUEUE_SIZE,
+	(uint8_t)1
+};
+
+/* presets indexed by conn_param_profile_t, min/max interval in 1.25ms, timeout in 10ms units */
+static const ble_gap_conn_params_t m_conn_param_profiles[CONN_PARAM_PROFILE_COUNT] =
+{
+	/* CONN_PARAM_DEFAULT */
+	{ (uint16_t)MIN_CONNECTION_INTERVAL, (uint16_t)MAX_CONNECTION_INTERVAL,
+	  (uint16_t)SLAVE_LATENCY, (uint16_t)CONNECTION_SUPERVISION_TIMEOUT },
+	/* CONN_PARAM_LOW_LATENCY */
+	{ (uint16_t)MSEC_TO_UNITS(7.5, UNIT_1_25_MS), (uint16_t)MSEC_TO_UNITS(7.5, UNIT_1_25_MS),
+	  0, (uint16_t)MSEC_TO_UNITS(2000, UNIT_10_MS) },
+	/* CONN_PARAM_THROUGHPUT */
+	{ (uint16_t)MSEC_TO_UNITS(15, UNIT_1_25_MS), (uint16_t)MSEC_TO_UNITS(30, UNIT_1_25_MS),
+	  0, (uint16_t)MSEC_TO_UNITS(4000, UNIT_10_MS) },
+	/* CONN_PARAM_POWER_SAVING */
+	{ (uint16_t)MSEC_TO_UNITS(100, UNIT_1_25_MS), (uint16_t)MSEC_TO_UNITS(200, UNIT_1_25_MS),
+	  4, (uint16_t)MSEC_TO_UNITS(6000, UNIT_10_MS) },
+};
+static const char* m_conn_param_profile_names[CONN_PARAM_PROFILE_COUNT] = { "default", "low latency", "throughput", "power saving" };
+static conn_param_profile_t m_conn_param_profile = CONN_PARAM_DEFAULT;
+static conn_param_policy_t m_conn_param_policy = CONN_PARAM_POLICY_ACCEPT;
+/* active connection parameters from BLE_GAP_EVT_CONNECTED or BLE_GAP_EVT_CONN_PARAM_UPDATE */
+static ble_gap_conn_params_t m_conn_param_active = { 0 };
+
+#if NRF_SD_BLE_API >= 5
+/* preferred PHY request after connected and reply to peer PHY update request */
+static ble_gap_phys_t m_phy_preference = { BLE_GAP_PHY_AUTO, BLE_GAP_PHY_AUTO };
+/* active PHY of connections updated from BLE_GAP_EVT_PHY_UPDATE */
+static std::map<uint16_t, ble_gap_phys_t> m_conn_phys; /* conn_handle, tx/rx phy */
+#endif
+
 static ble_gap_sec_params_t m_sec_params =
 {
 	(uint8_t)1, /*bond*/
@@ -239,6 +373,93 @@ static ble_gap_sec_params_t m_sec_params =
 static uint8_t m_private_key[ECC_P256_SK_LEN] = { 0 };
 //TODO: keep it or using m_pair_list?
 static uint8_t m_public_key[ECC_P256_PK_LEN] = { 0 };
+// ephemeral key pairs pre-generated in background for pairing
+#define ECC_KEYPOOL_SIZE 4
+/* bond store of all peers and own key pair, replaces nrf_ble_library.spk and nrf_ble_library_<addr>.mpk */
+#define BOND_STORE_FILE "nrf_ble_library.bond"
+// DHKey computing in worker threads
+static std::atomic<int> m_lesc_jobs{ 0 };
+
+// pairing auth key requests waiting for caller reply, rejected by watchdog thread if timeout,
+// default below SMP timeout(30s) so the pairing fails by our side
+#define AUTH_KEY_TIMEOUT_DEFAULT 25000
+typedef struct _auth_key_pending_t {
+	auth_key_request_t request;
+	std::chrono::steady_clock::time_point deadline;
+} auth_key_pending_t;
+static std::mutex m_mtx_auth_key;
+static std::condition_variable m_cond_auth_key;
+static std::map<uint16_t, auth_key_pending_t> m_auth_key_pending; /*conn handle, request*/
+static bool m_auth_key_watchdog = false;
+static uint32_t m_auth_key_timeout = AUTH_KEY_TIMEOUT_DEFAULT;
+
+// adapter recovery after transport error, serial port is reopened and stack configured again,
+// then the link of connected peer is resumed by stored LTK and cached GATT data
+#define RECOVERY_ATTEMPTS_DEFAULT 5
+#define RECOVERY_INTERVAL_DEFAULT 1000
+#define RECOVERY_RESUME_TIMEOUT   10000
+static char m_serial_port[64] = { 0 };
+static uint32_t m_baud_rate = 0;
+// advisory lock of serial port held while the dongle is in use, other processes of this library skip it, -1 if none
+#define PORT_LOCK_BUSY -2
+static int m_port_lock = -1;
+// adapter opened by dongle_probe and kept by dongle_init_auto, its handlers forward to the ones of m_adapter
+static std::atomic<adapter_t*> m_probe_adapter(NULL);
+static bool m_recovery_enabled = true;
+static uint8_t m_recovery_attempts = RECOVERY_ATTEMPTS_DEFAULT;
+static uint32_t m_recovery_interval = RECOVERY_INTERVAL_DEFAULT; /* ms between reopen attempts */
+static std::atomic<bool> m_recovering(false);
+// held while recovery closes, deletes and creates m_adapter, and by worker threads replying through it
+static std::mutex m_mtx_adapter;
+// set in recovery thread, its calls of API functions to resume the link are not busy
+static thread_local bool m_in_recovery = false;
+// DHKey workers and auth key watchdog given to finish before the adapter is closed by recovery
+#define RECOVERY_WORKERS_TIMEOUT 1000
+static uint32_t m_recovery_count = 0;
+static uint32_t m_recovery_failures = 0;
+static uint32_t m_recovery_reopen_ms = 0; /* the last one, transport error to stack enabled */
+static uint32_t m_recovery_resume_ms = 0; /* the last one, transport error to services enabled */
+// bumped by adapter recovery and shutdown, link resume of an earlier epoch gives up
+static std::atomic<uint32_t> m_link_epoch(0);
+
+// reconnection of configured peers after link loss(supervision timeout or failed to be established),
+// direct connection with exponential backoff, then resumed by stored LTK and cached GATT data as recovery
+#define RECONNECT_ATTEMPTS_DEFAULT    8
+#define RECONNECT_BACKOFF_MIN_DEFAULT 100
+#define RECONNECT_BACKOFF_MAX_DEFAULT 5000
+#define RECONNECT_CONNECT_TIMEOUT     5000 /* ms waiting for connected event of each attempt */
+typedef struct _reconnect_stats_t {
+	uint32_t outages;
+	uint32_t failures; /* outages not resumed within attempts */
+	uint32_t last_outage_ms; /* link lost to services enabled */
+	uint32_t max_outage_ms;
+} reconnect_stats_t;
+static bool m_reconnect_enabled = false;
+static uint8_t m_reconnect_attempts = RECONNECT_ATTEMPTS_DEFAULT;
+static uint32_t m_reconnect_backoff_min = RECONNECT_BACKOFF_MIN_DEFAULT; /* ms before the second attempt, doubled each time */
+static uint32_t m_reconnect_backoff_max = RECONNECT_BACKOFF_MAX_DEFAULT;
+static std::mutex m_mtx_reconnect;
+static std::map<uint64_t, reconnect_stats_t> m_reconnect_peers; /*addr num of configured peer, stats*/
+static std::atomic<bool> m_reconnecting(false);
+
+// serial transport of nrf-ble-driver, UART of connectivity firmware runs up to 1M baud,
+// high rates without hardware flow control may overrun its buffer and rely on retransmissions
+#define TRANSPORT_BAUD_RATE_MAX          1000000
+#define TRANSPORT_RETRANSMISSION_DEFAULT 250  /**< Three-wire(H5) retransmission interval(ms). */
+#define TRANSPORT_RESPONSE_TIMEOUT_DEFAULT 1500 /**< Response timeout(ms) of serialized SoftDevice call. */
+typedef struct _transport_config_t {
+	bool flow_control;
+	uint32_t retransmission_interval;
+	uint32_t response_timeout;
+} transport_config_t;
+static transport_config_t m_transport_config = { false, TRANSPORT_RETRANSMISSION_DEFAULT, TRANSPORT_RESPONSE_TIMEOUT_DEFAULT };
+static std::atomic<uint32_t> m_evt_count(0); /* events dispatched, for link_benchmark */
+
+// phases of the last dongle init, host preparation overlaps transport open and stack config
+static startup_timing_t m_startup_timing = { 0 };
+static std::future<uint32_t> m_init_future; /* pending dongle_init_async */
+// host preparation of dongle init, assigned before the backend is opened so events wait for it on event thread
+static std::shared_future<void> m_prepared;
 
 // keyset data for LE security authentication
 static ble_gap_enc_key_t m_own_enc = { 0 };
@@ -319,16 +540,18 @@ static void log_level(log_level_t level, const char *message, ...) {
 		break;
 	}
 
+	// local buffer, worker threads log as well, and message may be m_log_msg itself
+	char log_msg[sizeof(m_log_msg)] = { 0 };
 	va_list _args;
 	__crt_va_start(_args, message);
-	vsprintf_s(m_log_msg, message, _args);
+	vsprintf_s(log_msg, message, _args);
 	__crt_va_end(_args);
 
 
-	printf("%s %s\n", label, m_log_msg);
+	printf("%s %s\n", label, log_msg);
 	fflush(stdout);
 
-	log_file(label, m_log_msg);
+	log_file(label, log_msg);
 }
 
 /**@brief Function for handling the log message events from sd_rpc.
@@ -346,15 +569,91 @@ static void log_handler(adapter_t * adapter, sd_rpc_log_severity_t severity, con
 	log_level((log_level_t)severity, message);
 }
 
+/* serial port opened by nrf-ble-driver is not exclusive on Linux and opening resets connectivity firmware,
+so the port is locked by flock before, return descriptor holding the lock, -1 if it can not be locked,
+or PORT_LOCK_BUSY if another process holds the lock or opened the port exclusively(TIOCEXCL),
+COM ports of Windows are exclusive already */
+static int port_lock(const char* port)
+{
+#if defined(_WIN32)
+	return -1;
+#else
+	int fd = open(port, O_RDONLY | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+		return errno == EBUSY ? PORT_LOCK_BUSY : -1;
+	if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+		int err = errno;
+		close(fd);
+		return err == EWOULDBLOCK ? PORT_LOCK_BUSY : -1;
+	}
+	return fd;
+#endif
+}
+
+static void port_unlock(int& lock)
+{
+#if !defined(_WIN32)
+	if (lock >= 0)
+		close(lock);
+#endif
+	lock = -1;
+}
+
+/* adapter state checked by API functions, busy while recovery reopens the adapter and resumes the link
+except calls of recovery thread itself, adapter is deleted and created again meanwhile */
+static uint32_t adapter_state()
+{
+	if (m_recovering && !m_in_recovery)
+		return NRF_ERROR_BUSY;
+	return m_adapter == NULL ? NRF_ERROR_INVALID_STATE : NRF_SUCCESS;
+}
+
+/* reply of worker thread through adapter, skipped while recovery closes it since links are gone with it */
+static uint32_t adapter_worker_reply(std::function<uint32_t()> reply)
+{
+	std::lock_guard<std::mutex> lck(m_mtx_adapter);
+	if (m_adapter == NULL || m_recovering)
+		return NRF_ERROR_INVALID_STATE;
+	return reply();
+}
+
+/* drop pending auth key requests, then wait until watchdog thread and DHKey workers exit or deadline,
+return false if any of them is still running */
+static bool adapter_workers_stop(std::chrono::steady_clock::time_point deadline)
+{
+	std::unique_lock<std::mutex> lck(m_mtx_auth_key);
+	m_auth_key_pending.clear();
+	m_cond_auth_key.notify_all();
+	// both of them notify m_cond_auth_key on exit
+	return m_cond_auth_key.wait_until(lck, deadline, [] { return !m_auth_key_watchdog && m_lesc_jobs == 0; });
+}
+
 /**@brief Function for handling error message events from sd_rpc.
  *
  * @param[in] adapter The transport adapter.
  * @param[in] code Error code that the error message is associated with.
  * @param[in] message The error message that the callback is associated with.
  */
+static void recovery_start(sd_rpc_app_status_t code);
+
 static void status_handler(adapter_t * adapter, sd_rpc_app_status_t code, const char * message)
 {
 	log_level(LOG_INFO, "Adapter status: %d, message: %s", (uint32_t)code, message);
+
+	// connectivity firmware is unreachable or restarted by itself, its links and stack config are gone,
+	// reset performed while opening is expected, dongle_reset clears initialized flag before its own one
+	switch (code)
+	{
+	case PKT_SEND_MAX_RETRIES_REACHED:
+	case PKT_SEND_ERROR:
+	case IO_RESOURCES_UNAVAILABLE:
+	case RESET_PERFORMED:
+		if (m_dongle_initialized)
+			recovery_start(code);
+		break;
+	default:
+		break;
+	}
 }
 
 
@@ -386,6 +685,15 @@ static void convert_ble_address_to_uint64(uint8_t addr[BLE_GAP_ADDR_LEN], uint64
 	}
 }
 
+/* resolvable private address of a bonded peer converts to address of its bond,
+so adv and pair data of the peer are kept under one key while its address rotates */
+static void convert_peer_address_to_uint64(uint8_t addr[BLE_GAP_ADDR_LEN], uint64_t *number)
+{
+	if (irk_resolve(addr, number) == 1)
+		return;
+	convert_ble_address_to_uint64(addr, number);
+}
+
 /*forward declaration for bytes-string conversion*/
 static uint32_t convert_byte_string(uint8_t* byte_array, uint32_t len, char* str);
 
@@ -669,6 +977,21 @@ static bool get_uuid_string(uint16_t uuid, char *uuid_string) {
 	return result;
 }
 
+/**
+copy data into value buffer at offset, the buffer grows for long attribute value
+*/
+static void value_assign(value_t *value, const uint8_t *data, uint16_t len, uint16_t offset = 0)
+{
+	size_t size = std::max<size_t>((size_t)offset + len, DATA_BUFFER_SIZE);
+	if (offset == 0)
+		value->p_data.assign(size, 0);
+	else
+		value->p_data.resize(size, 0);
+	if (data != NULL && len > 0)
+		memcpy_s(&(value->p_data[offset]), value->p_data.size() - offset, data, len);
+	value->len = offset + len;
+}
+
 /**
 cleanup stored data for connected device
 */
@@ -678,6 +1001,7 @@ static void connection_cleanup() {
 	//m_connection_is_in_progress = false;
 	m_is_connected = false;
 	m_is_authenticated = false;
+	m_is_encrypting = false;
 	m_service_start_handle = 0;
 	m_service_end_handle = 0;
 	m_discovered_handle = 0;
@@ -686,44 +1010,310 @@ static void connection_cleanup() {
 	m_is_service_enabled = false;
 	m_char_list.clear();
 	m_char_idx = 0;
+	m_att_mtu = ATT_MTU_DEFAULT;
+	// long read cut by disconnection is incomplete
+	if (m_read_long_handle != 0)
+		m_read_status[m_read_long_handle] = BLE_GATT_STATUS_UNKNOWN;
+	m_read_long_handle = 0;
+	if (m_prep_write_handle != 0)
+		m_write_status[m_prep_write_handle] = BLE_GATT_STATUS_UNKNOWN;
+	m_prep_write_handle = 0;
+	m_batch_reading = false;
 	m_cond_read_write.notify_all();
 	m_cond_find.notify_all();
 }
 
+// timing of connection setup phases, each request to its response event, kept for the last connection
+#define SETUP_STEPS_MAX 256
+static const char* m_setup_phase_names[SETUP_PHASE_COUNT] = {
+	"adv", "connect", "auth", "service disc", "char disc", "desc disc", "report ref", "cccd"
+};
+static std::mutex m_mtx_setup;
+static std::chrono::steady_clock::time_point m_scan_started_at; /* unset once consumed by a connection */
+static std::chrono::steady_clock::time_point m_setup_origin;
+static std::chrono::steady_clock::time_point m_setup_pending_at[SETUP_PHASE_COUNT];
+static uint16_t m_setup_pending_handle[SETUP_PHASE_COUNT] = { 0 };
+static bool m_setup_pending[SETUP_PHASE_COUNT] = { false };
+static setup_timing_t m_setup_timing = { 0 };
+static std::vector<setup_step_t> m_setup_steps;
+
+static void setup_step_add(setup_phase_t phase, uint16_t handle, std::chrono::steady_clock::time_point start,
+	std::chrono::steady_clock::time_point end)
+{
+	setup_step_t step;
+	step.phase = phase;
+	step.handle = handle;
+	step.start_us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(start - m_setup_origin).count();
+	step.duration_us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
+	m_setup_timing.phase_us[phase] += step.duration_us;
+	m_setup_timing.phase_max_us[phase] = std::max(m_setup_timing.phase_max_us[phase], step.duration_us);
+	m_setup_timing.phase_count[phase]++;
+	if (m_setup_steps.size() < SETUP_STEPS_MAX)
+		m_setup_steps.push_back(step);
+}
+
+/* timing of a new connection, from scan start if the peer was found by the latest scan, otherwise connection request */
+static void setup_timing_begin(uint64_t addr_num)
+{
+	auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lck(m_mtx_setup);
+	m_setup_timing = { 0 };
+	m_setup_steps.clear();
+	memset(m_setup_pending, 0, sizeof(m_setup_pending));
+	m_setup_origin = now;
+
+	auto adv = m_adv_list.find(addr_num);
+	if (m_scan_started_at != std::chrono::steady_clock::time_point() &&
+		adv != m_adv_list.end() && adv->second.first_seen >= m_scan_started_at) {
+		m_setup_origin = m_scan_started_at;
+		setup_step_add(SETUP_PHASE_ADV, 0, m_scan_started_at, adv->second.first_seen);
+	}
+	m_scan_started_at = std::chrono::steady_clock::time_point();
+
+	m_setup_pending[SETUP_PHASE_CONNECT] = true;
+	m_setup_pending_at[SETUP_PHASE_CONNECT] = now;
+}
+
+/* request of phase sent, handle: attribute of read/write, start of discovery range or service UUID */
+static void setup_step_begin(setup_phase_t phase, uint16_t handle)
+{
+	std::lock_guard<std::mutex> lck(m_mtx_setup);
+	m_setup_pending[phase] = true;
+	m_setup_pending_at[phase] = std::chrono::steady_clock::now();
+	m_setup_pending_handle[phase] = handle;
+}
+
+/* response event of phase received, called before the handler sends the next request */
+static void setup_step_end(setup_phase_t phase)
+{
+	auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lck(m_mtx_setup);
+	if (!m_setup_pending[phase])
+		return;
+	m_setup_pending[phase] = false;
+	setup_step_add(phase, m_setup_pending_handle[phase], m_setup_pending_at[phase], now);
+}
+
+/* services enabled, log phases of the connection */
+static void setup_timing_end()
+{
+	std::lock_guard<std::mutex> lck(m_mtx_setup);
+	m_setup_timing.setup_us = (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - m_setup_origin).count();
+
+	char msg[512] = { 0 };
+	sprintf_s(msg, "Setup %.1f ms", m_setup_timing.setup_us / 1000.0);
+	for (int i = 0; i < SETUP_PHASE_COUNT; i++) {
+		if (m_setup_timing.phase_count[i] == 0)
+			continue;
+		char phase[64] = { 0 };
+		sprintf_s(phase, ", %s %ux %.1f ms(max %.1f)", m_setup_phase_names[i], m_setup_timing.phase_count[i],
+			m_setup_timing.phase_us[i] / 1000.0, m_setup_timing.phase_max_us[i] / 1000.0);
+		strcat_s(msg, phase);
+	}
+	log_level(LOG_INFO, msg);
+}
+
+/* LESC public keys of the pairing into bond store, written to file by its own thread, only if bonding */
 static void store_pair_data(uint64_t addr_num) {
-	char name[128] = { 0 };
-	sprintf_s(name, "nrf_ble_library_%llx.mpk", addr_num);
-	FILE* f;
-	errno_t err;
-	err = fopen_s(&f, name, "wb");
-	if (err || f == NULL)
+	if (!m_pair_list[addr_num].is_bonding)
 		return;
-	fwrite(m_pair_list[addr_num].own_pk, sizeof(uint8_t), ECC_P256_PK_LEN, f);
-	fwrite(m_pair_list[addr_num].peer_pk, sizeof(uint8_t), ECC_P256_PK_LEN, f);
-	fclose(f);
+	bond_data_t bond;
+	bond_get(addr_num, &bond);
+	bond.addr_type = m_pair_list[addr_num].adv_report.peer_addr.addr_type;
+	memcpy_s(bond.addr, BOND_ADDR_LEN, m_pair_list[addr_num].adv_report.peer_addr.addr, BLE_GAP_ADDR_LEN);
+	memcpy_s(bond.own_pk, BOND_PK_LEN, m_pair_list[addr_num].own_pk, ECC_P256_PK_LEN);
+	memcpy_s(bond.peer_pk, BOND_PK_LEN, m_pair_list[addr_num].peer_pk, ECC_P256_PK_LEN);
+	bond_put(addr_num, &bond);
+	secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+	secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
 }
 
 // overload
 static void store_pair_data(uint8_t addr[6]) {
 	uint64_t addr_num = 0;
-	convert_ble_address_to_uint64(addr, &addr_num);
+	convert_peer_address_to_uint64(addr, &addr_num);
 	store_pair_data(addr_num);
 }
 
 static bool read_pair_data(uint64_t addr_num) {
-	char name[128] = { 0 };
-	sprintf_s(name, "nrf_ble_library_%llx.mpk", addr_num);
-	FILE* f;
-	errno_t err;
-	err = fopen_s(&f, name, "rb");
-	if (err || f == NULL)
+	bond_data_t bond;
+	if (bond_get(addr_num, &bond) == 0)
+		return false;
+	memcpy_s(m_pair_list[addr_num].own_pk, ECC_P256_PK_LEN, bond.own_pk, BOND_PK_LEN);
+	memcpy_s(m_pair_list[addr_num].peer_pk, ECC_P256_PK_LEN, bond.peer_pk, BOND_PK_LEN);
+	m_pair_list[addr_num].is_paired = (bond.flags & (BOND_FLAG_OWN_ENC | BOND_FLAG_PEER_ENC)) != 0;
+	secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+	secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
+	return true;
+}
+
+static void bond_enc_key_from(bond_enc_key_t* key, const ble_gap_enc_key_t* enc) {
+	memcpy_s(key->ltk, BOND_KEY_LEN, enc->enc_info.ltk, BLE_GAP_SEC_KEY_LEN);
+	key->ltk_len = enc->enc_info.ltk_len;
+	key->auth = enc->enc_info.auth;
+	key->lesc = enc->enc_info.lesc;
+	key->ediv = enc->master_id.ediv;
+	memcpy_s(key->rand, BOND_RAND_LEN, enc->master_id.rand, BLE_GAP_SEC_RAND_LEN);
+}
+
+/* distributed keys of a bonded pairing into bond store */
+static void store_bond_keys(uint64_t addr_num, const ble_gap_evt_auth_status_t* auth_status) {
+	bond_data_t bond;
+	bond_get(addr_num, &bond);
+	bond.addr_type = m_pair_list[addr_num].adv_report.peer_addr.addr_type;
+	memcpy_s(bond.addr, BOND_ADDR_LEN, m_pair_list[addr_num].adv_report.peer_addr.addr, BLE_GAP_ADDR_LEN);
+	bond.flags = 0;
+	// LESC LTK is generated by both sides and reported in own enc key without distribution
+	if (auth_status->kdist_own.enc || auth_status->lesc) {
+		bond_enc_key_from(&bond.own_enc, &m_own_enc);
+		bond.flags |= BOND_FLAG_OWN_ENC;
+	}
+	if (auth_status->kdist_peer.enc) {
+		bond_enc_key_from(&bond.peer_enc, &m_peer_enc);
+		bond.flags |= BOND_FLAG_PEER_ENC;
+	}
+	if (auth_status->kdist_peer.id) {
+		memcpy_s(bond.peer_irk, BOND_KEY_LEN, m_peer_id.id_info.irk, BLE_GAP_SEC_KEY_LEN);
+		bond.peer_id_addr_type = m_peer_id.id_addr_info.addr_type;
+		memcpy_s(bond.peer_id_addr, BOND_ADDR_LEN, m_peer_id.id_addr_info.addr, BLE_GAP_ADDR_LEN);
+		bond.flags |= BOND_FLAG_PEER_ID;
+		irk_table_add(addr_num, bond.peer_irk);
+	}
+	if (auth_status->kdist_peer.sign) {
+		memcpy_s(bond.peer_csrk, BOND_KEY_LEN, m_peer_sign.csrk, BLE_GAP_SEC_KEY_LEN);
+		bond.flags |= BOND_FLAG_PEER_SIGN;
+	}
+	bond_put(addr_num, &bond);
+	secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+	secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
+	log_level(LOG_DEBUG, " bond keys of %llx stored, flags=0x%02x", addr_num, bond.flags);
+}
+
+/* IRKs of all bonds into resolving table */
+static void load_bond_irks() {
+	std::vector<uint64_t> addr_nums(bond_list(NULL, 0));
+	addr_nums.resize(bond_list(addr_nums.data(), (uint32_t)addr_nums.size()));
+	irk_table_clear();
+	for (auto addr_num : addr_nums) {
+		bond_data_t bond;
+		if (bond_get(addr_num, &bond) && (bond.flags & BOND_FLAG_PEER_ID))
+			irk_table_add(addr_num, bond.peer_irk);
+		secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+		secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
+	}
+	log_level(LOG_DEBUG, "IRK table loaded, %d of %d bonds", irk_table_size(), (int)addr_nums.size());
+}
+
+/* discovered characteristics of a bonded peer into bond store, 17 bytes per characteristic:
+handle, uuid, handle_decl, range start, range end, report_ref_handle, cccd_handle, props, report reference(2) */
+static void store_gatt_cache(uint64_t addr_num) {
+	bond_data_t bond;
+	if (bond_get(addr_num, &bond) == 0)
+		return;
+	if (bond.flags == 0) {
+		secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+		secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
+		return;
+	}
+
+	bond.gatt.clear();
+	for (auto& c : m_char_list) {
+		uint16_t values[] = { c.handle, c.uuid, c.handle_decl, c.handle_range.start_handle, c.handle_range.end_handle,
+			c.report_ref_handle, c.cccd_handle };
+		for (auto v : values) {
+			bond.gatt.push_back((uint8_t)v);
+			bond.gatt.push_back((uint8_t)(v >> 8));
+		}
+		bond.gatt.push_back(c.char_props.broadcast | c.char_props.read << 1 | c.char_props.write_wo_resp << 2 |
+			c.char_props.write << 3 | c.char_props.notify << 4 | c.char_props.indicate << 5 | c.char_props.auth_signed_wr << 6);
+		bond.gatt.push_back(c.report_ref[0]);
+		bond.gatt.push_back(c.report_ref[1]);
+	}
+	bond_put(addr_num, &bond);
+	secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+	secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
+}
+
+/* characteristics of a bonded peer from bond store, return false if none cached,
+report references are cached as well so only CCCDs are written to enable services */
+static bool load_gatt_cache(uint64_t addr_num) {
+	bond_data_t bond;
+	if (bond_get(addr_num, &bond) == 0 || bond.gatt.size() == 0 || bond.gatt.size() % 17 != 0) {
+		secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+		secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
 		return false;
-	fread(m_pair_list[addr_num].own_pk, sizeof(uint8_t), ECC_P256_PK_LEN, f);
-	fread(m_pair_list[addr_num].peer_pk, sizeof(uint8_t), ECC_P256_PK_LEN, f);
-	fclose(f);
+	}
+	secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+	secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
+
+	m_char_list.clear();
+	for (size_t i = 0; i < bond.gatt.size(); i += 17) {
+		const uint8_t* entry = &bond.gatt[i];
+		uint16_t values[7];
+		for (int j = 0; j < 7; j++)
+			values[j] = entry[j * 2] | (entry[j * 2 + 1] << 8);
+		dev_char_t c;
+		c.handle = values[0];
+		c.uuid = values[1];
+		c.handle_decl = values[2];
+		c.handle_range.start_handle = values[3];
+		c.handle_range.end_handle = values[4];
+		c.report_ref_handle = values[5];
+		c.cccd_handle = values[6];
+		uint8_t props = entry[14];
+		c.char_props.broadcast = props & 1;
+		c.char_props.read = (props >> 1) & 1;
+		c.char_props.write_wo_resp = (props >> 2) & 1;
+		c.char_props.write = (props >> 3) & 1;
+		c.char_props.notify = (props >> 4) & 1;
+		c.char_props.indicate = (props >> 5) & 1;
+		c.char_props.auth_signed_wr = (props >> 6) & 1;
+		c.report_ref[0] = entry[15];
+		c.report_ref[1] = entry[16];
+		c.report_ref_is_read = c.report_ref_handle != 0;
+		m_char_list.push_back(c);
+	}
+	log_level(LOG_DEBUG, "GATT cache of %llx loaded, %d characteristics", addr_num, (int)m_char_list.size());
 	return true;
 }
 
+/* encrypt link with LTK of a bonded peer, legacy pairing uses the key peripheral distributed,
+LESC uses the generated one with zero EDIV and Rand, return NRF_ERROR_NOT_FOUND if no key stored */
+static uint32_t encrypt_start(uint64_t addr_num) {
+	bond_data_t bond;
+	if (bond_get(addr_num, &bond) == 0)
+		return NRF_ERROR_NOT_FOUND;
+
+	const bond_enc_key_t* key = NULL;
+	if ((bond.flags & BOND_FLAG_OWN_ENC) && bond.own_enc.lesc)
+		key = &bond.own_enc;
+	else if (bond.flags & BOND_FLAG_PEER_ENC)
+		key = &bond.peer_enc;
+	if (key == NULL || key->ltk_len == 0) {
+		secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+		secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
+		return NRF_ERROR_NOT_FOUND;
+	}
+
+	ble_gap_master_id_t master_id = { 0 };
+	ble_gap_enc_info_t enc_info = { 0 };
+	master_id.ediv = key->ediv;
+	memcpy_s(master_id.rand, BLE_GAP_SEC_RAND_LEN, key->rand, BOND_RAND_LEN);
+	memcpy_s(enc_info.ltk, BLE_GAP_SEC_KEY_LEN, key->ltk, BOND_KEY_LEN);
+	enc_info.ltk_len = key->ltk_len;
+	enc_info.auth = key->auth;
+	enc_info.lesc = key->lesc;
+
+	uint32_t error_code = m_sd->ble_gap_encrypt(m_adapter, m_connection_handle, &master_id, &enc_info);
+	log_level(LOG_DEBUG, "encrypt with stored key of %llx, lesc=%d return=%d", addr_num, enc_info.lesc, error_code);
+
+	secure_zero(&enc_info, sizeof(enc_info));
+	secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+	secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
+	return error_code;
+}
+
 #pragma endregion
 
 
@@ -735,8 +1325,9 @@ static bool read_pair_data(uint64_t addr_num) {
  */
 uint32_t scan_start(float interval, float window, bool active, uint16_t timeout)
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
 
 	//m_discovered_report = { 0 };
 	m_adv_list.clear();
@@ -752,8 +1343,12 @@ uint32_t scan_start(float interval, float window, bool active, uint16_t timeout)
 	m_scan_param.window = MSEC_TO_UNITS(window, UNIT_0_625_MS); // 0x0050=50ms
 	m_scan_param.active = active ? 1 : 0;
 	m_scan_param.timeout = timeout;
+	{
+		std::lock_guard<std::mutex> lck(m_mtx_setup);
+		m_scan_started_at = std::chrono::steady_clock::now();
+	}
 
-	uint32_t error_code = sd_ble_gap_scan_start(m_adapter, &m_scan_param
+	uint32_t error_code = m_sd->ble_gap_scan_start(m_adapter, &m_scan_param
 #if NRF_SD_BLE_API >= 6
 		, &m_adv_report_buffer
 #endif
@@ -771,11 +1366,12 @@ uint32_t scan_start(float interval, float window, bool active, uint16_t timeout)
 
 uint32_t scan_stop()
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
 
 	uint32_t error_code = 0;
-	error_code = sd_ble_gap_scan_stop(m_adapter);
+	error_code = m_sd->ble_gap_scan_stop(m_adapter);
 
 	if (error_code != NRF_SUCCESS) {
 		log_level(LOG_ERROR, "Scan stop failed, code: %d", error_code);
@@ -789,8 +1385,9 @@ uint32_t scan_stop()
 
 uint32_t conn_start(uint8_t addr_type, uint8_t addr[6])
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
 
 	// cleanup previous data
 	connection_cleanup();
@@ -799,11 +1396,9 @@ uint32_t conn_start(uint8_t addr_type, uint8_t addr[6])
 	m_connected_addr.addr_type = addr_type;
 	memcpy_s(&(m_connected_addr.addr[0]), BLE_GAP_ADDR_LEN, &addr[0], BLE_GAP_ADDR_LEN);
 
-	m_connection_param.min_conn_interval = MIN_CONNECTION_INTERVAL;
-	m_connection_param.max_conn_interval = MAX_CONNECTION_INTERVAL;
-	m_connection_param.slave_latency = 0;
-	m_connection_param.conn_sup_timeout = CONNECTION_SUPERVISION_TIMEOUT;
-	log_level(LOG_DEBUG, "conn start, conn params min=%d max=%d late=%d timeout=%d",
+	m_connection_param = m_conn_param_profiles[m_conn_param_profile];
+	log_level(LOG_DEBUG, "conn start, conn params(%s) min=%d max=%d late=%d timeout=%d",
+		m_conn_param_profile_names[m_conn_param_profile],
 		(int)(m_connection_param.min_conn_interval * 1.25),
 		(int)(m_connection_param.max_conn_interval * 1.25),
 		m_connection_param.slave_latency,
@@ -816,7 +1411,7 @@ uint32_t conn_start(uint8_t addr_type, uint8_t addr[6])
 
 	// get or create data struct to follow up pairing sequences
 	uint64_t addr_num = 0;
-	convert_ble_address_to_uint64(addr, &addr_num);
+	convert_peer_address_to_uint64(addr, &addr_num);
 	pair_data_t data = { 0 };
 	m_pair_list.insert_or_assign(addr_num, data);
 	memcpy_s(&m_pair_list[addr_num].adv_report, sizeof(ble_gap_evt_adv_report_t),
@@ -826,9 +1421,10 @@ uint32_t conn_start(uint8_t addr_type, uint8_t addr[6])
 	read_pair_data(addr_num);
 	m_pair_addr_num = addr_num;
 	log_level(LOG_DEBUG, "Pair addr:%llx assign to the map, size=%lu", addr_num, m_pair_list.size());
+	setup_timing_begin(addr_num);
 
 	uint32_t err_code;
-	err_code = sd_ble_gap_connect(m_adapter,
+	err_code = m_sd->ble_gap_connect(m_adapter,
 		&(m_connected_addr),
 		&m_scan_param,
 		&m_connection_param
@@ -847,128 +1443,502 @@ uint32_t conn_start(uint8_t addr_type, uint8_t addr[6])
 	return err_code;
 }
 
-uint32_t auth_set_params(bool lesc, bool oob, bool mitm, uint8_t role, bool enc, bool id, bool sign, bool link)
+#if NRF_SD_BLE_API >= 5
+/*
+request maximum data length to given connection, also reply to peer data length update request
+*/
+static uint32_t data_length_update_start(uint16_t conn_handle)
 {
-	m_sec_params.lesc = lesc ? 1 : 0; /* enable LE secure conn */
-	m_sec_params.oob = oob ? 1 : 0; /* set if has out of band auth data */
-	m_sec_params.mitm = mitm ? 1 : 0;
-	/* OOB enabled will use OOB method if:
-	- both of devices have out of band(legacy), or
-	- at least one of device has peer OOB data(lesc enabled) */
-	//https://infocenter.nordicsemi.com/topic/com.nordic.infocenter.s132.api.v5.0.0/s132_msc_overview.html?cp=4_7_3_7_1
-	// GAP MSC -> Central Security Procedures
-	//TODO: debug gen ltk
-	/*ble_gap_master_id_t master_id = { 0 };
-	ble_gap_enc_info_t info = { 0 };
-	sd_ble_gap_encrypt(m_adapter, m_connection_handle, NULL, NULL);*/
-	//TODO: debug2 req peer enc
-	if (role == 0) {
-		m_sec_params.kdist_own.enc = enc ? 1 : 0;
-		m_sec_params.kdist_own.id = id ? 1 : 0;
-		m_sec_params.kdist_own.sign = sign ? 1 : 0; // 1:NRF_ERROR_NOT_SUPPORTED
-		m_sec_params.kdist_own.link = link ? 1 : 0; // 1:NRF_ERROR_NOT_SUPPORTED
-	}
-	if (role == 1) {
-		m_sec_params.kdist_peer.enc = enc ? 1 : 0;
-		m_sec_params.kdist_peer.id = id ? 1 : 0;
-		m_sec_params.kdist_peer.sign = sign ? 1 : 0; // 1:NRF_ERROR_NOT_SUPPORTED
-		m_sec_params.kdist_peer.link = link ? 1 : 0; // 1:NRF_ERROR_NOT_SUPPORTED
-	}
-	return NRF_SUCCESS;
+	ble_gap_data_length_params_t m_data_length = { 0 };
+	m_data_length.max_rx_octets = NRF_SDH_BLE_GAP_DATA_LENGTH;
+	m_data_length.max_tx_octets = NRF_SDH_BLE_GAP_DATA_LENGTH;
+	m_data_length.max_rx_time_us = BLE_GAP_DATA_LENGTH_AUTO;
+	m_data_length.max_tx_time_us = BLE_GAP_DATA_LENGTH_AUTO;
+	ble_gap_data_length_limitation_t m_data_limit = { 0 };
+	auto err_code = m_sd->ble_gap_data_length_update(m_adapter, conn_handle, &m_data_length, &m_data_limit);
+	log_level(LOG_INFO, "Request maximum packet length update=%d: rx=%d bytes, %d us, tx=%d bytes, %d us",
+		err_code,
+		m_data_length.max_rx_octets, m_data_length.max_rx_time_us,
+		m_data_length.max_tx_octets, m_data_length.max_tx_time_us);
+	log_level(LOG_INFO, "Request maximum packet length limit: rx=%d bytes, tx=%d bytes, %d us",
+		m_data_limit.rx_payload_limited_octets,
+		m_data_limit.tx_payload_limited_octets, m_data_limit.tx_rx_time_limited_us);
+	return err_code;
 }
 
-uint32_t auth_start(bool bond, bool keypress, uint8_t io_caps, const char* passkey)
+/*
+request PHY update to given connection by m_phy_preference,
+BLE_GAP_PHY_AUTO is expanded to 1M|2M here and leave the choice to controller
+*/
+static uint32_t phy_update_start(uint16_t conn_handle)
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	ble_gap_phys_t phys = m_phy_preference;
+	if (phys.tx_phys == BLE_GAP_PHY_AUTO)
+		phys.tx_phys = BLE_GAP_PHY_1MBPS | BLE_GAP_PHY_2MBPS;
+	if (phys.rx_phys == BLE_GAP_PHY_AUTO)
+		phys.rx_phys = BLE_GAP_PHY_1MBPS | BLE_GAP_PHY_2MBPS;
+
+	// link always established on 1M PHY, nothing to change
+	if (phys.tx_phys == BLE_GAP_PHY_1MBPS && phys.rx_phys == BLE_GAP_PHY_1MBPS)
+		return NRF_SUCCESS;
 
-	// update fixed passkey
-	if (passkey) {
-		memcpy_s(m_passkey, 6, passkey, 6);
-	}
+	uint32_t error_code = m_sd->ble_gap_phy_update(m_adapter, conn_handle, &phys);
+	log_level(LOG_DEBUG, "PHY update start, tx=0x%x rx=0x%x code:%d", phys.tx_phys, phys.rx_phys, error_code);
+	return error_code;
+}
+#endif
 
-	uint32_t error_code;
+uint32_t phy_set_preference(uint8_t tx_phys, uint8_t rx_phys)
+{
+#if NRF_SD_BLE_API >= 5
+	const uint8_t phys_mask = BLE_GAP_PHY_1MBPS | BLE_GAP_PHY_2MBPS | BLE_GAP_PHY_CODED;
+	if ((tx_phys & ~phys_mask) != 0 || (rx_phys & ~phys_mask) != 0)
+		return NRF_ERROR_INVALID_PARAM;
 
-	// try to get security mode before authenticate
-	ble_gap_conn_sec_t conn_sec;
-	error_code = sd_ble_gap_conn_sec_get(m_adapter, m_connection_handle, &conn_sec);
-	log_level(LOG_DEBUG, "get security, return=%d mode=%d level=%d",
-		error_code, conn_sec.sec_mode.sm, conn_sec.sec_mode.lv);
+	m_phy_preference.tx_phys = tx_phys;
+	m_phy_preference.rx_phys = rx_phys;
+	log_level(LOG_INFO, "PHY preference tx=0x%x rx=0x%x", tx_phys, rx_phys);
 
-	m_sec_params.bond = bond ? 1 : 0;
-	m_sec_params.keypress = keypress ? 1 : 0;
-	m_sec_params.io_caps = io_caps;
-	// NOTICE: refer to m_sec_params default value for other security options,
-	//   or change by auth_config() before authentication
+	// otherwise apply on next connection, or the one resumed by recovery
+	if (adapter_state() != NRF_SUCCESS || !m_is_connected)
+		return NRF_SUCCESS;
 
-	// NOTICE: refer to driver, testcase_security.cpp, we'll use the default security params
-	error_code = sd_ble_gap_authenticate(m_adapter, m_connection_handle, &m_sec_params);
-	// NOTICE: for other devices, check if return NRF_ERROR_NOT_SUPPORTED or NRF_ERROR_NO_MEM?
-	//         driver test case uses for passkey auth, refer to testcase_security.cpp
-	log_level(LOG_DEBUG, "authenticate return=%d should be %d", error_code, NRF_SUCCESS);
+	return phy_update_start(m_connection_handle);
+#else
+	return NRF_ERROR_NOT_SUPPORTED;
+#endif
+}
 
-	if (error_code != NRF_SUCCESS)
-	{
-		log_level(LOG_ERROR, "Authenticate start Failed, code: %d", error_code);
-	}
+uint32_t phy_get(uint8_t *tx_phy, uint8_t *rx_phy)
+{
+	if (tx_phy == NULL || rx_phy == NULL)
+		return NRF_ERROR_INVALID_PARAM;
+#if NRF_SD_BLE_API >= 5
+	auto found = m_conn_phys.find(m_connection_handle);
+	if (!m_is_connected || found == m_conn_phys.end())
+		return NRF_ERROR_INVALID_STATE;
+
+	*tx_phy = found->second.tx_phys;
+	*rx_phy = found->second.rx_phys;
+	return NRF_SUCCESS;
+#else
+	return NRF_ERROR_NOT_SUPPORTED;
+#endif
+}
 
+/*
+connection event extension let the link keep transferring packets beyond configured event length
+until next connection event, only worth for throughput profile
+*/
+static uint32_t conn_evt_ext_set(bool enable)
+{
+#if NRF_SD_BLE_API >= 5
+	ble_opt_t opt;
+	memset(&opt, 0, sizeof(opt));
+	opt.common_opt.conn_evt_ext.enable = enable ? 1 : 0;
+	uint32_t error_code = m_sd->ble_opt_set(m_adapter, BLE_COMMON_OPT_CONN_EVT_EXT, &opt);
+	log_level(LOG_DEBUG, "conn event extension enable=%d code:%d", enable, error_code);
 	return error_code;
+#else
+	return NRF_ERROR_NOT_SUPPORTED;
+#endif
 }
 
-/**@brief Function called upon connecting to BLE peripheral.
- *
- * @details Initiates primary service discovery.
- *
- * @return NRF_SUCCESS on success, otherwise an error code.
- */
-uint32_t service_discovery_start(uint16_t uuid, uint8_t type)
+uint32_t conn_param_profile_set(conn_param_profile_t profile)
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	if (profile < CONN_PARAM_DEFAULT || profile >= CONN_PARAM_PROFILE_COUNT)
+		return NRF_ERROR_INVALID_PARAM;
 
-	uint32_t   err_code;
-	uint16_t   start_handle = 0x01;
-	ble_uuid_t srvc_uuid;
+	m_conn_param_profile = profile;
+	log_level(LOG_INFO, "Conn params profile: %s", m_conn_param_profile_names[profile]);
 
-	char uuid_string[STRING_BUFFER_SIZE] = { 0 };
-	get_uuid_string(uuid, uuid_string);
-	log_level(LOG_INFO, "Discovering primary service:0x%04X(%s)", uuid, uuid_string);
+	// otherwise apply on next connection, or the one resumed by recovery
+	if (adapter_state() != NRF_SUCCESS)
+		return NRF_SUCCESS;
 
-	srvc_uuid.type = type;
-	srvc_uuid.uuid = uuid;
+	conn_evt_ext_set(m_stack_config.conn_evt_ext || profile == CONN_PARAM_THROUGHPUT);
 
-	// Initiate procedure to find the primary BLE_UUID_HEART_RATE_SERVICE.
-	err_code = sd_ble_gattc_primary_services_discover(m_adapter,
-		m_connection_handle, start_handle,
-		&srvc_uuid/*NULL*/);
-	if (err_code != NRF_SUCCESS)
-	{
-		log_level(LOG_ERROR, "Failed to initiate or continue a GATT Primary Service Discovery procedure");
+	if (!m_is_connected)
+		return NRF_SUCCESS;
+
+	m_connection_param = m_conn_param_profiles[profile];
+	uint32_t error_code = m_sd->ble_gap_conn_param_update(m_adapter, m_connection_handle, &m_connection_param);
+	log_level(LOG_DEBUG, "conn params update code=%d min=%d max=%d late=%d timeout=%d",
+		error_code,
+		(int)(m_connection_param.min_conn_interval * 1.25),
+		(int)(m_connection_param.max_conn_interval * 1.25),
+		m_connection_param.slave_latency,
+		(int)(m_connection_param.conn_sup_timeout * 10));
+	if (error_code != NRF_SUCCESS) {
+		log_level(LOG_ERROR, "Conn params update failed, code: %d", error_code);
 	}
 
-	return err_code;
+	return error_code;
 }
 
-/**@brief Function called upon discovering a BLE peripheral's primary service(s).
- *
- * @details Initiates service's (m_service) characteristic discovery.
- *
- * @return NRF_SUCCESS on success, otherwise an error code.
- */
-static uint32_t char_discovery_start(ble_gattc_handle_range_t handle_range)
+uint32_t conn_param_policy_set(conn_param_policy_t policy)
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	if (policy < CONN_PARAM_POLICY_ACCEPT || policy > CONN_PARAM_POLICY_PROFILE)
+		return NRF_ERROR_INVALID_PARAM;
 
-	if (handle_range.start_handle == 0 && handle_range.end_handle == 0) {
-		handle_range.start_handle = m_service_start_handle;
-		handle_range.end_handle = m_service_end_handle;
+	m_conn_param_policy = policy;
+	return NRF_SUCCESS;
+}
+
+uint32_t conn_param_get(float *interval, uint16_t *latency, uint16_t *timeout)
+{
+	if (interval == NULL || latency == NULL || timeout == NULL)
+		return NRF_ERROR_INVALID_PARAM;
+	if (!m_is_connected)
+		return NRF_ERROR_INVALID_STATE;
+
+	// min and max are the same value from connected or updated event
+	*interval = m_conn_param_active.max_conn_interval * 1.25f;
+	*latency = m_conn_param_active.slave_latency;
+	*timeout = m_conn_param_active.conn_sup_timeout * 10;
+	return NRF_SUCCESS;
+}
+
+uint32_t ecc_benchmark(uint8_t backend, uint32_t iterations, float *keygen_ops, float *ecdh_ops)
+{
+	if (keygen_ops == NULL || ecdh_ops == NULL || iterations == 0)
+		return NRF_ERROR_INVALID_PARAM;
+
+	if (ecc_p256_benchmark(backend, iterations, keygen_ops, ecdh_ops) != 1)
+		return NRF_ERROR_NOT_SUPPORTED;
+
+	log_level(LOG_INFO, "ECC backend %d: keygen %.1f ops/s, ecdh %.1f ops/s in %d iterations", backend, *keygen_ops, *ecdh_ops, iterations);
+	return NRF_SUCCESS;
+}
+
+uint32_t ecc_selftest(uint8_t backend, uint32_t iterations, float *pairing_us)
+{
+	if (pairing_us == NULL)
+		return NRF_ERROR_INVALID_PARAM;
+
+	int ret = ecc_p256_selftest(backend, iterations, pairing_us);
+	if (ret < 0)
+		return NRF_ERROR_NOT_SUPPORTED;
+	if (ret != 1) {
+		log_level(LOG_ERROR, "ECC backend %d self test failed", backend);
+		return NRF_ERROR_INTERNAL;
+	}
+
+	log_level(LOG_INFO, "ECC backend %d: self test passed, pairing crypto %.1f us in %d iterations", backend, *pairing_us, iterations);
+	return NRF_SUCCESS;
+}
+
+uint32_t rng_benchmark(uint32_t request_size, uint32_t total_size, float *bytes_per_sec)
+{
+	if (bytes_per_sec == NULL || request_size == 0 || total_size < request_size)
+		return NRF_ERROR_INVALID_PARAM;
+
+	if (rng_throughput(request_size, total_size, bytes_per_sec) != 1)
+		return NRF_ERROR_INTERNAL;
+
+	log_level(LOG_INFO, "RNG %d bytes per request: %.1f bytes/s", request_size, *bytes_per_sec);
+	return NRF_SUCCESS;
+}
+
+uint32_t ecc_valid_public_key_batch(uint8_t *pks, uint32_t count, uint8_t *results, uint8_t threads, float *ops_per_sec)
+{
+	if (pks == NULL || results == NULL || count == 0)
+		return NRF_ERROR_INVALID_PARAM;
+
+	float ops = 0;
+	int valid = ecc_p256_valid_public_key_batch(pks, count, results, threads, &ops);
+	if (ops_per_sec != NULL)
+		*ops_per_sec = ops;
+	log_level(LOG_DEBUG, "ECC valid batch: %d of %d valid, %.1f ops/s", valid, count, ops);
+	return NRF_SUCCESS;
+}
+
+uint32_t ecc_shared_secret_batch(uint8_t *sks, uint32_t sk_count, uint8_t *pks, uint32_t count, uint8_t *secrets, uint8_t *results, uint8_t threads, float *ops_per_sec)
+{
+	if (sks == NULL || pks == NULL || secrets == NULL || results == NULL || count == 0)
+		return NRF_ERROR_INVALID_PARAM;
+	if (sk_count != 1 && sk_count != count)
+		return NRF_ERROR_INVALID_LENGTH;
+
+	float ops = 0;
+	int done = ecc_p256_compute_sharedsecret_batch(sks, sk_count, pks, count, secrets, results, threads, &ops);
+	if (ops_per_sec != NULL)
+		*ops_per_sec = ops;
+	log_level(LOG_DEBUG, "ECC shared secret batch: %d of %d done, %.1f ops/s", done, count, ops);
+	return NRF_SUCCESS;
+}
+
+uint32_t oob_peer_set(uint8_t addr[6], uint8_t random[16], uint8_t confirm[16])
+{
+	if (addr == NULL || random == NULL || confirm == NULL)
+		return NRF_ERROR_INVALID_PARAM;
+
+	uint64_t addr_num = 0;
+	convert_peer_address_to_uint64(addr, &addr_num);
+	std::lock_guard<std::mutex> lck(m_mtx_oob);
+	auto& oob = m_oob_list[addr_num];
+	memcpy_s(oob.peer.addr.addr, BLE_GAP_ADDR_LEN, addr, BLE_GAP_ADDR_LEN);
+	memcpy_s(oob.peer.r, BLE_GAP_SEC_KEY_LEN, random, LESC_OOB_LEN);
+	memcpy_s(oob.peer.c, BLE_GAP_SEC_KEY_LEN, confirm, LESC_OOB_LEN);
+	oob.flags |= OOB_FLAG_PEER;
+	log_level(LOG_DEBUG, "OOB data of peer %llx set", addr_num);
+	return NRF_SUCCESS;
+}
+
+uint32_t oob_tk_set(uint8_t addr[6], uint8_t tk[16])
+{
+	if (addr == NULL || tk == NULL)
+		return NRF_ERROR_INVALID_PARAM;
+
+	uint64_t addr_num = 0;
+	convert_peer_address_to_uint64(addr, &addr_num);
+	std::lock_guard<std::mutex> lck(m_mtx_oob);
+	auto& oob = m_oob_list[addr_num];
+	memcpy_s(oob.tk, BLE_GAP_SEC_KEY_LEN, tk, BLE_GAP_SEC_KEY_LEN);
+	oob.flags |= OOB_FLAG_TK;
+	log_level(LOG_DEBUG, "OOB temporary key of peer %llx set", addr_num);
+	return NRF_SUCCESS;
+}
+
+uint32_t oob_own_get(uint8_t addr[6], uint8_t random[16], uint8_t confirm[16])
+{
+	if (addr == NULL || random == NULL || confirm == NULL)
+		return NRF_ERROR_INVALID_PARAM;
+
+	uint64_t addr_num = 0;
+	convert_peer_address_to_uint64(addr, &addr_num);
+	std::lock_guard<std::mutex> lck(m_mtx_oob);
+	auto& oob = m_oob_list[addr_num];
+	// confirm value commits to own public key, the same key pair must be used by the pairing
+	if ((oob.flags & OOB_FLAG_OWN) == 0) {
+		if (ecc_keypool_take(oob.own_sk, oob.own_pk) != 1 ||
+			lesc_oob_generate(oob.own_pk, oob.own.r, oob.own.c) != 1) {
+			m_oob_list.erase(addr_num);
+			log_level(LOG_ERROR, "OOB data of own for %llx generate failed", addr_num);
+			return NRF_ERROR_INTERNAL;
+		}
+		if (m_adapter != NULL)
+			m_sd->ble_gap_addr_get(m_adapter, &oob.own.addr);
+		oob.flags |= OOB_FLAG_OWN;
+	}
+	memcpy_s(random, LESC_OOB_LEN, oob.own.r, BLE_GAP_SEC_KEY_LEN);
+	memcpy_s(confirm, LESC_OOB_LEN, oob.own.c, BLE_GAP_SEC_KEY_LEN);
+	log_level(LOG_DEBUG, "OOB data of own for %llx get", addr_num);
+	return NRF_SUCCESS;
+}
+
+uint32_t oob_clear(uint8_t addr[6])
+{
+	std::lock_guard<std::mutex> lck(m_mtx_oob);
+	if (addr == NULL) {
+		for (auto& item : m_oob_list)
+			secure_zero(&item.second, sizeof(oob_data_t));
+		m_oob_list.clear();
+		return NRF_SUCCESS;
+	}
+
+	uint64_t addr_num = 0;
+	convert_peer_address_to_uint64(addr, &addr_num);
+	auto target = m_oob_list.find(addr_num);
+	if (target == m_oob_list.end())
+		return NRF_ERROR_NOT_FOUND;
+	secure_zero(&target->second, sizeof(oob_data_t));
+	m_oob_list.erase(target);
+	return NRF_SUCCESS;
+}
+
+uint32_t oob_confirm_compute(uint8_t pk[64], uint8_t random[16], uint8_t confirm[16])
+{
+	if (pk == NULL || random == NULL || confirm == NULL)
+		return NRF_ERROR_INVALID_PARAM;
+	if (ecc_p256_valid_public_key(pk) != 1)
+		return NRF_ERROR_INVALID_DATA;
+	return lesc_oob_confirm(pk, random, confirm) == 1 ? NRF_SUCCESS : NRF_ERROR_INTERNAL;
+}
+
+/* reply and remove pending auth key request, key is 6 digits for passkey, NULL to accept numeric comparison */
+static uint32_t auth_key_pending_reply(uint16_t conn_handle, auth_key_request_t request, bool accept, const uint8_t* key)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx_auth_key);
+		auto target = m_auth_key_pending.find(conn_handle);
+		if (target == m_auth_key_pending.end() || target->second.request != request)
+			return NRF_ERROR_INVALID_STATE;
+		m_auth_key_pending.erase(target);
+		m_cond_auth_key.notify_all();
+	}
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
+
+	uint32_t error_code = m_sd->ble_gap_auth_key_reply(m_adapter, conn_handle,
+		accept ? BLE_GAP_AUTH_KEY_TYPE_PASSKEY : BLE_GAP_AUTH_KEY_TYPE_NONE, accept ? key : NULL);
+	log_level(LOG_DEBUG, "auth key reply conn:%d request=%d accept=%d return=%d", conn_handle, request, accept, error_code);
+	return error_code;
+}
+
+uint32_t auth_key_reply(uint16_t conn_handle, const char* passkey)
+{
+	if (passkey != NULL) {
+		for (int i = 0; i < BLE_GAP_PASSKEY_LEN; i++) {
+			if (passkey[i] < '0' || passkey[i] > '9')
+				return NRF_ERROR_INVALID_PARAM;
+		}
+	}
+	return auth_key_pending_reply(conn_handle, AUTH_KEY_REQUEST_PASSKEY, passkey != NULL, (const uint8_t*)passkey);
+}
+
+uint32_t auth_numeric_reply(uint16_t conn_handle, bool match)
+{
+	return auth_key_pending_reply(conn_handle, AUTH_KEY_REQUEST_NUMERIC_COMPARISON, match, NULL);
+}
+
+uint32_t auth_key_timeout_set(uint32_t timeout)
+{
+	if (timeout == 0)
+		return NRF_ERROR_INVALID_PARAM;
+	std::lock_guard<std::mutex> lck(m_mtx_auth_key);
+	m_auth_key_timeout = timeout;
+	return NRF_SUCCESS;
+}
+
+uint32_t auth_set_params(bool lesc, bool oob, bool mitm, uint8_t role, bool enc, bool id, bool sign, bool link)
+{
+	m_sec_params.lesc = lesc ? 1 : 0; /* enable LE secure conn */
+	m_sec_params.oob = oob ? 1 : 0; /* set if has out of band auth data */
+	m_sec_params.mitm = mitm ? 1 : 0;
+	/* OOB enabled will use OOB method if:
+	- both of devices have out of band(legacy), or
+	- at least one of device has peer OOB data(lesc enabled) */
+	//https://infocenter.nordicsemi.com/topic/com.nordic.infocenter.s132.api.v5.0.0/s132_msc_overview.html?cp=4_7_3_7_1
+	// GAP MSC -> Central Security Procedures
+	//TODO: debug gen ltk
+	/*ble_gap_master_id_t master_id = { 0 };
+	ble_gap_enc_info_t info = { 0 };
+	sd_ble_gap_encrypt(m_adapter, m_connection_handle, NULL, NULL);*/
+	//TODO: debug2 req peer enc
+	if (role == 0) {
+		m_sec_params.kdist_own.enc = enc ? 1 : 0;
+		m_sec_params.kdist_own.id = id ? 1 : 0;
+		m_sec_params.kdist_own.sign = sign ? 1 : 0; // 1:NRF_ERROR_NOT_SUPPORTED
+		m_sec_params.kdist_own.link = link ? 1 : 0; // 1:NRF_ERROR_NOT_SUPPORTED
+	}
+	if (role == 1) {
+		m_sec_params.kdist_peer.enc = enc ? 1 : 0;
+		m_sec_params.kdist_peer.id = id ? 1 : 0;
+		m_sec_params.kdist_peer.sign = sign ? 1 : 0; // 1:NRF_ERROR_NOT_SUPPORTED
+		m_sec_params.kdist_peer.link = link ? 1 : 0; // 1:NRF_ERROR_NOT_SUPPORTED
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t auth_start(bool bond, bool keypress, uint8_t io_caps, const char* passkey)
+{
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
+
+	// update fixed passkey
+	if (passkey) {
+		memcpy_s(m_passkey, 6, passkey, 6);
+	}
+
+	uint32_t error_code;
+
+	// try to get security mode before authenticate
+	ble_gap_conn_sec_t conn_sec;
+	error_code = m_sd->ble_gap_conn_sec_get(m_adapter, m_connection_handle, &conn_sec);
+	log_level(LOG_DEBUG, "get security, return=%d mode=%d level=%d",
+		error_code, conn_sec.sec_mode.sm, conn_sec.sec_mode.lv);
+
+	m_sec_params.bond = bond ? 1 : 0;
+	m_sec_params.keypress = keypress ? 1 : 0;
+	m_sec_params.io_caps = io_caps;
+	// NOTICE: refer to m_sec_params default value for other security options,
+	//   or change by auth_config() before authentication
+	setup_step_begin(SETUP_PHASE_AUTH, 0);
+
+	// bonded peer only needs encryption with stored LTK, pairing again if peer reports key missing
+	if (bond && m_pair_list[m_pair_addr_num].is_paired) {
+		error_code = encrypt_start(m_pair_addr_num);
+		if (error_code == NRF_SUCCESS) {
+			m_is_encrypting = true;
+			return error_code;
+		}
+		log_level(LOG_INFO, "Encrypt with stored key failed, code: %d, pairing instead", error_code);
+	}
+
+	// NOTICE: refer to driver, testcase_security.cpp, we'll use the default security params
+	error_code = m_sd->ble_gap_authenticate(m_adapter, m_connection_handle, &m_sec_params);
+	// NOTICE: for other devices, check if return NRF_ERROR_NOT_SUPPORTED or NRF_ERROR_NO_MEM?
+	//         driver test case uses for passkey auth, refer to testcase_security.cpp
+	log_level(LOG_DEBUG, "authenticate return=%d should be %d", error_code, NRF_SUCCESS);
+
+	if (error_code != NRF_SUCCESS)
+	{
+		log_level(LOG_ERROR, "Authenticate start Failed, code: %d", error_code);
+	}
+
+	return error_code;
+}
+
+/**@brief Function called upon connecting to BLE peripheral.
+ *
+ * @details Initiates primary service discovery.
+ *
+ * @return NRF_SUCCESS on success, otherwise an error code.
+ */
+uint32_t service_discovery_start(uint16_t uuid, uint8_t type)
+{
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
+
+	uint32_t   err_code;
+	uint16_t   start_handle = 0x01;
+	ble_uuid_t srvc_uuid;
+
+	char uuid_string[STRING_BUFFER_SIZE] = { 0 };
+	get_uuid_string(uuid, uuid_string);
+	log_level(LOG_INFO, "Discovering primary service:0x%04X(%s)", uuid, uuid_string);
+
+	srvc_uuid.type = type;
+	srvc_uuid.uuid = uuid;
+
+	setup_step_begin(SETUP_PHASE_SERVICE_DISC, uuid);
+	// Initiate procedure to find the primary BLE_UUID_HEART_RATE_SERVICE.
+	err_code = m_sd->ble_gattc_primary_services_discover(m_adapter,
+		m_connection_handle, start_handle,
+		&srvc_uuid/*NULL*/);
+	if (err_code != NRF_SUCCESS)
+	{
+		log_level(LOG_ERROR, "Failed to initiate or continue a GATT Primary Service Discovery procedure");
+	}
+
+	return err_code;
+}
+
+/**@brief Function called upon discovering a BLE peripheral's primary service(s).
+ *
+ * @details Initiates service's (m_service) characteristic discovery.
+ *
+ * @return NRF_SUCCESS on success, otherwise an error code.
+ */
+static uint32_t char_discovery_start(ble_gattc_handle_range_t handle_range)
+{
+	if (m_adapter == NULL)
+		return NRF_ERROR_INVALID_STATE;
+
+	if (handle_range.start_handle == 0 && handle_range.end_handle == 0) {
+		handle_range.start_handle = m_service_start_handle;
+		handle_range.end_handle = m_service_end_handle;
 	}
 
 	log_level(LOG_INFO, "Discovering characteristics, handle range:0x%04X - 0x%04X",
 		handle_range.start_handle, handle_range.end_handle);
+	setup_step_begin(SETUP_PHASE_CHAR_DISC, handle_range.start_handle);
 
-	return sd_ble_gattc_characteristics_discover(m_adapter, m_connection_handle, &handle_range);
+	return m_sd->ble_gattc_characteristics_discover(m_adapter, m_connection_handle, &handle_range);
 }
 
 /**@brief Function called upon discovering service's characteristics.
@@ -989,8 +1959,9 @@ static uint32_t descr_discovery_start(ble_gattc_handle_range_t handle_range)
 
 	log_level(LOG_INFO, "Discovering descriptors, handle range:0x%04X - 0x%04X",
 		handle_range.start_handle, handle_range.end_handle);
+	setup_step_begin(SETUP_PHASE_DESC_DISC, handle_range.start_handle);
 
-	return sd_ble_gattc_descriptors_discover(m_adapter, m_connection_handle, &handle_range);
+	return m_sd->ble_gattc_descriptors_discover(m_adapter, m_connection_handle, &handle_range);
 }
 
 /*
@@ -1004,7 +1975,7 @@ static uint32_t read_device_name()
 	uint32_t error_code = 0;
 	// use m_device_name_handle or find BLE_UUID_GAP_CHARACTERISTIC_DEVICE_NAME in desc_list
 	uint16_t value_handle = m_device_name_handle;
-	error_code = sd_ble_gattc_read(
+	error_code = m_sd->ble_gattc_read(
 		m_adapter,
 		m_connection_handle,
 		value_handle, 0
@@ -1043,8 +2014,9 @@ static uint32_t set_cccd_notification(uint16_t handle)
 			write_params.p_value = cccd_value;
 			write_params.write_op = BLE_GATT_OP_WRITE_REQ;
 			write_params.offset = 0;
+			setup_step_begin(SETUP_PHASE_CCCD, write_params.handle);
 			// write it!
-			error_code = sd_ble_gattc_write(m_adapter, m_connection_handle, &write_params);
+			error_code = m_sd->ble_gattc_write(m_adapter, m_connection_handle, &write_params);
 			log_level(LOG_INFO, " Write to register CCCD handle:0x%04X code:%d",
 				m_char_list[m_char_idx].cccd_handle, error_code);
 			enable_next = true;
@@ -1070,6 +2042,7 @@ static uint32_t set_cccd_notification(uint16_t handle)
 		}
 
 		m_is_service_enabled = true;
+		setup_timing_end();
 
 		m_cond_find.notify_all();
 
@@ -1105,8 +2078,9 @@ static uint32_t read_report_refs(uint16_t handle)
 			continue;
 		if (m_char_list[i].report_ref_handle >= handle) {
 			m_char_idx = i;
+			setup_step_begin(SETUP_PHASE_REPORT_REF, m_char_list[m_char_idx].report_ref_handle);
 			// read it!, then check on_read_response()
-			error_code = sd_ble_gattc_read(
+			error_code = m_sd->ble_gattc_read(
 				m_adapter,
 				m_connection_handle,
 				m_char_list[m_char_idx].report_ref_handle, 0
@@ -1128,6 +2102,9 @@ static uint32_t read_report_refs(uint16_t handle)
 }
 
 uint32_t service_enable_start() {
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
 
 	read_report_refs(0);
 	// read_report_refs will also set_cccd_notification
@@ -1135,6 +2112,8 @@ uint32_t service_enable_start() {
 	return 0;
 }
 
+static uint32_t service_setup_wait(std::unique_lock<std::mutex>& lck, uint16_t timeout);
+
 uint32_t device_find(uint8_t addr[6], int8_t rssi, const char* passkey, uint16_t timeout) {
 	uint32_t error_code = 0;
 
@@ -1165,7 +2144,7 @@ uint32_t device_find(uint8_t addr[6], int8_t rssi, const char* passkey, uint16_t
 				continue;
 			if (addr != NULL) {
 				uint64_t addr_num = 0;
-				convert_ble_address_to_uint64(addr, &addr_num);
+				convert_peer_address_to_uint64(addr, &addr_num);
 				if (target->first == addr_num) {
 					break;
 				}
@@ -1206,7 +2185,15 @@ uint32_t device_find(uint8_t addr[6], int8_t rssi, const char* passkey, uint16_t
 	if (stat == std::cv_status::timeout) {
 		return NRF_ERROR_TIMEOUT;
 	}
-	
+
+	return service_setup_wait(lck, timeout);
+}
+
+/* discover services then enable them, each step waits for its callback by m_cond_find */
+static uint32_t service_setup_wait(std::unique_lock<std::mutex>& lck, uint16_t timeout) {
+	uint32_t error_code = 0;
+	std::cv_status stat;
+
 	typedef struct {
 		unsigned short uuid;
 		unsigned short type;
@@ -1281,11 +2268,14 @@ uint32_t report_char_list(uint16_t *handle_list, uint8_t *refs_list, uint16_t *l
 
 EXTERNC NRFBLEAPI uint32_t data_read_async(uint16_t handle)
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
 
 	uint32_t error_code = 0;
-	error_code = sd_ble_gattc_read(
+	// before the request, its response may arrive before returning
+	m_read_status[handle] = BLE_GATT_STATUS_SUCCESS;
+	error_code = m_sd->ble_gattc_read(
 		m_adapter,
 		m_connection_handle,
 		handle, 0
@@ -1313,12 +2303,15 @@ uint32_t data_read(uint16_t handle, uint8_t *data, uint16_t *len, uint16_t timeo
 		return NRF_ERROR_TIMEOUT;
 	}
 
-	if (m_read_data[handle].p_data == NULL || m_read_data[handle].len == 0)
+	uint16_t gatt_status = m_read_status[handle];
+	if (gatt_status != BLE_GATT_STATUS_SUCCESS)
+		return GATT_STATUS_ERROR_BASE + gatt_status;
+	if (m_read_data[handle].len == 0)
 		return NRF_ERROR_INVALID_DATA;
 	
 	// limited data length by given len
 	*len = std::min(*len, m_read_data[handle].len);
-	memcpy_s(data, *len, m_read_data[handle].p_data, *len);
+	memcpy_s(data, *len, m_read_data[handle].p_data.data(), *len);
 	
 	return NRF_SUCCESS;
 }
@@ -1343,55 +2336,157 @@ uint32_t data_read_by_report_ref(uint8_t *report_ref, uint8_t *data, uint16_t *l
 	return data_read(handle, data, len, timeout);
 }
 
-EXTERNC NRFBLEAPI uint32_t data_write_async(uint16_t handle, uint8_t* data, uint16_t len)
+uint32_t data_read_multiple(uint16_t *handles, uint16_t *lens, uint16_t count)
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
 
-	if (data == NULL || len == 0)
+	// each handle takes 2 bytes in request
+	if (handles == NULL || lens == NULL || count < 2 || count > (m_att_mtu - 1) / 2)
 		return NRF_ERROR_INVALID_PARAM;
 
-	memset(m_write_data[handle].p_data, 0, DATA_BUFFER_SIZE);
-	memcpy_s(m_write_data[handle].p_data, DATA_BUFFER_SIZE, data, len);
-	m_write_data[handle].len = len;
+	if (m_batch_reading)
+		return NRF_ERROR_BUSY;
 
-	ble_gattc_write_params_t write_params;
-	write_params.handle = handle;
-	write_params.len = m_write_data[handle].len;
-	write_params.p_value = m_write_data[handle].p_data;
-	write_params.write_op = BLE_GATT_OP_WRITE_REQ;
-	write_params.offset = 0;
-	uint32_t error_code = 0;
-	error_code = sd_ble_gattc_write(m_adapter, m_connection_handle, &write_params);
-	log_level(LOG_INFO, " Write value to handle:0x%04X data:0x%02x %02x code:%d",
-		handle, m_write_data[handle].p_data[0], m_write_data[handle].p_data[1], error_code);
+	m_batch_handles.assign(handles, handles + count);
+	m_batch_lens.assign(lens, lens + count);
+	m_batch_data.clear();
+
+	uint32_t error_code = m_sd->ble_gattc_char_values_read(m_adapter, m_connection_handle, handles, count);
+	log_level(LOG_INFO, " Read multiple values from %d handles:0x%04X.. code:%d", count, handles[0], error_code);
+	m_batch_reading = (error_code == NRF_SUCCESS);
 	return error_code;
 }
 
-uint32_t data_write(uint16_t handle, uint8_t *data, uint16_t len, uint16_t timeout)
+uint32_t data_read_by_uuid(uint16_t uuid, uint8_t type, uint16_t start_handle, uint16_t end_handle)
 {
-	if (data == NULL || len == 0)
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
+
+	if (start_handle == 0 || start_handle > end_handle)
 		return NRF_ERROR_INVALID_PARAM;
 
-	uint32_t error_code = data_write_async(handle, data, len);
-	if (error_code != NRF_SUCCESS) {
-		return error_code;
-	}
+	if (m_batch_reading)
+		return NRF_ERROR_BUSY;
 
-	log_level(LOG_DEBUG, " Lock mutex wait for write response in %d ms", timeout);
-	//std::unique_lock<std::mutex> lck{ m_mtx_read_write };
-	auto stat = m_cond_read_write.wait_for(m_lck, std::chrono::milliseconds(timeout));
-	if (stat == std::cv_status::timeout) {
-		log_level(LOG_INFO, " Lock mutex wait for write response timeout");
-		return NRF_ERROR_TIMEOUT;
-	}
-	//DEBUG: check write data?
-	return NRF_SUCCESS;
+	m_batch_handles.clear();
+	m_batch_lens.clear();
+	m_batch_data.clear();
+	m_batch_uuid.uuid = uuid;
+	m_batch_uuid.type = type;
+	m_batch_end_handle = end_handle;
+
+	ble_gattc_handle_range_t range{ start_handle, end_handle };
+	uint32_t error_code = m_sd->ble_gattc_char_value_by_uuid_read(m_adapter, m_connection_handle, &m_batch_uuid, &range);
+	log_level(LOG_INFO, " Read values by uuid:0x%04X from handle:0x%04X-0x%04X code:%d", uuid, start_handle, end_handle, error_code);
+	m_batch_reading = (error_code == NRF_SUCCESS);
+	return error_code;
 }
 
-uint32_t data_write_by_report_ref(uint8_t *report_ref, uint8_t *data, uint16_t len, uint16_t timeout)
+/*
+send part of m_write_data[handle] from offset by prepare write request, each part fits ATT MTU - 5
+(opcode, handle, offset), or execute write request once all parts queued by peer
+*/
+static uint32_t prep_write_next(uint16_t handle, uint16_t offset)
 {
-	uint16_t handle = 0;
+	auto &value = m_write_data[handle];
+	ble_gattc_write_params_t write_params = { 0 };
+	write_params.handle = handle;
+	if (offset < value.len) {
+		write_params.write_op = BLE_GATT_OP_PREP_WRITE_REQ;
+		write_params.offset = offset;
+		write_params.len = std::min<uint16_t>(value.len - offset, m_att_mtu - 5);
+		write_params.p_value = &(value.p_data[offset]);
+	}
+	else {
+		write_params.write_op = BLE_GATT_OP_EXEC_WRITE_REQ;
+		write_params.flags = BLE_GATT_EXEC_WRITE_FLAG_PREPARED_WRITE;
+	}
+
+	uint32_t error_code = m_sd->ble_gattc_write(m_adapter, m_connection_handle, &write_params);
+	log_level(LOG_DEBUG, " Prepared write to handle:0x%04X op:%d offset:%d len:%d code:%d",
+		handle, write_params.write_op, write_params.offset, write_params.len, error_code);
+	m_prep_write_handle = (error_code == NRF_SUCCESS) ? handle : 0;
+	m_prep_write_offset = offset;
+	return error_code;
+}
+
+/*
+drop parts queued by peer, response of the cancel request is ignored
+*/
+static void prep_write_cancel()
+{
+	ble_gattc_write_params_t write_params = { 0 };
+	write_params.write_op = BLE_GATT_OP_EXEC_WRITE_REQ;
+	write_params.flags = BLE_GATT_EXEC_WRITE_FLAG_PREPARED_CANCEL;
+	uint32_t error_code = m_sd->ble_gattc_write(m_adapter, m_connection_handle, &write_params);
+	log_level(LOG_DEBUG, " Prepared write to handle:0x%04X cancel code:%d", m_prep_write_handle, error_code);
+	m_prep_write_handle = 0;
+}
+
+EXTERNC NRFBLEAPI uint32_t data_write_async(uint16_t handle, uint8_t* data, uint16_t len)
+{
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
+
+	if (data == NULL || len == 0 || len > ATT_VALUE_MAX_LEN)
+		return NRF_ERROR_INVALID_PARAM;
+
+	// one ATT request at a time, wait for the queued prepared writes executed
+	if (m_prep_write_handle != 0)
+		return NRF_ERROR_BUSY;
+
+	value_assign(&m_write_data[handle], data, len);
+	// before the request, its response may arrive before returning
+	m_write_status[handle] = BLE_GATT_STATUS_SUCCESS;
+
+	// value longer than a write request, queue it by parts then execute at once
+	if (len > m_att_mtu - 3)
+		return prep_write_next(handle, 0);
+
+	ble_gattc_write_params_t write_params = { 0 };
+	write_params.handle = handle;
+	write_params.len = m_write_data[handle].len;
+	write_params.p_value = m_write_data[handle].p_data.data();
+	write_params.write_op = BLE_GATT_OP_WRITE_REQ;
+	write_params.offset = 0;
+	uint32_t error_code = 0;
+	error_code = m_sd->ble_gattc_write(m_adapter, m_connection_handle, &write_params);
+	log_level(LOG_INFO, " Write value to handle:0x%04X data:0x%02x %02x code:%d",
+		handle, m_write_data[handle].p_data[0], m_write_data[handle].p_data[1], error_code);
+	return error_code;
+}
+
+uint32_t data_write(uint16_t handle, uint8_t *data, uint16_t len, uint16_t timeout)
+{
+	if (data == NULL || len == 0)
+		return NRF_ERROR_INVALID_PARAM;
+
+	uint32_t error_code = data_write_async(handle, data, len);
+	if (error_code != NRF_SUCCESS) {
+		return error_code;
+	}
+
+	log_level(LOG_DEBUG, " Lock mutex wait for write response in %d ms", timeout);
+	//std::unique_lock<std::mutex> lck{ m_mtx_read_write };
+	auto stat = m_cond_read_write.wait_for(m_lck, std::chrono::milliseconds(timeout));
+	if (stat == std::cv_status::timeout) {
+		log_level(LOG_INFO, " Lock mutex wait for write response timeout");
+		return NRF_ERROR_TIMEOUT;
+	}
+
+	uint16_t gatt_status = m_write_status[handle];
+	if (gatt_status != BLE_GATT_STATUS_SUCCESS)
+		return GATT_STATUS_ERROR_BASE + gatt_status;
+	return NRF_SUCCESS;
+}
+
+uint32_t data_write_by_report_ref(uint8_t *report_ref, uint8_t *data, uint16_t len, uint16_t timeout)
+{
+	uint16_t handle = 0;
 	for (auto it = m_char_list.begin(); it != m_char_list.end(); it++) {
 		if (it->report_ref_handle == 0 || it->report_ref_is_read == false)
 			continue;
@@ -1411,11 +2506,12 @@ uint32_t data_write_by_report_ref(uint8_t *report_ref, uint8_t *data, uint16_t l
 
 uint32_t dongle_disconnect() 
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
 
 	uint32_t error_code = 0;
-	error_code = sd_ble_gap_disconnect(m_adapter, m_connection_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+	error_code = m_sd->ble_gap_disconnect(m_adapter, m_connection_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
 	log_level(LOG_INFO, "User disconnect, code:%d", error_code);
 	connection_cleanup();
 	return error_code;
@@ -1423,10 +2519,13 @@ uint32_t dongle_disconnect()
 
 uint32_t dongle_reset()
 {
-	if (m_adapter == NULL)
-		return NRF_ERROR_INVALID_STATE;
+	uint32_t state = adapter_state();
+	if (state != NRF_SUCCESS)
+		return state;
 
-	auto error_code = sd_rpc_conn_reset(m_adapter, SOFT_RESET);
+	// reset performed status of this reset is not a transport error to recover
+	m_dongle_initialized = false;
+	auto error_code = m_sd->rpc_conn_reset(m_adapter, SOFT_RESET);
 	sprintf_s(m_log_msg, "RPC reset, code: 0x%02X", error_code);
 
 	if (error_code != NRF_SUCCESS)
@@ -1437,8 +2536,11 @@ uint32_t dongle_reset()
 		log_level(LOG_INFO, m_log_msg);
 	}
 
-	error_code = sd_rpc_close(m_adapter);
+	error_code = m_sd->rpc_close(m_adapter);
 	sprintf_s(m_log_msg, "Close nRF BLE Driver. code: 0x%02X", error_code);
+	// port is free for other processes
+	m_probe_adapter = NULL;
+	port_unlock(m_port_lock);
 
 	if (error_code != NRF_SUCCESS)
 	{
@@ -1448,10 +2550,78 @@ uint32_t dongle_reset()
 		log_level(LOG_INFO, m_log_msg);
 	}
 
-	m_dongle_initialized = false;
+	// bonds of this session are on disk before caller unloads library, background workers stop as well
+	// since glibc blocks process exit on static condition variables a detached worker still waits on,
+	// dongle_init opens bond store and starts key pool again
+	bond_store_close();
+	ecc_keypool_stop();
+	ecc_pool_stop();
+
 	return error_code;
 }
 
+uint32_t dongle_shutdown(uint32_t timeout, uint32_t* elapsed_ms)
+{
+	if (m_adapter == NULL || !m_dongle_initialized)
+		return NRF_ERROR_INVALID_STATE;
+	if (m_recovering)
+		return NRF_ERROR_BUSY;
+
+	auto start = std::chrono::steady_clock::now();
+	auto deadline = start + std::chrono::milliseconds(timeout);
+	// reconnection in progress gives up and cancels its connection request
+	m_link_epoch++;
+	m_cond_find.notify_all();
+	{
+		std::unique_lock<std::mutex> lck{ m_mtx_find };
+		m_cond_find.wait_until(lck, deadline, [] { return !m_reconnecting; });
+	}
+	m_sd->ble_gap_scan_stop(m_adapter);
+
+	// disconnect requests of all links back to back, controller terminates them in parallel
+	std::vector<uint16_t> conn_handles;
+	if (m_is_connected)
+		conn_handles.push_back(m_connection_handle);
+#if NRF_SD_BLE_API >= 5
+	for (auto& phy : m_conn_phys) {
+		if (std::find(conn_handles.begin(), conn_handles.end(), phy.first) == conn_handles.end())
+			conn_handles.push_back(phy.first);
+	}
+#endif
+	for (auto conn_handle : conn_handles) {
+		uint32_t error_code = m_sd->ble_gap_disconnect(m_adapter, conn_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+		log_level(LOG_DEBUG, "Shutdown disconnect conn:%d, code: 0x%02X", conn_handle, error_code);
+	}
+
+	bool timed_out = false;
+	{
+		std::unique_lock<std::mutex> lck{ m_mtx_find };
+		timed_out = !m_cond_find.wait_until(lck, deadline, [] { return m_connected_devices == 0; });
+	}
+	// links not terminated in time are dropped, pending GATT requests return instead of waiting their timeout
+	if (timed_out) {
+		log_level(LOG_WARNING, "Shutdown, %d links not disconnected in %u ms", (int)m_connected_devices, timeout);
+		m_connected_devices = 0;
+		connection_cleanup();
+	}
+
+	// watchdog thread exits once nothing is pending, DHKey replies are sent before the adapter is closed
+	adapter_workers_stop(deadline);
+	if (m_lesc_jobs > 0)
+		log_level(LOG_WARNING, "Shutdown, %d DHKey computations pending", (int)m_lesc_jobs);
+
+	// bonds and GATT caches are written to file by closing bond store in dongle_reset
+	uint32_t error_code = dongle_reset();
+	uint32_t ms = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	log_level(LOG_INFO, "Shutdown in %u ms, %d links disconnected%s", ms, (int)conn_handles.size(), timed_out ? " by deadline" : "");
+	fflush(stdout);
+	if (elapsed_ms)
+		*elapsed_ms = ms;
+	if (error_code != NRF_SUCCESS)
+		return error_code;
+	return timed_out ? NRF_ERROR_TIMEOUT : NRF_SUCCESS;
+}
+
 #pragma endregion
 
 
@@ -1473,7 +2643,7 @@ static void on_adv_report(const ble_gap_evt_t * const p_ble_gap_evt)
 
 	uint64_t addr_num = 0;
 	if (near) {
-		convert_ble_address_to_uint64((uint8_t*)p_ble_gap_evt->params.adv_report.peer_addr.addr, &addr_num);
+		convert_peer_address_to_uint64((uint8_t*)p_ble_gap_evt->params.adv_report.peer_addr.addr, &addr_num);
 
 		// adv list always up-to-date
 		bool arrival = (m_adv_list.find(addr_num) == m_adv_list.end());
@@ -1481,8 +2651,15 @@ static void on_adv_report(const ble_gap_evt_t * const p_ble_gap_evt)
 			adv_data_t adv_data = {
 				p_ble_gap_evt->params.adv_report
 			};
+			adv_data.first_seen = std::chrono::steady_clock::now();
 			m_adv_list.insert_or_assign(addr_num, adv_data);
 		}
+		else if (memcmp(m_adv_list[addr_num].adv_report.peer_addr.addr,
+			p_ble_gap_evt->params.adv_report.peer_addr.addr, BLE_GAP_ADDR_LEN) != 0) {
+			// bonded peer has rotated its private address, connect to the current one
+			log_level(LOG_DEBUG, "Scan addr:%llx resolved from new private address", addr_num);
+			m_adv_list[addr_num].adv_report = p_ble_gap_evt->params.adv_report;
+		}
 		//m_adv_list.insert_or_assign(addr_num, p_ble_gap_evt->params.adv_report);
 
 		parse_adv_report_data(&p_ble_gap_evt->params.adv_report, &(m_adv_list[addr_num].type_data_list));
@@ -1558,7 +2735,7 @@ chidx:%d dataid:%d priphy:%d setid:%d txpwr:%d auxoff:%d auxphy:%d",
 
 #if NRF_SD_BLE_API >= 6
 	//TODO: may need manual stop flag prevent sending command to dongle at the same time
-	err_code = sd_ble_gap_scan_start(m_adapter, NULL, &m_adv_report_buffer);
+	err_code = m_sd->ble_gap_scan_start(m_adapter, NULL, &m_adv_report_buffer);
 
 	if (err_code != NRF_SUCCESS)
 	{
@@ -1603,7 +2780,11 @@ static void on_connected(const ble_gap_evt_t * const p_ble_gap_evt)
 	log_level(LOG_INFO, "Connection established role=%d",
 		p_ble_gap_evt->params.connected.role); /* BLE_GAP_ROLE_PERIPH 0x1, BLE_GAP_ROLE_CENTRAL 0x2 */
 	
-	m_connected_devices++;
+	setup_step_end(SETUP_PHASE_CONNECT);
+	{
+		std::lock_guard<std::mutex> lck{ m_mtx_find };
+		m_connected_devices++;
+	}
 	m_connection_handle = p_ble_gap_evt->conn_handle;
 	m_connection_is_in_progress = false;
 
@@ -1615,6 +2796,13 @@ static void on_connected(const ble_gap_evt_t * const p_ble_gap_evt)
 		}
 	}
 	m_is_connected = match;
+	m_conn_param_active = p_ble_gap_evt->params.connected.conn_params;
+
+#if NRF_SD_BLE_API >= 5
+	// link always established on 1M PHY, then request preferred one
+	m_conn_phys[m_connection_handle] = { BLE_GAP_PHY_1MBPS, BLE_GAP_PHY_1MBPS };
+	phy_update_start(m_connection_handle);
+#endif
 
 	m_cond_find.notify_all();
 
@@ -1628,22 +2816,123 @@ static void on_connected(const ble_gap_evt_t * const p_ble_gap_evt)
 	//service_discovery_start();
 }
 
+/* reject auth key requests without caller reply until timeout, thread exits when nothing pending */
+static void auth_key_watchdog()
+{
+	std::unique_lock<std::mutex> lck(m_mtx_auth_key);
+	while (!m_auth_key_pending.empty()) {
+		auto target = m_auth_key_pending.begin();
+		for (auto it = m_auth_key_pending.begin(); it != m_auth_key_pending.end(); it++) {
+			if (it->second.deadline < target->second.deadline)
+				target = it;
+		}
+
+		if (std::chrono::steady_clock::now() < target->second.deadline) {
+			m_cond_auth_key.wait_until(lck, target->second.deadline);
+			continue;
+		}
+
+		uint16_t conn_handle = target->first;
+		auth_key_request_t request = target->second.request;
+		m_auth_key_pending.erase(target);
+		lck.unlock();
+
+		uint32_t err_code = adapter_worker_reply([conn_handle]() {
+			return m_sd->ble_gap_auth_key_reply(m_adapter, conn_handle, BLE_GAP_AUTH_KEY_TYPE_NONE, NULL); });
+		log_level(LOG_WARNING, "Auth key request conn:%d type=%d timeout, rejected return=%d", conn_handle, request, err_code);
+		if (m_callback_fn_list[FN_ON_FAILED].size() > 0) {
+			std::string str = std::string("auth key timeout: " + std::to_string(conn_handle));
+			for (auto& fn : m_callback_fn_list[FN_ON_FAILED]) {
+				((fn_on_failed)fn)(str.c_str());
+			}
+		}
+
+		lck.lock();
+	}
+	m_auth_key_watchdog = false;
+	m_cond_auth_key.notify_all();
+}
+
+/*
+hand auth key request to caller provider, reply later by auth_key_reply() or auth_numeric_reply() from any thread,
+so event thread is not blocked by operator prompt, return false if no provider registered
+*/
+static bool auth_key_request_defer(uint16_t conn_handle, auth_key_request_t request, const char* passkey)
+{
+	if (m_callback_fn_list[FN_ON_AUTH_KEY_REQUEST].size() == 0)
+		return false;
+
+	{
+		std::lock_guard<std::mutex> lck(m_mtx_auth_key);
+		m_auth_key_pending[conn_handle] = { request,
+			std::chrono::steady_clock::now() + std::chrono::milliseconds(m_auth_key_timeout) };
+		if (!m_auth_key_watchdog) {
+			m_auth_key_watchdog = true;
+			std::thread(auth_key_watchdog).detach();
+		}
+		m_cond_auth_key.notify_all();
+	}
+	log_level(LOG_DEBUG, " auth key request conn:%d type=%d deferred to caller", conn_handle, request);
+
+	for (auto& fn : m_callback_fn_list[FN_ON_AUTH_KEY_REQUEST]) {
+		((fn_on_auth_key_request)fn)(conn_handle, request, passkey);
+	}
+	return true;
+}
+
+/* drop pending request of disconnected link, no reply needed */
+static void auth_key_request_cancel(uint16_t conn_handle)
+{
+	std::lock_guard<std::mutex> lck(m_mtx_auth_key);
+	if (m_auth_key_pending.erase(conn_handle) > 0)
+		m_cond_auth_key.notify_all();
+}
+
 /*
 called on BLE_GAP_EVT_DISCONNECTED event
 caller should check reason code, refer to BLE_HCI_STATUS_CODES
 BLE_HCI_CONNECTION_TIMEOUT 0x8
 BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION 0x16
 */
+static void reconnect_start(ble_gap_addr_t peer, bool services, uint8_t reason);
+
 static void on_disconnected(const ble_gap_evt_t *const p_ble_gap_evt) {
 	log_level(LOG_INFO, "Disconnected, reason: 0x%02X",
 		p_ble_gap_evt->params.disconnected.reason);
+	// captured before cleanup for reconnection
+	ble_gap_addr_t peer = m_connected_addr;
+	bool services = m_is_service_enabled;
 
-	m_connected_devices--;
+	// shutdown waits for zero by m_cond_find, notified in connection_cleanup
+	{
+		std::lock_guard<std::mutex> lck{ m_mtx_find };
+		m_connected_devices--;
+	}
+#if NRF_SD_BLE_API >= 5
+	m_conn_phys.erase(p_ble_gap_evt->conn_handle);
+#endif
+	// peer has a different LTK(MIC failure) or rejected it, pair on next connection
+	if (m_is_encrypting &&
+		(p_ble_gap_evt->params.disconnected.reason == BLE_HCI_CONN_TERMINATED_DUE_TO_MIC_FAILURE ||
+		p_ble_gap_evt->params.disconnected.reason == BLE_HCI_STATUS_CODE_PIN_OR_KEY_MISSING)) {
+		log_level(LOG_INFO, "Stored key of %llx rejected by peer", m_pair_addr_num);
+		m_pair_list[m_pair_addr_num].is_paired = false;
+		bond_data_t bond;
+		if (bond_get(m_pair_addr_num, &bond)) {
+			bond.flags &= ~(BOND_FLAG_OWN_ENC | BOND_FLAG_PEER_ENC);
+			secure_zero(&bond.own_enc, sizeof(bond.own_enc));
+			secure_zero(&bond.peer_enc, sizeof(bond.peer_enc));
+			bond_put(m_pair_addr_num, &bond);
+		}
+	}
+	auth_key_request_cancel(p_ble_gap_evt->conn_handle);
 	connection_cleanup();
 
 	for (auto &fn : m_callback_fn_list[FN_ON_DISCONNECTED]) {
 		((fn_on_disconnected)fn)(p_ble_gap_evt->params.disconnected.reason);
 	}
+
+	reconnect_start(peer, services, p_ble_gap_evt->params.disconnected.reason);
 }
 
 /**@brief Function called on BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP event.
@@ -1658,6 +2947,7 @@ static void on_service_discovery_response(const ble_gattc_evt_t * const p_ble_ga
 	int service_index;
 	const ble_gattc_service_t * service;
 
+	setup_step_end(SETUP_PHASE_SERVICE_DISC);
 	if (p_ble_gattc_evt->gatt_status != NRF_SUCCESS)
 	{
 		log_level(LOG_ERROR, "Service discovery failed. Error code 0x%X", p_ble_gattc_evt->gatt_status);
@@ -1700,6 +2990,7 @@ static void on_service_discovery_response(const ble_gattc_evt_t * const p_ble_ga
 static void on_characteristic_discovery_response(const ble_gattc_evt_t * const p_ble_gattc_evt)
 {
 	int count = p_ble_gattc_evt->params.char_disc_rsp.count;
+	setup_step_end(SETUP_PHASE_CHAR_DISC);
 
 	if (p_ble_gattc_evt->gatt_status != NRF_SUCCESS || count == 0)
 	{
@@ -1708,6 +2999,8 @@ static void on_characteristic_discovery_response(const ble_gattc_evt_t * const p
 
 		m_cond_find.notify_all();
 
+		store_gatt_cache(m_pair_addr_num);
+
 		// invoke callback to caller when serviec discovery terminated
 		for (auto &fn : m_callback_fn_list[FN_ON_SERVICE_DISCOVERED]) {
 			((fn_on_service_discovered)fn)(m_service_start_handle, m_char_list.size());
@@ -1749,8 +3042,8 @@ static void on_characteristic_discovery_response(const ble_gattc_evt_t * const p
 		m_char_list.push_back(dev_char);
 
 		auto handle_value = p_ble_gattc_evt->params.char_disc_rsp.chars[i].handle_value;
-		// std::map operator[] will create pair if key not exists, and fixed data_t.p_data allocation
-		memset(m_read_data[handle_value].p_data, 0, DATA_BUFFER_SIZE);
+		// std::map operator[] will create pair if key not exists, and pre-allocate value_t.p_data
+		value_assign(&m_read_data[handle_value], NULL, 0);
 	}
 	
 	// NOTICE: m_char_idx increases in on_descriptor_discovery_response
@@ -1767,6 +3060,7 @@ static void on_characteristic_discovery_response(const ble_gattc_evt_t * const p
 static void on_descriptor_discovery_response(const ble_gattc_evt_t * const p_ble_gattc_evt)
 {
 	int count = p_ble_gattc_evt->params.desc_disc_rsp.count;
+	setup_step_end(SETUP_PHASE_DESC_DISC);
 
 	if (p_ble_gattc_evt->gatt_status != NRF_SUCCESS || count == 0)
 	{
@@ -1775,6 +3069,8 @@ static void on_descriptor_discovery_response(const ble_gattc_evt_t * const p_ble
 
 		m_cond_find.notify_all();
 
+		store_gatt_cache(m_pair_addr_num);
+
 		// invoke callback to caller when serviec discovery terminated
 		for (auto &fn : m_callback_fn_list[FN_ON_SERVICE_DISCOVERED]) {
 			((fn_on_service_discovered)fn)(m_service_start_handle, m_char_list.size());
@@ -1890,6 +3186,8 @@ static void on_descriptor_discovery_response(const ble_gattc_evt_t * const p_ble
 	else {
 		m_cond_find.notify_all();
 
+		store_gatt_cache(m_pair_addr_num);
+
 		// invoke callback to caller when service dicovery ended
 		for (auto& fn : m_callback_fn_list[FN_ON_SERVICE_DISCOVERED]) {
 			((fn_on_service_discovered)fn)(m_service_start_handle, m_char_list.size());
@@ -1898,76 +3196,158 @@ static void on_descriptor_discovery_response(const ble_gattc_evt_t * const p_ble
 }
 
 
+/*
+batched read completed, invoke callback with all values read
+*/
+static void batch_read_complete()
+{
+	m_batch_reading = false;
+	log_level(LOG_DEBUG, "Batched read completed count:%d len:%d", m_batch_handles.size(), m_batch_data.size());
+	m_cond_read_write.notify_all();
+
+	for (auto &fn : m_callback_fn_list[FN_ON_DATA_BATCH_RECEIVED]) {
+		((fn_on_data_batch_received)fn)((uint16_t)m_batch_handles.size(),
+			m_batch_handles.data(), m_batch_lens.data(), m_batch_data.data());
+	}
+}
+
+/**@brief Function called on BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP event.
+ *
+ * @details Collect handle-value pairs of the same length, then continue after the last handle
+ * since server only responds values of the same length fit in ATT MTU.
+ *
+ * @param[in] p_ble_gattc_evt Read by UUID Response Event.
+ */
 static void on_read_characteristic_value_by_uuid_response(const ble_gattc_evt_t *const p_ble_gattc_evt)
 {
+	if (!m_batch_reading)
+		return;
+
+	// no more attributes in range
+	if (p_ble_gattc_evt->gatt_status == BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND)
+	{
+		batch_read_complete();
+		return;
+	}
+
 	if (p_ble_gattc_evt->gatt_status != NRF_SUCCESS)
 	{
 		log_level(LOG_ERROR, "Error read char val by uuid operation, error code 0x%x", p_ble_gattc_evt->gatt_status);
+		batch_read_complete();
 		return;
 	}
 
-	if (p_ble_gattc_evt->params.char_val_by_uuid_read_rsp.count == 0 ||
-		p_ble_gattc_evt->params.char_val_by_uuid_read_rsp.value_len == 0)
+	auto rsp = &(p_ble_gattc_evt->params.char_val_by_uuid_read_rsp);
+	if (rsp->count == 0)
 	{
-		log_level(LOG_WARNING, "Error read char val by uuid operation, no handle count or value length");
+		log_level(LOG_WARNING, "Error read char val by uuid operation, no handle count");
+		batch_read_complete();
 		return;
 	}
 
-	for (int i = 0; i < p_ble_gattc_evt->params.char_val_by_uuid_read_rsp.count; i++)
+	// handle_value is packed as [handle(2) value(value_len)] * count
+	uint16_t last_handle = 0;
+	const uint8_t *p_pair = rsp->handle_value;
+	for (int i = 0; i < rsp->count; i++, p_pair += sizeof(uint16_t) + rsp->value_len)
 	{
+		last_handle = (uint16_t)(p_pair[0] | (p_pair[1] << 8));
+		m_batch_handles.push_back(last_handle);
+		m_batch_lens.push_back(rsp->value_len);
+		m_batch_data.insert(m_batch_data.end(), p_pair + sizeof(uint16_t), p_pair + sizeof(uint16_t) + rsp->value_len);
 		log_level(LOG_DEBUG, "Received read char by uuid, value handle:0x%04X len:%d.",
-			p_ble_gattc_evt->params.char_val_by_uuid_read_rsp.handle_value[i],
-			p_ble_gattc_evt->params.char_val_by_uuid_read_rsp.value_len);
+			last_handle, rsp->value_len);
 	}
 
-	//DEBUG: directly use handle from descriptor?
-	uint32_t error_code = sd_ble_gattc_read(
-		m_adapter,
-		m_connection_handle,
-		p_ble_gattc_evt->params.char_val_by_uuid_read_rsp.handle_value[0],
-		0
-	);
-	log_level(LOG_DEBUG, " read from handle0:0x%04X", 
-		p_ble_gattc_evt->params.char_val_by_uuid_read_rsp.handle_value[0]);
+	if (last_handle >= m_batch_end_handle) {
+		batch_read_complete();
+		return;
+	}
+
+	ble_gattc_handle_range_t range{ (uint16_t)(last_handle + 1), m_batch_end_handle };
+	uint32_t error_code = m_sd->ble_gattc_char_value_by_uuid_read(m_adapter, m_connection_handle, &m_batch_uuid, &range);
+	log_level(LOG_DEBUG, " Read values by uuid continue from handle:0x%04X code:%d", range.start_handle, error_code);
+	if (error_code != NRF_SUCCESS)
+		batch_read_complete();
 }
 
+/**@brief Function called on BLE_GATTC_EVT_CHAR_VALS_READ_RSP event.
+ *
+ * @details Values are concatenated without length, split them by lengths given to data_read_multiple(),
+ * the one given 0 length takes the rest.
+ *
+ * @param[in] p_ble_gattc_evt Read Multiple Response Event.
+ */
 static void on_read_characteristic_values_response(const ble_gattc_evt_t *const p_ble_gattc_evt)
 {
-	if (p_ble_gattc_evt->gatt_status != NRF_SUCCESS)
-	{
-		log_level(LOG_ERROR, "Error read char vals operation, error code 0x%x", p_ble_gattc_evt->gatt_status);
+	if (!m_batch_reading)
 		return;
-	}
 
-	if (p_ble_gattc_evt->params.char_vals_read_rsp.len == 0)
+	if (p_ble_gattc_evt->gatt_status != NRF_SUCCESS)
 	{
-		log_level(LOG_WARNING, "Error read char vals operation, no att values length");
+		log_level(LOG_ERROR, "Error read char vals operation, error code 0x%x", p_ble_gattc_evt->gatt_status);
+		m_batch_handles.clear();
+		m_batch_lens.clear();
+		batch_read_complete();
 		return;
 	}
 
 	auto len = p_ble_gattc_evt->params.char_vals_read_rsp.len;
 	uint8_t *p_data = (uint8_t *)p_ble_gattc_evt->params.char_vals_read_rsp.values;
 
-	//char read_bytes[DATA_BUFFER_SIZE] = { 0 };
-	//memcpy_s(&read_bytes[0], DATA_BUFFER_SIZE, p_data, len);
 	sprintf_s(m_log_msg, "Received read char vals len:%d data: ", len);
 	convert_byte_string(p_data, len, &(m_log_msg[strlen(m_log_msg)]));
 	log_level(LOG_DEBUG, m_log_msg);
+
+	// response is truncated to ATT MTU - 1, so as the lengths of the last values
+	uint16_t offset = 0;
+	for (size_t i = 0; i < m_batch_lens.size(); i++) {
+		uint16_t value_len = (m_batch_lens[i] == 0) ? (len - offset) : m_batch_lens[i];
+		m_batch_lens[i] = std::min<uint16_t>(value_len, len - offset);
+		offset += m_batch_lens[i];
+	}
+	m_batch_data.assign(p_data, p_data + offset);
+
+	batch_read_complete();
 }
 
 static void on_read_response(const ble_gattc_evt_t *const p_ble_gattc_evt)
 {
 	auto rsp_handle = p_ble_gattc_evt->params.read_rsp.handle;
+	auto gatt_status = p_ble_gattc_evt->gatt_status;
+	setup_step_end(SETUP_PHASE_REPORT_REF);
+
+	// value length is multiple of the part size, nothing more to read blob
+	if (m_read_long_handle != 0 &&
+		(gatt_status == BLE_GATT_STATUS_ATTERR_INVALID_OFFSET ||
+		 gatt_status == BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_LONG ||
+		 (gatt_status == NRF_SUCCESS && p_ble_gattc_evt->params.read_rsp.len == 0)))
+	{
+		rsp_handle = m_read_long_handle;
+		m_read_long_handle = 0;
+		log_level(LOG_DEBUG, "Received long read response handle:0x%04X len:%d", rsp_handle, m_read_data[rsp_handle].len);
+		m_cond_read_write.notify_all();
+		if (m_is_service_enabled) {
+			for (auto &fn : m_callback_fn_list[FN_ON_DATA_RECEIVED]) {
+				((fn_on_data_received)fn)(rsp_handle, m_read_data[rsp_handle].p_data.data(), m_read_data[rsp_handle].len);
+			}
+		}
+		return;
+	}
 
-	if (p_ble_gattc_evt->gatt_status != NRF_SUCCESS || 
+	if (gatt_status != NRF_SUCCESS || 
 		p_ble_gattc_evt->params.read_rsp.len == 0)
 	{
 		// refer to BLE_GATT_STATUS_ATTERR_INSUF_AUTHENTICATION if handle access required authentication
 		// refer to BLE_GATT_STATUS_ATTERR_REQUEST_NOT_SUPPORTED if handle property not permitted
 		log_level(LOG_ERROR, "Error. Read operation failed or data empty, handle:0x%04X code 0x%x",
-			rsp_handle, p_ble_gattc_evt->gatt_status); //TODO: or warning?
+			gatt_status != NRF_SUCCESS ? p_ble_gattc_evt->error_handle : rsp_handle, gatt_status); //TODO: or warning?
 		//TODO: do something next if any error occurred
 
+		// read blob of a long read failed, the value is incomplete,
+		// read_rsp is not filled by error response, failed handle is error_handle
+		if (gatt_status != NRF_SUCCESS)
+			m_read_status[m_read_long_handle != 0 ? m_read_long_handle : p_ble_gattc_evt->error_handle] = gatt_status;
+		m_read_long_handle = 0;
 		m_cond_read_write.notify_all();
 		return;
 	}
@@ -1976,27 +3356,41 @@ static void on_read_response(const ble_gattc_evt_t *const p_ble_gattc_evt)
 	uint16_t offset = p_ble_gattc_evt->params.read_rsp.offset;
 	uint16_t len = p_ble_gattc_evt->params.read_rsp.len;
 
-	sprintf_s(m_log_msg, "Received read response handle:0x%04X len:%d data: ", rsp_handle, len);
+	sprintf_s(m_log_msg, "Received read response handle:0x%04X offset:%d len:%d data: ", rsp_handle, offset, len);
 	convert_byte_string(p_data, len, &(m_log_msg[strlen(m_log_msg)]));
 	log_level(LOG_DEBUG, m_log_msg);
 
-	// NOTICE: refer to on_characteristic_discovery_response has pre-allocated memory
-	memset(m_read_data[rsp_handle].p_data, 0, DATA_BUFFER_SIZE);
-	memcpy_s(m_read_data[rsp_handle].p_data, DATA_BUFFER_SIZE, p_data + offset, len);
-	m_read_data[rsp_handle].len = len;
+	// response data starts from requested offset
+	value_assign(&m_read_data[rsp_handle], p_data, len, offset);
+
+	// full response may have more value, continue reading blob from the next offset
+	if (len == m_att_mtu - 1 && offset + len < ATT_VALUE_MAX_LEN) {
+		uint32_t error_code = m_sd->ble_gattc_read(m_adapter, m_connection_handle, rsp_handle, offset + len);
+		log_level(LOG_DEBUG, " Read blob from handle:0x%04X offset:%d code:%d", rsp_handle, offset + len, error_code);
+		if (error_code == NRF_SUCCESS) {
+			m_read_long_handle = rsp_handle;
+			return;
+		}
+	}
+	m_read_long_handle = 0;
+
 	log_level(LOG_DEBUG, " Raise condition to mutex for read response");
 	// release lock for data_read()
 	m_cond_read_write.notify_all();
 
 	// manipulate characteristic list only in service enabling stage
-	if (m_is_service_enabled)
+	if (m_is_service_enabled) {
+		for (auto &fn : m_callback_fn_list[FN_ON_DATA_RECEIVED]) {
+			((fn_on_data_received)fn)(rsp_handle, m_read_data[rsp_handle].p_data.data(), m_read_data[rsp_handle].len);
+		}
 		return;
+	}
 
 	// check handle is report reference descriptor, to read the next report reference.
 	//ASSERT: rsp_handle == m_char_list[m_char_idx].report_ref_handle
 	for (int i = 0; i < m_char_list.size(); i++) {
 		if (m_char_list[i].report_ref_handle == rsp_handle) {
-			memcpy_s(&(m_char_list[i].report_ref[0]), len, p_data + offset, len);
+			memcpy_s(&(m_char_list[i].report_ref[0]), sizeof(m_char_list[i].report_ref), p_data, std::min<uint16_t>(len, sizeof(m_char_list[i].report_ref)));
 			m_char_list[i].report_ref_is_read = true;
 			// read the next report reference
 			read_report_refs(0);
@@ -2005,6 +3399,65 @@ static void on_read_response(const ble_gattc_evt_t *const p_ble_gattc_evt)
 	}
 }
 
+/**@brief Function called on BLE_GATTC_EVT_WRITE_RSP event of prepare or execute write request.
+ *
+ * @details Verify the part echoed by peer and send the next one, until the queued parts executed.
+ *
+ * @param[in] p_ble_gattc_evt Write Response Event.
+ */
+static void on_prepared_write_response(const ble_gattc_evt_t * const p_ble_gattc_evt)
+{
+	auto write_rsp = &(p_ble_gattc_evt->params.write_rsp);
+	uint16_t handle = m_prep_write_handle;
+
+	// response of cancel request
+	if (handle == 0) {
+		log_level(LOG_DEBUG, "Prepared write cancelled code 0x%X", p_ble_gattc_evt->gatt_status);
+		return;
+	}
+
+	if (p_ble_gattc_evt->gatt_status != NRF_SUCCESS)
+	{
+		log_level(LOG_ERROR, "Error. Prepared write failed. handle 0x%04X op:%d code 0x%X",
+			handle, write_rsp->write_op, p_ble_gattc_evt->gatt_status);
+		m_write_status[handle] = p_ble_gattc_evt->gatt_status;
+		if (write_rsp->write_op == BLE_GATT_OP_PREP_WRITE_REQ)
+			prep_write_cancel();
+		m_prep_write_handle = 0;
+		m_cond_read_write.notify_all();
+		return;
+	}
+
+	auto &value = m_write_data[handle];
+	if (write_rsp->write_op == BLE_GATT_OP_PREP_WRITE_REQ) {
+		// peer echoes the queued part, verify it before execution
+		if (write_rsp->offset != m_prep_write_offset || write_rsp->offset + write_rsp->len > value.len ||
+			memcmp(write_rsp->data, &(value.p_data[write_rsp->offset]), write_rsp->len) != 0) {
+			log_level(LOG_ERROR, "Error. Prepared write part mismatched. handle 0x%04X offset:%d len:%d",
+				handle, write_rsp->offset, write_rsp->len);
+			m_write_status[handle] = BLE_GATT_STATUS_UNKNOWN;
+			prep_write_cancel();
+			m_cond_read_write.notify_all();
+			return;
+		}
+		if (prep_write_next(handle, write_rsp->offset + write_rsp->len) != NRF_SUCCESS) {
+			m_write_status[handle] = BLE_GATT_STATUS_UNKNOWN;
+			prep_write_cancel();
+			m_cond_read_write.notify_all();
+		}
+		return;
+	}
+
+	m_prep_write_handle = 0;
+	log_level(LOG_DEBUG, "Sent prepared write response handle:0x%04X len:%d", handle, value.len);
+	// release lock for data_write()
+	m_cond_read_write.notify_all();
+
+	for (auto &fn : m_callback_fn_list[FN_ON_DATA_SENT]) {
+		((fn_on_data_sent)fn)(handle, value.p_data.data(), value.len);
+	}
+}
+
 /**@brief Function called on BLE_GATTC_EVT_WRITE_RSP event.
  *
  * @param[in] p_ble_gattc_evt Write Response Event.
@@ -2012,32 +3465,38 @@ static void on_read_response(const ble_gattc_evt_t *const p_ble_gattc_evt)
 static void on_write_response(const ble_gattc_evt_t * const p_ble_gattc_evt)
 {
 	auto rsp_handle = p_ble_gattc_evt->params.write_rsp.handle;
+	auto write_op = p_ble_gattc_evt->params.write_rsp.write_op;
+
+	if (write_op == BLE_GATT_OP_PREP_WRITE_REQ || write_op == BLE_GATT_OP_EXEC_WRITE_REQ)
+	{
+		on_prepared_write_response(p_ble_gattc_evt);
+		return;
+	}
+	setup_step_end(SETUP_PHASE_CCCD);
 
 	if (p_ble_gattc_evt->gatt_status != NRF_SUCCESS)
 	{
+		// write_rsp is not filled by error response, failed handle is error_handle
 		log_level(LOG_ERROR, "Error. Write operation failed or data empty. handle 0x%04X code 0x%X",
-			rsp_handle, p_ble_gattc_evt->gatt_status); //TODO: or warning?
+			p_ble_gattc_evt->error_handle, p_ble_gattc_evt->gatt_status); //TODO: or warning?
+		m_write_status[p_ble_gattc_evt->error_handle] = p_ble_gattc_evt->gatt_status;
 		m_cond_read_write.notify_all();
 		return;
 	}
 
-	uint8_t* p_data = (uint8_t *)p_ble_gattc_evt->params.write_rsp.data;
-	uint16_t offset = p_ble_gattc_evt->params.write_rsp.offset;
-	uint16_t len = p_ble_gattc_evt->params.write_rsp.len;
-
-	log_level(LOG_DEBUG, "Sent write response handle:0x%04X len:%d data: ...", rsp_handle, len);
+	log_level(LOG_DEBUG, "Sent write response handle:0x%04X len:%d", rsp_handle, m_write_data[rsp_handle].len);
 
-	// NOTICE: refer to on_characteristic_discovery_response has pre-allocated memory
-	memset(m_write_data[rsp_handle].p_data, 0, DATA_BUFFER_SIZE);
-	memcpy_s(m_write_data[rsp_handle].p_data, DATA_BUFFER_SIZE, p_data + offset, len);
-	m_write_data[rsp_handle].len = len;
 	log_level(LOG_DEBUG, " Raise condition to mutex for write response");
 	// release lock for data_write()
 	m_cond_read_write.notify_all();
 
 	// manipulate characteristic list only in service enabling stage
-	if (m_is_service_enabled)
+	if (m_is_service_enabled) {
+		for (auto &fn : m_callback_fn_list[FN_ON_DATA_SENT]) {
+			((fn_on_data_sent)fn)(rsp_handle, m_write_data[rsp_handle].p_data.data(), m_write_data[rsp_handle].len);
+		}
 		return;
+	}
 
 	// check handle is CCCD, to set the next CCCD notification.
 	//ASSERT: rsp_handle == m_char_list[m_char_idx].cccd_handle
@@ -2090,19 +3549,16 @@ static void on_hvx(const ble_gattc_evt_t * const p_ble_gattc_evt)
 	convert_byte_string((uint8_t*)p_data, len, msg_pos);
 	log_level(LOG_DEBUG, m_log_msg);
 
-	// NOTICE: refer to on_characteristic_discovery_response has pre-allocated memory
-	memset(m_read_data[hvx_handle].p_data, 0, DATA_BUFFER_SIZE);
-	memcpy_s(m_read_data[hvx_handle].p_data, DATA_BUFFER_SIZE, p_data, len);
-	m_read_data[hvx_handle].len = len;
+	value_assign(&m_read_data[hvx_handle], p_data, len);
 
 	for (auto &fn : m_callback_fn_list[FN_ON_DATA_RECEIVED]) {
-		((fn_on_data_received)fn)(hvx_handle, m_read_data[hvx_handle].p_data, m_read_data[hvx_handle].len);
+		((fn_on_data_received)fn)(hvx_handle, m_read_data[hvx_handle].p_data.data(), m_read_data[hvx_handle].len);
 	}
 }
 
 /**@brief Function called on BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST event.
  *
- * @details Update GAP connection parameters.
+ * @details Update GAP connection parameters by m_conn_param_policy.
  *
  * @param[in] p_ble_gap_evt Connection Parameter Update Event.
  */
@@ -2110,14 +3566,44 @@ static void on_conn_params_update_request(const ble_gap_evt_t * const p_ble_gap_
 {
 	auto conn_params = p_ble_gap_evt->
 		params.conn_param_update_request.conn_params;
-	uint32_t err_code = sd_ble_gap_conn_param_update(m_adapter, m_connection_handle,
-		&(conn_params));
-	log_level(LOG_DEBUG, "connection update request code=%d min=%d max=%d late=%d timeout=%d",
-		err_code,
-		(int)(conn_params.min_conn_interval * 1.25),
-		(int)(conn_params.max_conn_interval * 1.25),
-		conn_params.slave_latency,
-		(int)(conn_params.conn_sup_timeout / 100));
+	auto profile = &m_conn_param_profiles[m_conn_param_profile];
+	uint32_t err_code;
+
+	switch (m_conn_param_policy) {
+	case CONN_PARAM_POLICY_REJECT:
+		// NULL params from central role rejects peripheral request
+		err_code = m_sd->ble_gap_conn_param_update(m_adapter, p_ble_gap_evt->conn_handle, NULL);
+		log_level(LOG_DEBUG, "connection update request rejected code=%d", err_code);
+		break;
+	case CONN_PARAM_POLICY_PROFILE:
+		// overlap of requested and profile interval range, or force profile if no overlap
+		if (conn_params.min_conn_interval < profile->min_conn_interval)
+			conn_params.min_conn_interval = profile->min_conn_interval;
+		if (conn_params.max_conn_interval > profile->max_conn_interval)
+			conn_params.max_conn_interval = profile->max_conn_interval;
+		if (conn_params.min_conn_interval > conn_params.max_conn_interval) {
+			conn_params = *profile;
+		}
+		else {
+			// less latency and longer timeout still satisfy peer supervision timeout constraint
+			if (conn_params.slave_latency > profile->slave_latency)
+				conn_params.slave_latency = profile->slave_latency;
+			if (conn_params.conn_sup_timeout < profile->conn_sup_timeout)
+				conn_params.conn_sup_timeout = profile->conn_sup_timeout;
+		}
+		// fall through
+	case CONN_PARAM_POLICY_ACCEPT:
+	default:
+		err_code = m_sd->ble_gap_conn_param_update(m_adapter, p_ble_gap_evt->conn_handle,
+			&(conn_params));
+		log_level(LOG_DEBUG, "connection update request code=%d min=%d max=%d late=%d timeout=%d",
+			err_code,
+			(int)(conn_params.min_conn_interval * 1.25),
+			(int)(conn_params.max_conn_interval * 1.25),
+			conn_params.slave_latency,
+			(int)(conn_params.conn_sup_timeout * 10));
+		break;
+	}
 
 	if (err_code != NRF_SUCCESS)
 	{
@@ -2131,15 +3617,16 @@ connection parameters responsed from peripheral
 static void on_conn_params_update(const ble_gap_evt_t * const p_ble_gap_evt)
 {
 	auto conn_params = &(p_ble_gap_evt->params.conn_param_update.conn_params);
+	m_conn_param_active = *conn_params;
 
 	log_level(LOG_INFO, "Connection params updated, interval:%d[ms] latency:%d timeout:%d[ms]",
 		(int)(conn_params->min_conn_interval * 1.25),
 		conn_params->slave_latency,
-		(int)(conn_params->conn_sup_timeout * 100));
+		(int)(conn_params->conn_sup_timeout * 10));
 
 	uint32_t error_code;
 	ble_gap_conn_sec_t conn_sec;
-	error_code = sd_ble_gap_conn_sec_get(m_adapter, m_connection_handle, &conn_sec);
+	error_code = m_sd->ble_gap_conn_sec_get(m_adapter, m_connection_handle, &conn_sec);
 	log_level(LOG_DEBUG, " get security code=%d mode=%d level=%d",
 		error_code, conn_sec.sec_mode.sm, conn_sec.sec_mode.lv);
 }
@@ -2151,20 +3638,33 @@ reply security parameters with owner public key for peripheral authentication.
 static void on_sec_params_request(const ble_gap_evt_t * const p_ble_gap_evt)
 {
 	auto peer_params = p_ble_gap_evt->params.sec_params_request.peer_params;
+	// keys of a pairing without bond are not kept after the connection
+	m_pair_list[m_pair_addr_num].is_bonding = peer_params.bond && m_sec_params.bond;
 
 	log_level(LOG_DEBUG, " on security params request, peer: bond=%d io=%d min=%d max=%d ownenc=%d peerenc=%d",
 		peer_params.bond, peer_params.io_caps,
 		peer_params.min_key_size, peer_params.max_key_size,
 		peer_params.kdist_own.enc, peer_params.kdist_peer.enc);
 
-	// use stored pk for individual peer, invalid(not 1) if unset or private key changed
-	if (ecc_p256_valid_public_key(m_pair_list[m_pair_addr_num].own_pk) != 1) {
-		//TODO: DEBUG: for current uecc algo, always got the same public key from the same private key
-		auto ecc_res = ecc_p256_compute_pubkey(m_private_key, m_pair_list[m_pair_addr_num].own_pk);
-		log_level(LOG_DEBUG, " on security params request, gen %llx own pk %02x %02x.. which is empty or invalid",
-			m_pair_addr_num, m_pair_list[m_pair_addr_num].own_pk[0], m_pair_list[m_pair_addr_num].own_pk[1]);
-		store_pair_data(m_pair_list[m_pair_addr_num].adv_report.peer_addr.addr);
+	// ephemeral key pair for each pairing, pre-generated and validated by key pool,
+	// or the one committed by own OOB data handed to caller
+	int ecc_res = 0;
+	{
+		std::lock_guard<std::mutex> lck(m_mtx_oob);
+		auto oob = m_oob_list.find(m_pair_addr_num);
+		if (oob != m_oob_list.end() && (oob->second.flags & OOB_FLAG_OWN)) {
+			memcpy_s(m_pair_list[m_pair_addr_num].own_sk, ECC_P256_SK_LEN, oob->second.own_sk, ECC_P256_SK_LEN);
+			memcpy_s(m_pair_list[m_pair_addr_num].own_pk, ECC_P256_PK_LEN, oob->second.own_pk, ECC_P256_PK_LEN);
+			ecc_res = 1;
+		}
 	}
+	if (ecc_res == 0)
+		ecc_res = ecc_keypool_take(m_pair_list[m_pair_addr_num].own_sk, m_pair_list[m_pair_addr_num].own_pk);
+	if (ecc_res != 1)
+		log_level(LOG_ERROR, "Error. %s key pair generate failed, code:%d", ecc_backend_name(), NRF_ERROR_INTERNAL);
+	log_level(LOG_DEBUG, " on security params request, take %llx own pk %02x %02x.. res=%d should be 1",
+		m_pair_addr_num, m_pair_list[m_pair_addr_num].own_pk[0], m_pair_list[m_pair_addr_num].own_pk[1], ecc_res);
+	store_pair_data(m_pair_list[m_pair_addr_num].adv_report.peer_addr.addr);
 	memcpy_s(m_own_pk.pk, BLE_GAP_LESC_P256_PK_LEN, m_pair_list[m_pair_addr_num].own_pk, ECC_P256_PK_LEN);
 	//memcpy_s(m_own_pk.pk, BLE_GAP_LESC_P256_PK_LEN, m_public_key, ECC_P256_PK_LEN);
 	sprintf_s(m_log_msg, " own_pk= ");
@@ -2181,7 +3681,7 @@ static void on_sec_params_request(const ble_gap_evt_t * const p_ble_gap_evt)
 	sec_keyset.keys_peer.p_sign_key = &m_peer_sign;
 	sec_keyset.keys_peer.p_pk = &m_peer_pk;
 	// NOTICE: to the peripheral role, given security_param as null, generate public key to keyset
-	uint32_t err_code = sd_ble_gap_sec_params_reply(
+	uint32_t err_code = m_sd->ble_gap_sec_params_reply(
 		m_adapter, m_connection_handle, BLE_GAP_SEC_STATUS_SUCCESS, 0, &sec_keyset);
 	log_level(LOG_DEBUG, " on security params request, return=%d should be %d", err_code, NRF_SUCCESS);
 }
@@ -2195,6 +3695,7 @@ static void on_auth_status(const ble_gap_evt_t * const p_ble_gap_evt)
 	log_level(LOG_DEBUG, " on auth status, status=%d, bond=%d",
 		p_ble_gap_evt->params.auth_status.auth_status,
 		p_ble_gap_evt->params.auth_status.bonded);
+	setup_step_end(SETUP_PHASE_AUTH);
 
 	// check auth status and bonded by given security parameter
 	// NOTICE: w/o bond may not have enough privilege interacting most services
@@ -2203,6 +3704,11 @@ static void on_auth_status(const ble_gap_evt_t * const p_ble_gap_evt)
 
 		m_is_authenticated = true;
 
+		if (p_ble_gap_evt->params.auth_status.bonded) {
+			m_pair_list[m_pair_addr_num].is_paired = true;
+			store_bond_keys(m_pair_addr_num, &p_ble_gap_evt->params.auth_status);
+		}
+
 		m_cond_find.notify_all();
 
 		// NOTICE: let caller decide the next action, can wait util conn param updated to discover service
@@ -2224,76 +3730,130 @@ static void on_auth_status(const ble_gap_evt_t * const p_ble_gap_evt)
 }
 
 /*
-from ble_evt_dispatch() BLE_GAP_EVT_LESC_DHKEY_REQUEST event received.
-reply shared secret for LESC and OOB
+from ble_evt_dispatch() BLE_GAP_EVT_CONN_SEC_UPDATE event received.
+link encrypted by stored LTK completes authentication of a bonded peer,
+security level stays 1 if peer has lost the bond(key missing), then pair again
 */
-static void on_lesc_dhkey_request(const ble_gap_evt_t * const p_ble_gap_evt)
+static void on_conn_sec_update(const ble_gap_evt_t * const p_ble_gap_evt)
 {
-	auto lesc_request = p_ble_gap_evt->params.lesc_dhkey_request;
+	auto sec_mode = p_ble_gap_evt->params.conn_sec_update.conn_sec.sec_mode;
+	log_level(LOG_DEBUG, " on conn security updated, mode=%d level=%d encrypting=%d",
+		sec_mode.sm, sec_mode.lv, m_is_encrypting);
 
-	// if sd_ble_gap_authenticate lesc = 1
-	log_level(LOG_DEBUG, " on lesc dhkey request, oobd_req=%d, peer_pk0=%d",
-		lesc_request.oobd_req,
-		lesc_request.p_pk_peer->pk[0]);
+	if (m_is_encrypting == false)
+		return;
+	// encryption by stored key completes authentication without auth status
+	setup_step_end(SETUP_PHASE_AUTH);
+	m_is_encrypting = false;
 
-	// print peer pubkey
-	sprintf_s(m_log_msg, " peer_pk= ");
-	convert_byte_string(lesc_request.p_pk_peer->pk,
-		BLE_GAP_LESC_P256_PK_LEN, &m_log_msg[strlen(m_log_msg)]);
-	log_level(LOG_DEBUG, m_log_msg);
-	// valid peer pubkey
-	int ecc_res = ecc_p256_valid_public_key(lesc_request.p_pk_peer->pk);
-	log_level(LOG_DEBUG, " peer_pk valid=%d should be 1", ecc_res);
-	if (ecc_res == 1) {
-		memcpy_s(m_pair_list[m_pair_addr_num].peer_pk, ECC_P256_PK_LEN, lesc_request.p_pk_peer->pk, BLE_GAP_LESC_P256_PK_LEN);
-		log_level(LOG_DEBUG, " on lesc dhkey request, store peer pk");
-		store_pair_data(m_pair_list[m_pair_addr_num].adv_report.peer_addr.addr);
-	}
-
-	// compute share secret from peer pk
-	ble_gap_lesc_dhkey_t dhkey = { 0 };
-	ecc_p256_compute_sharedsecret(m_private_key, lesc_request.p_pk_peer->pk, dhkey.key);
-	sprintf_s(m_log_msg, " compute ss= ");
-	convert_byte_string(dhkey.key, BLE_GAP_LESC_DHKEY_LEN, &m_log_msg[strlen(m_log_msg)]);
-	log_level(LOG_DEBUG, m_log_msg);
+	if (sec_mode.sm >= 1 && sec_mode.lv >= 2) {
+		m_is_authenticated = true;
+		log_level(LOG_INFO, "Encrypted with stored key, level=%d", sec_mode.lv);
 
-	// sd_ble_gap_lesc_dhkey_reply: reply shared
-	uint32_t err_code = sd_ble_gap_lesc_dhkey_reply(m_adapter, m_connection_handle, &dhkey);
-	log_level(LOG_DEBUG, " reply dhkey: %d", err_code);
+		m_cond_find.notify_all();
 
-	// sd_ble_gap_lesc_oob_data_get: get own oob
-	ble_gap_lesc_p256_pk_t pk_own = { 0 };
-	// use stored pk for individual peer, invalid(not 1) if unset or private key changed
-	if (ecc_p256_valid_public_key(m_pair_list[m_pair_addr_num].own_pk) != 1) {
-		auto ecc_res = ecc_p256_compute_pubkey(m_private_key, m_pair_list[m_pair_addr_num].own_pk);
-		log_level(LOG_DEBUG, " on lesc dhkey request, gen %llx own pk %02x %02x.. which is empty or invalid",
-			m_pair_addr_num, m_pair_list[m_pair_addr_num].own_pk[0], m_pair_list[m_pair_addr_num].own_pk[1]);
-		store_pair_data(m_pair_list[m_pair_addr_num].adv_report.peer_addr.addr);
-	}
-	memcpy_s(m_own_pk.pk, BLE_GAP_LESC_P256_PK_LEN, m_pair_list[m_pair_addr_num].own_pk, ECC_P256_PK_LEN);
-	//memcpy_s(pk_own.pk, ECC_P256_PK_LEN, m_public_key, ECC_P256_PK_LEN);
-	ble_gap_lesc_oob_data_t oob_own = { 0 };
-	err_code = sd_ble_gap_lesc_oob_data_get(m_adapter, m_connection_handle, &pk_own, &oob_own);
-	log_level(LOG_TRACE, " oob_get: %d", err_code);
-
-	sprintf_s(m_log_msg, "  pk_own= ");
-	convert_byte_string(pk_own.pk, BLE_GAP_LESC_P256_PK_LEN, &m_log_msg[strlen(m_log_msg)]);
-	log_level(LOG_TRACE, m_log_msg);
-	sprintf_s(m_log_msg, "  oob_own.random= ");
-	convert_byte_string(oob_own.r, BLE_GAP_SEC_KEY_LEN, &m_log_msg[strlen(m_log_msg)]);
-	log_level(LOG_TRACE, m_log_msg);
-	sprintf_s(m_log_msg, "  oob_own.confirm= ");
-	convert_byte_string(oob_own.c, BLE_GAP_SEC_KEY_LEN, &m_log_msg[strlen(m_log_msg)]);
-	log_level(LOG_TRACE, m_log_msg);
-
-	if (lesc_request.oobd_req == 0)
+		for (auto& fn : m_callback_fn_list[FN_ON_AUTHENTICATED]) {
+			((fn_on_authenticated)fn)(BLE_GAP_SEC_STATUS_SUCCESS);
+		}
 		return;
+	}
 
-	// sd_ble_gap_lesc_oob_data_set: set own oob, peer oob
-	ble_gap_lesc_oob_data_t oob_peer = { 0 }; // TODO: input required
-	err_code = sd_ble_gap_lesc_oob_data_set(m_adapter, m_connection_handle, &oob_own, &oob_peer);
-	log_level(LOG_DEBUG, " oob_set: %d", err_code);
-}
+	// stored keys are no longer valid, new ones will be stored by on_auth_status
+	log_level(LOG_INFO, "Encrypt with stored key rejected, pairing instead");
+	m_pair_list[m_pair_addr_num].is_paired = false;
+	uint32_t error_code = m_sd->ble_gap_authenticate(m_adapter, p_ble_gap_evt->conn_handle, &m_sec_params);
+	if (error_code != NRF_SUCCESS) {
+		log_level(LOG_ERROR, "Authenticate start Failed, code: %d", error_code);
+		if (m_callback_fn_list[FN_ON_FAILED].size() > 0) {
+			std::string str = std::string("auth failed: " + std::to_string(error_code));
+			for (auto& fn : m_callback_fn_list[FN_ON_FAILED]) {
+				((fn_on_failed)fn)(str.c_str());
+			}
+		}
+	}
+}
+
+/*
+validate peer pk and compute shared secret by own ephemeral sk in a worker thread,
+then reply DHKey, an invalid peer pk replies zeros to fail the DHKey check
+*/
+static void lesc_dhkey_compute(uint16_t conn_handle, const uint8_t own_sk[ECC_P256_SK_LEN], const uint8_t peer_pk[ECC_P256_PK_LEN])
+{
+	std::array<uint8_t, ECC_P256_SK_LEN> sk;
+	std::array<uint8_t, ECC_P256_PK_LEN> pk;
+	memcpy_s(sk.data(), sk.size(), own_sk, ECC_P256_SK_LEN);
+	memcpy_s(pk.data(), pk.size(), peer_pk, ECC_P256_PK_LEN);
+
+	m_lesc_jobs++;
+	std::thread([conn_handle, sk, pk]() mutable {
+		auto start = std::chrono::steady_clock::now();
+
+		ble_gap_lesc_dhkey_t dhkey = { 0 };
+		int ecc_res = ecc_p256_valid_public_key(pk.data());
+		if (ecc_res != 1)
+			log_level(LOG_ERROR, "Error. Peer public key of conn:%d is invalid", conn_handle);
+		else if ((ecc_res = ecc_p256_compute_sharedsecret(sk.data(), pk.data(), dhkey.key)) != 1)
+			log_level(LOG_ERROR, "Error. %s compute dhkey of conn:%d failed, code:%d", ecc_backend_name(), conn_handle, NRF_ERROR_INTERNAL);
+		secure_zero(sk.data(), sk.size());
+
+		auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+		log_level(LOG_DEBUG, " compute dhkey conn:%d res=%d should be 1 in %lld us", conn_handle, ecc_res, (long long)elapsed.count());
+
+		// sd_ble_gap_lesc_dhkey_reply: reply shared
+		uint32_t err_code = adapter_worker_reply([conn_handle, &dhkey]() {
+			return m_sd->ble_gap_lesc_dhkey_reply(m_adapter, conn_handle, &dhkey); });
+		log_level(LOG_DEBUG, " reply dhkey: %d", err_code);
+		secure_zero(&dhkey, sizeof(dhkey));
+		{
+			std::lock_guard<std::mutex> lck(m_mtx_auth_key);
+			m_lesc_jobs--;
+		}
+		m_cond_auth_key.notify_all();
+	}).detach();
+}
+
+/*
+from ble_evt_dispatch() BLE_GAP_EVT_LESC_DHKEY_REQUEST event received.
+reply shared secret for LESC and OOB
+*/
+static void on_lesc_dhkey_request(const ble_gap_evt_t * const p_ble_gap_evt)
+{
+	auto lesc_request = p_ble_gap_evt->params.lesc_dhkey_request;
+
+	// if sd_ble_gap_authenticate lesc = 1
+	log_level(LOG_DEBUG, " on lesc dhkey request, oobd_req=%d, peer_pk0=%d",
+		lesc_request.oobd_req,
+		lesc_request.p_pk_peer->pk[0]);
+
+	// print peer pubkey
+	sprintf_s(m_log_msg, " peer_pk= ");
+	convert_byte_string(lesc_request.p_pk_peer->pk,
+		BLE_GAP_LESC_P256_PK_LEN, &m_log_msg[strlen(m_log_msg)]);
+	log_level(LOG_DEBUG, m_log_msg);
+	memcpy_s(m_pair_list[m_pair_addr_num].peer_pk, ECC_P256_PK_LEN, lesc_request.p_pk_peer->pk, BLE_GAP_LESC_P256_PK_LEN);
+	store_pair_data(m_pair_list[m_pair_addr_num].adv_report.peer_addr.addr);
+
+	// OOB data must be set before DHKey reply, own one if handed to peer, peer one if received
+	if (lesc_request.oobd_req) {
+		std::lock_guard<std::mutex> lck(m_mtx_oob);
+		auto oob = m_oob_list.find(m_pair_addr_num);
+		if (oob != m_oob_list.end() && (oob->second.flags & (OOB_FLAG_OWN | OOB_FLAG_PEER))) {
+			uint32_t err_code = m_sd->ble_gap_lesc_oob_data_set(m_adapter, p_ble_gap_evt->conn_handle,
+				(oob->second.flags & OOB_FLAG_OWN) ? &oob->second.own : NULL,
+				(oob->second.flags & OOB_FLAG_PEER) ? &oob->second.peer : NULL);
+			log_level(LOG_DEBUG, " oob set, flags=0x%02x return=%d", oob->second.flags, err_code);
+			// single use, next pairing exchanges new OOB data
+			secure_zero(&oob->second, sizeof(oob_data_t));
+			m_oob_list.erase(oob);
+		}
+		else {
+			log_level(LOG_WARNING, " OOB data of %llx required but not set, pairing will fail", m_pair_addr_num);
+		}
+	}
+
+	// validate peer pk and compute share secret out of event thread, reply when done
+	lesc_dhkey_compute(p_ble_gap_evt->conn_handle, m_pair_list[m_pair_addr_num].own_sk, lesc_request.p_pk_peer->pk);
+}
 
 
 #if NRF_SD_BLE_API >= 3
@@ -2305,7 +3865,7 @@ static void on_lesc_dhkey_request(const ble_gap_evt_t * const p_ble_gap_evt)
  */
 static void on_exchange_mtu_request(const ble_gatts_evt_t* const p_ble_gatts_evt)
 {
-	uint32_t err_code = sd_ble_gatts_exchange_mtu_reply(
+	uint32_t err_code = m_sd->ble_gatts_exchange_mtu_reply(
 		m_adapter,
 		m_connection_handle,
 #if NRF_SD_BLE_API < 5
@@ -2331,25 +3891,73 @@ static void on_exchange_mtu_response(const ble_gattc_evt_t* const p_ble_gattc_ev
 {
 	uint16_t server_rx_mtu = p_ble_gattc_evt->params.exchange_mtu_rsp.server_rx_mtu;
 
+#if NRF_SD_BLE_API >= 5
+	m_att_mtu = std::min<uint16_t>(server_rx_mtu, NRF_SDH_BLE_GATT_MAX_MTU_SIZE);
+#else
+	m_att_mtu = std::min<uint16_t>(server_rx_mtu, GATT_MTU_SIZE_DEFAULT);
+#endif
 	log_level(LOG_DEBUG, "MTU response received. New ATT_MTU is %d\n", server_rx_mtu);
 	fflush(stdout);
 }
 #endif
 
+#if NRF_SD_BLE_API >= 5
+/**@brief Function called on BLE_GAP_EVT_PHY_UPDATE_REQUEST event.
+ *
+ * @details Reply PHYs preferred by both sides, or m_phy_preference if nothing in common.
+ *
+ * @param[in] p_ble_gap_evt PHY Update Request Event.
+ */
+static void on_phy_update_request(const ble_gap_evt_t * const p_ble_gap_evt)
+{
+	auto peer_phys = p_ble_gap_evt->params.phy_update_request.peer_preferred_phys;
+	ble_gap_phys_t phys = m_phy_preference;
+	if ((phys.tx_phys & peer_phys.tx_phys) != 0)
+		phys.tx_phys &= peer_phys.tx_phys;
+	if ((phys.rx_phys & peer_phys.rx_phys) != 0)
+		phys.rx_phys &= peer_phys.rx_phys;
+
+	uint32_t err_code = m_sd->ble_gap_phy_update(m_adapter, p_ble_gap_evt->conn_handle, &phys);
+	log_level(LOG_INFO, "PHY update request peer tx=0x%x rx=0x%x, reply tx=0x%x rx=0x%x",
+		peer_phys.tx_phys, peer_phys.rx_phys, phys.tx_phys, phys.rx_phys);
+	if (err_code != NRF_SUCCESS)
+	{
+		log_level(LOG_ERROR, "PHY update request reply failed, err_code %d", err_code);
+	}
+}
 
-#pragma endregion
+/**@brief Function called on BLE_GAP_EVT_PHY_UPDATE event.
+ *
+ * @details PHY update procedure completed by either side, store active PHY of the link
+ * and extend data length since 2M PHY carries twice the payload in the same air time.
+ *
+ * @param[in] p_ble_gap_evt PHY Update Event.
+ */
+static void on_phy_update(const ble_gap_evt_t * const p_ble_gap_evt)
+{
+	auto phy_update = p_ble_gap_evt->params.phy_update;
+	if (phy_update.status != BLE_HCI_STATUS_CODE_SUCCESS)
+	{
+		// e.g. BLE_HCI_UNSUPPORTED_REMOTE_FEATURE 0x1A from peer only supports 1M PHY
+		log_level(LOG_WARNING, "PHY update failed, status: 0x%02X", phy_update.status);
+		return;
+	}
 
-//TODO: DEDBUG: dummy oob data hardcoded in peripheral for behavior debugging
-//  for vendor's out of band TK exchange, likes MSFT swift pair
-/* NOTICE: dummy legacy oob data for debug
-* reference: https://devzone.nordicsemi.com/f/nordic-q-a/47932/oob-works-with-mcp-but-fails-with-nrf-connect
-*/
-static uint8_t m_oob_debug[16] = { 0xAA, 0xBB, 0xCC, 0xDD,
-									  0xEE, 0xFF, 0x99, 0x88,
-									  0x77, 0x66, 0x55, 0x44,
-									  0x33, 0x22, 0x11, 0x00 };
+	m_conn_phys[p_ble_gap_evt->conn_handle] = { phy_update.tx_phy, phy_update.rx_phy };
+	log_level(LOG_INFO, "PHY updated, tx=0x%x rx=0x%x", phy_update.tx_phy, phy_update.rx_phy);
+
+	if (phy_update.tx_phy == BLE_GAP_PHY_2MBPS || phy_update.rx_phy == BLE_GAP_PHY_2MBPS)
+		data_length_update_start(p_ble_gap_evt->conn_handle);
+
+	for (auto &fn : m_callback_fn_list[FN_ON_PHY_UPDATED]) {
+		((fn_on_phy_updated)fn)(phy_update.tx_phy, phy_update.rx_phy);
+	}
+}
+#endif
 
 
+#pragma endregion
+
 /** Event dispatcher */
 
 /**@brief Function for handling the Application's BLE Stack events.
@@ -2365,6 +3973,13 @@ static void ble_evt_dispatch(adapter_t * adapter, ble_evt_t * p_ble_evt)
 		return;
 	}
 
+	// handlers use key pool, bond store and IRKs, an event of the stack enabled before host preparation waits for it
+	if (m_prepared.valid())
+		m_prepared.wait();
+
+	trace_record(p_ble_evt);
+	m_evt_count++;
+
 	uint32_t err_code = 0;
 
 	switch (p_ble_evt->header.evt_id)
@@ -2404,9 +4019,8 @@ static void ble_evt_dispatch(adapter_t * adapter, ble_evt_t * p_ble_evt)
 		break;
 
 	case BLE_GAP_EVT_CONN_SEC_UPDATE:
-		log_level(LOG_DEBUG, " on conn security updated, mode=%d level=%d",
-			p_ble_evt->evt.gap_evt.params.conn_sec_update.conn_sec.sec_mode.sm,
-			p_ble_evt->evt.gap_evt.params.conn_sec_update.conn_sec.sec_mode.lv);
+		// result of encryption with stored LTK, or link secured by pairing
+		on_conn_sec_update(&(p_ble_evt->evt.gap_evt));
 		break;
 
 	case BLE_GAP_EVT_AUTH_STATUS:
@@ -2426,25 +4040,40 @@ static void ble_evt_dispatch(adapter_t * adapter, ble_evt_t * p_ble_evt)
 	{
 		uint8_t key_type = p_ble_evt->evt.gap_evt.params.auth_key_request.key_type;
 		uint8_t *key = NULL;
+		uint8_t oob_tk[BLE_GAP_SEC_KEY_LEN] = { 0 };
+		// passkey displayed on peer, entered by caller provider if registered
+		if (key_type == BLE_GAP_AUTH_KEY_TYPE_PASSKEY &&
+			auth_key_request_defer(p_ble_evt->evt.gap_evt.conn_handle, AUTH_KEY_REQUEST_PASSKEY, NULL)) {
+			break;
+		}
 		// provide fixed passkey
 		if (key_type == BLE_GAP_AUTH_KEY_TYPE_PASSKEY) {
 			key = (uint8_t*)&m_passkey[0];
 			log_level(LOG_INFO, " use %s for passkey", m_passkey);
 		}
 		else if (key_type == BLE_GAP_AUTH_KEY_TYPE_OOB) {
-			//TODO: DEDBUG: dummy oob data hardcoded in peripheral for behavior debugging
-			//  for vendor's out of band TK exchange, likes MSFT swift pair
-			key = &m_oob_debug[0];
-			sprintf_s(m_log_msg, " on auth key req by OOB: ");
-			convert_byte_string(m_oob_debug, 16, &m_log_msg[strlen(m_log_msg)]);
-			log_level(LOG_DEBUG, m_log_msg);
+			// legacy OOB temporary key given by oob_tk_set(), likes vendor's exchange of MSFT swift pair
+			// reference: https://devzone.nordicsemi.com/f/nordic-q-a/47932/oob-works-with-mcp-but-fails-with-nrf-connect
+			std::lock_guard<std::mutex> lck(m_mtx_oob);
+			auto oob = m_oob_list.find(m_pair_addr_num);
+			if (oob != m_oob_list.end() && (oob->second.flags & OOB_FLAG_TK)) {
+				memcpy_s(oob_tk, BLE_GAP_SEC_KEY_LEN, oob->second.tk, BLE_GAP_SEC_KEY_LEN);
+				key = &oob_tk[0];
+				log_level(LOG_DEBUG, " on auth key req by OOB, use temporary key of %llx", m_pair_addr_num);
+			}
+			else {
+				// no key rejects the pairing
+				key_type = BLE_GAP_AUTH_KEY_TYPE_NONE;
+				log_level(LOG_WARNING, " on auth key req by OOB, temporary key of %llx not set", m_pair_addr_num);
+			}
 		}
 		else if (key_type == BLE_GAP_AUTH_KEY_TYPE_NONE) {
 			log_level(LOG_DEBUG, " no auth key required");
 		}
 		// follow up peer's design, reply the same key_type to peer
-		err_code = sd_ble_gap_auth_key_reply(m_adapter, m_connection_handle, key_type, key);
+		err_code = m_sd->ble_gap_auth_key_reply(m_adapter, m_connection_handle, key_type, key);
 		log_level(LOG_DEBUG, " on auth key req, keytype:%d return:%d", key_type, err_code);
+		secure_zero(oob_tk, sizeof(oob_tk));
 
 		// only notify to caller which auth via passkey, duplicated behavior while BLE_GAP_EVT_PASSKEY_DISPLAY event received
 		if (key_type == BLE_GAP_AUTH_KEY_TYPE_PASSKEY &&
@@ -2458,19 +4087,20 @@ static void ble_evt_dispatch(adapter_t * adapter, ble_evt_t * p_ble_evt)
 
 	case BLE_GAP_EVT_PASSKEY_DISPLAY:
 	{
-		//TODO: asume only works in passkey type, w/o verified
-		uint8_t key[6] = { 0 };
-		memcpy_s(&key[0], 6, p_ble_evt->evt.gap_evt.params.passkey_display.passkey, 6);
-		sprintf_s(m_log_msg, " on passkey display, key: ");
-		for (int i = 0; i < 6 && key[i]; i++)
-			strcat_s(m_log_msg, (char*)key[i]);
-		log_level(LOG_INFO, m_log_msg);
-
-		err_code = sd_ble_gap_auth_key_reply(m_adapter, m_connection_handle, BLE_GAP_AUTH_KEY_TYPE_PASSKEY, key);
-		log_level(LOG_DEBUG, " on passkey display auth reply, code:%d", err_code);
+		// passkey digits are not null terminated
+		std::string str = std::string((char*)p_ble_evt->evt.gap_evt.params.passkey_display.passkey, BLE_GAP_PASSKEY_LEN);
+		uint8_t match_request = p_ble_evt->evt.gap_evt.params.passkey_display.match_request;
+		log_level(LOG_INFO, " on passkey display, key: %s match request: %d", str.c_str(), match_request);
+
+		// LESC numeric comparison, caller confirms passkey is the same as peer shows,
+		// accepted without provider as previous versions
+		if (match_request &&
+			!auth_key_request_defer(p_ble_evt->evt.gap_evt.conn_handle, AUTH_KEY_REQUEST_NUMERIC_COMPARISON, str.c_str())) {
+			err_code = m_sd->ble_gap_auth_key_reply(m_adapter, p_ble_evt->evt.gap_evt.conn_handle, BLE_GAP_AUTH_KEY_TYPE_PASSKEY, NULL);
+			log_level(LOG_DEBUG, " on passkey display match reply, code:%d", err_code);
+		}
 
 		if (m_callback_fn_list[FN_ON_PASSKEY_REQUIRED].size() > 0) {
-			std::string str = std::string((char*)key, 6);
 			for (auto &fn : m_callback_fn_list[FN_ON_PASSKEY_REQUIRED]) {
 				((fn_on_passkey_required)fn)(str.c_str());
 			}
@@ -2561,38 +4191,18 @@ static void ble_evt_dispatch(adapter_t * adapter, ble_evt_t * p_ble_evt)
 			peer_params.max_tx_octets,
 			peer_params.max_tx_time_us);
 
-#define NRF_SDH_BLE_GAP_DATA_LENGTH 251
-
-		ble_gap_data_length_params_t m_data_length = { 0 };
-		m_data_length.max_rx_octets = NRF_SDH_BLE_GAP_DATA_LENGTH;
-		m_data_length.max_tx_octets = NRF_SDH_BLE_GAP_DATA_LENGTH;
-		m_data_length.max_rx_time_us = BLE_GAP_DATA_LENGTH_AUTO;
-		m_data_length.max_tx_time_us = BLE_GAP_DATA_LENGTH_AUTO;
-		ble_gap_data_length_limitation_t m_data_limit = { 0 };
-		auto err_code = sd_ble_gap_data_length_update(m_adapter, m_connection_handle, &m_data_length, NULL);
-		log_level(LOG_INFO, "Request maximum packet length update=%d: rx=%d bytes, %d us, tx=%d bytes, %d us",
-			err_code,
-			m_data_length.max_rx_octets, m_data_length.max_rx_time_us,
-			m_data_length.max_tx_octets, m_data_length.max_tx_time_us);
-		log_level(LOG_INFO, "Request maximum packet length limit: rx=%d bytes, tx=%d bytes, %d us",
-			m_data_limit.rx_payload_limited_octets,
-			m_data_limit.tx_payload_limited_octets, m_data_limit.tx_rx_time_limited_us);
+		data_length_update_start(p_ble_evt->evt.gap_evt.conn_handle);
 	}break;
 
 	case BLE_GAP_EVT_PHY_UPDATE_REQUEST:
-	{
-		log_level(LOG_INFO, "PHY update request.");
-		ble_gap_phys_t const phys =
-		{
-			BLE_GAP_PHY_AUTO, /*tx_phys*/
-			BLE_GAP_PHY_AUTO, /*rx_phys*/
-		};
-		err_code = sd_ble_gap_phy_update(m_adapter, m_connection_handle, &phys);
-		if (err_code != NRF_SUCCESS)
-		{
-			log_level(LOG_ERROR, "PHY update request reply failed, err_code %d", err_code);
-		}
-	} break;
+		log_level(LOG_DEBUG, "evt PHY update request.");
+		on_phy_update_request(&(p_ble_evt->evt.gap_evt));
+		break;
+
+	case BLE_GAP_EVT_PHY_UPDATE:
+		log_level(LOG_DEBUG, "evt PHY update.");
+		on_phy_update(&(p_ble_evt->evt.gap_evt));
+		break;
 
 #endif
 
@@ -2630,9 +4240,9 @@ static uint32_t ble_stack_init()
 	ble_enable_params.gap_enable_params.central_conn_count = 1;
 	ble_enable_params.gap_enable_params.central_sec_count = 1;
 
-	err_code = sd_ble_enable(m_adapter, &ble_enable_params, app_ram_base);
+	err_code = m_sd->ble_enable(m_adapter, &ble_enable_params, app_ram_base);
 #else
-	err_code = sd_ble_enable(m_adapter, app_ram_base);
+	err_code = m_sd->ble_enable(m_adapter, app_ram_base);
 #endif
 
 	switch (err_code) {
@@ -2665,7 +4275,7 @@ static uint32_t ble_options_set()
 	common_opt.conn_bw.conn_bw.conn_bw_tx = BLE_CONN_BW_HIGH;
 	opt.common_opt = common_opt;
 
-	return sd_ble_opt_set(m_adapter, BLE_COMMON_OPT_CONN_BW, &opt);
+	return m_sd->ble_opt_set(m_adapter, BLE_COMMON_OPT_CONN_BW, &opt);
 #else
 	return NRF_ERROR_NOT_SUPPORTED;
 #endif
@@ -2690,10 +4300,10 @@ static uint32_t ble_cfg_set(uint8_t conn_cfg_tag)
 	ble_cfg.gap_cfg.role_count_cfg.adv_set_count = BLE_GAP_ADV_SET_COUNT_DEFAULT;
 #endif
 	ble_cfg.gap_cfg.role_count_cfg.periph_role_count = 0;
-	ble_cfg.gap_cfg.role_count_cfg.central_role_count = 1;
-	ble_cfg.gap_cfg.role_count_cfg.central_sec_count = 1;; /*NOTICE: set for sd_ble_gap_authenticate*/
+	ble_cfg.gap_cfg.role_count_cfg.central_role_count = m_stack_config.conn_count;
+	ble_cfg.gap_cfg.role_count_cfg.central_sec_count = m_stack_config.conn_count; /*NOTICE: set for sd_ble_gap_authenticate*/
 
-	error_code = sd_ble_cfg_set(m_adapter, BLE_GAP_CFG_ROLE_COUNT, &ble_cfg, ram_start);
+	error_code = m_sd->ble_cfg_set(m_adapter, BLE_GAP_CFG_ROLE_COUNT, &ble_cfg, ram_start);
 	if (error_code != NRF_SUCCESS)
 	{
 		log_level(LOG_ERROR, "sd_ble_cfg_set() failed when attempting to set BLE_GAP_CFG_ROLE_COUNT. Error code: 0x%02X", error_code);
@@ -2701,15 +4311,12 @@ static uint32_t ble_cfg_set(uint8_t conn_cfg_tag)
 	}
 
 	// GAP config code block from nordic_uart_client example
-#define NRF_SDH_BLE_GAP_EVENT_LENGTH 8/*320*/
-#define NRF_SDH_BLE_GATT_MAX_MTU_SIZE 247
-
 #if NRF_SD_BLE_API >= 5
 	memset(&ble_cfg, 0, sizeof(ble_cfg));
 	ble_cfg.conn_cfg.conn_cfg_tag = conn_cfg_tag;
-	ble_cfg.conn_cfg.params.gap_conn_cfg.conn_count = 1;
-	ble_cfg.conn_cfg.params.gap_conn_cfg.event_length = NRF_SDH_BLE_GAP_EVENT_LENGTH;
-	error_code = sd_ble_cfg_set(m_adapter, BLE_CONN_CFG_GAP, &ble_cfg, ram_start);
+	ble_cfg.conn_cfg.params.gap_conn_cfg.conn_count = m_stack_config.conn_count;
+	ble_cfg.conn_cfg.params.gap_conn_cfg.event_length = m_stack_config.event_length;
+	error_code = m_sd->ble_cfg_set(m_adapter, BLE_CONN_CFG_GAP, &ble_cfg, ram_start);
 	if (error_code != NRF_SUCCESS)
 	{
 		log_level(LOG_ERROR, "sd_ble_cfg_set() failed when attempting to set BLE_CONN_CFG_GAP. Error code: 0x%02X", error_code);
@@ -2721,23 +4328,23 @@ static uint32_t ble_cfg_set(uint8_t conn_cfg_tag)
 	//ble_cfg.conn_cfg.conn_cfg_tag = conn_cfg_tag;
 	ble_cfg.conn_cfg.params.gatt_conn_cfg.att_mtu = NRF_SDH_BLE_GATT_MAX_MTU_SIZE/*150*/;
 
-	error_code = sd_ble_cfg_set(m_adapter, BLE_CONN_CFG_GATT, &ble_cfg, ram_start);
+	error_code = m_sd->ble_cfg_set(m_adapter, BLE_CONN_CFG_GATT, &ble_cfg, ram_start);
 	if (error_code != NRF_SUCCESS)
 	{
 		log_level(LOG_ERROR, "sd_ble_cfg_set() failed when attempting to set BLE_CONN_CFG_GATT. Error code: 0x%02X", error_code);
 		return error_code;
 	}
 
-	ble_cfg.conn_cfg.params.gattc_conn_cfg.write_cmd_tx_queue_size = 10;
-	error_code = sd_ble_cfg_set(m_adapter, BLE_CONN_CFG_GATTC, &ble_cfg, ram_start);
+	ble_cfg.conn_cfg.params.gattc_conn_cfg.write_cmd_tx_queue_size = m_stack_config.write_cmd_tx_queue_size;
+	error_code = m_sd->ble_cfg_set(m_adapter, BLE_CONN_CFG_GATTC, &ble_cfg, ram_start);
 	if (error_code != NRF_SUCCESS)
 	{
 		log_level(LOG_ERROR, "sd_ble_cfg_set() failed when attempting to set BLE_CONN_CFG_GATTC. Error code: 0x%02X", error_code);
 		return error_code;
 	}
 
-	ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = 10;
-	error_code = sd_ble_cfg_set(m_adapter, BLE_CONN_CFG_GATTS, &ble_cfg, ram_start);
+	ble_cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = m_stack_config.hvn_tx_queue_size;
+	error_code = m_sd->ble_cfg_set(m_adapter, BLE_CONN_CFG_GATTS, &ble_cfg, ram_start);
 	if (error_code != NRF_SUCCESS)
 	{
 		log_level(LOG_ERROR, "sd_ble_cfg_set() failed when attempting to set BLE_CONN_CFG_GATTS. Error code: 0x%02X", error_code);
@@ -2747,9 +4354,9 @@ static uint32_t ble_cfg_set(uint8_t conn_cfg_tag)
 	ble_cfg.conn_cfg.params.l2cap_conn_cfg.ch_count = BLE_L2CAP_CH_COUNT_MAX;
 	ble_cfg.conn_cfg.params.l2cap_conn_cfg.rx_mps = BLE_L2CAP_MPS_MIN;
 	ble_cfg.conn_cfg.params.l2cap_conn_cfg.tx_mps = BLE_L2CAP_MPS_MIN;
-	ble_cfg.conn_cfg.params.l2cap_conn_cfg.rx_queue_size = 10;
-	ble_cfg.conn_cfg.params.l2cap_conn_cfg.tx_queue_size = 10;
-	error_code = sd_ble_cfg_set(m_adapter, BLE_CONN_CFG_L2CAP, &ble_cfg, ram_start);
+	ble_cfg.conn_cfg.params.l2cap_conn_cfg.rx_queue_size = NRF_SDH_BLE_QUEUE_SIZE;
+	ble_cfg.conn_cfg.params.l2cap_conn_cfg.tx_queue_size = NRF_SDH_BLE_QUEUE_SIZE;
+	error_code = m_sd->ble_cfg_set(m_adapter, BLE_CONN_CFG_L2CAP, &ble_cfg, ram_start);
 	if (error_code != NRF_SUCCESS)
 	{
 		log_level(LOG_ERROR, "sd_ble_cfg_set() failed when attempting to set BLE_CONN_CFG_L2CAP. Error code: 0x%02X", error_code);
@@ -2774,10 +4381,10 @@ static adapter_t * adapter_init(char * serial_port, uint32_t baud_rate)
 
 	phy = sd_rpc_physical_layer_create_uart(serial_port,
 		baud_rate,
-		SD_RPC_FLOW_CONTROL_NONE,
+		m_transport_config.flow_control ? SD_RPC_FLOW_CONTROL_HARDWARE : SD_RPC_FLOW_CONTROL_NONE,
 		SD_RPC_PARITY_NONE);
-	data_link_layer = sd_rpc_data_link_layer_create_bt_three_wire(phy, 250);
-	transport_layer = sd_rpc_transport_layer_create(data_link_layer, 1500);
+	data_link_layer = sd_rpc_data_link_layer_create_bt_three_wire(phy, m_transport_config.retransmission_interval);
+	transport_layer = sd_rpc_transport_layer_create(data_link_layer, m_transport_config.response_timeout);
 	return sd_rpc_adapter_create(transport_layer);
 }
 
@@ -2787,105 +4394,167 @@ uint32_t callback_add(fn_callback_id_t fn_id, void* fn) {
 	return 0;
 }
 
+uint32_t log_level_set(log_level_t level) {
+	if (level > LOG_FATAL)
+		return NRF_ERROR_INVALID_PARAM;
+	m_log_level = level;
+	return NRF_SUCCESS;
+}
+
 uint32_t keypair_init(bool renew)
 {
-	char log_sk[ECC_P256_SK_LEN * 4] = { 0 };
 	char log_pk[ECC_P256_PK_LEN * 4] = { 0 };
 	int ecc_res = 0;
 
-	FILE* f;
-	errno_t err;
-	//err = fopen_s(&f, "nrf_ble_library.cfg", "r");
-	err = fopen_s(&f, "nrf_ble_library.spk", "rb");
-	if (err != 0 || f == 0) {
-		renew = true;
-	}
-	else {
-		// use binary data, TODO: add salt hash
-		fread(m_private_key, sizeof(uint8_t), ECC_P256_SK_LEN, f);
-		fread(m_public_key, sizeof(uint8_t), ECC_P256_PK_LEN, f);
-		//fgets(log_sk, sizeof(log_sk), f);
-		//fgets(log_pk, sizeof(log_pk), f);
-		//// remove trailing newline 
-		//log_sk[strcspn(log_sk, "\r\n")] = 0;
-		//log_pk[strcspn(log_pk, "\r\n")] = 0;
-		//log_level(LOG_TRACE, "cfg prvkey: %s", log_sk);
-		//log_level(LOG_TRACE, "cfg pubkey: %s", log_pk);
-		//convert_string_byte(log_sk, m_private_key, ECC_P256_SK_LEN);
-		//convert_string_byte(log_pk, m_public_key, ECC_P256_PK_LEN);
-		fclose(f);
+	// no-op if dongle_init opened it already
+	if (bond_store_open(BOND_STORE_FILE) == 0)
+		log_level(LOG_WARNING, "Bond store %s open failed, key pair will not be persisted", BOND_STORE_FILE);
 
+	if (!renew && bond_local_key_get(m_private_key, m_public_key) == 1) {
 		log_level(LOG_DEBUG, "uECC key pair restored");
 	}
+	else if (!renew) {
+		// import key pair from file of previous versions once
+		FILE* f;
+		errno_t err = fopen_s(&f, "nrf_ble_library.spk", "rb");
+		if (err == 0 && f != 0) {
+			size_t len = fread(m_private_key, sizeof(uint8_t), ECC_P256_SK_LEN, f);
+			len += fread(m_public_key, sizeof(uint8_t), ECC_P256_PK_LEN, f);
+			fclose(f);
+			if (len == ECC_P256_SK_LEN + ECC_P256_PK_LEN) {
+				bond_local_key_set(m_private_key, m_public_key);
+				log_level(LOG_DEBUG, "uECC key pair imported from nrf_ble_library.spk");
+			}
+			else {
+				renew = true;
+			}
+		}
+		else {
+			renew = true;
+		}
+	}
 
 	if (renew) {
-		memset(m_private_key, 0, ECC_P256_SK_LEN);
-		memset(m_public_key, 0, ECC_P256_PK_LEN);
+		secure_zero(m_private_key, ECC_P256_SK_LEN);
+		secure_zero(m_public_key, ECC_P256_PK_LEN);
 		ecc_res = ecc_p256_gen_keypair(m_private_key, m_public_key);
-		// log key pair
-		convert_byte_string(m_private_key, ECC_P256_SK_LEN, log_sk);
+		if (ecc_res != 1) {
+			log_level(LOG_ERROR, "Error. %s key pair generate failed, code:%d", ecc_backend_name(), NRF_ERROR_INTERNAL);
+			return NRF_ERROR_INTERNAL;
+		}
+		// log public key only, private key never leaves the key buffers
 		convert_byte_string(m_public_key, ECC_P256_PK_LEN, log_pk);
-		log_level(LOG_TRACE, "uECC prvkey: %s", log_sk);
 		log_level(LOG_TRACE, "uECC pubkey: %s", log_pk);
 
-		// for debug, simple get a new public key and check it
-		uint8_t test_pubkey[ECC_P256_PK_LEN] = { 0 };
-		ecc_res = ecc_p256_compute_pubkey(m_private_key, test_pubkey);
-		// validate pubkey
-		ecc_res = ecc_p256_valid_public_key(test_pubkey);
-		log_level(LOG_TRACE, "check test pub key:%d == 1, sk[0]:0x%02x, pk[0]:0x%02x", ecc_res, m_private_key[0], test_pubkey[0]);
-
+		// public key of generated pair is validated below, deriving it again from private key costs one more scalar multiplication
 		// use binary data, TODO: add salt hash
-		err = fopen_s(&f, "nrf_ble_library.spk", "wb");
-		if (err == 0 && f != 0) {
-			fwrite(m_private_key, sizeof(uint8_t), ECC_P256_SK_LEN, f);
-			fwrite(m_public_key, sizeof(uint8_t), ECC_P256_PK_LEN, f);
-			fclose(f);
-			log_level(LOG_DEBUG, "uECC key pair stored (bin)");
-		}
-		/*err = fopen_s(&f, "nrf_ble_library.cfg", "w");
-		if (err == 0 && f != 0) {
-			fprintf(f, "%s\n", log_sk);
-			fprintf(f, "%s\n", log_pk);
-			fclose(f);
-			log_level(LOG_DEBUG, "uECC key pair stored (txt)");
-		}*/
+		bond_local_key_set(m_private_key, m_public_key);
+		log_level(LOG_DEBUG, "uECC key pair stored");
 	}
 
 	// validate pubkey
 	ecc_res = ecc_p256_valid_public_key(m_public_key);
-	log_level(LOG_INFO, "uECC check key pair: %d should be 1, sk[0]:0x%02x, pk[0]:0x%02x", ecc_res, m_private_key[0], m_public_key[0]);
+	log_level(LOG_INFO, "uECC check key pair: %d should be 1, pk[0]:0x%02x", ecc_res, m_public_key[0]);
+	if (ecc_res != 1) {
+		log_level(LOG_ERROR, "Error. %s key pair is invalid, code:%d", ecc_backend_name(), NRF_ERROR_INTERNAL);
+		return NRF_ERROR_INTERNAL;
+	}
 
-	return 0;
+	return NRF_SUCCESS;
 }
 
-/* init Nordic connectiviy dongle and register event for rpc*/
-uint32_t dongle_init(char* serial_port, uint32_t baud_rate)
+/*
+rough estimation of SoftDevice RAM required by stack configuration,
+link layer buffers grow with packets exchanged per event, ~2.5ms for max data length on 2M PHY,
+the actual limit is reported by sd_ble_cfg_set() or sd_ble_enable() as NRF_ERROR_NO_MEM
+*/
+static uint32_t stack_config_ram_estimate(const stack_config_t *cfg)
 {
-	if (m_dongle_initialized) {
-		sprintf_s(m_log_msg, "Dongle must be reset before re-initialize(re-plug dongle is recommanded)");
-		log_level(LOG_ERROR, m_log_msg);
+	uint32_t exchanges = (cfg->event_length * UNIT_1_25_MS + 2499) / 2500;
+	uint32_t per_link = SD_RAM_LINK_CONTEXT
+		+ exchanges * 2 * SD_RAM_LL_BUFFER
+		+ (cfg->write_cmd_tx_queue_size + cfg->hvn_tx_queue_size) * SD_RAM_QUEUE_ENTRY;
+	return per_link * cfg->conn_count;
+}
+
+uint32_t stack_config_set(float event_length, bool conn_evt_ext, uint8_t write_cmd_tx_queue_size, uint8_t hvn_tx_queue_size, uint8_t conn_count)
+{
+#if NRF_SD_BLE_API >= 5
+	// applied again by recovery while reopening
+	if (m_recovering)
+		return NRF_ERROR_BUSY;
+	if (m_dongle_initialized)
 		return NRF_ERROR_INVALID_STATE;
+
+	stack_config_t cfg = { 0 };
+	cfg.event_length = (uint16_t)MSEC_TO_UNITS(event_length, UNIT_1_25_MS);
+	cfg.conn_evt_ext = conn_evt_ext;
+	cfg.write_cmd_tx_queue_size = write_cmd_tx_queue_size;
+	cfg.hvn_tx_queue_size = hvn_tx_queue_size;
+	cfg.conn_count = conn_count;
+
+	if (event_length > 0xFFFF * 1.25f || cfg.event_length < BLE_GAP_EVENT_LENGTH_MIN ||
+		cfg.write_cmd_tx_queue_size == 0 || cfg.hvn_tx_queue_size == 0 ||
+		cfg.conn_count == 0 || cfg.conn_count > BLE_GAP_ROLE_COUNT_COMBINED_MAX)
+		return NRF_ERROR_INVALID_PARAM;
+
+	uint32_t ram = stack_config_ram_estimate(&cfg);
+	log_level(LOG_INFO, "Stack config event length=%d[ms] ext=%d write cmd queue=%d hvn queue=%d conn count=%d, estimated %u bytes",
+		(int)(cfg.event_length * 1.25), cfg.conn_evt_ext, cfg.write_cmd_tx_queue_size, cfg.hvn_tx_queue_size, cfg.conn_count, ram);
+	if (ram > SD_RAM_BUDGET) {
+		log_level(LOG_ERROR, "Stack config exceeds SoftDevice RAM %u bytes", SD_RAM_BUDGET);
+		return NRF_ERROR_NO_MEM;
 	}
 
+	m_stack_config = cfg;
+	return NRF_SUCCESS;
+#else
+	return NRF_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+static uint32_t elapsed_us(std::chrono::steady_clock::time_point start)
+{
+	return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+/* host side state shared by dongle and simulated backend */
+static void dongle_prepare()
+{
+	auto start = std::chrono::steady_clock::now();
 	// init ecc and generate keypair for later usage?
 	ecc_init();
-
-	// get new keypair or from file store
+	log_level(LOG_DEBUG, "ECC backend: %s", ecc_backend_name());
+	ecc_keypool_start(ECC_KEYPOOL_SIZE);
+
+	// bonds and own key pair are loaded once, following reconnections read them from memory
+	if (bond_store_open(BOND_STORE_FILE) == 1)
+		log_level(LOG_DEBUG, "Bond store %s opened, %d bonds", BOND_STORE_FILE, bond_list(NULL, 0));
+	// recognize bonded peers advertising with resolvable private address
+	load_bond_irks();
+	m_startup_timing.prepare_us = elapsed_us(start);
+
+	// get new keypair or from bond store
+	start = std::chrono::steady_clock::now();
 	keypair_init();
+	m_startup_timing.keypair_us = elapsed_us(start);
+}
 
-	uint32_t error_code;
-	uint8_t  cccd_value = 0;
-	
-	log_level(LOG_DEBUG, "Serial port used: %s Baud rate used: %d", serial_port, baud_rate);
+/* open backend of m_sd and m_adapter, then configure and enable BLE stack,
+opened: m_adapter was opened by dongle_probe, connectivity firmware is reset already */
+static uint32_t dongle_open(bool opened = false)
+{
+	uint32_t error_code = NRF_SUCCESS;
 
-	m_adapter = adapter_init(serial_port, baud_rate);
 #ifdef _DEBUG
-	sd_rpc_log_handler_severity_filter_set(m_adapter, SD_RPC_LOG_INFO);
+	m_sd->rpc_log_handler_severity_filter_set(m_adapter, SD_RPC_LOG_INFO);
 #else
-	sd_rpc_log_handler_severity_filter_set(m_adapter, SD_RPC_LOG_INFO);
+	m_sd->rpc_log_handler_severity_filter_set(m_adapter, SD_RPC_LOG_INFO);
 #endif
-	error_code = sd_rpc_open(m_adapter, status_handler, ble_evt_dispatch, log_handler);
+	auto start = std::chrono::steady_clock::now();
+	if (!opened)
+		error_code = m_sd->rpc_open(m_adapter, status_handler, ble_evt_dispatch, log_handler);
+	m_startup_timing.open_us = elapsed_us(start);
 
 	if (error_code != NRF_SUCCESS)
 	{
@@ -2894,10 +4563,21 @@ uint32_t dongle_init(char* serial_port, uint32_t baud_rate)
 	}
 
 #if NRF_SD_BLE_API >= 5
+	start = std::chrono::steady_clock::now();
 	error_code = ble_cfg_set(m_config_id);
+	m_startup_timing.config_us = elapsed_us(start);
+
+	if (error_code != NRF_SUCCESS)
+	{
+		log_level(LOG_ERROR, "Failed to set BLE stack config, estimated %u bytes. Error code: 0x%02X",
+			stack_config_ram_estimate(&m_stack_config), error_code);
+		return error_code;
+	}
 #endif
 
+	start = std::chrono::steady_clock::now();
 	error_code = ble_stack_init();
+	m_startup_timing.enable_us = elapsed_us(start);
 
 	if (error_code != NRF_SUCCESS)
 	{
@@ -2912,12 +4592,15 @@ uint32_t dongle_init(char* serial_port, uint32_t baud_rate)
 	{
 		return error_code;
 	}
+#else
+	// profile may be assigned before initialized
+	conn_evt_ext_set(m_stack_config.conn_evt_ext || m_conn_param_profile == CONN_PARAM_THROUGHPUT);
 #endif
 
-	m_dongle_initialized = true;
-
 	ble_version_t ver = { 0 };
-	error_code = sd_ble_version_get(m_adapter, &ver);
+	start = std::chrono::steady_clock::now();
+	error_code = m_sd->ble_version_get(m_adapter, &ver);
+	m_startup_timing.version_us = elapsed_us(start);
 	if (error_code != NRF_SUCCESS)
 	{
 		log_level(LOG_ERROR, "Failed to get connectivity FW versions. Error code: 0x%02X", error_code);
@@ -2930,3 +4613,840 @@ uint32_t dongle_init(char* serial_port, uint32_t baud_rate)
 	return error_code;
 }
 
+/* prepare host state and open backend of m_sd concurrently, key pair generation and bond store loading
+run while the transport waits for connectivity firmware reset and responses of stack config RPCs */
+static uint32_t dongle_start(bool opened = false)
+{
+	auto start = std::chrono::steady_clock::now();
+	m_prepared = std::async(std::launch::async, dongle_prepare).share();
+	uint32_t error_code = dongle_open(opened);
+	// transport errors start recovery only after initialized, which needs host preparation done
+	m_prepared.wait();
+	if (error_code == NRF_SUCCESS)
+		m_dongle_initialized = true;
+	m_startup_timing.total_us = elapsed_us(start);
+
+	const startup_timing_t& t = m_startup_timing;
+	log_level(LOG_INFO, "Startup %.1f ms, host: prepare %.1f ms key pair %.1f ms, transport: open %.1f ms config %.1f ms enable %.1f ms version %.1f ms",
+		t.total_us / 1000.0, t.prepare_us / 1000.0, t.keypair_us / 1000.0,
+		t.open_us / 1000.0, t.config_us / 1000.0, t.enable_us / 1000.0, t.version_us / 1000.0);
+	return error_code;
+}
+
+/* init dongle by adapter of serial port and lock of the port, opened: adapter was opened by dongle_probe,
+adapter of failed init is closed and deleted and the port is released */
+static uint32_t dongle_init_port(const char* serial_port, uint32_t baud_rate, adapter_t* adapter, bool opened, int lock)
+{
+	// kept to reopen the port on recovery
+	strcpy_s(m_serial_port, serial_port);
+	m_baud_rate = baud_rate;
+	m_sd = &sd_api_driver;
+	m_adapter = adapter;
+	m_port_lock = lock;
+	if (opened)
+		m_probe_adapter = adapter;
+	uint32_t error_code = dongle_start(opened);
+	if (error_code != NRF_SUCCESS) {
+		m_dongle_initialized = false;
+		m_sd->rpc_close(m_adapter);
+		sd_rpc_adapter_delete(m_adapter);
+		m_adapter = NULL;
+		m_probe_adapter = NULL;
+		port_unlock(m_port_lock);
+	}
+	return error_code;
+}
+
+/* init Nordic connectiviy dongle and register event for rpc*/
+uint32_t dongle_init(char* serial_port, uint32_t baud_rate)
+{
+	return dongle_init_ex(serial_port, baud_rate, false, TRANSPORT_RETRANSMISSION_DEFAULT, TRANSPORT_RESPONSE_TIMEOUT_DEFAULT);
+}
+
+uint32_t dongle_init_ex(char* serial_port, uint32_t baud_rate, bool flow_control, uint32_t retransmission_interval, uint32_t response_timeout)
+{
+	if (m_recovering)
+		return NRF_ERROR_BUSY;
+	if (m_dongle_initialized) {
+		sprintf_s(m_log_msg, "Dongle must be reset before re-initialize(re-plug dongle is recommanded)");
+		log_level(LOG_ERROR, m_log_msg);
+		return NRF_ERROR_INVALID_STATE;
+	}
+	if (serial_port == NULL)
+		return NRF_ERROR_NULL;
+	// a lost request or response must be retransmitted at least once before the call times out
+	if (baud_rate == 0 || baud_rate > TRANSPORT_BAUD_RATE_MAX ||
+		retransmission_interval == 0 || response_timeout < retransmission_interval) {
+		log_level(LOG_ERROR, "Invalid transport config, baud rate %u, retransmission %u ms, response timeout %u ms",
+			baud_rate, retransmission_interval, response_timeout);
+		return NRF_ERROR_INVALID_PARAM;
+	}
+
+	log_level(LOG_DEBUG, "Serial port used: %s Baud rate used: %d flow control: %d retransmission: %u ms response timeout: %u ms",
+		serial_port, baud_rate, flow_control, retransmission_interval, response_timeout);
+
+	int lock = port_lock(serial_port);
+	if (lock == PORT_LOCK_BUSY) {
+		log_level(LOG_ERROR, "Serial port %s is in use by another process", serial_port);
+		return NRF_ERROR_BUSY;
+	}
+
+	m_transport_config.flow_control = flow_control;
+	m_transport_config.retransmission_interval = retransmission_interval;
+	m_transport_config.response_timeout = response_timeout;
+	return dongle_init_port(serial_port, baud_rate, adapter_init(serial_port, baud_rate), false, lock);
+}
+
+uint32_t dongle_init_async(char* serial_port, uint32_t baud_rate)
+{
+	if (serial_port == NULL)
+		return NRF_ERROR_NULL;
+	if (m_recovering)
+		return NRF_ERROR_BUSY;
+	if (m_dongle_initialized || m_init_future.valid())
+		return NRF_ERROR_INVALID_STATE;
+	if (strlen(serial_port) >= sizeof(m_serial_port))
+		return NRF_ERROR_INVALID_PARAM;
+
+	// port string of caller may not outlive this call
+	std::array<char, sizeof(m_serial_port)> port = { 0 };
+	strcpy_s(port.data(), port.size(), serial_port);
+	m_init_future = std::async(std::launch::async, [port, baud_rate]() mutable {
+		return dongle_init(port.data(), baud_rate);
+	});
+	return NRF_SUCCESS;
+}
+
+uint32_t dongle_init_wait(uint32_t timeout, startup_timing_t* timing)
+{
+	if (!m_init_future.valid())
+		return NRF_ERROR_INVALID_STATE;
+	if (m_init_future.wait_for(std::chrono::milliseconds(timeout)) != std::future_status::ready)
+		return NRF_ERROR_TIMEOUT;
+
+	uint32_t error_code = m_init_future.get();
+	if (timing)
+		*timing = m_startup_timing;
+	return error_code;
+}
+
+uint32_t startup_timing_get(startup_timing_t* timing)
+{
+	if (timing == NULL)
+		return NRF_ERROR_NULL;
+	*timing = m_startup_timing;
+	return NRF_SUCCESS;
+}
+
+uint32_t setup_timing_get(setup_timing_t* timing, setup_step_t* steps, uint16_t* len)
+{
+	std::lock_guard<std::mutex> lck(m_mtx_setup);
+	if (timing)
+		*timing = m_setup_timing;
+	if (steps && len) {
+		*len = (uint16_t)std::min((size_t)*len, m_setup_steps.size());
+		std::copy(m_setup_steps.begin(), m_setup_steps.begin() + *len, steps);
+	}
+	else if (len) {
+		*len = (uint16_t)m_setup_steps.size();
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t dongle_init_simulated(uint16_t peripherals, uint32_t adv_interval, uint32_t notify_interval, uint16_t notify_len, uint32_t latency_us, uint32_t seed)
+{
+#if NRF_SD_BLE_API >= 5
+	if (m_recovering)
+		return NRF_ERROR_BUSY;
+	if (m_dongle_initialized) {
+		sprintf_s(m_log_msg, "Dongle must be reset before re-initialize");
+		log_level(LOG_ERROR, m_log_msg);
+		return NRF_ERROR_INVALID_STATE;
+	}
+
+	sim_config_t config = { 0 };
+	config.seed = seed;
+	config.peripheral_count = peripherals;
+	config.adv_interval_ms = adv_interval;
+	config.notify_interval_ms = notify_interval;
+	config.notify_len = notify_len;
+	config.latency_us = latency_us;
+	// above the RSSI threshold of device_find
+	config.rssi_min = -55;
+	config.rssi_max = -35;
+	uint32_t error_code = sim_configure(&config);
+	if (error_code != NRF_SUCCESS) {
+		log_level(LOG_ERROR, "Failed to configure simulator. Error code: 0x%02X", error_code);
+		return error_code;
+	}
+
+	log_level(LOG_INFO, "Simulated backend: %u peripherals, advertising %ums, notification %ums, latency %uus, seed %u",
+		peripherals, adv_interval, notify_interval, latency_us, seed);
+
+	m_sd = sim_api();
+	m_adapter = sim_adapter();
+	return dongle_start();
+#else
+	return NRF_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t simulator_stats_get(uint32_t* events, uint32_t* adv_reports, uint32_t* notifications, uint64_t* notified_bytes)
+{
+#if NRF_SD_BLE_API >= 5
+	if (m_sd != sim_api())
+		return NRF_ERROR_INVALID_STATE;
+
+	sim_stats_t stats = { 0 };
+	sim_stats_get(&stats);
+	if (events)
+		*events = stats.events;
+	if (adv_reports)
+		*adv_reports = stats.adv_reports;
+	if (notifications)
+		*notifications = stats.notifications;
+	if (notified_bytes)
+		*notified_bytes = stats.notified_bytes;
+	return NRF_SUCCESS;
+#else
+	return NRF_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t simulator_disconnect(uint8_t reason)
+{
+#if NRF_SD_BLE_API >= 5
+	if (m_sd != sim_api())
+		return NRF_ERROR_INVALID_STATE;
+	return sim_disconnect(m_connection_handle, reason);
+#else
+	return NRF_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t simulator_transport_error()
+{
+#if NRF_SD_BLE_API >= 5
+	if (m_sd != sim_api())
+		return NRF_ERROR_INVALID_STATE;
+	return sim_transport_error(PKT_SEND_MAX_RETRIES_REACHED);
+#else
+	return NRF_ERROR_NOT_SUPPORTED;
+#endif
+}
+
+uint32_t event_record_start(const char* path)
+{
+	uint32_t error_code = trace_record_start(path);
+	if (error_code != NRF_SUCCESS) {
+		log_level(LOG_ERROR, "Failed to start event trace %s. Error code: 0x%02X", path ? path : "", error_code);
+		return error_code;
+	}
+	log_level(LOG_INFO, "Event trace recording to %s", path);
+	return NRF_SUCCESS;
+}
+
+uint32_t event_record_stop(uint32_t* events, uint64_t* bytes)
+{
+	uint32_t count = 0;
+	uint64_t size = 0;
+	uint32_t error_code = trace_record_stop(&count, &size);
+	if (error_code == NRF_ERROR_INVALID_STATE)
+		return error_code;
+	log_level(LOG_INFO, "Event trace stopped, %u events in %llu bytes", count, (unsigned long long)size);
+	if (events)
+		*events = count;
+	if (bytes)
+		*bytes = size;
+	return error_code;
+}
+
+uint32_t event_replay(const char* path, float speed, uint32_t* events, float* events_per_sec)
+{
+	if (m_recovering)
+		return NRF_ERROR_BUSY;
+	if (m_dongle_initialized) {
+		sprintf_s(m_log_msg, "Dongle must be reset before replay");
+		log_level(LOG_ERROR, m_log_msg);
+		return NRF_ERROR_INVALID_STATE;
+	}
+
+	uint32_t error_code = trace_replay_load(path);
+	if (error_code != NRF_SUCCESS) {
+		log_level(LOG_ERROR, "Failed to load event trace %s. Error code: 0x%02X", path ? path : "", error_code);
+		return error_code;
+	}
+
+	m_sd = trace_api();
+	m_adapter = trace_adapter();
+	error_code = dongle_start();
+	if (error_code != NRF_SUCCESS)
+		return error_code;
+
+	// handlers run in this thread as the event thread of nrf-ble-driver
+	trace_replay_stats_t stats = { 0 };
+	error_code = trace_replay_run(speed, &stats);
+	float per_sec = stats.elapsed_us > 0 ? stats.events * 1000000.0f / stats.elapsed_us : 0;
+	log_level(LOG_INFO, "Replayed %u events of %llu ms in %llu ms, %.1f events/s", stats.events,
+		(unsigned long long)(stats.trace_us / 1000), (unsigned long long)(stats.elapsed_us / 1000), per_sec);
+	if (events)
+		*events = stats.events;
+	if (events_per_sec)
+		*events_per_sec = per_sec;
+	return error_code;
+}
+
+uint32_t event_replay_stats_get(uint16_t* evt_ids, uint32_t* counts, float* avg_us, float* max_us, uint16_t* len)
+{
+	if (len == NULL)
+		return NRF_ERROR_NULL;
+
+	std::vector<trace_handler_stats_t> stats(trace_handler_stats_get(NULL, 0));
+	uint32_t count = trace_handler_stats_get(stats.data(), std::min<uint32_t>((uint32_t)stats.size(), *len));
+	for (uint32_t i = 0; i < count; i++) {
+		if (evt_ids)
+			evt_ids[i] = stats[i].evt_id;
+		if (counts)
+			counts[i] = stats[i].count;
+		if (avg_us)
+			avg_us[i] = stats[i].count > 0 ? stats[i].total_ns / 1000.0f / stats[i].count : 0;
+		if (max_us)
+			max_us[i] = stats[i].max_ns / 1000.0f;
+	}
+	*len = (uint16_t)count;
+	return NRF_SUCCESS;
+}
+
+/* links of the closed adapter are gone without disconnected events, release waiters and forget them */
+static void recovery_links_drop()
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx_auth_key);
+		m_auth_key_pending.clear();
+		m_cond_auth_key.notify_all();
+	}
+#if NRF_SD_BLE_API >= 5
+	m_conn_phys.clear();
+#endif
+	{
+		std::lock_guard<std::mutex> lck{ m_mtx_find };
+		m_connected_devices = 0;
+	}
+	m_connection_is_in_progress = false;
+	connection_cleanup();
+}
+
+/* connect peer of the broken link again, encrypt by stored LTK if bonded, then enable services
+by cached GATT data or discover them if the peer has no cache, services are skipped if they were not enabled,
+connection request is cancelled if peer is not connected in connect_timeout(ms),
+return NRF_ERROR_INVALID_STATE if link is lost again or link epoch changed while resuming */
+static uint32_t link_resume(ble_gap_addr_t peer, bool services, uint32_t connect_timeout)
+{
+	auto timeout = std::chrono::milliseconds(RECOVERY_RESUME_TIMEOUT);
+	uint32_t epoch = m_link_epoch;
+	std::unique_lock<std::mutex> lck{ m_mtx_find };
+	uint32_t error_code = conn_start(peer.addr_type, peer.addr);
+	if (error_code != NRF_SUCCESS)
+		return error_code;
+	bool woken = m_cond_find.wait_for(lck, std::chrono::milliseconds(connect_timeout), [epoch] {
+		return m_is_connected || m_link_epoch != epoch; });
+	if (!m_is_connected) {
+		m_sd->ble_gap_connect_cancel(m_adapter);
+		m_connection_is_in_progress = false;
+		return woken ? NRF_ERROR_INVALID_STATE : NRF_ERROR_TIMEOUT;
+	}
+
+	auto lost = [epoch] { return !m_is_connected || m_link_epoch != epoch; };
+	if (m_pair_list[m_pair_addr_num].is_paired) {
+		error_code = auth_start(true, false, m_sec_params.io_caps, NULL);
+		if (error_code != NRF_SUCCESS)
+			return error_code;
+		if (!m_cond_find.wait_for(lck, timeout, [lost] { return m_is_authenticated || lost(); }))
+			return NRF_ERROR_TIMEOUT;
+		if (lost())
+			return NRF_ERROR_INVALID_STATE;
+	}
+
+	if (!services)
+		return NRF_SUCCESS;
+	if (!load_gatt_cache(m_pair_addr_num))
+		return service_setup_wait(lck, RECOVERY_RESUME_TIMEOUT);
+	service_enable_start();
+	if (!m_cond_find.wait_for(lck, timeout, [lost] { return m_is_service_enabled || lost(); }))
+		return NRF_ERROR_TIMEOUT;
+	return lost() ? NRF_ERROR_INVALID_STATE : NRF_SUCCESS;
+}
+
+/* reopen adapter and configure stack again with retries, then resume the link, runs in its own thread
+since transport of nrf-ble-driver can not be closed from its status handler */
+static void adapter_recover(sd_rpc_app_status_t code, ble_gap_addr_t peer, bool resume, bool services)
+{
+	auto start = std::chrono::steady_clock::now();
+	auto elapsed_ms = [start]() {
+		return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+	};
+	log_level(LOG_WARNING, "Transport error %d, recovering adapter", (uint32_t)code);
+	m_in_recovery = true;
+	recovery_links_drop();
+	// replies of pending pairings are skipped from now, workers are not left holding the adapter being deleted
+	if (!adapter_workers_stop(std::chrono::steady_clock::now() + std::chrono::milliseconds(RECOVERY_WORKERS_TIMEOUT)))
+		log_level(LOG_WARNING, "Recovery, %d DHKey computations pending", (int)m_lesc_jobs);
+
+	uint32_t error_code = NRF_ERROR_INTERNAL;
+	for (uint8_t attempt = 0; attempt < m_recovery_attempts; attempt++) {
+		if (attempt > 0)
+			std::this_thread::sleep_for(std::chrono::milliseconds(m_recovery_interval));
+		{
+			std::lock_guard<std::mutex> lck(m_mtx_adapter);
+			m_sd->rpc_close(m_adapter);
+			// dongle may be re-enumerated after it restarts, transport layers and lock of its device node are created again
+			if (m_sd == &sd_api_driver) {
+				sd_rpc_adapter_delete(m_adapter);
+				m_probe_adapter = NULL;
+				port_unlock(m_port_lock);
+				m_port_lock = port_lock(m_serial_port);
+				m_adapter = adapter_init(m_serial_port, m_baud_rate);
+			}
+		}
+		// taken by another process meanwhile, opening would reset its dongle
+		error_code = m_port_lock == PORT_LOCK_BUSY ? NRF_ERROR_BUSY : dongle_open();
+		log_level(LOG_INFO, "Adapter reopen attempt %d, code: 0x%02X", attempt + 1, error_code);
+		// host state was prepared by dongle init and kept
+		if (error_code == NRF_SUCCESS) {
+			m_dongle_initialized = true;
+			break;
+		}
+	}
+	m_recovery_reopen_ms = elapsed_ms();
+
+	if (error_code == NRF_SUCCESS && resume) {
+		error_code = link_resume(peer, services, RECOVERY_RESUME_TIMEOUT);
+		log_level(LOG_INFO, "Link resume, code: 0x%02X", error_code);
+	}
+	else if (error_code != NRF_SUCCESS) {
+		std::lock_guard<std::mutex> lck(m_mtx_adapter);
+		m_sd->rpc_close(m_adapter);
+	}
+	m_recovery_resume_ms = elapsed_ms();
+
+	if (error_code == NRF_SUCCESS)
+		m_recovery_count++;
+	else
+		m_recovery_failures++;
+	log_level(error_code == NRF_SUCCESS ? LOG_INFO : LOG_ERROR, "Adapter recovery code: 0x%02X, reopen %u ms, resume %u ms",
+		error_code, m_recovery_reopen_ms, m_recovery_resume_ms);
+	m_in_recovery = false;
+	m_recovering = false;
+
+	for (auto& fn : m_callback_fn_list[FN_ON_RECOVERED]) {
+		((fn_on_recovered)fn)(error_code, m_recovery_resume_ms);
+	}
+}
+
+static void recovery_start(sd_rpc_app_status_t code)
+{
+	if (!m_recovery_enabled) {
+		log_level(LOG_ERROR, "Transport error %d, recovery disabled", (uint32_t)code);
+		if (m_callback_fn_list[FN_ON_FAILED].size() > 0) {
+			std::string str = std::string("transport error: " + std::to_string((uint32_t)code));
+			for (auto& fn : m_callback_fn_list[FN_ON_FAILED]) {
+				((fn_on_failed)fn)(str.c_str());
+			}
+		}
+		return;
+	}
+	if (m_recovering.exchange(true))
+		return;
+
+	// captured before links are dropped
+	ble_gap_addr_t peer = m_connected_addr;
+	bool resume = m_is_connected;
+	bool services = m_is_service_enabled;
+	m_dongle_initialized = false;
+	// a running reconnection leaves the link to recovery
+	m_link_epoch++;
+	m_cond_find.notify_all();
+	std::thread(adapter_recover, code, peer, resume, services).detach();
+}
+
+/* connect lost peer again with exponential backoff until resumed or attempts exhausted, runs in its own thread
+since each step waits for events, failed attempts disconnected by reason 0x3E do not start another one */
+static void link_reconnect(ble_gap_addr_t peer, bool services, uint8_t reason, uint32_t epoch,
+	std::chrono::steady_clock::time_point lost)
+{
+	uint64_t addr_num = 0;
+	convert_peer_address_to_uint64(peer.addr, &addr_num);
+	log_level(LOG_WARNING, "Link of %llx lost, reason: 0x%02X, reconnecting", addr_num, reason);
+
+	uint32_t error_code = NRF_ERROR_INVALID_STATE;
+	uint32_t backoff = m_reconnect_backoff_min;
+	uint8_t attempt = 0;
+	while (attempt < m_reconnect_attempts) {
+		if (attempt > 0) {
+			std::unique_lock<std::mutex> lck{ m_mtx_find };
+			m_cond_find.wait_for(lck, std::chrono::milliseconds(backoff), [epoch] { return m_link_epoch != epoch; });
+			backoff = std::min(backoff * 2, m_reconnect_backoff_max);
+		}
+		if (m_link_epoch != epoch || !m_dongle_initialized) {
+			error_code = NRF_ERROR_INVALID_STATE;
+			break;
+		}
+		attempt++;
+		error_code = link_resume(peer, services, RECONNECT_CONNECT_TIMEOUT);
+		log_level(LOG_INFO, "Reconnect attempt %d of %llx, code: 0x%02X", attempt, addr_num, error_code);
+		if (error_code == NRF_SUCCESS)
+			break;
+		// link connected but not resumed is closed before the next attempt
+		if (m_is_connected) {
+			m_sd->ble_gap_disconnect(m_adapter, m_connection_handle, BLE_HCI_REMOTE_USER_TERMINATED_CONNECTION);
+			std::unique_lock<std::mutex> lck{ m_mtx_find };
+			m_cond_find.wait_for(lck, std::chrono::milliseconds(RECONNECT_CONNECT_TIMEOUT), [] { return !m_is_connected; });
+		}
+	}
+
+	uint32_t outage_ms = (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - lost).count();
+	{
+		std::lock_guard<std::mutex> lck(m_mtx_reconnect);
+		auto found = m_reconnect_peers.find(addr_num);
+		if (found != m_reconnect_peers.end()) {
+			reconnect_stats_t& stats = found->second;
+			stats.outages++;
+			if (error_code != NRF_SUCCESS)
+				stats.failures++;
+			stats.last_outage_ms = outage_ms;
+			stats.max_outage_ms = std::max(stats.max_outage_ms, outage_ms);
+		}
+	}
+	log_level(error_code == NRF_SUCCESS ? LOG_INFO : LOG_ERROR, "Reconnect of %llx code: 0x%02X, %d attempts, outage %u ms",
+		addr_num, error_code, attempt, outage_ms);
+	{
+		std::lock_guard<std::mutex> lck{ m_mtx_find };
+		m_reconnecting = false;
+	}
+	m_cond_find.notify_all();
+
+	for (auto& fn : m_callback_fn_list[FN_ON_RECONNECTED]) {
+		((fn_on_reconnected)fn)(peer.addr_type, peer.addr, error_code, outage_ms);
+	}
+}
+
+static void reconnect_start(ble_gap_addr_t peer, bool services, uint8_t reason)
+{
+	// peer went out of range or did not answer the connection request, others are intended by either side
+	if (reason != BLE_HCI_CONNECTION_TIMEOUT && reason != BLE_HCI_CONN_FAILED_TO_BE_ESTABLISHED)
+		return;
+	if (!m_reconnect_enabled || !m_dongle_initialized || m_recovering)
+		return;
+
+	uint64_t addr_num = 0;
+	convert_peer_address_to_uint64(peer.addr, &addr_num);
+	{
+		std::lock_guard<std::mutex> lck(m_mtx_reconnect);
+		if (m_reconnect_peers.find(addr_num) == m_reconnect_peers.end())
+			return;
+	}
+	if (m_reconnecting.exchange(true))
+		return;
+	std::thread(link_reconnect, peer, services, reason, m_link_epoch.load(), std::chrono::steady_clock::now()).detach();
+}
+
+uint32_t link_benchmark(uint32_t iterations, uint32_t duration, float* rtt_avg_us, float* rtt_max_us, float* events_per_sec)
+{
+	if (m_recovering)
+		return NRF_ERROR_BUSY;
+	if (!m_dongle_initialized)
+		return NRF_ERROR_INVALID_STATE;
+	if (iterations == 0 || duration == 0)
+		return NRF_ERROR_INVALID_PARAM;
+
+	// serialized command and its response without radio activity, bound by baud rate and transport layers
+	double rtt_sum = 0, rtt_max = 0;
+	ble_version_t ver = { 0 };
+	for (uint32_t i = 0; i < iterations; i++) {
+		auto start = std::chrono::steady_clock::now();
+		uint32_t error_code = m_sd->ble_version_get(m_adapter, &ver);
+		double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		if (error_code != NRF_SUCCESS) {
+			log_level(LOG_ERROR, "Link benchmark request %u failed, code: 0x%02X", i, error_code);
+			return error_code;
+		}
+		rtt_sum += us;
+		rtt_max = std::max(rtt_max, us);
+	}
+
+	// continuous active scan, each report is an event and v6 resumes scanning by one more command,
+	// rate is also bound by advertisers around
+	uint32_t error_code = scan_start(100, 100, true, 0);
+	if (error_code != NRF_SUCCESS)
+		return error_code;
+	uint32_t evt_count = m_evt_count;
+	auto start = std::chrono::steady_clock::now();
+	std::this_thread::sleep_for(std::chrono::milliseconds(duration));
+	evt_count = m_evt_count - evt_count;
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	scan_stop();
+
+	log_level(LOG_INFO, "Link benchmark, rtt avg %.1f us max %.1f us, %.1f events/s",
+		rtt_sum / iterations, rtt_max, evt_count / seconds);
+	if (rtt_avg_us)
+		*rtt_avg_us = (float)(rtt_sum / iterations);
+	if (rtt_max_us)
+		*rtt_max_us = (float)rtt_max;
+	if (events_per_sec)
+		*events_per_sec = (float)(evt_count / seconds);
+	return NRF_SUCCESS;
+}
+
+// USB vendor ids of connectivity dongles, nRF52840 dongle/PCA10059 and DK on-board interface
+static const uint16_t DONGLE_VENDOR_IDS[] = { 0x1915 /* Nordic */, 0x1366 /* SEGGER J-Link */, 0x0D28 /* ARM DAPLink */ };
+#define DONGLE_ENUM_MAX 32
+
+uint32_t dongle_enumerate(dongle_desc_t* descs, uint32_t* count)
+{
+	if (count == NULL)
+		return NRF_ERROR_NULL;
+
+	// enumerated by udev on Linux, registry on Windows, vendor/product ids are hex strings
+	std::vector<sd_rpc_serial_port_desc_t> ports(DONGLE_ENUM_MAX);
+	uint32_t size = (uint32_t)ports.size();
+	uint32_t error_code = sd_rpc_serial_port_enum(ports.data(), &size);
+	if (error_code != NRF_SUCCESS) {
+		log_level(LOG_ERROR, "Serial port enumeration failed, code: 0x%02X", error_code);
+		return error_code;
+	}
+
+	uint32_t found = 0;
+	for (uint32_t i = 0; i < size; i++) {
+		uint16_t vendor_id = (uint16_t)strtoul(ports[i].vendorId, NULL, 16);
+		uint16_t product_id = (uint16_t)strtoul(ports[i].productId, NULL, 16);
+		if (std::find(std::begin(DONGLE_VENDOR_IDS), std::end(DONGLE_VENDOR_IDS), vendor_id) == std::end(DONGLE_VENDOR_IDS))
+			continue;
+		log_level(LOG_DEBUG, "Dongle found at %s, serial number: %s, VID: %04X PID: %04X",
+			ports[i].port, ports[i].serialNumber, vendor_id, product_id);
+		if (descs != NULL) {
+			if (found >= *count)
+				break;
+			dongle_desc_t& desc = descs[found];
+			// truncated to fixed size fields of the exported struct
+			size_t len = std::min(strlen(ports[i].port), sizeof(desc.port) - 1);
+			memcpy(desc.port, ports[i].port, len);
+			desc.port[len] = 0;
+			len = std::min(strlen(ports[i].serialNumber), sizeof(desc.serial_number) - 1);
+			memcpy(desc.serial_number, ports[i].serialNumber, len);
+			desc.serial_number[len] = 0;
+			desc.vendor_id = vendor_id;
+			desc.product_id = product_id;
+		}
+		found++;
+	}
+	*count = found;
+	return NRF_SUCCESS;
+}
+
+// handlers of probing adapters, status of a probe must not start recovery of the opened dongle,
+// the adapter kept by dongle_init_auto forwards to handlers of m_adapter
+static void probe_status_handler(adapter_t * adapter, sd_rpc_app_status_t code, const char * message) {
+	if (adapter == m_probe_adapter)
+		status_handler(adapter, code, message);
+}
+static void probe_evt_handler(adapter_t * adapter, ble_evt_t * p_ble_evt) {
+	if (adapter == m_probe_adapter)
+		ble_evt_dispatch(adapter, p_ble_evt);
+}
+static void probe_log_handler(adapter_t * adapter, sd_rpc_log_severity_t severity, const char * message) {
+	if (adapter == m_probe_adapter)
+		log_handler(adapter, severity, message);
+}
+
+/* adapter of a probe left open and lock of its port */
+typedef struct _probe_port_t {
+	adapter_t* adapter;
+	int lock;
+} probe_port_t;
+
+static void probe_close(probe_port_t& probe)
+{
+	if (probe.adapter != NULL) {
+		sd_rpc_close(probe.adapter);
+		sd_rpc_adapter_delete(probe.adapter);
+		probe.adapter = NULL;
+	}
+	port_unlock(probe.lock);
+}
+
+/* open ports in parallel, responded ones are left open in probes, ports locked by other processes
+are skipped with NRF_ERROR_BUSY since opening resets their dongles */
+static uint32_t probe_open(dongle_desc_t* descs, uint32_t count, uint32_t baud_rate, uint32_t* results, probe_port_t* probes)
+{
+	// opening resets connectivity firmware and waits its response, probes run in parallel take the time
+	// of the slowest dongle instead of their sum
+	auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (uint32_t i = 0; i < count; i++) {
+		threads.emplace_back([&descs, &results, &probes, baud_rate, i]() {
+			probes[i] = { NULL, port_lock(descs[i].port) };
+			if (probes[i].lock == PORT_LOCK_BUSY) {
+				results[i] = NRF_ERROR_BUSY;
+				return;
+			}
+			probes[i].adapter = adapter_init(descs[i].port, baud_rate);
+			results[i] = sd_rpc_open(probes[i].adapter, probe_status_handler, probe_evt_handler, probe_log_handler);
+			if (results[i] != NRF_SUCCESS) {
+				sd_rpc_adapter_delete(probes[i].adapter);
+				probes[i].adapter = NULL;
+				port_unlock(probes[i].lock);
+			}
+		});
+	}
+	uint32_t responded = 0;
+	for (uint32_t i = 0; i < count; i++) {
+		threads[i].join();
+		log_level(LOG_DEBUG, "Dongle probe %s, code: 0x%02X", descs[i].port, results[i]);
+		if (results[i] == NRF_SUCCESS)
+			responded++;
+	}
+	log_level(LOG_INFO, "Dongle probe, %u of %u responded in %lld ms", responded, count,
+		(long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+	return responded ? NRF_SUCCESS : NRF_ERROR_NOT_FOUND;
+}
+
+uint32_t dongle_probe(dongle_desc_t* descs, uint32_t count, uint32_t baud_rate, uint32_t* results)
+{
+	if (descs == NULL || results == NULL)
+		return NRF_ERROR_NULL;
+	if (count == 0 || baud_rate == 0 || baud_rate > TRANSPORT_BAUD_RATE_MAX)
+		return NRF_ERROR_INVALID_PARAM;
+
+	std::vector<probe_port_t> probes(count);
+	uint32_t error_code = probe_open(descs, count, baud_rate, results, probes.data());
+	for (auto& probe : probes)
+		probe_close(probe);
+	return error_code;
+}
+
+uint32_t dongle_init_auto(uint32_t baud_rate, const char* serial_number, char port[64])
+{
+	if (m_recovering)
+		return NRF_ERROR_BUSY;
+	if (m_dongle_initialized)
+		return NRF_ERROR_INVALID_STATE;
+	if (baud_rate == 0 || baud_rate > TRANSPORT_BAUD_RATE_MAX)
+		return NRF_ERROR_INVALID_PARAM;
+
+	auto start = std::chrono::steady_clock::now();
+	dongle_desc_t descs[DONGLE_ENUM_MAX];
+	uint32_t count = DONGLE_ENUM_MAX;
+	uint32_t error_code = dongle_enumerate(descs, &count);
+	if (error_code != NRF_SUCCESS)
+		return error_code;
+	// the dongle of given serial number only
+	if (serial_number != NULL) {
+		auto end = std::remove_if(descs, descs + count, [serial_number](const dongle_desc_t& desc) {
+			return strcmp(desc.serial_number, serial_number) != 0;
+		});
+		count = (uint32_t)(end - descs);
+	}
+	if (count == 0) {
+		log_level(LOG_ERROR, "No dongle found%s%s", serial_number ? " of serial number " : "", serial_number ? serial_number : "");
+		return NRF_ERROR_NOT_FOUND;
+	}
+
+	// transport config of dongle_init, probing adapters are created by it and handed to init as opened
+	m_transport_config = { false, TRANSPORT_RETRANSMISSION_DEFAULT, TRANSPORT_RESPONSE_TIMEOUT_DEFAULT };
+	uint32_t results[DONGLE_ENUM_MAX];
+	probe_port_t probes[DONGLE_ENUM_MAX];
+	error_code = probe_open(descs, count, baud_rate, results, probes);
+	if (error_code != NRF_SUCCESS)
+		return error_code;
+	// the first responding dongle is initialized without another reset, failed init releases its adapter and port,
+	// then the next one is taken, the others are closed
+	uint32_t initialized = count;
+	for (uint32_t i = 0; i < count; i++) {
+		if (results[i] != NRF_SUCCESS || initialized < count)
+			continue;
+		error_code = dongle_init_port(descs[i].port, baud_rate, probes[i].adapter, true, probes[i].lock);
+		probes[i] = { NULL, -1 };
+		if (error_code == NRF_SUCCESS)
+			initialized = i;
+	}
+	for (uint32_t i = 0; i < count; i++)
+		probe_close(probes[i]);
+	if (initialized == count)
+		return error_code;
+
+	log_level(LOG_INFO, "Dongle %s serial number %s initialized in %lld ms", descs[initialized].port, descs[initialized].serial_number,
+		(long long)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+	if (port != NULL)
+		strcpy_s(port, 64, descs[initialized].port);
+	return NRF_SUCCESS;
+}
+
+uint32_t reconnect_set(bool enable, uint8_t attempts, uint32_t backoff_min, uint32_t backoff_max)
+{
+	if (attempts == 0 || backoff_min == 0 || backoff_max < backoff_min)
+		return NRF_ERROR_INVALID_PARAM;
+	m_reconnect_enabled = enable;
+	m_reconnect_attempts = attempts;
+	m_reconnect_backoff_min = backoff_min;
+	m_reconnect_backoff_max = backoff_max;
+	return NRF_SUCCESS;
+}
+
+uint32_t reconnect_peer_set(uint8_t addr[6], bool enable)
+{
+	if (addr == NULL)
+		return NRF_ERROR_NULL;
+	uint64_t addr_num = 0;
+	convert_peer_address_to_uint64(addr, &addr_num);
+	std::lock_guard<std::mutex> lck(m_mtx_reconnect);
+	if (enable)
+		m_reconnect_peers.insert({ addr_num, { 0 } });
+	else if (m_reconnect_peers.erase(addr_num) == 0)
+		return NRF_ERROR_NOT_FOUND;
+	return NRF_SUCCESS;
+}
+
+uint32_t reconnect_stats_get(uint8_t addr[6], uint32_t* outages, uint32_t* failures, uint32_t* last_outage_ms, uint32_t* max_outage_ms)
+{
+	if (addr == NULL)
+		return NRF_ERROR_NULL;
+	uint64_t addr_num = 0;
+	convert_peer_address_to_uint64(addr, &addr_num);
+	std::lock_guard<std::mutex> lck(m_mtx_reconnect);
+	auto found = m_reconnect_peers.find(addr_num);
+	if (found == m_reconnect_peers.end())
+		return NRF_ERROR_NOT_FOUND;
+	if (outages)
+		*outages = found->second.outages;
+	if (failures)
+		*failures = found->second.failures;
+	if (last_outage_ms)
+		*last_outage_ms = found->second.last_outage_ms;
+	if (max_outage_ms)
+		*max_outage_ms = found->second.max_outage_ms;
+	return m_reconnecting ? NRF_ERROR_BUSY : NRF_SUCCESS;
+}
+
+uint32_t recovery_set(bool enable, uint8_t attempts, uint32_t interval)
+{
+	if (attempts == 0)
+		return NRF_ERROR_INVALID_PARAM;
+	m_recovery_enabled = enable;
+	m_recovery_attempts = attempts;
+	m_recovery_interval = interval;
+	return NRF_SUCCESS;
+}
+
+uint32_t recovery_stats_get(uint32_t* recoveries, uint32_t* failures, uint32_t* reopen_ms, uint32_t* resume_ms)
+{
+	if (recoveries)
+		*recoveries = m_recovery_count;
+	if (failures)
+		*failures = m_recovery_failures;
+	if (reopen_ms)
+		*reopen_ms = m_recovery_reopen_ms;
+	if (resume_ms)
+		*resume_ms = m_recovery_resume_ms;
+	return m_recovering ? NRF_ERROR_BUSY : NRF_SUCCESS;
+}
+
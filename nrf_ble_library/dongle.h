@@ -1,10 +1,15 @@
 #pragma once
 
+#if defined(_WIN32)
 #ifdef NRFBLELIBRARY_EXPORTS
 #define NRFBLEAPI __declspec(dllexport)
 #else
 #define NRFBLEAPI __declspec(dllimport)
 #endif
+#else
+// shared library is built with hidden visibility, only exported API is visible
+#define NRFBLEAPI __attribute__((visibility("default")))
+#endif
 #ifdef __cplusplus
 #define EXTERNC extern "C"
 #else
@@ -13,6 +18,9 @@
 
 #define STRING_BUFFER_SIZE 50
 #define DATA_BUFFER_SIZE 256
+/* error code of a GATT request failed by peer, GATT_STATUS_ERROR_BASE + BLE_GATT_STATUS_*(0x0001~0x01FF),
+distinct from NRF_ERROR_* of SoftDevice(below 0x4000) and of serialization(0x8000~) */
+#define GATT_STATUS_ERROR_BASE 0xC000
 
 #include <string>
 
@@ -26,7 +34,12 @@ typedef enum _fn_callback_id_t {
 	FN_ON_DISCONNECTED,
 	FN_ON_FAILED,
 	FN_ON_DATA_RECEIVED,
-	FN_ON_DATA_SENT
+	FN_ON_DATA_SENT,
+	FN_ON_PHY_UPDATED,
+	FN_ON_DATA_BATCH_RECEIVED,
+	FN_ON_AUTH_KEY_REQUEST,
+	FN_ON_RECOVERED,
+	FN_ON_RECONNECTED
 } fn_callback_id_t;
 
 /* align to sd_rpc_log_severity_t */
@@ -39,6 +52,76 @@ typedef enum _log_level_t {
 	LOG_FATAL
 } log_level_t;
 
+/* connection parameter presets, refer to conn_param_profile_set */
+typedef enum _conn_param_profile_t {
+	CONN_PARAM_DEFAULT,      /* interval 7.5~18.75ms, latency 0, timeout 4s */
+	CONN_PARAM_LOW_LATENCY,  /* interval 7.5ms, latency 0, timeout 2s, for HID input reports */
+	CONN_PARAM_THROUGHPUT,   /* interval 15~30ms with connection event extension, for bulk data transfer */
+	CONN_PARAM_POWER_SAVING, /* interval 100~200ms, latency 4, timeout 6s */
+	CONN_PARAM_PROFILE_COUNT
+} conn_param_profile_t;
+
+/* auth key required by pairing, refer to fn_on_auth_key_request */
+typedef enum _auth_key_request_t {
+	AUTH_KEY_REQUEST_PASSKEY,            /* enter passkey displayed on peer, reply by auth_key_reply */
+	AUTH_KEY_REQUEST_NUMERIC_COMPARISON  /* confirm passkey is the same as peer shows, reply by auth_numeric_reply */
+} auth_key_request_t;
+
+/* reply to connection parameter update request from peripheral */
+typedef enum _conn_param_policy_t {
+	CONN_PARAM_POLICY_ACCEPT,  /* accept parameters as requested (default) */
+	CONN_PARAM_POLICY_REJECT,  /* reject request and keep current parameters */
+	CONN_PARAM_POLICY_PROFILE  /* narrow down requested parameters into range of current profile */
+} conn_param_policy_t;
+
+/* phases of dongle init in microseconds, refer to startup_timing_get */
+typedef struct _startup_timing_t {
+	uint32_t prepare_us; /* ECC init, key pool start, bond store and IRKs loading */
+	uint32_t keypair_us; /* own key pair restored or generated */
+	uint32_t open_us; /* transport open and connectivity firmware reset */
+	uint32_t config_us; /* stack config RPCs, SoftDevice API v5 or later */
+	uint32_t enable_us; /* BLE stack enable */
+	uint32_t version_us; /* connectivity firmware version */
+	uint32_t total_us; /* host phases run concurrently with transport phases */
+} startup_timing_t;
+
+/* connection setup phase, each one is timed from its request to the response event */
+typedef enum _setup_phase_t {
+	SETUP_PHASE_ADV, /* scan start to the first advertisement of connected peer */
+	SETUP_PHASE_CONNECT, /* connection request to connected event */
+	SETUP_PHASE_AUTH, /* pairing or encryption by stored key to auth status or security updated */
+	SETUP_PHASE_SERVICE_DISC,
+	SETUP_PHASE_CHAR_DISC,
+	SETUP_PHASE_DESC_DISC,
+	SETUP_PHASE_REPORT_REF, /* HID report reference read */
+	SETUP_PHASE_CCCD, /* CCCD write to enable notification */
+	SETUP_PHASE_COUNT
+} setup_phase_t;
+
+/* one request and its response during connection setup */
+typedef struct _setup_step_t {
+	setup_phase_t phase;
+	uint16_t handle; /* attribute of read/write, start of discovery range, or UUID of service discovery */
+	uint32_t start_us; /* since scan start, or connection request if the peer was not found by scan */
+	uint32_t duration_us;
+} setup_step_t;
+
+/* phases of the last connection setup, refer to setup_timing_get */
+typedef struct _setup_timing_t {
+	uint32_t setup_us; /* scan start or connection request to services enabled, 0 until enabled */
+	uint32_t phase_us[SETUP_PHASE_COUNT]; /* sum of steps */
+	uint32_t phase_max_us[SETUP_PHASE_COUNT];
+	uint16_t phase_count[SETUP_PHASE_COUNT];
+} setup_timing_t;
+
+/* USB serial port of connectivity dongle, refer to dongle_enumerate */
+typedef struct _dongle_desc_t {
+	char port[64]; /* "COMx" or device path, e.g. /dev/ttyACM0 */
+	char serial_number[64];
+	uint16_t vendor_id;
+	uint16_t product_id;
+} dongle_desc_t;
+
 typedef void(*fn_on_discovered)(const char *addr_str, const char *name, 
 	uint8_t addr_type, uint8_t addr[6], int8_t rssi);
 typedef void(*fn_on_connected)(uint8_t addr_type, uint8_t addr[6]);
@@ -52,13 +135,114 @@ typedef void(*fn_on_disconnected)(uint8_t reason);
 typedef void(*fn_on_failed)(const char *stage); /* failure from connection or authentication */
 typedef void(*fn_on_data_received)(uint16_t handle, uint8_t *data, uint16_t len);
 typedef void(*fn_on_data_sent)(uint16_t handle, uint8_t *data, uint16_t len);
+/* tx_phy, rx_phy: active PHY of the link, refer to BLE_GAP_PHYS */
+typedef void(*fn_on_phy_updated)(uint8_t tx_phy, uint8_t rx_phy);
+/* values of batched read concatenated in data by handle order, each value length is lens[i] */
+typedef void(*fn_on_data_batch_received)(uint16_t count, uint16_t *handles, uint16_t *lens, uint8_t *data);
+/* called from event thread, must not block, reply later from any thread before auth_key_timeout_set timeout,
+passkey: 6 digits to compare for numeric comparison, NULL for passkey entry */
+typedef void(*fn_on_auth_key_request)(uint16_t conn_handle, auth_key_request_t request, const char *passkey);
+/* called from recovery thread after adapter reopened and link resumed, error_code: NRF_SUCCESS or the failed step,
+recovery_ms: from transport error to services enabled */
+typedef void(*fn_on_recovered)(uint32_t error_code, uint32_t recovery_ms);
+/* called from reconnect thread after lost link of configured peer resumed or attempts exhausted,
+outage_ms: from disconnected event to services enabled */
+typedef void(*fn_on_reconnected)(uint8_t addr_type, uint8_t* addr, uint32_t error_code, uint32_t outage_ms);
 
 EXTERNC NRFBLEAPI uint32_t callback_add(fn_callback_id_t fn_id, void* fn);
+/* messages below level are neither printed nor written to log file, default LOG_TRACE,
+raise it to measure hot paths without logging cost */
+EXTERNC NRFBLEAPI uint32_t log_level_set(log_level_t level);
 
-/*initialize uECC keypair from config file or create new one*/
+/*initialize uECC keypair from bond store(nrf_ble_library.bond) or create new one,
+return NRF_ERROR_INTERNAL if the key pair can not be generated or is invalid*/
 EXTERNC NRFBLEAPI uint32_t keypair_init(bool renew = false);
 /*serial_port:"COMx", baud_rate:10000*/
 EXTERNC NRFBLEAPI uint32_t dongle_init(char* serial_port, uint32_t baud_rate);
+/* init with transport config, dongle_init uses no flow control, 250ms retransmission and 1500ms response timeout,
+serial port is locked while in use, return NRF_ERROR_BUSY if another process of this library holds it
+baud_rate: up to 1000000, must match the UART baud rate connectivity firmware is built with,
+higher rates usually need flow_control(RTS/CTS) to be stable
+flow_control: hardware flow control of UART, connectivity firmware must be built with it
+retransmission_interval: three-wire(H5) packet retransmission interval(ms)
+response_timeout: timeout(ms) of each serialized SoftDevice call, covers at least one retransmission_interval */
+EXTERNC NRFBLEAPI uint32_t dongle_init_ex(char* serial_port, uint32_t baud_rate, bool flow_control, uint32_t retransmission_interval, uint32_t response_timeout);
+/* start dongle_init in background and return, caller may load its own resources meanwhile,
+other functions must not be called until dongle_init_wait returns the result */
+EXTERNC NRFBLEAPI uint32_t dongle_init_async(char* serial_port, uint32_t baud_rate);
+/* wait for dongle_init_async up to timeout(ms), return NRF_ERROR_TIMEOUT if still running(call again),
+otherwise result of dongle_init, timing: phases of the init, can be NULL */
+EXTERNC NRFBLEAPI uint32_t dongle_init_wait(uint32_t timeout, startup_timing_t* timing);
+/* phases of the last dongle init, simulated or replay init as well */
+EXTERNC NRFBLEAPI uint32_t startup_timing_get(startup_timing_t* timing);
+/* phases of the last connection setup(device_find, conn_start or reconnection), also logged when services enabled,
+timing: sums per phase, can be NULL, steps: up to len steps in order, len is updated to steps filled, or total if steps is NULL */
+EXTERNC NRFBLEAPI uint32_t setup_timing_get(setup_timing_t* timing, setup_step_t* steps, uint16_t* len);
+/* attached connectivity dongles, USB serial ports of Nordic(0x1915), SEGGER(0x1366) or ARM DAPLink(0x0D28) vendor,
+enumerated by udev on Linux, descs: array of count entries, count is updated to entries filled, or total if descs is NULL */
+EXTERNC NRFBLEAPI uint32_t dongle_enumerate(dongle_desc_t* descs, uint32_t* count);
+/* open serial ports of descs in parallel and check connectivity firmware responds, then close them,
+ports locked by another process of this library are not opened(reset), results: NRF_SUCCESS, NRF_ERROR_BUSY
+if locked or error code of each desc, return NRF_ERROR_NOT_FOUND if none responds */
+EXTERNC NRFBLEAPI uint32_t dongle_probe(dongle_desc_t* descs, uint32_t count, uint32_t baud_rate, uint32_t* results);
+/* enumerate and probe dongles, then init the first responding one, or the one of serial_number if not NULL,
+its adapter is kept open from the probe, a port locked by another process is skipped,
+so each process of a multi-dongle station takes a free one, port: output port of initialized dongle, can be NULL */
+EXTERNC NRFBLEAPI uint32_t dongle_init_auto(uint32_t baud_rate, const char* serial_number, char port[64]);
+/* measure transport of initialized dongle, iterations of serialized call round trip(us), then event rate during
+continuous active scan for duration(ms), compare settings by dongle_init_ex, link_benchmark and dongle_reset of each */
+EXTERNC NRFBLEAPI uint32_t link_benchmark(uint32_t iterations, uint32_t duration, float* rtt_avg_us, float* rtt_max_us, float* events_per_sec);
+/* adapter recovery on transport error(no ack from dongle, serial port error or unexpected reset), default enabled,
+adapter is reopened up to attempts times every interval(ms), then connected peer is resumed by stored LTK
+and cached GATT data, FN_ON_RECOVERED reports result, FN_ON_FAILED is called instead if disabled,
+functions using the adapter return NRF_ERROR_BUSY until recovery is done */
+EXTERNC NRFBLEAPI uint32_t recovery_set(bool enable, uint8_t attempts, uint32_t interval);
+/* succeeded and failed recoveries, reopen_ms: transport error to stack enabled, resume_ms: to services enabled of the last one,
+any of them can be NULL, return NRF_ERROR_BUSY while recovering */
+EXTERNC NRFBLEAPI uint32_t recovery_stats_get(uint32_t* recoveries, uint32_t* failures, uint32_t* reopen_ms, uint32_t* resume_ms);
+/* reconnection of configured peers on link loss(0x08 supervision timeout or 0x3E failed to be established), default disabled,
+peer is connected directly by its address up to attempts times, waiting backoff_min(ms) doubled each time up to backoff_max,
+then resumed by stored LTK and cached GATT data as recovery, FN_ON_RECONNECTED reports result */
+EXTERNC NRFBLEAPI uint32_t reconnect_set(bool enable, uint8_t attempts, uint32_t backoff_min, uint32_t backoff_max);
+/* add(enable) or remove peer of reconnection, addr: 6 bytes LSB as reported by FN_ON_CONNECTED */
+EXTERNC NRFBLEAPI uint32_t reconnect_peer_set(uint8_t addr[6], bool enable);
+/* outages of configured peer, failures: outages not resumed, last/max_outage_ms: link lost to services enabled,
+any of them can be NULL, return NRF_ERROR_NOT_FOUND if peer is not configured, NRF_ERROR_BUSY while reconnecting */
+EXTERNC NRFBLEAPI uint32_t reconnect_stats_get(uint8_t addr[6], uint32_t* outages, uint32_t* failures, uint32_t* last_outage_ms, uint32_t* max_outage_ms);
+/* init with simulated connectivity instead of dongle, for benchmarks of host side without hardware(API v5 and later)
+peripherals: 1~64 synthetic HID keyboards "SIM-nn" with battery service, adv_interval: 20~10240(ms)
+notify_interval: input report and battery level notifications after CCCD enabled(ms), 0 disables
+notify_len: 1~244 bytes of input report, latency_us: from each request to its response event
+seed: decides addresses, keys and order of events, the same seed repeats the same run
+reset by dongle_reset as dongle */
+EXTERNC NRFBLEAPI uint32_t dongle_init_simulated(uint16_t peripherals, uint32_t adv_interval, uint32_t notify_interval, uint16_t notify_len, uint32_t latency_us, uint32_t seed);
+/* counters of simulated backend since dongle_init_simulated, any of them can be NULL
+events: all events delivered to library, notified_bytes: payload of notifications */
+EXTERNC NRFBLEAPI uint32_t simulator_stats_get(uint32_t* events, uint32_t* adv_reports, uint32_t* notifications, uint64_t* notified_bytes);
+/* simulated peer disconnection or link loss of current connection, reason: HCI status code, e.g. 0x08 supervision timeout */
+EXTERNC NRFBLEAPI uint32_t simulator_disconnect(uint8_t reason);
+/* simulated transport error as serial port of dongle failed, links are dropped without events and adapter recovery starts */
+EXTERNC NRFBLEAPI uint32_t simulator_transport_error();
+/* capture every event received by library into a binary trace file with monotonic timestamps until event_record_stop,
+recording continues across dongle_reset, a trace is replayed only by library of the same build configuration */
+EXTERNC NRFBLEAPI uint32_t event_record_start(const char* path);
+/* close trace file, events: recorded events, bytes: file size, any of them can be NULL */
+EXTERNC NRFBLEAPI uint32_t event_record_stop(uint32_t* events, uint64_t* bytes);
+/* initialize library with trace file as backend and dispatch its events to library in caller thread,
+speed: 1 replays at captured pace, 2 twice as fast, 0 as fast as possible,
+SoftDevice calls made by library succeed without effect, returns when all events are handled,
+events: handled events, events_per_sec: handled rate, reset by dongle_reset as dongle */
+EXTERNC NRFBLEAPI uint32_t event_replay(const char* path, float speed, uint32_t* events, float* events_per_sec);
+/* handler latency of the last replay by event id(BLE_GAP_EVT_*, BLE_GATTC_EVT_*...),
+arrays hold len entries, len is updated to entries filled, any array can be NULL */
+EXTERNC NRFBLEAPI uint32_t event_replay_stats_get(uint16_t* evt_ids, uint32_t* counts, float* avg_us, float* max_us, uint16_t* len);
+/* SoftDevice stack configuration, must be called before dongle_init
+event_length: connection event length 2.5~(ms), longer one fits more packets per connection event, default 10ms
+conn_evt_ext: extend connection event beyond event_length while packets are pending, default false
+write_cmd_tx_queue_size, hvn_tx_queue_size: queued write without response and notification packets, default 10
+conn_count: concurrent connections in SoftDevice, default 1
+return NRF_ERROR_NO_MEM if estimated RAM usage exceeds SoftDevice of connectivity firmware */
+EXTERNC NRFBLEAPI uint32_t stack_config_set(float event_length, bool conn_evt_ext, uint8_t write_cmd_tx_queue_size, uint8_t hvn_tx_queue_size, uint8_t conn_count);
 /*interval:2.5~10240(ms), window:2.5~10240(ms), timeout:0(disable),1~65535(s)*/
 EXTERNC NRFBLEAPI uint32_t scan_start(float interval, float window, bool active, uint16_t timeout);
 EXTERNC NRFBLEAPI uint32_t scan_stop();
@@ -66,8 +250,16 @@ EXTERNC NRFBLEAPI uint32_t conn_start(uint8_t addr_type, uint8_t addr[6]);
 /*TODO:isolate ble secure func for further dev, params not fixed yet*/
 EXTERNC NRFBLEAPI uint32_t auth_set_params(bool lesc, bool oob, bool mitm, uint8_t role, bool enc, bool id, bool sign, bool link);
 /*io_caps:0x2(BLE_GAP_IO_CAPS_KEYBOARD_ONLY), 
-passkey:assign 6 digits string or given NULL will be default "123456"*/
+passkey:assign 6 digits string or given NULL will be default "123456",
+bonded peer is encrypted with stored LTK, pairing only if peer has lost the key*/
 EXTERNC NRFBLEAPI uint32_t auth_start(bool bond, bool keypress, uint8_t io_caps, const char* passkey);
+/* reply to AUTH_KEY_REQUEST_PASSKEY of fn_on_auth_key_request, passkey: 6 digits, NULL to reject,
+without FN_ON_AUTH_KEY_REQUEST callback the passkey of auth_start is replied immediately */
+EXTERNC NRFBLEAPI uint32_t auth_key_reply(uint16_t conn_handle, const char* passkey);
+/* reply to AUTH_KEY_REQUEST_NUMERIC_COMPARISON of fn_on_auth_key_request, match: false to reject */
+EXTERNC NRFBLEAPI uint32_t auth_numeric_reply(uint16_t conn_handle, bool match);
+/* timeout(ms) of unreplied auth key request, then rejected and FN_ON_FAILED called, default 25000 */
+EXTERNC NRFBLEAPI uint32_t auth_key_timeout_set(uint32_t timeout);
 EXTERNC NRFBLEAPI uint32_t service_discovery_start(uint16_t uuid, uint8_t type);
 /* read all report reference and set CCCD notification */
 EXTERNC NRFBLEAPI uint32_t service_enable_start();
@@ -86,21 +278,89 @@ len: given length of these lists, will be modified to actual length after return
 EXTERNC NRFBLEAPI uint32_t report_char_list(uint16_t *handle_list, uint8_t *refs_list, uint16_t *len);
 
 /* read data from given endpoint handle asynchronously
+value longer than ATT_MTU-1 is continued by read blob requests until a short response, up to 512 bytes
 retrieve response from fn_on_data_received callback */
 EXTERNC NRFBLEAPI uint32_t data_read_async(uint16_t handle);
 /* overload for data_read_async synchronously waiting read response in timeout ms
+return GATT_STATUS_ERROR_BASE + GATT status if the read or a read blob of long value failed,
+BLE_GATT_STATUS_UNKNOWN if cut by disconnection, data is not filled
 NOTICE: caller thread may be blocked until response or timeout */
 EXTERNC NRFBLEAPI uint32_t data_read(uint16_t handle, uint8_t *data, uint16_t *len, uint16_t timeout);
 /* overload for data_read by report reference data */
 EXTERNC NRFBLEAPI uint32_t data_read_by_report_ref(uint8_t *report_ref, uint8_t *data, uint16_t *len, uint16_t timeout);
 /* write data to given endpoint handle asynchronously
+value longer than ATT_MTU-3 is queued by prepared write requests and executed at once, up to 512 bytes
 retrieve response from fn_on_data_sent callback */
 EXTERNC NRFBLEAPI uint32_t data_write_async(uint16_t handle, uint8_t *data, uint16_t len);
 /* overload for write_data_async synchronously waiting write response in timeout ms
+return GATT_STATUS_ERROR_BASE + GATT status if the write or a part of prepared write failed,
+BLE_GATT_STATUS_UNKNOWN if a prepared write is cancelled by mismatched echo or cut by disconnection
 NOTICE: caller thread may be blocked until response or timeout */
 EXTERNC NRFBLEAPI uint32_t data_write(uint16_t handle, uint8_t *data, uint16_t len, uint16_t timeout);
 /* overload for data_write by report reference data */
 EXTERNC NRFBLEAPI uint32_t data_write_by_report_ref(uint8_t *report_ref, uint8_t *data, uint16_t len, uint16_t timeout);
+/* read values from given handles in one request(Read Multiple) asynchronously
+handles: at least 2 handles, up to (ATT_MTU-1)/2
+lens: value length of each handle since response has no length info, 0 for the rest of response(the last one usually)
+retrieve response from fn_on_data_batch_received callback */
+EXTERNC NRFBLEAPI uint32_t data_read_multiple(uint16_t *handles, uint16_t *lens, uint16_t count);
+/* read values of characteristics by uuid in handle range(Read by Type) asynchronously, e.g. 0x2A19 battery level
+type: 0x1(BLE_UUID_TYPE_BLE), start_handle, end_handle: 0x0001~0xFFFF for all
+retrieve response from fn_on_data_batch_received callback */
+EXTERNC NRFBLEAPI uint32_t data_read_by_uuid(uint16_t uuid, uint8_t type, uint16_t start_handle, uint16_t end_handle);
+
+/* preferred PHY of connections, tx_phys/rx_phys: bitmask of BLE_GAP_PHY_1MBPS(0x1), BLE_GAP_PHY_2MBPS(0x2), BLE_GAP_PHY_CODED(0x4),
+or 0(BLE_GAP_PHY_AUTO, default) let the controller pick the fastest PHY supported by both sides.
+applies to the current connection immediately, and to the following connections and peer PHY update requests */
+EXTERNC NRFBLEAPI uint32_t phy_set_preference(uint8_t tx_phys, uint8_t rx_phys);
+/* get active PHY of the current connection, refer to BLE_GAP_PHYS */
+EXTERNC NRFBLEAPI uint32_t phy_get(uint8_t *tx_phy, uint8_t *rx_phy);
+
+/* switch connection parameter profile, applies to the current connection immediately
+and to the following connections, refer to conn_param_profile_t */
+EXTERNC NRFBLEAPI uint32_t conn_param_profile_set(conn_param_profile_t profile);
+/* policy of connection parameter update request from peripheral, refer to conn_param_policy_t */
+EXTERNC NRFBLEAPI uint32_t conn_param_policy_set(conn_param_policy_t policy);
+/* get active connection parameters of the current connection
+interval: ms, latency: number of connection events, timeout: ms */
+EXTERNC NRFBLEAPI uint32_t conn_param_get(float *interval, uint16_t *latency, uint16_t *timeout);
+
+/* measure LESC key pair generation and DHKey computation of P-256 backend
+backend: 0(micro-ecc), 1(64-bit limbs, only on 64-bit build, the default one there)
+iterations: operations of each measurement, keygen_ops, ecdh_ops: operations per second
+return NRF_ERROR_NOT_SUPPORTED if backend is not built in */
+EXTERNC NRFBLEAPI uint32_t ecc_benchmark(uint8_t backend, uint32_t iterations, float *keygen_ops, float *ecdh_ops);
+/* known answer test of ECC backend by uECC public key and NIST ECDH vectors, works without dongle
+iterations: pairing crypto(own key pair, peer key validation, DHKey) runs to measure, pairing_us: average microseconds
+return NRF_ERROR_INTERNAL if any vector failed, NRF_ERROR_NOT_SUPPORTED if backend is not built in */
+EXTERNC NRFBLEAPI uint32_t ecc_selftest(uint8_t backend, uint32_t iterations, float *pairing_us);
+/* measure random bytes generation of OS CSPRNG used by key generation and nonces
+request_size: bytes of each request, e.g. 32 for a private key, total_size: bytes to generate */
+EXTERNC NRFBLEAPI uint32_t rng_benchmark(uint32_t request_size, uint32_t total_size, float *bytes_per_sec);
+/* validate P-256 public keys(LSB, as BLE_GAP_LESC_P256_PK_LEN each) across worker threads
+pks: count keys concatenated, results: count bytes, 1 for valid key
+threads: threads work on this batch including caller thread, 0 for all cores
+ops_per_sec: optional throughput of this batch */
+EXTERNC NRFBLEAPI uint32_t ecc_valid_public_key_batch(uint8_t *pks, uint32_t count, uint8_t *results, uint8_t threads, float *ops_per_sec);
+/* validate public keys and compute shared secrets(LSB, as BLE_GAP_LESC_DHKEY_LEN each) across worker threads
+sks: sk_count private keys, sk_count is 1 for the same private key of all public keys, or count
+pks: count public keys, secrets: count shared secrets, zeroed if failed, results: count bytes, 1 for success */
+EXTERNC NRFBLEAPI uint32_t ecc_shared_secret_batch(uint8_t *sks, uint32_t sk_count, uint8_t *pks, uint32_t count, uint8_t *secrets, uint8_t *results, uint8_t threads, float *ops_per_sec);
+
+/* OOB pairing data exchanged by caller before pairing(file, QR code, NFC), keyed by peer address,
+random and confirm are 16 bytes LSB as ble_gap_lesc_oob_data_t, each one is used by the next pairing only,
+auth_set_params(oob=true) to tell peer OOB data is present */
+/* LESC OOB data of peer received over OOB channel */
+EXTERNC NRFBLEAPI uint32_t oob_peer_set(uint8_t addr[6], uint8_t random[16], uint8_t confirm[16]);
+/* legacy pairing OOB temporary key of peer, replied to BLE_GAP_AUTH_KEY_TYPE_OOB request */
+EXTERNC NRFBLEAPI uint32_t oob_tk_set(uint8_t addr[6], uint8_t tk[16]);
+/* own LESC OOB data to send to peer, own key pair of the pairing is reserved by this call */
+EXTERNC NRFBLEAPI uint32_t oob_own_get(uint8_t addr[6], uint8_t random[16], uint8_t confirm[16]);
+/* remove OOB data of peer, NULL for all peers */
+EXTERNC NRFBLEAPI uint32_t oob_clear(uint8_t addr[6]);
+/* LESC OOB confirm f4(PKx, PKx, random, 0) of public key(LSB, as BLE_GAP_LESC_P256_PK_LEN),
+for verifying received OOB data or generating it by a scripted peer, works without dongle */
+EXTERNC NRFBLEAPI uint32_t oob_confirm_compute(uint8_t pk[64], uint8_t random[16], uint8_t confirm[16]);
 
 /* disconnect action will response status BLE_HCI_LOCAL_HOST_TERMINATED_CONNECTION from BLE_GAP_EVT_DISCONNECTED */
 EXTERNC NRFBLEAPI uint32_t dongle_disconnect();
@@ -109,3 +369,7 @@ refer to https://infocenter.nordicsemi.com/index.jsp?topic=%2Fps_nrf52840%2Fpowe
 refer to https://infocenter.nordicsemi.com/index.jsp?topic=%2Fcom.nordic.infocenter.sdk5.v15.3.0%2Fserialization_codecs.html
 */
 EXTERNC NRFBLEAPI uint32_t dongle_reset();
+/* stop scanning, disconnect all links at once and wait their disconnected events up to timeout(ms),
+then wait pending DHKey replies, store bonds and GATT caches, and close adapter as dongle_reset,
+return NRF_ERROR_TIMEOUT if links are dropped by deadline(adapter is closed anyway), elapsed_ms can be NULL */
+EXTERNC NRFBLEAPI uint32_t dongle_shutdown(uint32_t timeout, uint32_t* elapsed_ms);
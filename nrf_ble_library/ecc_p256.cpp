@@ -0,0 +1,616 @@
+#include "ecc_p256.h"
+#include "security.h"
+
+#if ECC_P256_64_SUPPORTED
+
+#include "uECC/uECC.h"
+
+#include <string.h>
+#include <mutex>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// field element and scalar in 4 little endian 64-bit limbs,
+// field elements are kept in Montgomery form a*R mod p with R=2^256
+typedef uint64_t fe_t[4];
+
+// Jacobian point (X/Z^2, Y/Z^3), Z=0 is infinity
+typedef struct _jpoint_t {
+	fe_t x;
+	fe_t y;
+	fe_t z;
+} jpoint_t;
+
+// affine point for precomputed tables
+typedef struct _apoint_t {
+	fe_t x;
+	fe_t y;
+} apoint_t;
+
+static const fe_t P = { 0xFFFFFFFFFFFFFFFFull, 0x00000000FFFFFFFFull, 0x0000000000000000ull, 0xFFFFFFFF00000001ull };
+static const fe_t N = { 0xF3B9CAC2FC632551ull, 0xBCE6FAADA7179E84ull, 0xFFFFFFFFFFFFFFFFull, 0xFFFFFFFF00000000ull };
+// R^2 mod p, converts into Montgomery form
+static const fe_t RR = { 0x0000000000000003ull, 0xFFFFFFFBFFFFFFFFull, 0xFFFFFFFFFFFFFFFEull, 0x00000004FFFFFFFDull };
+// R mod p, one in Montgomery form
+static const fe_t ONE = { 0x0000000000000001ull, 0xFFFFFFFF00000000ull, 0xFFFFFFFFFFFFFFFFull, 0x00000000FFFFFFFEull };
+static const fe_t B = { 0x3BCE3C3E27D2604Bull, 0x651D06B0CC53B0F6ull, 0xB3EBBD55769886BCull, 0x5AC635D8AA3A93E7ull };
+static const fe_t GX = { 0xF4A13945D898C296ull, 0x77037D812DEB33A0ull, 0xF8BCE6E563A440F2ull, 0x6B17D1F2E12C4247ull };
+static const fe_t GY = { 0xCBB6406837BF51F5ull, 0x2BCE33576B315ECEull, 0x8EE7EB4A7C0F9E16ull, 0x4FE342E2FE1A7F9Bull };
+
+/* 64-bit word arithmetic */
+
+// a*b+c+d, return low word and high word in hi, never overflows 128 bits
+static inline uint64_t mac(uint64_t a, uint64_t b, uint64_t c, uint64_t d, uint64_t* hi) {
+#if defined(_MSC_VER)
+#if defined(_M_X64)
+	uint64_t h;
+	uint64_t l = _umul128(a, b, &h);
+#else
+	uint64_t h = __umulh(a, b);
+	uint64_t l = a * b;
+#endif
+	l += c;
+	h += (l < c);
+	l += d;
+	h += (l < d);
+	*hi = h;
+	return l;
+#else
+	unsigned __int128 t = (unsigned __int128)a * b + c + d;
+	*hi = (uint64_t)(t >> 64);
+	return (uint64_t)t;
+#endif
+}
+
+// a+b+carry, carry may be any word and returns the carry out
+static inline uint64_t adc(uint64_t a, uint64_t b, uint64_t* carry) {
+#if defined(_MSC_VER)
+	uint64_t s = a + b;
+	uint64_t c = (s < a);
+	s += *carry;
+	c += (s < *carry);
+	*carry = c;
+	return s;
+#else
+	unsigned __int128 t = (unsigned __int128)a + b + *carry;
+	*carry = (uint64_t)(t >> 64);
+	return (uint64_t)t;
+#endif
+}
+
+static inline uint64_t sbb(uint64_t a, uint64_t b, uint64_t* borrow) {
+	uint64_t d = a - b;
+	uint64_t c = (a < b);
+	c += (d < *borrow);
+	d -= *borrow;
+	*borrow = c;
+	return d;
+}
+
+// r = mask ? a : r, mask is all 0 or all 1 bits
+static inline void fe_cmov(fe_t r, const fe_t a, uint64_t mask) {
+	for (int i = 0; i < 4; i++)
+		r[i] ^= mask & (r[i] ^ a[i]);
+}
+
+static inline uint64_t fe_is_zero(const fe_t a) {
+	uint64_t t = a[0] | a[1] | a[2] | a[3];
+	// all 1 bits if zero
+	return ((t | (0 - t)) >> 63) - 1;
+}
+
+static inline int fe_lt(const fe_t a, const fe_t m) {
+	uint64_t borrow = 0;
+	for (int i = 0; i < 4; i++)
+		sbb(a[i], m[i], &borrow);
+	return (int)borrow;
+}
+
+/* field arithmetic mod p */
+
+// t + hi*2^256 reduced by one conditional subtraction of p
+static inline void fe_reduce_once(fe_t r, const uint64_t t[4], uint64_t hi) {
+	fe_t s;
+	uint64_t borrow = 0;
+	for (int i = 0; i < 4; i++)
+		s[i] = sbb(t[i], P[i], &borrow);
+	// keep t only if t < p, that is no carry above 256 bits and subtraction borrowed
+	sbb(hi, 0, &borrow);
+	uint64_t mask = 0 - borrow;
+	for (int i = 0; i < 4; i++)
+		r[i] = (s[i] & ~mask) | (t[i] & mask);
+}
+
+static void fe_add(fe_t r, const fe_t a, const fe_t b) {
+	uint64_t t[4];
+	uint64_t carry = 0;
+	for (int i = 0; i < 4; i++)
+		t[i] = adc(a[i], b[i], &carry);
+	fe_reduce_once(r, t, carry);
+}
+
+static void fe_sub(fe_t r, const fe_t a, const fe_t b) {
+	uint64_t t[4];
+	uint64_t borrow = 0;
+	for (int i = 0; i < 4; i++)
+		t[i] = sbb(a[i], b[i], &borrow);
+	// add p back if borrowed
+	uint64_t mask = 0 - borrow;
+	uint64_t carry = 0;
+	for (int i = 0; i < 4; i++)
+		r[i] = adc(t[i], P[i] & mask, &carry);
+}
+
+// Montgomery reduction t*R^-1 mod p of 512-bit t, -p^-1 mod 2^64 is 1 for P-256
+static void fe_mont_reduce(fe_t r, uint64_t t[8]) {
+	uint64_t top = 0;
+	for (int i = 0; i < 4; i++) {
+		uint64_t m = t[i];
+		// m*p[0]+t[i] is m*2^64 since p[0] = 2^64-1,
+		// then m*p[1]+m is m*2^32 since p[1] = 2^32-1, and p[2] = 0, only p[3] needs a multiplication
+		uint64_t c = 0;
+		t[i + 1] = adc(t[i + 1], m << 32, &c);
+		c += m >> 32;
+		t[i + 2] = adc(t[i + 2], 0, &c);
+		t[i + 3] = mac(m, P[3], t[i + 3], c, &c);
+		uint64_t s = t[i + 4] + c;
+		uint64_t c1 = (s < c);
+		s += top;
+		c1 += (s < top);
+		t[i + 4] = s;
+		top = c1;
+	}
+	fe_reduce_once(r, &t[4], top);
+}
+
+static void fe_mul(fe_t r, const fe_t a, const fe_t b) {
+	uint64_t t[8];
+	uint64_t c;
+	for (int i = 0; i < 4; i++) {
+		c = 0;
+		for (int j = 0; j < 4; j++)
+			t[i + j] = mac(a[i], b[j], i == 0 ? 0 : t[i + j], c, &c);
+		t[i + 4] = c;
+	}
+	fe_mont_reduce(r, t);
+}
+
+// dedicated square, cross products computed once and doubled
+static void fe_sqr(fe_t r, const fe_t a) {
+	uint64_t t[8] = { 0 };
+	uint64_t c;
+	for (int i = 0; i < 3; i++) {
+		c = 0;
+		for (int j = i + 1; j < 4; j++)
+			t[i + j] = mac(a[i], a[j], t[i + j], c, &c);
+		t[i + 4] = c;
+	}
+	// double cross products
+	for (int i = 7; i > 0; i--)
+		t[i] = (t[i] << 1) | (t[i - 1] >> 63);
+	t[0] <<= 1;
+	// add squares on diagonal
+	c = 0;
+	for (int i = 0; i < 4; i++) {
+		uint64_t hi;
+		uint64_t lo = mac(a[i], a[i], 0, 0, &hi);
+		t[2 * i] = adc(t[2 * i], lo, &c);
+		t[2 * i + 1] = adc(t[2 * i + 1], hi, &c);
+	}
+	fe_mont_reduce(r, t);
+}
+
+static void fe_to_mont(fe_t r, const fe_t a) {
+	fe_mul(r, a, RR);
+}
+
+static void fe_from_mont(fe_t r, const fe_t a) {
+	uint64_t t[8] = { a[0], a[1], a[2], a[3], 0, 0, 0, 0 };
+	fe_mont_reduce(r, t);
+}
+
+// r = a^(p-2), exponent is public so plain square and multiply
+static void fe_inv(fe_t r, const fe_t a) {
+	static const fe_t e = { 0xFFFFFFFFFFFFFFFDull, 0x00000000FFFFFFFFull, 0x0000000000000000ull, 0xFFFFFFFF00000001ull };
+	fe_t x;
+	memcpy(x, ONE, sizeof(fe_t));
+	for (int i = 255; i >= 0; i--) {
+		fe_sqr(x, x);
+		if ((e[i / 64] >> (i % 64)) & 1)
+			fe_mul(x, x, a);
+	}
+	memcpy(r, x, sizeof(fe_t));
+}
+
+static void fe_from_bytes(fe_t r, const uint8_t* be) {
+	for (int i = 0; i < 4; i++) {
+		uint64_t w = 0;
+		for (int j = 0; j < 8; j++)
+			w = (w << 8) | be[(3 - i) * 8 + j];
+		r[i] = w;
+	}
+}
+
+static void fe_to_bytes(uint8_t* be, const fe_t a) {
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 8; j++)
+			be[(3 - i) * 8 + j] = (uint8_t)(a[i] >> (56 - j * 8));
+	}
+}
+
+/* point arithmetic, curve a=-3 */
+
+// dbl-2001-b
+static void point_double(jpoint_t* r, const jpoint_t* p) {
+	fe_t delta, gamma, beta, alpha, t0, t1;
+	fe_sqr(delta, p->z);
+	fe_sqr(gamma, p->y);
+	fe_mul(beta, p->x, gamma);
+	// alpha = 3*(x-delta)*(x+delta)
+	fe_sub(t0, p->x, delta);
+	fe_add(t1, p->x, delta);
+	fe_mul(alpha, t0, t1);
+	fe_add(t0, alpha, alpha);
+	fe_add(alpha, t0, alpha);
+	// z3 = (y+z)^2-gamma-delta
+	fe_add(t0, p->y, p->z);
+	fe_sqr(t0, t0);
+	fe_sub(t0, t0, gamma);
+	fe_sub(r->z, t0, delta);
+	// x3 = alpha^2-8*beta
+	fe_add(beta, beta, beta);
+	fe_add(beta, beta, beta);
+	fe_add(t1, beta, beta);
+	fe_sqr(t0, alpha);
+	fe_sub(r->x, t0, t1);
+	// y3 = alpha*(4*beta-x3)-8*gamma^2
+	fe_sub(t0, beta, r->x);
+	fe_mul(t0, alpha, t0);
+	fe_sqr(gamma, gamma);
+	fe_add(gamma, gamma, gamma);
+	fe_add(gamma, gamma, gamma);
+	fe_add(gamma, gamma, gamma);
+	fe_sub(r->y, t0, gamma);
+}
+
+// add-2007-bl, caller handles infinity and p == q, both are excluded by scalar range and window selection
+static void point_add(jpoint_t* r, const jpoint_t* p, const jpoint_t* q) {
+	fe_t z1z1, z2z2, u1, u2, s1, s2, h, i, j, rr, v, t0;
+	fe_sqr(z1z1, p->z);
+	fe_sqr(z2z2, q->z);
+	fe_mul(u1, p->x, z2z2);
+	fe_mul(u2, q->x, z1z1);
+	fe_mul(s1, p->y, q->z);
+	fe_mul(s1, s1, z2z2);
+	fe_mul(s2, q->y, p->z);
+	fe_mul(s2, s2, z1z1);
+	fe_sub(h, u2, u1);
+	fe_add(i, h, h);
+	fe_sqr(i, i);
+	fe_mul(j, h, i);
+	fe_sub(rr, s2, s1);
+	fe_add(rr, rr, rr);
+	fe_mul(v, u1, i);
+	// x3 = r^2-j-2*v
+	fe_sqr(t0, rr);
+	fe_sub(t0, t0, j);
+	fe_sub(t0, t0, v);
+	fe_sub(r->x, t0, v);
+	// y3 = r*(v-x3)-2*s1*j
+	fe_sub(t0, v, r->x);
+	fe_mul(t0, rr, t0);
+	fe_mul(s1, s1, j);
+	fe_add(s1, s1, s1);
+	fe_sub(r->y, t0, s1);
+	// z3 = ((z1+z2)^2-z1z1-z2z2)*h
+	fe_add(t0, p->z, q->z);
+	fe_sqr(t0, t0);
+	fe_sub(t0, t0, z1z1);
+	fe_sub(t0, t0, z2z2);
+	fe_mul(r->z, t0, h);
+}
+
+// madd-2007-bl, q is affine
+static void point_add_affine(jpoint_t* r, const jpoint_t* p, const apoint_t* q) {
+	fe_t z1z1, u2, s2, h, hh, i, j, rr, v, t0;
+	fe_sqr(z1z1, p->z);
+	fe_mul(u2, q->x, z1z1);
+	fe_mul(s2, q->y, p->z);
+	fe_mul(s2, s2, z1z1);
+	fe_sub(h, u2, p->x);
+	fe_sqr(hh, h);
+	fe_add(i, hh, hh);
+	fe_add(i, i, i);
+	fe_mul(j, h, i);
+	fe_sub(rr, s2, p->y);
+	fe_add(rr, rr, rr);
+	fe_mul(v, p->x, i);
+	// x3 = r^2-j-2*v
+	fe_sqr(t0, rr);
+	fe_sub(t0, t0, j);
+	fe_sub(t0, t0, v);
+	fe_sub(r->x, t0, v);
+	// y3 = r*(v-x3)-2*y1*j
+	fe_sub(t0, v, r->x);
+	fe_mul(t0, rr, t0);
+	fe_mul(j, p->y, j);
+	fe_add(j, j, j);
+	fe_sub(r->y, t0, j);
+	// z3 = (z1+h)^2-z1z1-hh
+	fe_add(t0, p->z, h);
+	fe_sqr(t0, t0);
+	fe_sub(t0, t0, z1z1);
+	fe_sub(r->z, t0, hh);
+}
+
+static void point_cmov(jpoint_t* r, const jpoint_t* a, uint64_t mask) {
+	fe_cmov(r->x, a->x, mask);
+	fe_cmov(r->y, a->y, mask);
+	fe_cmov(r->z, a->z, mask);
+}
+
+// affine coordinates out of Montgomery form
+static void point_to_affine(fe_t x, fe_t y, const jpoint_t* p) {
+	fe_t zi, zi2;
+	fe_inv(zi, p->z);
+	fe_sqr(zi2, zi);
+	fe_mul(x, p->x, zi2);
+	fe_mul(zi2, zi2, zi);
+	fe_mul(y, p->y, zi2);
+	fe_from_mont(x, x);
+	fe_from_mont(y, y);
+}
+
+// y^2 = x^3-3x+b, both in Montgomery form
+static int point_on_curve(const fe_t x, const fe_t y) {
+	fe_t lhs, rhs, t0;
+	fe_sqr(lhs, y);
+	fe_sqr(rhs, x);
+	fe_mul(rhs, rhs, x);
+	fe_add(t0, x, x);
+	fe_add(t0, t0, x);
+	fe_sub(rhs, rhs, t0);
+	fe_to_mont(t0, B);
+	fe_add(rhs, rhs, t0);
+	fe_sub(t0, lhs, rhs);
+	return fe_is_zero(t0) != 0;
+}
+
+static inline uint32_t scalar_nibble(const fe_t k, int i) {
+	return (uint32_t)(k[i / 16] >> ((i % 16) * 4)) & 0xF;
+}
+
+// mask of all 1 bits if a == b
+static inline uint64_t eq_mask(uint32_t a, uint32_t b) {
+	uint64_t t = a ^ b;
+	return ((t | (0 - t)) >> 63) - 1;
+}
+
+/* fixed base comb table for k*G, table[i][j-1] = j*16^i*G in affine Montgomery form */
+
+#define BASE_WINDOWS 64
+static apoint_t m_base_table[BASE_WINDOWS][15];
+static std::once_flag m_base_table_once;
+
+static void base_table_build() {
+	jpoint_t base;
+	fe_to_mont(base.x, GX);
+	fe_to_mont(base.y, GY);
+	memcpy(base.z, ONE, sizeof(fe_t));
+
+	jpoint_t row[15];
+	fe_t acc[15];
+	fe_t inv;
+	for (int i = 0; i < BASE_WINDOWS; i++) {
+		row[0] = base;
+		point_double(&row[1], &base);
+		for (int j = 2; j < 15; j++)
+			point_add(&row[j], &row[j - 1], &base);
+
+		// batch inversion of all Z in a row by Montgomery trick
+		memcpy(acc[0], row[0].z, sizeof(fe_t));
+		for (int j = 1; j < 15; j++)
+			fe_mul(acc[j], acc[j - 1], row[j].z);
+		fe_inv(inv, acc[14]);
+		for (int j = 14; j >= 0; j--) {
+			fe_t zi, zi2;
+			if (j > 0) {
+				fe_mul(zi, inv, acc[j - 1]);
+				fe_mul(inv, inv, row[j].z);
+			}
+			else {
+				memcpy(zi, inv, sizeof(fe_t));
+			}
+			fe_sqr(zi2, zi);
+			fe_mul(m_base_table[i][j].x, row[j].x, zi2);
+			fe_mul(zi2, zi2, zi);
+			fe_mul(m_base_table[i][j].y, row[j].y, zi2);
+		}
+
+		// next window base = 16*base
+		for (int j = 0; j < 4; j++)
+			point_double(&base, &base);
+	}
+}
+
+// r = k*G, 0 < k < n
+static void scalar_mult_base(jpoint_t* r, const fe_t k) {
+	std::call_once(m_base_table_once, base_table_build);
+
+	jpoint_t acc;
+	memset(&acc, 0, sizeof(acc));
+	uint64_t acc_inf = ~0ull;
+	for (int i = 0; i < BASE_WINDOWS; i++) {
+		uint32_t d = scalar_nibble(k, i);
+		// scan whole row to not leak the digit by memory access
+		apoint_t t;
+		memset(&t, 0, sizeof(t));
+		for (uint32_t j = 1; j < 16; j++) {
+			uint64_t mask = eq_mask(d, j);
+			fe_cmov(t.x, m_base_table[i][j - 1].x, mask);
+			fe_cmov(t.y, m_base_table[i][j - 1].y, mask);
+		}
+
+		jpoint_t sum, tj;
+		point_add_affine(&sum, &acc, &t);
+		memcpy(tj.x, t.x, sizeof(fe_t));
+		memcpy(tj.y, t.y, sizeof(fe_t));
+		memcpy(tj.z, ONE, sizeof(fe_t));
+
+		uint64_t nonzero = ~eq_mask(d, 0);
+		point_cmov(&sum, &tj, acc_inf);
+		point_cmov(&acc, &sum, nonzero);
+		acc_inf &= ~nonzero;
+	}
+	*r = acc;
+}
+
+// r = k*p, 0 < k < n, 4-bit fixed window from most significant digit
+static void scalar_mult(jpoint_t* r, const fe_t k, const jpoint_t* p) {
+	jpoint_t table[16];
+	memset(&table[0], 0, sizeof(jpoint_t));
+	table[1] = *p;
+	point_double(&table[2], p);
+	for (int j = 3; j < 16; j++)
+		point_add(&table[j], &table[j - 1], p);
+
+	jpoint_t acc;
+	memset(&acc, 0, sizeof(acc));
+	uint64_t acc_inf = ~0ull;
+	for (int i = 63; i >= 0; i--) {
+		for (int j = 0; j < 4; j++)
+			point_double(&acc, &acc);
+
+		uint32_t d = scalar_nibble(k, i);
+		jpoint_t t;
+		memset(&t, 0, sizeof(t));
+		for (uint32_t j = 1; j < 16; j++)
+			point_cmov(&t, &table[j], eq_mask(d, j));
+
+		jpoint_t sum;
+		point_add(&sum, &acc, &t);
+
+		uint64_t nonzero = ~eq_mask(d, 0);
+		point_cmov(&sum, &t, acc_inf);
+		point_cmov(&acc, &sum, nonzero);
+		acc_inf &= ~nonzero;
+	}
+	*r = acc;
+	secure_zero(table, sizeof(table));
+}
+
+static int scalar_from_bytes(fe_t k, const uint8_t* be) {
+	fe_from_bytes(k, be);
+	// private key must be in range [1, n-1]
+	if (fe_is_zero(k) || !fe_lt(k, N))
+		return 0;
+	return 1;
+}
+
+static int point_from_bytes(fe_t x, fe_t y, const uint8_t* be) {
+	fe_from_bytes(x, be);
+	fe_from_bytes(y, be + 32);
+	if (!fe_lt(x, P) || !fe_lt(y, P))
+		return 0;
+	if (fe_is_zero(x) && fe_is_zero(y))
+		return 0;
+	fe_to_mont(x, x);
+	fe_to_mont(y, y);
+	return 1;
+}
+
+// micro-ecc rejects private keys 1, n-2 and n-1 its co-Z ladder can not handle, they are rejected here
+// as well so both backends accept the same keys, which is checked by uECC test vectors
+static int scalar_uecc_rejected(const fe_t k) {
+	if (k[0] == 1 && k[1] == 0 && k[2] == 0 && k[3] == 0)
+		return 1;
+	return k[1] == N[1] && k[2] == N[2] && k[3] == N[3] && (k[0] == N[0] - 1 || k[0] == N[0] - 2);
+}
+
+int p256_64_compute_public_key(const uint8_t* private_key, uint8_t* public_key) {
+	fe_t k, x, y;
+	if (!scalar_from_bytes(k, private_key) || scalar_uecc_rejected(k)) {
+		secure_zero(k, sizeof(k));
+		return 0;
+	}
+
+	jpoint_t r;
+	scalar_mult_base(&r, k);
+	point_to_affine(x, y, &r);
+	fe_to_bytes(public_key, x);
+	fe_to_bytes(public_key + 32, y);
+	secure_zero(k, sizeof(k));
+	return 1;
+}
+
+int p256_64_make_key(uint8_t* public_key, uint8_t* private_key) {
+	uECC_RNG_Function rng = uECC_get_rng();
+	if (rng == NULL)
+		return 0;
+
+	uint8_t sk[32];
+	// rejection sampling, chance of out of range is about 2^-32 per try
+	for (int tries = 0; tries < 64; tries++) {
+		if (!rng(sk, sizeof(sk)))
+			return 0;
+		if (p256_64_compute_public_key(sk, public_key)) {
+			memcpy(private_key, sk, sizeof(sk));
+			secure_zero(sk, sizeof(sk));
+			return 1;
+		}
+	}
+	secure_zero(sk, sizeof(sk));
+	return 0;
+}
+
+int p256_64_valid_public_key(const uint8_t* public_key) {
+	fe_t x, y;
+	if (!point_from_bytes(x, y, public_key))
+		return 0;
+	return point_on_curve(x, y);
+}
+
+int p256_64_shared_secret(const uint8_t* public_key, const uint8_t* private_key, uint8_t* secret) {
+	fe_t k, x, y;
+	if (!scalar_from_bytes(k, private_key))
+		return 0;
+	// reject invalid curve points rather than leaking k over a weak curve
+	if (!point_from_bytes(x, y, public_key) || !point_on_curve(x, y))
+		return 0;
+
+	jpoint_t p;
+	memcpy(p.x, x, sizeof(fe_t));
+	memcpy(p.y, y, sizeof(fe_t));
+	memcpy(p.z, ONE, sizeof(fe_t));
+
+	// randomize projective coordinates (X*l^2, Y*l^3, l) as uECC does with its rng
+	uECC_RNG_Function rng = uECC_get_rng();
+	uint8_t l_be[32];
+	fe_t l, l2;
+	if (rng != NULL && rng(l_be, sizeof(l_be))) {
+		fe_from_bytes(l, l_be);
+		if (!fe_is_zero(l) && fe_lt(l, P)) {
+			fe_to_mont(l, l);
+			fe_sqr(l2, l);
+			fe_mul(p.x, p.x, l2);
+			fe_mul(l2, l2, l);
+			fe_mul(p.y, p.y, l2);
+			memcpy(p.z, l, sizeof(fe_t));
+		}
+	}
+
+	jpoint_t r;
+	scalar_mult(&r, k, &p);
+	secure_zero(k, sizeof(k));
+	// k*p is infinity only if p is not on curve or has small order
+	if (fe_is_zero(r.z))
+		return 0;
+
+	point_to_affine(x, y, &r);
+	fe_to_bytes(secret, x);
+	return 1;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+#include <stdint.h>
+
+// P-256 backend with 64-bit limbs and Montgomery reduction for 64-bit hosts,
+// keys and points are big endian bytes as uECC, public key is x|y without prefix
+
+#if (defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))) || \
+	(!defined(_MSC_VER) && defined(__SIZEOF_INT128__))
+#define ECC_P256_64_SUPPORTED 1
+#else
+#define ECC_P256_64_SUPPORTED 0
+#endif
+
+#if ECC_P256_64_SUPPORTED
+// random private key and its public key, by rng from uECC_get_rng()
+int p256_64_make_key(uint8_t* public_key, uint8_t* private_key);
+// given private key to get public key
+int p256_64_compute_public_key(const uint8_t* private_key, uint8_t* public_key);
+// public key is a point on curve
+int p256_64_valid_public_key(const uint8_t* public_key);
+// x coordinate of private key * public key
+int p256_64_shared_secret(const uint8_t* public_key, const uint8_t* private_key, uint8_t* secret);
+#endif
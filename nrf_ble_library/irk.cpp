@@ -0,0 +1,143 @@
+#include "irk.h"
+#include "aes.h"
+#include "security.h"
+
+#include <string.h>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+/* ah(k, r) = e(k, padding || r) mod 2^24, k and r in big-endian for AES */
+static int ah_match(const aes_key_t* key, const uint8_t addr[6]) {
+	uint8_t r[16] = { 0 };
+	r[13] = addr[5];
+	r[14] = addr[4];
+	r[15] = addr[3];
+	uint8_t e[16];
+	aes_encrypt(key, r, e);
+	return e[15] == addr[0] && e[14] == addr[1] && e[13] == addr[2] ? 1 : 0;
+}
+
+static void aes_key_from_irk(aes_key_t* key, const uint8_t irk[IRK_LEN]) {
+	uint8_t k[16];
+	for (int i = 0; i < 16; i++)
+		k[i] = irk[15 - i];
+	aes_expand_key(key, k);
+	secure_zero(k, sizeof(k));
+}
+
+typedef struct _irk_entry_t {
+	uint64_t id;
+	aes_key_t key;
+} irk_entry_t;
+
+static std::mutex m_mtx_irk;
+static std::vector<irk_entry_t> m_irk_table;
+/* address to index of IRK table, -1 if not resolved by any */
+static std::unordered_map<uint64_t, int32_t> m_irk_cache;
+
+static uint64_t addr_to_uint64(const uint8_t addr[6]) {
+	uint64_t num = 0;
+	for (int i = 5; i >= 0; --i)
+		num = (num << 8) | addr[i];
+	return num;
+}
+
+int irk_table_add(uint64_t id, const uint8_t irk[IRK_LEN]) {
+	if (irk == NULL)
+		return 0;
+	irk_entry_t entry{};
+	entry.id = id;
+	aes_key_from_irk(&entry.key, irk);
+
+	std::lock_guard<std::mutex> lck(m_mtx_irk);
+	bool found = false;
+	for (auto& e : m_irk_table) {
+		if (e.id == id) {
+			e.key = entry.key;
+			found = true;
+			break;
+		}
+	}
+	if (!found)
+		m_irk_table.push_back(entry);
+	secure_zero(&entry.key, sizeof(entry.key));
+	// unresolved addresses may belong to the new IRK
+	m_irk_cache.clear();
+	return 1;
+}
+
+int irk_table_remove(uint64_t id) {
+	std::lock_guard<std::mutex> lck(m_mtx_irk);
+	for (auto it = m_irk_table.begin(); it != m_irk_table.end(); it++) {
+		if (it->id == id) {
+			secure_zero(&it->key, sizeof(it->key));
+			m_irk_table.erase(it);
+			m_irk_cache.clear();
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void irk_table_clear() {
+	std::lock_guard<std::mutex> lck(m_mtx_irk);
+	for (auto& e : m_irk_table)
+		secure_zero(&e.key, sizeof(e.key));
+	m_irk_table.clear();
+	m_irk_cache.clear();
+}
+
+uint32_t irk_table_size() {
+	std::lock_guard<std::mutex> lck(m_mtx_irk);
+	return (uint32_t)m_irk_table.size();
+}
+
+int irk_is_resolvable(const uint8_t addr[6]) {
+	// two most significant bits of random part are 0b01
+	return addr != NULL && (addr[5] & 0xC0) == 0x40 ? 1 : 0;
+}
+
+int irk_resolve(const uint8_t addr[6], uint64_t* id) {
+	if (irk_is_resolvable(addr) == 0)
+		return 0;
+
+	uint64_t addr_num = addr_to_uint64(addr);
+	std::lock_guard<std::mutex> lck(m_mtx_irk);
+	if (m_irk_table.empty())
+		return 0;
+
+	int32_t idx = -1;
+	auto cached = m_irk_cache.find(addr_num);
+	if (cached != m_irk_cache.end()) {
+		idx = cached->second;
+	}
+	else {
+		for (size_t i = 0; i < m_irk_table.size(); i++) {
+			if (ah_match(&m_irk_table[i].key, addr)) {
+				idx = (int32_t)i;
+				break;
+			}
+		}
+		// addresses of other devices rotate too, drop all rather than tracking age
+		if (m_irk_cache.size() >= IRK_CACHE_SIZE)
+			m_irk_cache.clear();
+		m_irk_cache[addr_num] = idx;
+	}
+
+	if (idx < 0)
+		return 0;
+	if (id)
+		*id = m_irk_table[idx].id;
+	return 1;
+}
+
+int irk_ah_match(const uint8_t irk[IRK_LEN], const uint8_t addr[6]) {
+	if (irk == NULL || addr == NULL)
+		return 0;
+	aes_key_t key;
+	aes_key_from_irk(&key, irk);
+	int res = ah_match(&key, addr);
+	secure_zero(&key, sizeof(key));
+	return res;
+}
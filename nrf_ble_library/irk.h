@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// resolvable private address resolution by IRKs of bonded peers,
+// ah() hashes are computed by AES-128 with key schedules expanded once per IRK,
+// results are cached per address so repeated advertising reports cost one lookup
+
+#define IRK_LEN 16 /*BLE_GAP_SEC_KEY_LEN*/
+#define IRK_CACHE_SIZE 256
+
+// add or replace IRK(little-endian as ble_gap_irk_t) of the peer identified by id, return 0 on failure
+int irk_table_add(uint64_t id, const uint8_t irk[IRK_LEN]);
+// remove IRK of the peer, return 1 if existed
+int irk_table_remove(uint64_t id);
+// remove all IRKs and cached results
+void irk_table_clear();
+// number of IRKs in table
+uint32_t irk_table_size();
+
+// check address(little-endian as ble_gap_addr_t::addr) is a resolvable private address
+int irk_is_resolvable(const uint8_t addr[6]);
+// resolve address to peer id by IRK table, return 1 if resolved
+int irk_resolve(const uint8_t addr[6], uint64_t* id);
+// ah() of bluetooth core spec Vol 3 Part H 2.2.2, hash and prand in little-endian, return 1 if matched
+int irk_ah_match(const uint8_t irk[IRK_LEN], const uint8_t addr[6]);
@@ -0,0 +1,111 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+// MSVC secure CRT functions used by library sources, mapped to POSIX/C99 ones on other compilers,
+// truncate instead of invoking invalid parameter handler as MSVC does, sizes still bound every copy
+
+#if !defined(_MSC_VER)
+
+#ifndef __STDC_LIB_EXT1__
+typedef int errno_t;
+#endif
+
+inline errno_t memcpy_s(void* dest, size_t dest_size, const void* src, size_t count)
+{
+	if (dest == NULL)
+		return EINVAL;
+	if (src == NULL || dest_size < count) {
+		memset(dest, 0, dest_size);
+		return src == NULL ? EINVAL : ERANGE;
+	}
+	memcpy(dest, src, count);
+	return 0;
+}
+
+inline errno_t fopen_s(FILE** file, const char* path, const char* mode)
+{
+	if (file == NULL)
+		return EINVAL;
+	*file = fopen(path, mode);
+	return *file == NULL ? errno : 0;
+}
+
+inline errno_t localtime_s(struct tm* result, const time_t* time)
+{
+	return localtime_r(time, result) == NULL ? EINVAL : 0;
+}
+
+inline errno_t strcpy_s(char* dest, size_t dest_size, const char* src)
+{
+	if (dest == NULL || dest_size == 0)
+		return EINVAL;
+	size_t len = strlen(src);
+	if (len >= dest_size) {
+		dest[0] = 0;
+		return ERANGE;
+	}
+	memcpy(dest, src, len + 1);
+	return 0;
+}
+
+inline errno_t strcat_s(char* dest, size_t dest_size, const char* src)
+{
+	if (dest == NULL || dest_size == 0)
+		return EINVAL;
+	size_t len = strnlen(dest, dest_size);
+	if (len == dest_size)
+		return EINVAL;
+	return strcpy_s(dest + len, dest_size - len, src);
+}
+
+inline int vsprintf_s(char* buffer, size_t size, const char* format, va_list args)
+{
+	return vsnprintf(buffer, size, format, args);
+}
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wformat-security"
+#pragma GCC diagnostic ignored "-Wformat-nonliteral"
+template <typename... Args>
+inline int sprintf_s(char* buffer, size_t size, const char* format, Args... args)
+{
+	return snprintf(buffer, size, format, args...);
+}
+#pragma GCC diagnostic pop
+
+// size deduced from array as the template overloads of MSVC
+template <size_t N>
+inline errno_t strcpy_s(char (&dest)[N], const char* src)
+{
+	return strcpy_s(dest, N, src);
+}
+
+template <size_t N>
+inline errno_t strcat_s(char (&dest)[N], const char* src)
+{
+	return strcat_s(dest, N, src);
+}
+
+template <size_t N>
+inline int vsprintf_s(char (&buffer)[N], const char* format, va_list args)
+{
+	return vsprintf_s(buffer, N, format, args);
+}
+
+template <size_t N, typename... Args>
+inline int sprintf_s(char (&buffer)[N], const char* format, Args... args)
+{
+	return sprintf_s(buffer, N, format, args...);
+}
+
+#define strtok_s strtok_r
+#define __crt_va_start va_start
+#define __crt_va_end va_end
+
+#endif
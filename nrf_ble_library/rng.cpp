@@ -0,0 +1,104 @@
+#include "rng.h"
+#include "security.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#elif defined(__linux__)
+#include <sys/random.h>
+#include <errno.h>
+#else
+#include <stdio.h>
+#endif
+
+#include <string.h>
+#include <vector>
+#include <chrono>
+
+static int rng_os_fill(uint8_t* dest, uint32_t len) {
+#if defined(_WIN32)
+	return BCryptGenRandom(NULL, dest, len, BCRYPT_USE_SYSTEM_PREFERRED_RNG) == 0 ? 1 : 0;
+#elif defined(__linux__)
+	while (len > 0) {
+		// up to 256 bytes never interrupted, larger one may return partially
+		ssize_t n = getrandom(dest, len, 0);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		dest += n;
+		len -= (uint32_t)n;
+	}
+	return 1;
+#else
+	FILE* f = fopen("/dev/urandom", "rb");
+	if (f == NULL)
+		return 0;
+	size_t n = fread(dest, 1, len, f);
+	fclose(f);
+	return n == len ? 1 : 0;
+#endif
+}
+
+/* per thread block, so key pool and DHKey workers do not contend on a lock */
+typedef struct _rng_block_t {
+	uint8_t data[RNG_BLOCK_SIZE];
+	uint32_t pos = RNG_BLOCK_SIZE; /* consumed bytes, refill when reaches block size */
+	~_rng_block_t() {
+		secure_zero(data, sizeof(data));
+	}
+} rng_block_t;
+
+static thread_local rng_block_t m_block;
+
+int rng_fill(uint8_t* dest, uint32_t len) {
+	if (dest == NULL)
+		return 0;
+	// large request does not need buffering
+	if (len >= RNG_BLOCK_SIZE)
+		return rng_os_fill(dest, len);
+
+	while (len > 0) {
+		if (m_block.pos == RNG_BLOCK_SIZE) {
+			if (rng_os_fill(m_block.data, RNG_BLOCK_SIZE) == 0)
+				return 0;
+			m_block.pos = 0;
+		}
+
+		uint32_t n = RNG_BLOCK_SIZE - m_block.pos;
+		if (n > len)
+			n = len;
+		memcpy(dest, &m_block.data[m_block.pos], n);
+		// handed out bytes must not stay in memory
+		secure_zero(&m_block.data[m_block.pos], n);
+		m_block.pos += n;
+		dest += n;
+		len -= n;
+	}
+	return 1;
+}
+
+int rng_uecc(uint8_t* dest, unsigned size) {
+	return rng_fill(dest, size);
+}
+
+int rng_throughput(uint32_t request_size, uint32_t total, float* bytes_per_sec) {
+	if (request_size == 0 || total < request_size || bytes_per_sec == NULL)
+		return 0;
+
+	std::vector<uint8_t> buf(request_size);
+	uint32_t count = total / request_size;
+	int ret = 1;
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < count && ret == 1; i++)
+		ret = rng_fill(buf.data(), request_size);
+	std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+	secure_zero(buf.data(), buf.size());
+	if (ret != 1)
+		return 0;
+
+	*bytes_per_sec = elapsed.count() > 0 ? (float)count * request_size / elapsed.count() : 0;
+	return 1;
+}
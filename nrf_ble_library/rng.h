@@ -0,0 +1,14 @@
+#pragma once
+#include <stdint.h>
+
+// random bytes from OS CSPRNG, BCryptGenRandom on Windows, getrandom on Linux,
+// requests are served from a per thread block which is refilled by one OS call
+
+#define RNG_BLOCK_SIZE 512
+
+// fill dest with len random bytes, return 1 on success
+int rng_fill(uint8_t* dest, uint32_t len);
+// uECC_RNG_Function compatible wrapper of rng_fill
+int rng_uecc(uint8_t* dest, unsigned size);
+// bytes/sec of rng_fill by given request size, total: bytes to generate
+int rng_throughput(uint32_t request_size, uint32_t total, float* bytes_per_sec);
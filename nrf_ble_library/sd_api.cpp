@@ -0,0 +1,45 @@
+#include "sd_api.h"
+
+const sd_api_t sd_api_driver = {
+	sd_rpc_open,
+	sd_rpc_close,
+	sd_rpc_conn_reset,
+	sd_rpc_log_handler_severity_filter_set,
+
+	sd_ble_enable,
+	sd_ble_opt_set,
+	sd_ble_version_get,
+#if NRF_SD_BLE_API >= 5
+	sd_ble_cfg_set,
+#endif
+
+	sd_ble_gap_addr_get,
+	sd_ble_gap_scan_start,
+	sd_ble_gap_scan_stop,
+	sd_ble_gap_connect,
+	sd_ble_gap_connect_cancel,
+	sd_ble_gap_disconnect,
+	sd_ble_gap_conn_param_update,
+#if NRF_SD_BLE_API >= 5
+	sd_ble_gap_data_length_update,
+	sd_ble_gap_phy_update,
+#endif
+	sd_ble_gap_authenticate,
+	sd_ble_gap_sec_params_reply,
+	sd_ble_gap_auth_key_reply,
+	sd_ble_gap_lesc_dhkey_reply,
+	sd_ble_gap_lesc_oob_data_set,
+	sd_ble_gap_encrypt,
+	sd_ble_gap_conn_sec_get,
+
+	sd_ble_gattc_primary_services_discover,
+	sd_ble_gattc_characteristics_discover,
+	sd_ble_gattc_descriptors_discover,
+	sd_ble_gattc_read,
+	sd_ble_gattc_char_values_read,
+	sd_ble_gattc_char_value_by_uuid_read,
+	sd_ble_gattc_write,
+#if NRF_SD_BLE_API >= 3
+	sd_ble_gatts_exchange_mtu_reply,
+#endif
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include "ble.h"
+#include "sd_rpc.h"
+
+// SoftDevice calls used by dongle.cpp as a table, so the serial port dongle of nrf-ble-driver
+// can be replaced by another backend such as simulator, calls take the adapter of the same backend
+
+#define SD_API_FN(name) decltype(&sd_##name) name
+
+typedef struct _sd_api_t {
+	SD_API_FN(rpc_open);
+	SD_API_FN(rpc_close);
+	SD_API_FN(rpc_conn_reset);
+	SD_API_FN(rpc_log_handler_severity_filter_set);
+
+	SD_API_FN(ble_enable);
+	SD_API_FN(ble_opt_set);
+	SD_API_FN(ble_version_get);
+#if NRF_SD_BLE_API >= 5
+	SD_API_FN(ble_cfg_set);
+#endif
+
+	SD_API_FN(ble_gap_addr_get);
+	SD_API_FN(ble_gap_scan_start);
+	SD_API_FN(ble_gap_scan_stop);
+	SD_API_FN(ble_gap_connect);
+	SD_API_FN(ble_gap_connect_cancel);
+	SD_API_FN(ble_gap_disconnect);
+	SD_API_FN(ble_gap_conn_param_update);
+#if NRF_SD_BLE_API >= 5
+	SD_API_FN(ble_gap_data_length_update);
+	SD_API_FN(ble_gap_phy_update);
+#endif
+	SD_API_FN(ble_gap_authenticate);
+	SD_API_FN(ble_gap_sec_params_reply);
+	SD_API_FN(ble_gap_auth_key_reply);
+	SD_API_FN(ble_gap_lesc_dhkey_reply);
+	SD_API_FN(ble_gap_lesc_oob_data_set);
+	SD_API_FN(ble_gap_encrypt);
+	SD_API_FN(ble_gap_conn_sec_get);
+
+	SD_API_FN(ble_gattc_primary_services_discover);
+	SD_API_FN(ble_gattc_characteristics_discover);
+	SD_API_FN(ble_gattc_descriptors_discover);
+	SD_API_FN(ble_gattc_read);
+	SD_API_FN(ble_gattc_char_values_read);
+	SD_API_FN(ble_gattc_char_value_by_uuid_read);
+	SD_API_FN(ble_gattc_write);
+#if NRF_SD_BLE_API >= 3
+	SD_API_FN(ble_gatts_exchange_mtu_reply);
+#endif
+} sd_api_t;
+
+// calls of nrf-ble-driver to connectivity firmware through serial port
+extern const sd_api_t sd_api_driver;
@@ -1,24 +1,24 @@
 #include "security.h"
+#include "ecc_p256.h"
+#include "rng.h"
+#include "aes.h"
+#include "platform.h"
 #include "uECC/uECC.h"
 
 #include <iostream>
+#include <string.h>
 #include <cstdlib>
 #include <time.h>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
 
 // class functions duplicated from pc-ble-driver-js\src\driver_uecc.cpp
 
-int rng(uint8_t *dest, unsigned size)
-{
-	for (unsigned i = 0; i < size; ++i)
-	{
-		dest[i] = rand() % 256;
-	}
-
-	return 1;
-}
-
-static uint8_t m_be_keys[ECC_P256_SK_LEN * 3];
-
 static void reverse(uint8_t* p_dst, uint8_t* p_src, uint32_t len)
 {
 	uint32_t i, j;
@@ -29,136 +29,539 @@ static void reverse(uint8_t* p_dst, uint8_t* p_src, uint32_t len)
 	}
 }
 
+/* memset called through volatile pointer, so wiping a buffer about to go out of scope is not optimized away */
+static void* (*const volatile m_secure_memset)(void*, int, size_t) = memset;
+
+/* P-256 functions in big endian bytes as uECC, the public key is x|y without prefix */
+typedef struct _ecc_backend_t {
+	const char* name;
+	int (*make_key)(uint8_t* public_key, uint8_t* private_key);
+	int (*compute_public_key)(const uint8_t* private_key, uint8_t* public_key);
+	int (*valid_public_key)(const uint8_t* public_key);
+	int (*shared_secret)(const uint8_t* public_key, const uint8_t* private_key, uint8_t* secret);
+} ecc_backend_t;
+
+static int uecc_make_key(uint8_t* public_key, uint8_t* private_key) {
+	return uECC_make_key(public_key, private_key, uECC_secp256r1());
+}
+
+static int uecc_compute_public_key(const uint8_t* private_key, uint8_t* public_key) {
+	return uECC_compute_public_key(private_key, public_key, uECC_secp256r1());
+}
+
+static int uecc_valid_public_key(const uint8_t* public_key) {
+	return uECC_valid_public_key(public_key, uECC_secp256r1());
+}
+
+static int uecc_shared_secret(const uint8_t* public_key, const uint8_t* private_key, uint8_t* secret) {
+	return uECC_shared_secret(public_key, private_key, secret, uECC_secp256r1());
+}
+
+// indexed by ECC_BACKEND_*
+static const ecc_backend_t m_ecc_backends[] = {
+	{ "micro-ecc", uecc_make_key, uecc_compute_public_key, uecc_valid_public_key, uecc_shared_secret },
+#if ECC_P256_64_SUPPORTED
+	{ "p256-64", p256_64_make_key, p256_64_compute_public_key, p256_64_valid_public_key, p256_64_shared_secret },
+#endif
+};
+
+#if ECC_P256_64_SUPPORTED && !defined(ECC_BACKEND_UECC_ONLY)
+static const ecc_backend_t* m_ecc = &m_ecc_backends[ECC_BACKEND_P256_64];
+#else
+static const ecc_backend_t* m_ecc = &m_ecc_backends[ECC_BACKEND_UECC];
+#endif
+
 static bool isEccInitialized = false;
 
 void ecc_init() {
 	if (!isEccInitialized)
 	{
-		srand((unsigned int)time(NULL));
-		uECC_set_rng(rng);
+		// OS CSPRNG instead of rand(), which was seeded by time and repeats keys of dongles started in the same second
+		uECC_set_rng(rng_uecc);
 		isEccInitialized = true;
 	}
 }
 
-int ecc_p256_gen_keypair(uint8_t* sk, uint8_t* pk) {
-	const struct uECC_Curve_t * p_curve;
+void secure_zero(void* p, size_t len) {
+	if (p != NULL)
+		m_secure_memset(p, 0, len);
+}
 
-	uint8_t p_le_sk[ECC_P256_SK_LEN];   // Out
-	uint8_t p_le_pk[ECC_P256_PK_LEN];   // Out
+int secure_compare(const void* a, const void* b, size_t len) {
+	const volatile uint8_t* x = (const volatile uint8_t*)a;
+	const volatile uint8_t* y = (const volatile uint8_t*)b;
+	uint8_t diff = 0;
+	for (size_t i = 0; i < len; i++)
+		diff |= x[i] ^ y[i];
+	return diff == 0 ? 1 : 0;
+}
 
-	p_curve = uECC_secp256r1();
-	int ret = uECC_make_key((uint8_t *)&m_be_keys[ECC_P256_SK_LEN], (uint8_t *)&m_be_keys[0], p_curve);
-	if (ret == 0) {
-		printf("NRF_ERROR_INTERNAL: uecc_make_key=%d\n", ret);
-		return 0;
+/* functions of given backend with little endian keys as SoftDevice, converted in one big endian buffer of the call,
+which is wiped before return, so they are reentrant for key pool and batch workers,
+failures are returned as 0 to the caller, which reports them through its own log */
+
+static int ecc_gen_keypair(const ecc_backend_t* ecc, uint8_t* sk, uint8_t* pk) {
+	uint8_t be[ECC_P256_SK_LEN + ECC_P256_PK_LEN]; // sk, pk
+	int ret = ecc->make_key(&be[ECC_P256_SK_LEN], &be[0]);
+	if (ret != 0) {
+		if (sk != NULL)
+			reverse(sk, &be[0], ECC_P256_SK_LEN);
+		if (pk != NULL) {
+			reverse(&pk[0], &be[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
+			reverse(&pk[ECC_P256_SK_LEN], &be[ECC_P256_SK_LEN * 2], ECC_P256_SK_LEN);
+		}
 	}
+	secure_zero(be, sizeof(be));
+	return ret == 0 ? 0 : 1;
+}
 
-	/* convert to little endian bytes and store in p_le_sk */
-	reverse(&p_le_sk[0], &m_be_keys[0], ECC_P256_SK_LEN);
-	/* convert to little endian bytes in 2 passes, store in p_le_pk */
-	reverse(&p_le_pk[0], &m_be_keys[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
-	reverse(&p_le_pk[ECC_P256_SK_LEN], &m_be_keys[ECC_P256_SK_LEN * 2], ECC_P256_SK_LEN);
+static int ecc_compute_pubkey(const ecc_backend_t* ecc, const uint8_t* sk, uint8_t* pk) {
+	uint8_t be[ECC_P256_SK_LEN + ECC_P256_PK_LEN]; // sk, pk
+	reverse(&be[0], (uint8_t*)sk, ECC_P256_SK_LEN);
+	int ret = ecc->compute_public_key(&be[0], &be[ECC_P256_SK_LEN]);
+	if (ret != 0 && pk != NULL) {
+		reverse(&pk[0], &be[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
+		reverse(&pk[ECC_P256_SK_LEN], &be[ECC_P256_SK_LEN * 2], ECC_P256_SK_LEN);
+	}
+	secure_zero(be, sizeof(be));
+	return ret == 0 ? 0 : 1;
+}
 
-	if (sk != NULL)
-		memcpy_s(sk, ECC_P256_SK_LEN, p_le_sk, ECC_P256_SK_LEN);
-	if (pk != NULL)
-		memcpy_s(pk, ECC_P256_PK_LEN, p_le_pk, ECC_P256_PK_LEN);
-	return 1;
+static int ecc_valid_public_key(const ecc_backend_t* ecc, const uint8_t* pk) {
+	uint8_t be[ECC_P256_PK_LEN];
+	reverse(&be[0], (uint8_t*)&pk[0], ECC_P256_SK_LEN);
+	reverse(&be[ECC_P256_SK_LEN], (uint8_t*)&pk[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
+
+	return ecc->valid_public_key(be) == 0 ? 0 : 1;
+}
+
+static int ecc_compute_sharedsecret(const ecc_backend_t* ecc, const uint8_t* sk, const uint8_t* pk, uint8_t* ss) {
+	uint8_t be[ECC_P256_SK_LEN * 2 + ECC_P256_PK_LEN]; // sk, pk, ss
+	reverse(&be[0], (uint8_t*)sk, ECC_P256_SK_LEN);
+	reverse(&be[ECC_P256_SK_LEN], (uint8_t*)&pk[0], ECC_P256_SK_LEN);
+	reverse(&be[ECC_P256_SK_LEN * 2], (uint8_t*)&pk[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
+
+	uint8_t* be_ss = &be[ECC_P256_SK_LEN + ECC_P256_PK_LEN];
+	int ret = ecc->shared_secret(&be[ECC_P256_SK_LEN], &be[0], be_ss);
+	if (ret != 0 && ss != NULL) {
+		reverse(ss, be_ss, ECC_P256_SK_LEN);
+	}
+	secure_zero(be, sizeof(be));
+	return ret == 0 ? 0 : 1;
+}
+
+int ecc_p256_gen_keypair(uint8_t* sk, uint8_t* pk) {
+	return ecc_gen_keypair(m_ecc, sk, pk);
 }
 
 int ecc_p256_compute_pubkey(uint8_t* sk, uint8_t* pk) {
 	if (sk == NULL)
 		return 0;
+	return ecc_compute_pubkey(m_ecc, sk, pk);
+}
 
-	const struct uECC_Curve_t * p_curve;
-	//uint8_t *p_le_sk;   // In
-	uint8_t p_le_sk[ECC_P256_SK_LEN];	// Duplicated data from In
-	uint8_t p_le_pk[ECC_P256_PK_LEN];   // Out
-	auto argumentcount = 0;
+int ecc_p256_valid_public_key(uint8_t* pk) {
+	if (pk == NULL)
+		return 0;
+	return ecc_valid_public_key(m_ecc, pk);
+}
+
+int ecc_p256_compute_sharedsecret(uint8_t* sk, uint8_t* pk, uint8_t* ss) {
+	if (sk == NULL || pk == NULL)
+		return 0;
+	return ecc_compute_sharedsecret(m_ecc, sk, pk, ss);
+}
 
-	memcpy_s(p_le_sk, ECC_P256_SK_LEN, sk, ECC_P256_SK_LEN);
-	argumentcount++;
+int ecc_keypair_generate(ecc_keypair_t* keypair) {
+	if (keypair == NULL)
+		return 0;
+	int ret = ecc_p256_gen_keypair(keypair->sk, keypair->pk);
+	if (ret == 1)
+		ret = ecc_p256_valid_public_key(keypair->pk);
+	if (ret != 1)
+		ecc_keypair_clear(keypair);
+	return ret;
+}
 
-	p_curve = uECC_secp256r1();
+void ecc_keypair_clear(ecc_keypair_t* keypair) {
+	secure_zero(keypair, sizeof(ecc_keypair_t));
+}
 
-	reverse(&m_be_keys[0], (uint8_t *)p_le_sk, ECC_P256_SK_LEN);
-	//free(p_le_sk);
+const char* ecc_backend_name() {
+	return m_ecc->name;
+}
 
-	//int ret = uECC_compute_public_key(p_le_sk, (uint8_t *)p_le_pk, p_curve);
-	int ret = uECC_compute_public_key((uint8_t *)&m_be_keys[0], (uint8_t *)&m_be_keys[ECC_P256_SK_LEN], p_curve);
-	if (ret == 0) {
-		printf("NRF_ERROR_INTERNAL: uecc_compute_pk=%d\n", ret);
+int ecc_p256_benchmark(uint8_t backend, uint32_t iterations, float* keygen_ops, float* ecdh_ops) {
+	if (backend >= sizeof(m_ecc_backends) / sizeof(m_ecc_backends[0]) || iterations == 0)
 		return 0;
-	}
+	ecc_init();
 
-	/* convert to little endian bytes in 2 passes, store in m_be_keys */
-	reverse(&p_le_pk[0], &m_be_keys[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
-	reverse(&p_le_pk[ECC_P256_SK_LEN], &m_be_keys[ECC_P256_SK_LEN * 2], ECC_P256_SK_LEN);
+	const ecc_backend_t* ecc = &m_ecc_backends[backend];
+	uint8_t sk[ECC_P256_SK_LEN];
+	uint8_t pk[ECC_P256_PK_LEN];
+	uint8_t peer_pk[ECC_P256_PK_LEN];
+	uint8_t ss[ECC_P256_SK_LEN];
+	int ret = 1;
 
-	if (pk != NULL)
-		memcpy_s(pk, ECC_P256_PK_LEN, p_le_pk, ECC_P256_PK_LEN);
+	// first call is excluded, the 64-bit backend builds its fixed base table there
+	if (ecc->make_key(peer_pk, sk) == 0)
+		return 0;
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterations && ret == 1; i++)
+		ret = ecc->make_key(pk, sk);
+	std::chrono::duration<float> keygen_elapsed = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for (uint32_t i = 0; i < iterations && ret == 1; i++)
+		ret = ecc->shared_secret(peer_pk, sk, ss);
+	std::chrono::duration<float> ecdh_elapsed = std::chrono::steady_clock::now() - start;
+
+	secure_zero(sk, sizeof(sk));
+	secure_zero(ss, sizeof(ss));
+	if (ret != 1)
+		return 0;
+
+	if (keygen_ops != NULL)
+		*keygen_ops = keygen_elapsed.count() > 0 ? iterations / keygen_elapsed.count() : 0;
+	if (ecdh_ops != NULL)
+		*ecdh_ops = ecdh_elapsed.count() > 0 ? iterations / ecdh_elapsed.count() : 0;
 	return 1;
 }
 
-int ecc_p256_valid_public_key(uint8_t* pk) {
-	if (pk == NULL)
-		return 0;
-	const struct uECC_Curve_t* p_curve;
-	uint8_t p_le_pk[ECC_P256_PK_LEN];
+/* secp256r1 vectors of uECC/test/public_key_test_vectors.c which both backends accept, k and Q in big endian hex */
+static const struct {
+	const char* k;
+	const char* Q; /* NULL if k is out of range */
+} m_pubkey_vectors[] = {
+	{ "0000000000000000000000000000000000000000000000000000000000000000", NULL },
+	{ "0000000000000000000000000000000000000000000000000000000000000002",
+		"7CF27B188D034F7E8A52380304B51AC3C08969E277F21B35A60B48FC4766997807775510DB8ED040293D9AC69F7430DBBA7DADE63CE982299E04B79D227873D1" },
+	{ "0000000000000000000000000000000000000000000000000000000000000003",
+		"5ECBE4D1A6330A44C8F7EF951D4BF165E6C6B721EFADA985FB41661BC6E7FD6C8734640C4998FF7E374B06CE1A64A2ECD82AB036384FB83D9A79B127A27D5032" },
+	{ "FFFFFFFF00000000FFFFFFFFFFFFFFFFBCE6FAADA7179E84F3B9CAC2FC63254D", /* n - 4 */
+		"E2534A3532D08FBBA02DDE659EE62BD0031FE2DB785596EF509302446B0308521F0EA8A4B39CC339E62011A02579D289B103693D0CF11FFAA3BD3DC0E7B12739" },
+	{ "FFFFFFFF00000000FFFFFFFFFFFFFFFFBCE6FAADA7179E84F3B9CAC2FC63254E", /* n - 3 */
+		"5ECBE4D1A6330A44C8F7EF951D4BF165E6C6B721EFADA985FB41661BC6E7FD6C78CB9BF2B6670082C8B4F931E59B5D1327D54FCAC7B047C265864ED85D82AFCD" },
+	{ "FFFFFFFF00000000FFFFFFFFFFFFFFFFBCE6FAADA7179E84F3B9CAC2FC632551", NULL }, /* n */
+};
+
+/* NIST CAVS ECC CDH P-256 COUNT 0, own private key d, own public key Q, peer public key, shared secret Z */
+static const char* m_ecdh_vector[] = {
+	"7D7DC5F71EB29DDAF80D6214632EEAE03D9058AF1FB6D22ED80BADB62BC1A534",
+	"EAD218590119E8876B29146FF89CA61770C4EDBBF97D38CE385ED281D8A6B23028AF61281FD35E2FA7002523ACC85A429CB06EE6648325389F59EDFCE1405141",
+	"700C48F77F56584C5CC632CA65640DB91B6BACCE3A4DF6B42CE7CC838833D287DB71E509E3FD9B060DDB20BA5C51DCC5948D46FBF640DFE0441782CAB85FA4AC",
+	"46FC62106420FF012E54A434FBDD2D25CCC5852060561E68040DD7778997BD7B",
+};
+
+/* big endian hex of P-256 numbers into little endian bytes as SoftDevice, each 32 bytes reversed */
+static void hex_to_le(const char* hex, uint8_t* le, uint32_t len) {
+	for (uint32_t i = 0; i < len; i++) {
+		unsigned int v = 0;
+		sscanf(&hex[i * 2], "%2x", &v);
+		uint32_t base = i / ECC_P256_SK_LEN * ECC_P256_SK_LEN;
+		le[base + ECC_P256_SK_LEN - 1 - (i % ECC_P256_SK_LEN)] = (uint8_t)v;
+	}
+}
+
+int ecc_p256_selftest(uint8_t backend, uint32_t iterations, float* pairing_us) {
+	if (backend >= sizeof(m_ecc_backends) / sizeof(m_ecc_backends[0]))
+		return -1;
+	ecc_init();
+
+	const ecc_backend_t* ecc = &m_ecc_backends[backend];
+	uint8_t sk[ECC_P256_SK_LEN];
+	uint8_t pk[ECC_P256_PK_LEN];
+	uint8_t expected[ECC_P256_PK_LEN];
+	uint8_t ss[ECC_P256_SK_LEN];
+	int failed = 0;
+
+	for (auto& v : m_pubkey_vectors) {
+		hex_to_le(v.k, sk, ECC_P256_SK_LEN);
+		int ret = ecc_compute_pubkey(ecc, sk, pk);
+		if (v.Q == NULL) {
+			failed += ret == 0 ? 0 : 1;
+			continue;
+		}
+		hex_to_le(v.Q, expected, ECC_P256_PK_LEN);
+		if (ret != 1 || secure_compare(pk, expected, ECC_P256_PK_LEN) == 0 || ecc_valid_public_key(ecc, pk) != 1)
+			failed++;
+		// off the curve
+		pk[0] ^= 0x01;
+		failed += ecc_valid_public_key(ecc, pk) == 0 ? 0 : 1;
+	}
 
-	p_curve = uECC_secp256r1();
+	uint8_t peer_pk[ECC_P256_PK_LEN];
+	hex_to_le(m_ecdh_vector[0], sk, ECC_P256_SK_LEN);
+	hex_to_le(m_ecdh_vector[1], expected, ECC_P256_PK_LEN);
+	if (ecc_compute_pubkey(ecc, sk, pk) != 1 || secure_compare(pk, expected, ECC_P256_PK_LEN) == 0)
+		failed++;
+	hex_to_le(m_ecdh_vector[2], peer_pk, ECC_P256_PK_LEN);
+	hex_to_le(m_ecdh_vector[3], expected, ECC_P256_SK_LEN);
+	if (ecc_compute_sharedsecret(ecc, sk, peer_pk, ss) != 1 || secure_compare(ss, expected, ECC_P256_SK_LEN) == 0)
+		failed++;
+
+	// crypto part of a LESC pairing through the wrappers: own key pair, validate peer key, DHKey
+	if (failed == 0 && iterations > 0 && pairing_us != NULL) {
+		int ret = 1;
+		auto start = std::chrono::steady_clock::now();
+		for (uint32_t i = 0; i < iterations && ret == 1; i++) {
+			ret = ecc_gen_keypair(ecc, sk, pk);
+			if (ret == 1)
+				ret = ecc_valid_public_key(ecc, peer_pk);
+			if (ret == 1)
+				ret = ecc_compute_sharedsecret(ecc, sk, peer_pk, ss);
+		}
+		std::chrono::duration<float, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+		failed += ret == 1 ? 0 : 1;
+		*pairing_us = elapsed.count() / iterations;
+	}
+
+	secure_zero(sk, sizeof(sk));
+	secure_zero(ss, sizeof(ss));
+	return failed == 0 ? 1 : 0;
+}
 
-	reverse(&p_le_pk[0], (uint8_t*)&pk[0], ECC_P256_SK_LEN);
-	reverse(&p_le_pk[ECC_P256_SK_LEN], (uint8_t*)&pk[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
+/* key pool of pre-generated and validated key pairs, refilled by a worker thread */
+static std::deque<ecc_keypair_t> m_keypool;
+static std::mutex m_keypool_mtx;
+static std::condition_variable m_keypool_cond;
+static size_t m_keypool_size = 0;
+static bool m_keypool_running = false;
+static bool m_keypool_active = false; /* worker thread alive */
+
+static void keypool_worker() {
+	std::unique_lock<std::mutex> lck(m_keypool_mtx);
+	while (m_keypool_running) {
+		if (m_keypool.size() >= m_keypool_size) {
+			m_keypool_cond.wait(lck);
+			continue;
+		}
+
+		// generate without lock, caller can take the pool meanwhile
+		lck.unlock();
+		ecc_keypair_t keypair;
+		int ret = ecc_keypair_generate(&keypair);
+		lck.lock();
+
+		if (ret == 1)
+			m_keypool.push_back(keypair);
+		ecc_keypair_clear(&keypair);
+	}
+	m_keypool_active = false;
+	m_keypool_cond.notify_all();
+}
+
+void ecc_keypool_start(uint32_t size) {
+	std::lock_guard<std::mutex> lck(m_keypool_mtx);
+	m_keypool_size = size;
+	if (m_keypool_active) {
+		m_keypool_cond.notify_all();
+		return;
+	}
 
-	int ret = uECC_valid_public_key((uint8_t*)&p_le_pk[0], p_curve);
-	if (ret == 0) {
-		printf("NRF_ERROR_INTERNAL: uecc_valid_pk=%d\n", ret);
+	m_keypool_running = true;
+	m_keypool_active = true;
+	// detached, since joining a thread from DLL unload may dead lock, ecc_keypool_stop waits for it instead
+	std::thread(keypool_worker).detach();
+}
+
+int ecc_keypool_take(uint8_t* sk, uint8_t* pk) {
+	if (sk == NULL || pk == NULL)
 		return 0;
+
+	std::unique_lock<std::mutex> lck(m_keypool_mtx);
+	if (m_keypool.empty()) {
+		lck.unlock();
+		// pool drained or not started, generate in caller thread
+		int ret = ecc_p256_gen_keypair(sk, pk);
+		if (ret == 1)
+			ret = ecc_p256_valid_public_key(pk);
+		return ret;
 	}
 
+	auto& keypair = m_keypool.front();
+	memcpy_s(sk, ECC_P256_SK_LEN, keypair.sk, ECC_P256_SK_LEN);
+	memcpy_s(pk, ECC_P256_PK_LEN, keypair.pk, ECC_P256_PK_LEN);
+	ecc_keypair_clear(&keypair);
+	m_keypool.pop_front();
+	// refill
+	m_keypool_cond.notify_all();
 	return 1;
 }
 
-int ecc_p256_compute_sharedsecret(uint8_t* sk, uint8_t* pk, uint8_t* ss) {
-	if (sk == NULL || pk == NULL)
+void ecc_keypool_stop() {
+	std::unique_lock<std::mutex> lck(m_keypool_mtx);
+	m_keypool_running = false;
+	m_keypool_cond.notify_all();
+	m_keypool_cond.wait(lck, [] { return !m_keypool_active; });
+
+	for (auto& keypair : m_keypool)
+		ecc_keypair_clear(&keypair);
+	m_keypool.clear();
+}
+
+/* worker pool of batch functions, items of a batch are taken by index from the caller thread
+and pool workers, each item only touches its own keys and stack buffers */
+typedef struct _ecc_batch_t {
+	std::function<void(uint32_t)> fn;
+	uint32_t count = 0;
+	uint32_t max_workers = 0; /* workers may join this batch besides caller thread */
+	std::atomic<uint32_t> next{ 0 };
+	std::atomic<uint32_t> joined{ 0 };
+	uint32_t active = 0; /* joined workers not left yet, guarded by m_pool_mtx */
+} ecc_batch_t;
+
+static std::mutex m_pool_mtx;
+static std::mutex m_pool_batch_mtx; /* one batch at a time */
+static std::condition_variable m_pool_cond;
+static std::condition_variable m_pool_done_cond;
+static ecc_batch_t* m_pool_batch = NULL;
+static uint64_t m_pool_batch_id = 0;
+static uint32_t m_pool_size = 0; /* alive workers */
+static bool m_pool_running = false;
+
+static void batch_run_items(ecc_batch_t* batch) {
+	uint32_t i;
+	while ((i = batch->next++) < batch->count)
+		batch->fn(i);
+}
+
+static void pool_worker() {
+	uint64_t last_id = 0;
+	std::unique_lock<std::mutex> lck(m_pool_mtx);
+	while (m_pool_running) {
+		if (m_pool_batch == NULL || m_pool_batch_id == last_id) {
+			m_pool_cond.wait(lck);
+			continue;
+		}
+
+		ecc_batch_t* batch = m_pool_batch;
+		last_id = m_pool_batch_id;
+		if (batch->joined++ >= batch->max_workers)
+			continue;
+		batch->active++;
+		lck.unlock();
+		batch_run_items(batch);
+		lck.lock();
+		batch->active--;
+		m_pool_done_cond.notify_all();
+	}
+	m_pool_size--;
+	m_pool_done_cond.notify_all();
+}
+
+static void pool_start() {
+	std::lock_guard<std::mutex> lck(m_pool_mtx);
+	if (m_pool_running)
+		return;
+
+	unsigned hw = std::thread::hardware_concurrency();
+	m_pool_running = true;
+	// caller thread takes items too
+	m_pool_size = hw > 1 ? hw - 1 : 1;
+	for (uint32_t i = 0; i < m_pool_size; i++)
+		std::thread(pool_worker).detach();
+}
+
+// run fn(0)~fn(count-1) across pool, threads: 0 for all cores, return elapsed seconds
+static float pool_run(uint32_t count, uint32_t threads, std::function<void(uint32_t)> fn) {
+	std::lock_guard<std::mutex> batch_lck(m_pool_batch_mtx);
+	pool_start();
+
+	ecc_batch_t batch;
+	batch.fn = fn;
+	batch.count = count;
+	batch.max_workers = threads == 0 ? UINT32_MAX : threads - 1;
+
+	auto start = std::chrono::steady_clock::now();
+	if (batch.max_workers > 0 && count > 1) {
+		std::lock_guard<std::mutex> lck(m_pool_mtx);
+		m_pool_batch = &batch;
+		m_pool_batch_id++;
+		m_pool_cond.notify_all();
+	}
+	batch_run_items(&batch);
+
+	// items are all taken, wait for joined workers leaving before batch goes out of scope
+	std::unique_lock<std::mutex> lck(m_pool_mtx);
+	if (m_pool_batch == &batch)
+		m_pool_batch = NULL;
+	m_pool_done_cond.wait(lck, [&batch] { return batch.active == 0; });
+	std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - start;
+	return elapsed.count();
+}
+
+int ecc_p256_valid_public_key_batch(uint8_t* pks, uint32_t count, uint8_t* results, uint32_t threads, float* ops_per_sec) {
+	if (pks == NULL || results == NULL || count == 0)
 		return 0;
 
-	const struct uECC_Curve_t* p_curve;
-	//uint8_t* p_le_sk;  // In
-	//uint8_t* p_le_pk;  // In
-	uint8_t p_le_sk[ECC_P256_SK_LEN];	// Duplicated data from In
-	uint8_t p_le_pk[ECC_P256_PK_LEN];	// Duplicated data from In
-	uint8_t p_le_ss[ECC_P256_SK_LEN];  // Out
-	auto argumentcount = 0;
-
-	memcpy_s(p_le_sk, ECC_P256_SK_LEN, sk, ECC_P256_SK_LEN);
-	memcpy_s(p_le_pk, ECC_P256_PK_LEN, pk, ECC_P256_PK_LEN);
-	argumentcount++;
-
-	p_curve = uECC_secp256r1();
-
-	/* convert to big endian bytes and store in m_be_keys */
-	reverse(&m_be_keys[0], (uint8_t*)p_le_sk, ECC_P256_SK_LEN);
-	reverse(&m_be_keys[ECC_P256_SK_LEN], (uint8_t*)&p_le_pk[0], ECC_P256_SK_LEN);
-	reverse(&m_be_keys[ECC_P256_SK_LEN * 2], (uint8_t*)&p_le_pk[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
-	// no need to free in method scope
-	//free(p_le_sk);
-	//free(p_le_pk);
-
-	int ret = uECC_shared_secret((uint8_t*)&m_be_keys[ECC_P256_SK_LEN], (uint8_t*)&m_be_keys[0], p_le_ss, p_curve);
-	if (ret == 0) {
-		printf("NRF_ERROR_INTERNAL: uecc_shared_secret=%d\n", ret);
+	std::atomic<uint32_t> valid{ 0 };
+	float elapsed = pool_run(count, threads, [&](uint32_t i) {
+		results[i] = (uint8_t)ecc_p256_valid_public_key(&pks[i * ECC_P256_PK_LEN]);
+		if (results[i] == 1)
+			valid++;
+	});
+
+	if (ops_per_sec != NULL)
+		*ops_per_sec = elapsed > 0 ? count / elapsed : 0;
+	return (int)valid;
+}
+
+int ecc_p256_compute_sharedsecret_batch(uint8_t* sks, uint32_t sk_count, uint8_t* pks, uint32_t count,
+	uint8_t* ss, uint8_t* results, uint32_t threads, float* ops_per_sec) {
+	if (sks == NULL || pks == NULL || ss == NULL || results == NULL || count == 0)
 		return 0;
-	}
+	if (sk_count != 1 && sk_count != count)
+		return 0;
+
+	std::atomic<uint32_t> done{ 0 };
+	float elapsed = pool_run(count, threads, [&](uint32_t i) {
+		uint8_t* sk = &sks[(sk_count == 1 ? 0 : i) * ECC_P256_SK_LEN];
+		uint8_t* pk = &pks[i * ECC_P256_PK_LEN];
+		int ret = ecc_p256_valid_public_key(pk);
+		if (ret == 1)
+			ret = ecc_p256_compute_sharedsecret(sk, pk, &ss[i * ECC_P256_SK_LEN]);
+		if (ret != 1)
+			secure_zero(&ss[i * ECC_P256_SK_LEN], ECC_P256_SK_LEN);
+		results[i] = (uint8_t)ret;
+		if (ret == 1)
+			done++;
+	});
+
+	if (ops_per_sec != NULL)
+		*ops_per_sec = elapsed > 0 ? count / elapsed : 0;
+	return (int)done;
+}
 
-	/* convert to little endian bytes and store in m_be_keys */
-	reverse(&m_be_keys[0], &p_le_ss[0], ECC_P256_SK_LEN);
+void ecc_pool_stop() {
+	std::lock_guard<std::mutex> batch_lck(m_pool_batch_mtx);
+	std::unique_lock<std::mutex> lck(m_pool_mtx);
+	m_pool_running = false;
+	m_pool_cond.notify_all();
+	m_pool_done_cond.wait(lck, [] { return m_pool_size == 0; });
+}
 
-	/* copy back the little endian bytes to p_le_ss */
-	memcpy(p_le_ss, m_be_keys, ECC_P256_SK_LEN);
+int lesc_oob_confirm(const uint8_t* pk, const uint8_t* r, uint8_t* c) {
+	if (pk == NULL || r == NULL || c == NULL)
+		return 0;
 
-	if (ss != NULL)
-		memcpy_s(ss, ECC_P256_SK_LEN, p_le_ss, ECC_P256_SK_LEN);
+	// f4(U, V, X, Z) = AES-CMAC_X(U || V || Z), U and V are both x coordinate of own pk
+	uint8_t m[ECC_P256_SK_LEN * 2 + 1] = { 0 };
+	uint8_t x[LESC_OOB_LEN];
+	uint8_t mac[LESC_OOB_LEN];
+	reverse(&m[0], (uint8_t*)pk, ECC_P256_SK_LEN);
+	memcpy(&m[ECC_P256_SK_LEN], &m[0], ECC_P256_SK_LEN);
+	reverse(x, (uint8_t*)r, LESC_OOB_LEN);
+	aes_cmac(x, m, sizeof(m), mac);
+	reverse(c, mac, LESC_OOB_LEN);
+
+	secure_zero(x, sizeof(x));
 	return 1;
 }
+
+int lesc_oob_generate(const uint8_t* pk, uint8_t* r, uint8_t* c) {
+	if (r == NULL || rng_fill(r, LESC_OOB_LEN) == 0)
+		return 0;
+	return lesc_oob_confirm(pk, r, c);
+}
@@ -1,10 +1,26 @@
 #pragma once
 #include <stdint.h>
+#include <stddef.h>
 
 #define ECC_P256_SK_LEN 32 /*BLE_GAP_LESC_P256_SK_LEN*/
 #define ECC_P256_PK_LEN 64 /*BLE_GAP_LESC_P256_PK_LEN*/
 
 void ecc_init();
+
+// wipe secret bytes, not optimized away as memset before going out of scope
+void secure_zero(void* p, size_t len);
+// compare in constant time of len, return 1 if equal
+int secure_compare(const void* a, const void* b, size_t len);
+
+/* key pair owned by caller, little endian as SoftDevice, wiped by ecc_keypair_clear */
+typedef struct _ecc_keypair_t {
+	uint8_t sk[ECC_P256_SK_LEN];
+	uint8_t pk[ECC_P256_PK_LEN];
+} ecc_keypair_t;
+// generate and validate key pair, return 1 on success
+int ecc_keypair_generate(ecc_keypair_t* keypair);
+void ecc_keypair_clear(ecc_keypair_t* keypair);
+
 // generate private key and public key
 int ecc_p256_gen_keypair(uint8_t* sk, uint8_t* pk);
 // given private key to get public key
@@ -12,3 +28,37 @@ int ecc_p256_compute_pubkey(uint8_t* sk, uint8_t* pk);
 int ecc_p256_valid_public_key(uint8_t* pk);
 // given key pair to get shared secret
 int ecc_p256_compute_sharedsecret(uint8_t* sk, uint8_t* pk, uint8_t* ss);
+
+// ECC backend of above functions is selected at build time, the 64-bit one by default
+// on 64-bit hosts, or define ECC_BACKEND_UECC_ONLY to build with micro-ecc only
+#define ECC_BACKEND_UECC 0
+#define ECC_BACKEND_P256_64 1
+const char* ecc_backend_name();
+// ops/sec of key pair generation and shared secret computation by given backend
+int ecc_p256_benchmark(uint8_t backend, uint32_t iterations, float* keygen_ops, float* ecdh_ops);
+// known answer test of backend with uECC and NIST vectors, then average microseconds of
+// key pair generation, peer key validation and DHKey in iterations, return -1 if backend is not built in
+int ecc_p256_selftest(uint8_t backend, uint32_t iterations, float* pairing_us);
+
+// pre-generate and validate key pairs in a background thread, up to given size
+void ecc_keypool_start(uint32_t size);
+// take a key pair from pool, or generate one if pool is drained
+int ecc_keypool_take(uint8_t* sk, uint8_t* pk);
+// stop background thread and clear pooled key pairs
+void ecc_keypool_stop();
+
+// validate count public keys in pks across worker pool, results[i] is 1 if pks[i] is valid
+// threads: threads may work on this batch including caller, 0 for all cores, return valid count
+int ecc_p256_valid_public_key_batch(uint8_t* pks, uint32_t count, uint8_t* results, uint32_t threads, float* ops_per_sec);
+// validate and compute shared secret of each pks[i] into ss[i], sk_count is 1 for the same sk or count
+// results[i] is 1 on success, failed ss[i] is zeroed, return succeeded count
+int ecc_p256_compute_sharedsecret_batch(uint8_t* sks, uint32_t sk_count, uint8_t* pks, uint32_t count,
+	uint8_t* ss, uint8_t* results, uint32_t threads, float* ops_per_sec);
+// stop batch worker pool
+void ecc_pool_stop();
+
+#define LESC_OOB_LEN 16 /*BLE_GAP_SEC_KEY_LEN*/
+// LESC OOB confirm value c = f4(PKx, PKx, r, 0) of public key pk, all in little-endian as SoftDevice
+int lesc_oob_confirm(const uint8_t* pk, const uint8_t* r, uint8_t* c);
+// random r and its confirm c for public key pk, sent to peer over OOB channel before pairing
+int lesc_oob_generate(const uint8_t* pk, uint8_t* r, uint8_t* c);
@@ -0,0 +1,1602 @@
+#include "simulator.h"
+#include "security.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#include <vector>
+#include <map>
+#include <set>
+#include <queue>
+#include <functional>
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+#define SIM_PERIPHERAL_MAX          64
+#define SIM_ATT_MTU_MAX             247  /**< Client rx MTU of peripherals, effective one is decided by exchange MTU reply. */
+#define SIM_ATT_VALUE_MAX_LEN       512
+#define SIM_ADV_DELAY_MAX_MS        10   /**< Pseudo-random advDelay added to each advertising interval. */
+#define SIM_CONNECT_TIMEOUT_MS      2000 /**< Connection timeout to unknown address if scan params has none. */
+#define SIM_DATA_LENGTH_MAX         251
+#define SIM_DATA_LENGTH_TIME_MAX_US 2120
+#define SIM_ENC_KEY_SIZE            16
+
+#define SIM_PROP_READ               0x02
+#define SIM_PROP_WRITE_WO_RESP      0x04
+#define SIM_PROP_WRITE              0x08
+#define SIM_PROP_NOTIFY             0x10
+
+#define SIM_UUID_BATTERY_SRV        0x180F
+#define SIM_UUID_HID_SRV            0x1812
+#define SIM_UUID_BATTERY_LEVEL_CHAR 0x2A19
+#define SIM_UUID_HID_INFORMATION    0x2A4A
+#define SIM_UUID_REPORT_MAP         0x2A4B
+#define SIM_UUID_HID_CONTROL_POINT  0x2A4C
+#define SIM_UUID_REPORT             0x2A4D
+#define SIM_UUID_PROTOCOL_MODE      0x2A4E
+#define SIM_UUID_REPORT_REF_DESCR   0x2908
+#define SIM_APPEARANCE_KEYBOARD     0x03C1
+
+#define SIM_HCI_LOCAL_HOST_TERMINATED_CONNECTION 0x16
+
+#if NRF_SD_BLE_API >= 5
+
+typedef std::chrono::steady_clock sim_clock_t;
+/* ble_evt_t followed by variable length data of the event, 8-byte aligned as SoftDevice event buffer */
+typedef std::vector<uint64_t> sim_evt_t;
+typedef std::function<void(std::vector<sim_evt_t>&)> sim_job_t;
+
+typedef struct _sim_task_t {
+	sim_clock_t::time_point due;
+	uint64_t seq; /* tasks due at the same time run in scheduled order */
+	sim_job_t job;
+	bool operator>(const _sim_task_t& other) const {
+		return due != other.due ? due > other.due : seq > other.seq;
+	}
+} sim_task_t;
+
+/* attribute of GATT server, handle is index + 1 */
+typedef struct _sim_attr_t {
+	uint16_t uuid;
+	uint8_t perm; /* SIM_PROP_* allowed to client */
+	std::vector<uint8_t> value;
+} sim_attr_t;
+
+typedef struct _sim_peripheral_t {
+	ble_gap_addr_t addr;
+	std::vector<uint8_t> adv_data;
+	std::vector<sim_attr_t> attrs;
+	/* keys derived from seed, so bonds stored by previous runs of the same seed stay valid */
+	uint8_t ltk[BLE_GAP_SEC_KEY_LEN];
+	uint16_t ediv;
+	uint8_t rand[BLE_GAP_SEC_RAND_LEN];
+	uint8_t irk[BLE_GAP_SEC_KEY_LEN];
+	uint8_t sk[ECC_P256_SK_LEN];
+	ble_gap_lesc_p256_pk_t pk;
+	uint16_t conn_handle = BLE_CONN_HANDLE_INVALID;
+} sim_peripheral_t;
+
+typedef struct _sim_prep_write_t {
+	uint16_t handle;
+	uint16_t offset;
+	std::vector<uint8_t> data;
+} sim_prep_write_t;
+
+typedef struct _sim_conn_t {
+	uint32_t peripheral = 0;
+	uint64_t generation = 0; /* tasks of a previous connection on the same handle are dropped */
+	uint16_t mtu = BLE_GATT_ATT_MTU_DEFAULT;
+	bool disconnecting = false;
+	bool gattc_busy = false; /* one GATT client procedure at a time as SoftDevice */
+	bool pairing = false;
+	ble_gap_conn_params_t conn_params = { 0 };
+	ble_gap_conn_sec_t conn_sec = { { 1, 1 }, 0 };
+	ble_gap_sec_params_t sec_params = { 0 }; /* of central given by sd_ble_gap_authenticate */
+	ble_gap_sec_keyset_t keyset = { 0 }; /* pointers given by sd_ble_gap_sec_params_reply */
+	std::vector<sim_prep_write_t> prep_writes;
+	std::set<uint16_t> notifying; /* value handles with notification task */
+	uint32_t hvx_seq = 0;
+} sim_conn_t;
+
+static std::mutex m_mtx;
+static std::condition_variable m_cond;
+static std::thread m_thread;
+static bool m_opened = false;
+static uint64_t m_open_generation = 0; /* thread detached by close in event handler ends even if reopened */
+static sim_config_t m_config = { 1, 4, 100, 0, 8, 1000, -55, -35 };
+static sim_stats_t m_stats = { 0 };
+static std::priority_queue<sim_task_t, std::vector<sim_task_t>, std::greater<sim_task_t>> m_tasks;
+static uint64_t m_seq = 0;
+static uint64_t m_rng = 0; /* timing jitter, rssi and channel of reports */
+static uint64_t m_generation = 0;
+static std::vector<sim_peripheral_t> m_peripherals;
+static std::map<uint16_t, sim_conn_t> m_conns; /*conn handle, connection*/
+static ble_gap_addr_t m_own_addr = { 0 };
+
+static bool m_scanning = false;
+static bool m_scan_paused = false; /* v6 pauses scanning after each report until sd_ble_gap_scan_start(NULL) */
+static uint64_t m_scan_generation = 0;
+#if NRF_SD_BLE_API >= 6
+static ble_data_t m_scan_buffer = { 0 };
+#endif
+static bool m_connecting = false;
+static uint64_t m_connect_generation = 0;
+
+static sd_rpc_evt_handler_t m_evt_handler = NULL;
+static sd_rpc_status_handler_t m_status_handler = NULL;
+alignas(8) static uint8_t m_adapter[64] = { 0 }; /* only its address is used to identify adapter */
+
+/* HID boot keyboard report map */
+static const uint8_t m_report_map[] = {
+	0x05, 0x01, 0x09, 0x06, 0xA1, 0x01, 0x05, 0x07, 0x19, 0xE0, 0x29, 0xE7, 0x15, 0x00, 0x25, 0x01,
+	0x75, 0x01, 0x95, 0x08, 0x81, 0x02, 0x95, 0x01, 0x75, 0x08, 0x81, 0x01, 0x95, 0x05, 0x75, 0x01,
+	0x05, 0x08, 0x19, 0x01, 0x29, 0x05, 0x91, 0x02, 0x95, 0x01, 0x75, 0x03, 0x91, 0x01, 0x95, 0x06,
+	0x75, 0x08, 0x15, 0x00, 0x25, 0x65, 0x05, 0x07, 0x19, 0x00, 0x29, 0x65, 0x81, 0x00, 0xC0
+};
+
+#pragma region /** Helpers */
+
+/* splitmix64, same seed same sequence on every platform */
+static uint64_t sim_random(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static void sim_random_fill(uint64_t* state, uint8_t* dest, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		if (i % 8 == 0) {
+			uint64_t r = sim_random(state);
+			memcpy(&dest[i], &r, std::min<size_t>(8, len - i));
+		}
+	}
+}
+
+static void sim_schedule(uint64_t delay_us, sim_job_t job)
+{
+	sim_task_t task = { sim_clock_t::now() + std::chrono::microseconds(delay_us), m_seq++, job };
+	m_tasks.push(task);
+	m_cond.notify_one();
+}
+
+static ble_evt_t* sim_evt_add(std::vector<sim_evt_t>& evts, uint16_t evt_id, size_t extra = 0)
+{
+	size_t len = sizeof(ble_evt_t) + extra;
+	evts.emplace_back((len + sizeof(uint64_t) - 1) / sizeof(uint64_t), 0);
+	auto p_evt = (ble_evt_t*)evts.back().data();
+	p_evt->header.evt_id = evt_id;
+	p_evt->header.evt_len = (uint16_t)len;
+	return p_evt;
+}
+
+static ble_gap_evt_t* sim_gap_evt(std::vector<sim_evt_t>& evts, uint16_t evt_id, uint16_t conn_handle)
+{
+	auto p_gap_evt = &sim_evt_add(evts, evt_id)->evt.gap_evt;
+	p_gap_evt->conn_handle = conn_handle;
+	return p_gap_evt;
+}
+
+static ble_gattc_evt_t* sim_gattc_evt(std::vector<sim_evt_t>& evts, uint16_t evt_id, uint16_t conn_handle,
+	uint16_t gatt_status, uint16_t error_handle, size_t extra = 0)
+{
+	auto p_gattc_evt = &sim_evt_add(evts, evt_id, extra)->evt.gattc_evt;
+	p_gattc_evt->conn_handle = conn_handle;
+	p_gattc_evt->gatt_status = gatt_status;
+	p_gattc_evt->error_handle = error_handle;
+	return p_gattc_evt;
+}
+
+/* connection of the handle if it is the same one the task was scheduled for */
+static sim_conn_t* sim_conn_find(uint16_t conn_handle, uint64_t generation)
+{
+	auto conn = m_conns.find(conn_handle);
+	if (conn == m_conns.end() || conn->second.generation != generation)
+		return NULL;
+	return &conn->second;
+}
+
+/* common checks of calls on a connection, count the request if accepted */
+static uint32_t sim_conn_request(uint16_t conn_handle, sim_conn_t** pp_conn)
+{
+	if (!m_opened)
+		return NRF_ERROR_INVALID_STATE;
+	auto conn = m_conns.find(conn_handle);
+	if (conn == m_conns.end() || conn->second.disconnecting)
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	*pp_conn = &conn->second;
+	m_stats.requests++;
+	return NRF_SUCCESS;
+}
+
+/* GATT client procedure on a connection, busy until its response */
+static uint32_t sim_gattc_request(uint16_t conn_handle, sim_conn_t** pp_conn)
+{
+	uint32_t err_code = sim_conn_request(conn_handle, pp_conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+	if ((*pp_conn)->gattc_busy) {
+		m_stats.requests--;
+		return NRF_ERROR_BUSY;
+	}
+	(*pp_conn)->gattc_busy = true;
+	return NRF_SUCCESS;
+}
+
+static sim_attr_t* sim_attr_find(sim_peripheral_t* p, uint16_t handle)
+{
+	if (handle == 0 || handle > p->attrs.size())
+		return NULL;
+	return &p->attrs[handle - 1];
+}
+
+static uint16_t sim_service_end(const sim_peripheral_t* p, uint16_t handle)
+{
+	for (uint16_t h = handle + 1; h <= p->attrs.size(); h++) {
+		if (p->attrs[h - 1].uuid == BLE_UUID_SERVICE_PRIMARY)
+			return h - 1;
+	}
+	return (uint16_t)p->attrs.size();
+}
+
+/* value handle of characteristic the descriptor belongs to */
+static uint16_t sim_char_value_handle(const sim_peripheral_t* p, uint16_t desc_handle)
+{
+	for (uint16_t h = desc_handle - 1; h > 0; h--) {
+		if (p->attrs[h - 1].uuid == BLE_UUID_CHARACTERISTIC)
+			return h + 1;
+		if (p->attrs[h - 1].uuid == BLE_UUID_SERVICE_PRIMARY)
+			break;
+	}
+	return 0;
+}
+
+#pragma endregion
+
+
+#pragma region /** Synthetic peripherals */
+
+static void sim_attr_add(sim_peripheral_t* p, uint16_t uuid, uint8_t perm, std::vector<uint8_t> value)
+{
+	sim_attr_t attr = { uuid, perm, value };
+	p->attrs.push_back(attr);
+}
+
+static void sim_service_add(sim_peripheral_t* p, uint16_t uuid)
+{
+	sim_attr_add(p, BLE_UUID_SERVICE_PRIMARY, SIM_PROP_READ, { (uint8_t)uuid, (uint8_t)(uuid >> 8) });
+}
+
+/* characteristic declaration and value, return value handle */
+static uint16_t sim_char_add(sim_peripheral_t* p, uint16_t uuid, uint8_t props, std::vector<uint8_t> value)
+{
+	uint16_t handle = (uint16_t)p->attrs.size() + 2;
+	sim_attr_add(p, BLE_UUID_CHARACTERISTIC, SIM_PROP_READ,
+		{ props, (uint8_t)handle, (uint8_t)(handle >> 8), (uint8_t)uuid, (uint8_t)(uuid >> 8) });
+	sim_attr_add(p, uuid, props, value);
+	return handle;
+}
+
+static void sim_cccd_add(sim_peripheral_t* p)
+{
+	sim_attr_add(p, BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG, SIM_PROP_READ | SIM_PROP_WRITE, { 0, 0 });
+}
+
+static void sim_peripheral_build(sim_peripheral_t* p, uint32_t index)
+{
+	uint64_t state = m_config.seed ^ ((uint64_t)(index + 1) << 32);
+
+	p->addr = { 0 };
+	p->addr.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+	sim_random_fill(&state, p->addr.addr, BLE_GAP_ADDR_LEN);
+	p->addr.addr[BLE_GAP_ADDR_LEN - 1] |= 0xC0; /* two most significant bits of static address */
+
+	sim_random_fill(&state, p->ltk, sizeof(p->ltk));
+	sim_random_fill(&state, p->rand, sizeof(p->rand));
+	p->ediv = (uint16_t)sim_random(&state);
+	sim_random_fill(&state, p->irk, sizeof(p->irk));
+	// random 256 bits are almost always a valid private key, take the next one if not
+	do {
+		sim_random_fill(&state, p->sk, sizeof(p->sk));
+	} while (ecc_p256_compute_pubkey(p->sk, p->pk.pk) != 1);
+	p->conn_handle = BLE_CONN_HANDLE_INVALID;
+
+	char name[16] = { 0 };
+	int name_len = snprintf(name, sizeof(name), "SIM-%02u", index);
+	p->adv_data = { 0x02, 0x01, 0x06 }; /* flags: LE general discoverable, BR/EDR not supported */
+	p->adv_data.push_back((uint8_t)(name_len + 1));
+	p->adv_data.push_back(0x09); /* complete local name */
+	p->adv_data.insert(p->adv_data.end(), name, name + name_len);
+	p->adv_data.insert(p->adv_data.end(), { 0x05, 0x03, /* complete list of 16-bit service UUIDs */
+		(uint8_t)SIM_UUID_HID_SRV, (uint8_t)(SIM_UUID_HID_SRV >> 8), (uint8_t)SIM_UUID_BATTERY_SRV, (uint8_t)(SIM_UUID_BATTERY_SRV >> 8) });
+	p->adv_data.insert(p->adv_data.end(), { 0x03, 0x19, (uint8_t)SIM_APPEARANCE_KEYBOARD, (uint8_t)(SIM_APPEARANCE_KEYBOARD >> 8) });
+
+	p->attrs.clear();
+	sim_service_add(p, BLE_UUID_GAP);
+	sim_char_add(p, BLE_UUID_GAP_CHARACTERISTIC_DEVICE_NAME, SIM_PROP_READ, std::vector<uint8_t>(name, name + name_len));
+	sim_char_add(p, BLE_UUID_GAP_CHARACTERISTIC_APPEARANCE, SIM_PROP_READ,
+		{ (uint8_t)SIM_APPEARANCE_KEYBOARD, (uint8_t)(SIM_APPEARANCE_KEYBOARD >> 8) });
+
+	sim_service_add(p, SIM_UUID_BATTERY_SRV);
+	sim_char_add(p, SIM_UUID_BATTERY_LEVEL_CHAR, SIM_PROP_READ | SIM_PROP_NOTIFY, { (uint8_t)(100 - index % 50) });
+	sim_cccd_add(p);
+
+	sim_service_add(p, SIM_UUID_HID_SRV);
+	sim_char_add(p, SIM_UUID_HID_INFORMATION, SIM_PROP_READ, { 0x11, 0x01, 0x00, 0x02 });
+	sim_char_add(p, SIM_UUID_REPORT_MAP, SIM_PROP_READ, std::vector<uint8_t>(m_report_map, m_report_map + sizeof(m_report_map)));
+	sim_char_add(p, SIM_UUID_PROTOCOL_MODE, SIM_PROP_READ | SIM_PROP_WRITE_WO_RESP, { 0x01 });
+	// input report notified by notify_interval_ms
+	sim_char_add(p, SIM_UUID_REPORT, SIM_PROP_READ | SIM_PROP_NOTIFY, std::vector<uint8_t>(m_config.notify_len, 0));
+	sim_cccd_add(p);
+	sim_attr_add(p, SIM_UUID_REPORT_REF_DESCR, SIM_PROP_READ, { 0x01, 0x01 }); /* report id 1, input */
+	// output report takes long writes
+	sim_char_add(p, SIM_UUID_REPORT, SIM_PROP_READ | SIM_PROP_WRITE | SIM_PROP_WRITE_WO_RESP, { 0x00 });
+	sim_attr_add(p, SIM_UUID_REPORT_REF_DESCR, SIM_PROP_READ, { 0x02, 0x02 }); /* report id 2, output */
+	sim_char_add(p, SIM_UUID_HID_CONTROL_POINT, SIM_PROP_WRITE_WO_RESP, { 0x00 });
+}
+
+static void sim_adv_report(std::vector<sim_evt_t>& evts, sim_peripheral_t* p)
+{
+	auto p_gap_evt = sim_gap_evt(evts, BLE_GAP_EVT_ADV_REPORT, BLE_CONN_HANDLE_INVALID);
+	auto report = &p_gap_evt->params.adv_report;
+	report->peer_addr = p->addr;
+	report->rssi = (int8_t)(m_config.rssi_min + (int)(sim_random(&m_rng) % (uint64_t)(m_config.rssi_max - m_config.rssi_min + 1)));
+#if NRF_SD_BLE_API >= 6
+	report->type.connectable = 1;
+	report->type.scannable = 1;
+	report->primary_phy = BLE_GAP_PHY_1MBPS;
+	report->secondary_phy = BLE_GAP_PHY_NOT_SET;
+	report->tx_power = 127; /* not available */
+	report->ch_index = (uint8_t)(37 + sim_random(&m_rng) % 3);
+	report->set_id = 0xFF; /* not available */
+	// report data is in the buffer given to scan start, scanning pauses until caller is done with it
+	uint16_t len = (uint16_t)std::min<size_t>(p->adv_data.size(), m_scan_buffer.len);
+	memcpy(m_scan_buffer.p_data, p->adv_data.data(), len);
+	report->data.p_data = m_scan_buffer.p_data;
+	report->data.len = len;
+	m_scan_paused = true;
+#else
+	report->scan_rsp = 0;
+	report->type = 0; /* BLE_GAP_ADV_TYPE_ADV_IND */
+	report->dlen = (uint8_t)std::min<size_t>(p->adv_data.size(), sizeof(report->data));
+	memcpy(report->data, p->adv_data.data(), report->dlen);
+#endif
+	m_stats.adv_reports++;
+}
+
+/* advertising event of peripheral, reported if scanning and not connected */
+static void sim_adv_event(std::vector<sim_evt_t>& evts, uint32_t index, uint64_t scan_generation)
+{
+	if (!m_scanning || scan_generation != m_scan_generation)
+		return;
+
+	auto p = &m_peripherals[index];
+	if (p->conn_handle == BLE_CONN_HANDLE_INVALID && !m_scan_paused)
+		sim_adv_report(evts, p);
+
+	uint64_t delay_us = (uint64_t)m_config.adv_interval_ms * 1000 + sim_random(&m_rng) % (SIM_ADV_DELAY_MAX_MS * 1000);
+	sim_schedule(delay_us, [index, scan_generation](std::vector<sim_evt_t>& evts) {
+		sim_adv_event(evts, index, scan_generation);
+	});
+}
+
+static void sim_scan_begin(uint32_t timeout_ms)
+{
+	m_scanning = true;
+	m_scan_paused = false;
+	uint64_t scan_generation = ++m_scan_generation;
+	for (uint32_t i = 0; i < m_peripherals.size(); i++) {
+		uint64_t delay_us = sim_random(&m_rng) % ((uint64_t)m_config.adv_interval_ms * 1000);
+		sim_schedule(delay_us, [i, scan_generation](std::vector<sim_evt_t>& evts) {
+			sim_adv_event(evts, i, scan_generation);
+		});
+	}
+
+	if (timeout_ms == 0)
+		return;
+	sim_schedule((uint64_t)timeout_ms * 1000, [scan_generation](std::vector<sim_evt_t>& evts) {
+		if (!m_scanning || scan_generation != m_scan_generation)
+			return;
+		m_scanning = false;
+		auto p_gap_evt = sim_gap_evt(evts, BLE_GAP_EVT_TIMEOUT, BLE_CONN_HANDLE_INVALID);
+		p_gap_evt->params.timeout.src = BLE_GAP_TIMEOUT_SRC_SCAN;
+#if NRF_SD_BLE_API >= 6
+		p_gap_evt->params.timeout.params.adv_report_buffer = m_scan_buffer;
+#endif
+	});
+}
+
+static void sim_conn_close(std::vector<sim_evt_t>& evts, uint16_t conn_handle, uint64_t generation, uint8_t reason)
+{
+	auto conn = sim_conn_find(conn_handle, generation);
+	if (conn == NULL)
+		return;
+
+	// GATT server of peripheral forgets CCCDs of the client
+	auto p = &m_peripherals[conn->peripheral];
+	for (auto& attr : p->attrs) {
+		if (attr.uuid == BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG)
+			attr.value.assign(2, 0);
+	}
+	p->conn_handle = BLE_CONN_HANDLE_INVALID;
+	m_conns.erase(conn_handle);
+
+	auto p_gap_evt = sim_gap_evt(evts, BLE_GAP_EVT_DISCONNECTED, conn_handle);
+	p_gap_evt->params.disconnected.reason = reason;
+}
+
+/* notification of a value handle while its CCCD is enabled */
+static void sim_notify_event(std::vector<sim_evt_t>& evts, uint16_t conn_handle, uint64_t generation, uint16_t handle)
+{
+	auto conn = sim_conn_find(conn_handle, generation);
+	if (conn == NULL)
+		return;
+	auto p = &m_peripherals[conn->peripheral];
+	auto cccd = sim_attr_find(p, handle + 1);
+	if (cccd == NULL || cccd->uuid != BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG || (cccd->value[0] & 0x01) == 0) {
+		conn->notifying.erase(handle);
+		return;
+	}
+
+	auto value = &sim_attr_find(p, handle)->value;
+	uint32_t seq = conn->hvx_seq++;
+	if (value->size() == 1)
+		(*value)[0] = (uint8_t)(100 - seq % 101);
+	else {
+		for (size_t i = 0; i < value->size(); i++)
+			(*value)[i] = (uint8_t)(seq + i);
+	}
+
+	uint16_t len = (uint16_t)std::min<size_t>(value->size(), conn->mtu - 3);
+	auto p_gattc_evt = sim_gattc_evt(evts, BLE_GATTC_EVT_HVX, conn_handle, BLE_GATT_STATUS_SUCCESS, 0, len);
+	p_gattc_evt->params.hvx.handle = handle;
+	p_gattc_evt->params.hvx.type = BLE_GATT_HVX_NOTIFICATION;
+	p_gattc_evt->params.hvx.len = len;
+	memcpy(p_gattc_evt->params.hvx.data, value->data(), len);
+	m_stats.notifications++;
+	m_stats.notified_bytes += len;
+
+	sim_schedule((uint64_t)m_config.notify_interval_ms * 1000, [conn_handle, generation, handle](std::vector<sim_evt_t>& evts) {
+		sim_notify_event(evts, conn_handle, generation, handle);
+	});
+}
+
+/* CCCD written by client, start notifying its characteristic */
+static void sim_cccd_written(sim_conn_t* conn, uint16_t conn_handle, uint16_t cccd_handle)
+{
+	auto p = &m_peripherals[conn->peripheral];
+	if ((p->attrs[cccd_handle - 1].value[0] & 0x01) == 0 || m_config.notify_interval_ms == 0)
+		return;
+	uint16_t handle = sim_char_value_handle(p, cccd_handle);
+	if (handle == 0 || (p->attrs[handle - 1].perm & SIM_PROP_NOTIFY) == 0 || conn->notifying.count(handle) > 0)
+		return;
+
+	conn->notifying.insert(handle);
+	uint64_t generation = conn->generation;
+	sim_schedule((uint64_t)m_config.notify_interval_ms * 1000, [conn_handle, generation, handle](std::vector<sim_evt_t>& evts) {
+		sim_notify_event(evts, conn_handle, generation, handle);
+	});
+}
+
+/* pairing of Just Works finished, keys are written to keyset given by sd_ble_gap_sec_params_reply */
+static void sim_pairing_complete(std::vector<sim_evt_t>& evts, uint16_t conn_handle, uint64_t generation, uint8_t status)
+{
+	auto conn = sim_conn_find(conn_handle, generation);
+	if (conn == NULL || conn->pairing == false)
+		return;
+	conn->pairing = false;
+
+	auto p = &m_peripherals[conn->peripheral];
+	auto sec_params = conn->sec_params;
+	ble_gap_evt_auth_status_t auth_status = { 0 };
+	auth_status.auth_status = status;
+	if (status != BLE_GAP_SEC_STATUS_SUCCESS) {
+		auth_status.error_src = 1; /* BLE_GAP_SEC_STATUS_SOURCE_REMOTE */
+		sim_gap_evt(evts, BLE_GAP_EVT_AUTH_STATUS, conn_handle)->params.auth_status = auth_status;
+		return;
+	}
+
+	conn->conn_sec.sec_mode.sm = 1;
+	conn->conn_sec.sec_mode.lv = 2; /* unauthenticated encryption */
+	conn->conn_sec.encr_key_size = SIM_ENC_KEY_SIZE;
+	sim_gap_evt(evts, BLE_GAP_EVT_CONN_SEC_UPDATE, conn_handle)->params.conn_sec_update.conn_sec = conn->conn_sec;
+
+	auth_status.bonded = sec_params.bond;
+	auth_status.lesc = sec_params.lesc;
+	auth_status.sm1_levels.lv1 = 1;
+	auth_status.sm1_levels.lv2 = 1;
+	if (sec_params.bond) {
+		// LESC LTK is generated by both sides instead of distributed
+		auth_status.kdist_own.enc = sec_params.lesc ? 0 : sec_params.kdist_own.enc;
+		auth_status.kdist_own.id = sec_params.kdist_own.id;
+		auth_status.kdist_peer.enc = sec_params.lesc ? 0 : sec_params.kdist_peer.enc;
+		auth_status.kdist_peer.id = sec_params.kdist_peer.id;
+	}
+
+	auto keys_own = conn->keyset.keys_own;
+	auto keys_peer = conn->keyset.keys_peer;
+	if (sec_params.bond && sec_params.lesc && keys_own.p_enc_key) {
+		*keys_own.p_enc_key = { 0 };
+		memcpy(keys_own.p_enc_key->enc_info.ltk, p->ltk, BLE_GAP_SEC_KEY_LEN);
+		keys_own.p_enc_key->enc_info.lesc = 1;
+		keys_own.p_enc_key->enc_info.ltk_len = SIM_ENC_KEY_SIZE;
+	}
+	if (auth_status.kdist_own.enc && keys_own.p_enc_key) {
+		*keys_own.p_enc_key = { 0 };
+		sim_random_fill(&m_rng, keys_own.p_enc_key->enc_info.ltk, BLE_GAP_SEC_KEY_LEN);
+		keys_own.p_enc_key->enc_info.ltk_len = SIM_ENC_KEY_SIZE;
+	}
+	if (auth_status.kdist_peer.enc && keys_peer.p_enc_key) {
+		*keys_peer.p_enc_key = { 0 };
+		memcpy(keys_peer.p_enc_key->enc_info.ltk, p->ltk, BLE_GAP_SEC_KEY_LEN);
+		keys_peer.p_enc_key->enc_info.ltk_len = SIM_ENC_KEY_SIZE;
+		keys_peer.p_enc_key->master_id.ediv = p->ediv;
+		memcpy(keys_peer.p_enc_key->master_id.rand, p->rand, BLE_GAP_SEC_RAND_LEN);
+	}
+	if (auth_status.kdist_peer.id && keys_peer.p_id_key) {
+		memcpy(keys_peer.p_id_key->id_info.irk, p->irk, BLE_GAP_SEC_KEY_LEN);
+		keys_peer.p_id_key->id_addr_info = p->addr;
+	}
+
+	sim_gap_evt(evts, BLE_GAP_EVT_AUTH_STATUS, conn_handle)->params.auth_status = auth_status;
+}
+
+#pragma endregion
+
+
+#pragma region /** RPC and common calls */
+
+static void sim_run(uint64_t open_generation)
+{
+	std::unique_lock<std::mutex> lck(m_mtx);
+	while (m_opened && open_generation == m_open_generation) {
+		if (m_tasks.empty()) {
+			m_cond.wait(lck);
+			continue;
+		}
+		auto due = m_tasks.top().due;
+		if (sim_clock_t::now() < due) {
+			m_cond.wait_until(lck, due);
+			continue;
+		}
+
+		sim_job_t job = m_tasks.top().job;
+		m_tasks.pop();
+		std::vector<sim_evt_t> evts;
+		job(evts);
+		m_stats.events += (uint32_t)evts.size();
+		auto evt_handler = m_evt_handler;
+
+		// handler may call back into simulator
+		lck.unlock();
+		for (auto& evt : evts)
+			evt_handler((adapter_t*)m_adapter, (ble_evt_t*)evt.data());
+		lck.lock();
+	}
+}
+
+static uint32_t sim_rpc_open(adapter_t* adapter, sd_rpc_status_handler_t status_handler, sd_rpc_evt_handler_t event_handler, sd_rpc_log_handler_t log_handler)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (m_opened || event_handler == NULL)
+		return NRF_ERROR_INVALID_STATE;
+
+	m_evt_handler = event_handler;
+	m_status_handler = status_handler;
+	m_opened = true;
+	m_thread = std::thread(sim_run, ++m_open_generation);
+	return NRF_SUCCESS;
+}
+
+static void sim_state_reset()
+{
+	m_tasks = decltype(m_tasks)();
+	m_conns.clear();
+	for (auto& p : m_peripherals)
+		p.conn_handle = BLE_CONN_HANDLE_INVALID;
+	m_scanning = false;
+	m_scan_paused = false;
+	m_connecting = false;
+}
+
+static uint32_t sim_rpc_close(adapter_t* adapter)
+{
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		if (!m_opened)
+			return NRF_ERROR_INVALID_STATE;
+		m_opened = false;
+		sim_state_reset();
+	}
+	m_cond.notify_all();
+	// closed by event handler, the thread ends after handler returns
+	if (m_thread.get_id() == std::this_thread::get_id())
+		m_thread.detach();
+	else if (m_thread.joinable())
+		m_thread.join();
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_rpc_conn_reset(adapter_t* adapter, sd_rpc_reset_t reset_mode)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (!m_opened)
+		return NRF_ERROR_INVALID_STATE;
+	// links are gone without events as connectivity firmware restarts
+	sim_state_reset();
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_rpc_log_handler_severity_filter_set(adapter_t* adapter, sd_rpc_log_severity_t severity_filter)
+{
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_enable(adapter_t* adapter, uint32_t* p_app_ram_base)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_opened ? NRF_SUCCESS : NRF_ERROR_INVALID_STATE;
+}
+
+static uint32_t sim_ble_opt_set(adapter_t* adapter, uint32_t opt_id, ble_opt_t const* p_opt)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_opened ? NRF_SUCCESS : NRF_ERROR_INVALID_STATE;
+}
+
+static uint32_t sim_ble_version_get(adapter_t* adapter, ble_version_t* p_version)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (!m_opened)
+		return NRF_ERROR_INVALID_STATE;
+	p_version->version_number = 9; /* Bluetooth 5.0 */
+	p_version->company_id = 0x0059; /* Nordic Semiconductor */
+	p_version->subversion_number = 0xFFFF; /* not a SoftDevice build */
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_cfg_set(adapter_t* adapter, uint32_t cfg_id, ble_cfg_t const* p_cfg, uint32_t app_ram_base)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	return m_opened ? NRF_SUCCESS : NRF_ERROR_INVALID_STATE;
+}
+
+#pragma endregion
+
+
+#pragma region /** GAP calls */
+
+static uint32_t sim_ble_gap_addr_get(adapter_t* adapter, ble_gap_addr_t* p_addr)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	*p_addr = m_own_addr;
+	return NRF_SUCCESS;
+}
+
+#if NRF_SD_BLE_API >= 6
+static uint32_t sim_ble_gap_scan_start(adapter_t* adapter, ble_gap_scan_params_t const* p_scan_params, ble_data_t const* p_adv_report_buffer)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (!m_opened)
+		return NRF_ERROR_INVALID_STATE;
+	if (p_adv_report_buffer == NULL || p_adv_report_buffer->p_data == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+
+	// continue scanning paused by the last report
+	if (p_scan_params == NULL) {
+		if (!m_scanning || !m_scan_paused)
+			return NRF_ERROR_INVALID_STATE;
+		m_scan_buffer = *p_adv_report_buffer;
+		m_scan_paused = false;
+		m_stats.requests++;
+		return NRF_SUCCESS;
+	}
+
+	if (m_scanning || m_connecting)
+		return NRF_ERROR_INVALID_STATE;
+	m_scan_buffer = *p_adv_report_buffer;
+	m_stats.requests++;
+	sim_scan_begin(p_scan_params->timeout * 10); /* in 10 ms units */
+	return NRF_SUCCESS;
+}
+#else
+static uint32_t sim_ble_gap_scan_start(adapter_t* adapter, ble_gap_scan_params_t const* p_scan_params)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (!m_opened || m_scanning || m_connecting)
+		return NRF_ERROR_INVALID_STATE;
+	if (p_scan_params == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+	m_stats.requests++;
+	sim_scan_begin(p_scan_params->timeout * 1000); /* in seconds */
+	return NRF_SUCCESS;
+}
+#endif
+
+static uint32_t sim_ble_gap_scan_stop(adapter_t* adapter)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (!m_opened || !m_scanning)
+		return NRF_ERROR_INVALID_STATE;
+	m_scanning = false;
+	m_stats.requests++;
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_connect(adapter_t* adapter, ble_gap_addr_t const* p_peer_addr, ble_gap_scan_params_t const* p_scan_params,
+	ble_gap_conn_params_t const* p_conn_params, uint8_t conn_cfg_tag)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (!m_opened || m_connecting)
+		return NRF_ERROR_INVALID_STATE;
+	if (p_peer_addr == NULL || p_scan_params == NULL || p_conn_params == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+
+	// scanning stops when connecting
+	m_scanning = false;
+	m_connecting = true;
+	m_stats.requests++;
+	uint64_t connect_generation = ++m_connect_generation;
+
+	uint32_t index = (uint32_t)m_peripherals.size();
+	for (uint32_t i = 0; i < m_peripherals.size(); i++) {
+		if (memcmp(m_peripherals[i].addr.addr, p_peer_addr->addr, BLE_GAP_ADDR_LEN) == 0 &&
+			m_peripherals[i].conn_handle == BLE_CONN_HANDLE_INVALID) {
+			index = i;
+			break;
+		}
+	}
+
+	if (index == m_peripherals.size()) {
+#if NRF_SD_BLE_API >= 6
+		uint64_t timeout_ms = (uint64_t)p_scan_params->timeout * 10;
+#else
+		uint64_t timeout_ms = (uint64_t)p_scan_params->timeout * 1000;
+#endif
+		if (timeout_ms == 0)
+			timeout_ms = SIM_CONNECT_TIMEOUT_MS;
+		sim_schedule(timeout_ms * 1000, [connect_generation](std::vector<sim_evt_t>& evts) {
+			if (!m_connecting || connect_generation != m_connect_generation)
+				return;
+			m_connecting = false;
+			sim_gap_evt(evts, BLE_GAP_EVT_TIMEOUT, BLE_CONN_HANDLE_INVALID)->params.timeout.src = BLE_GAP_TIMEOUT_SRC_CONN;
+		});
+		return NRF_SUCCESS;
+	}
+
+	// connection request goes with the next advertising event of peripheral
+	ble_gap_conn_params_t conn_params = *p_conn_params;
+	conn_params.max_conn_interval = conn_params.min_conn_interval;
+	uint64_t delay_us = m_config.latency_us + sim_random(&m_rng) % ((uint64_t)m_config.adv_interval_ms * 1000);
+	sim_schedule(delay_us, [connect_generation, index, conn_params](std::vector<sim_evt_t>& evts) {
+		if (!m_connecting || connect_generation != m_connect_generation)
+			return;
+		m_connecting = false;
+
+		uint16_t conn_handle = 0;
+		while (m_conns.count(conn_handle) > 0)
+			conn_handle++;
+		auto p = &m_peripherals[index];
+		p->conn_handle = conn_handle;
+		sim_conn_t conn;
+		conn.peripheral = index;
+		conn.generation = ++m_generation;
+		conn.conn_params = conn_params;
+		m_conns[conn_handle] = conn;
+
+		auto p_gap_evt = sim_gap_evt(evts, BLE_GAP_EVT_CONNECTED, conn_handle);
+		p_gap_evt->params.connected.peer_addr = p->addr;
+		p_gap_evt->params.connected.role = BLE_GAP_ROLE_CENTRAL;
+		p_gap_evt->params.connected.conn_params = conn_params;
+
+		// peripheral asks for a larger ATT MTU as most HID devices do
+		uint64_t generation = conn.generation;
+		sim_schedule(m_config.latency_us, [conn_handle, generation](std::vector<sim_evt_t>& evts) {
+			if (sim_conn_find(conn_handle, generation) == NULL)
+				return;
+			auto p_evt = sim_evt_add(evts, BLE_GATTS_EVT_EXCHANGE_MTU_REQUEST);
+			p_evt->evt.gatts_evt.conn_handle = conn_handle;
+			p_evt->evt.gatts_evt.params.exchange_mtu_request.client_rx_mtu = SIM_ATT_MTU_MAX;
+		});
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_connect_cancel(adapter_t* adapter)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (!m_opened || !m_connecting)
+		return NRF_ERROR_INVALID_STATE;
+	// scheduled connection or timeout of this request is dropped by generation
+	m_connecting = false;
+	m_connect_generation++;
+	m_stats.requests++;
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_disconnect(adapter_t* adapter, uint16_t conn_handle, uint8_t hci_status_code)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	conn->disconnecting = true;
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation](std::vector<sim_evt_t>& evts) {
+		sim_conn_close(evts, conn_handle, generation, SIM_HCI_LOCAL_HOST_TERMINATED_CONNECTION);
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_conn_param_update(adapter_t* adapter, uint16_t conn_handle, ble_gap_conn_params_t const* p_conn_params)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	// NULL accepts parameters requested by peripheral, which never requests
+	if (err_code != NRF_SUCCESS || p_conn_params == NULL)
+		return err_code;
+
+	ble_gap_conn_params_t conn_params = *p_conn_params;
+	conn_params.max_conn_interval = conn_params.min_conn_interval;
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, conn_params](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		conn->conn_params = conn_params;
+		sim_gap_evt(evts, BLE_GAP_EVT_CONN_PARAM_UPDATE, conn_handle)->params.conn_param_update.conn_params = conn_params;
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_data_length_update(adapter_t* adapter, uint16_t conn_handle,
+	ble_gap_data_length_params_t const* p_dl_params, ble_gap_data_length_limitation_t* p_dl_limitation)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	ble_gap_data_length_params_t effective = { SIM_DATA_LENGTH_MAX, SIM_DATA_LENGTH_MAX, SIM_DATA_LENGTH_TIME_MAX_US, SIM_DATA_LENGTH_TIME_MAX_US };
+	if (p_dl_params != NULL) {
+		if (p_dl_params->max_tx_octets != BLE_GAP_DATA_LENGTH_AUTO)
+			effective.max_tx_octets = std::min<uint16_t>(p_dl_params->max_tx_octets, SIM_DATA_LENGTH_MAX);
+		if (p_dl_params->max_rx_octets != BLE_GAP_DATA_LENGTH_AUTO)
+			effective.max_rx_octets = std::min<uint16_t>(p_dl_params->max_rx_octets, SIM_DATA_LENGTH_MAX);
+	}
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, effective](std::vector<sim_evt_t>& evts) {
+		if (sim_conn_find(conn_handle, generation) == NULL)
+			return;
+		sim_gap_evt(evts, BLE_GAP_EVT_DATA_LENGTH_UPDATE, conn_handle)->params.data_length_update.effective_params = effective;
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_phy_update(adapter_t* adapter, uint16_t conn_handle, ble_gap_phys_t const* p_gap_phys)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+	if (p_gap_phys == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+
+	// peripheral supports 1M and 2M, fastest one in common
+	auto pick = [](uint8_t phys) -> uint8_t {
+		if (phys == BLE_GAP_PHY_AUTO || (phys & BLE_GAP_PHY_2MBPS))
+			return BLE_GAP_PHY_2MBPS;
+		return BLE_GAP_PHY_1MBPS;
+	};
+	uint8_t tx_phy = pick(p_gap_phys->tx_phys);
+	uint8_t rx_phy = pick(p_gap_phys->rx_phys);
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, tx_phy, rx_phy](std::vector<sim_evt_t>& evts) {
+		if (sim_conn_find(conn_handle, generation) == NULL)
+			return;
+		auto p_gap_evt = sim_gap_evt(evts, BLE_GAP_EVT_PHY_UPDATE, conn_handle);
+		p_gap_evt->params.phy_update.status = BLE_HCI_STATUS_CODE_SUCCESS;
+		p_gap_evt->params.phy_update.tx_phy = tx_phy;
+		p_gap_evt->params.phy_update.rx_phy = rx_phy;
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_authenticate(adapter_t* adapter, uint16_t conn_handle, ble_gap_sec_params_t const* p_sec_params)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+	if (p_sec_params == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+	if (conn->pairing)
+		return NRF_ERROR_BUSY;
+
+	conn->pairing = true;
+	conn->sec_params = *p_sec_params;
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation](std::vector<sim_evt_t>& evts) {
+		if (sim_conn_find(conn_handle, generation) == NULL)
+			return;
+		// peripheral without IO capabilities, distributes its LTK and IRK
+		ble_gap_sec_params_t peer_params = { 0 };
+		peer_params.bond = 1;
+		peer_params.lesc = 1;
+		peer_params.io_caps = BLE_GAP_IO_CAPS_NONE;
+		peer_params.min_key_size = 7;
+		peer_params.max_key_size = SIM_ENC_KEY_SIZE;
+		peer_params.kdist_own.enc = 1;
+		peer_params.kdist_own.id = 1;
+		peer_params.kdist_peer.enc = 1;
+		peer_params.kdist_peer.id = 1;
+		sim_gap_evt(evts, BLE_GAP_EVT_SEC_PARAMS_REQUEST, conn_handle)->params.sec_params_request.peer_params = peer_params;
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_sec_params_reply(adapter_t* adapter, uint16_t conn_handle, uint8_t sec_status,
+	ble_gap_sec_params_t const* p_sec_params, ble_gap_sec_keyset_t const* p_sec_keyset)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+	if (conn->pairing == false)
+		return NRF_ERROR_INVALID_STATE;
+
+	uint64_t generation = conn->generation;
+	if (sec_status != BLE_GAP_SEC_STATUS_SUCCESS) {
+		sim_schedule(m_config.latency_us, [conn_handle, generation, sec_status](std::vector<sim_evt_t>& evts) {
+			sim_pairing_complete(evts, conn_handle, generation, sec_status);
+		});
+		return NRF_SUCCESS;
+	}
+
+	conn->keyset = p_sec_keyset ? *p_sec_keyset : ble_gap_sec_keyset_t{ 0 };
+	if (conn->sec_params.lesc == 0) {
+		sim_schedule(m_config.latency_us, [conn_handle, generation](std::vector<sim_evt_t>& evts) {
+			sim_pairing_complete(evts, conn_handle, generation, BLE_GAP_SEC_STATUS_SUCCESS);
+		});
+		return NRF_SUCCESS;
+	}
+	// own public key is sent to peripheral right away
+	if (conn->keyset.keys_own.p_pk == NULL)
+		return NRF_ERROR_INVALID_PARAM;
+
+	sim_schedule(m_config.latency_us, [conn_handle, generation](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		auto p = &m_peripherals[conn->peripheral];
+		if (conn->keyset.keys_peer.p_pk)
+			*conn->keyset.keys_peer.p_pk = p->pk;
+		auto p_gap_evt = sim_gap_evt(evts, BLE_GAP_EVT_LESC_DHKEY_REQUEST, conn_handle);
+		p_gap_evt->params.lesc_dhkey_request.p_pk_peer = &p->pk;
+		p_gap_evt->params.lesc_dhkey_request.oobd_req = conn->sec_params.oob;
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_auth_key_reply(adapter_t* adapter, uint16_t conn_handle, uint8_t key_type, uint8_t const* p_key)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	return sim_conn_request(conn_handle, &conn);
+}
+
+static uint32_t sim_ble_gap_lesc_dhkey_reply(adapter_t* adapter, uint16_t conn_handle, ble_gap_lesc_dhkey_t const* p_dhkey)
+{
+	uint8_t sk[ECC_P256_SK_LEN];
+	uint8_t pk[ECC_P256_PK_LEN];
+	uint64_t generation = 0;
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		sim_conn_t* conn = NULL;
+		uint32_t err_code = sim_conn_request(conn_handle, &conn);
+		if (err_code != NRF_SUCCESS)
+			return err_code;
+		if (p_dhkey == NULL)
+			return NRF_ERROR_INVALID_ADDR;
+		if (conn->pairing == false || conn->keyset.keys_own.p_pk == NULL)
+			return NRF_ERROR_INVALID_STATE;
+		memcpy(sk, m_peripherals[conn->peripheral].sk, ECC_P256_SK_LEN);
+		memcpy(pk, conn->keyset.keys_own.p_pk->pk, ECC_P256_PK_LEN);
+		generation = conn->generation;
+	}
+
+	// peripheral computes its DHKey as well, out of the lock as the caller does
+	uint8_t dhkey[BLE_GAP_LESC_DHKEY_LEN] = { 0 };
+	int ecc_res = ecc_p256_valid_public_key(pk);
+	if (ecc_res == 1)
+		ecc_res = ecc_p256_compute_sharedsecret(sk, pk, dhkey);
+	uint8_t status = (ecc_res == 1 && secure_compare(dhkey, p_dhkey->key, BLE_GAP_LESC_DHKEY_LEN) == 1) ?
+		BLE_GAP_SEC_STATUS_SUCCESS : BLE_GAP_SEC_STATUS_DHKEY_FAILURE;
+	secure_zero(sk, sizeof(sk));
+	secure_zero(dhkey, sizeof(dhkey));
+
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (sim_conn_find(conn_handle, generation) == NULL)
+		return BLE_ERROR_INVALID_CONN_HANDLE;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, status](std::vector<sim_evt_t>& evts) {
+		sim_pairing_complete(evts, conn_handle, generation, status);
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_lesc_oob_data_set(adapter_t* adapter, uint16_t conn_handle,
+	ble_gap_lesc_oob_data_t const* p_oobd_own, ble_gap_lesc_oob_data_t const* p_oobd_peer)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	return sim_conn_request(conn_handle, &conn);
+}
+
+static uint32_t sim_ble_gap_encrypt(adapter_t* adapter, uint16_t conn_handle, ble_gap_master_id_t const* p_master_id, ble_gap_enc_info_t const* p_enc_info)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+	if (p_master_id == NULL || p_enc_info == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+	if (conn->pairing)
+		return NRF_ERROR_BUSY;
+
+	// LESC key has zero EDIV and Rand, legacy one is looked up by them
+	auto p = &m_peripherals[conn->peripheral];
+	bool match = secure_compare(p_enc_info->ltk, p->ltk, BLE_GAP_SEC_KEY_LEN) == 1 &&
+		(p_enc_info->lesc || (p_master_id->ediv == p->ediv && memcmp(p_master_id->rand, p->rand, BLE_GAP_SEC_RAND_LEN) == 0));
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, match](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		// peripheral without the key rejects, link stays at level 1
+		if (match) {
+			conn->conn_sec.sec_mode.sm = 1;
+			conn->conn_sec.sec_mode.lv = 2;
+			conn->conn_sec.encr_key_size = SIM_ENC_KEY_SIZE;
+		}
+		sim_gap_evt(evts, BLE_GAP_EVT_CONN_SEC_UPDATE, conn_handle)->params.conn_sec_update.conn_sec = conn->conn_sec;
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gap_conn_sec_get(adapter_t* adapter, uint16_t conn_handle, ble_gap_conn_sec_t* p_conn_sec)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+	if (p_conn_sec == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+	*p_conn_sec = conn->conn_sec;
+	return NRF_SUCCESS;
+}
+
+#pragma endregion
+
+
+#pragma region /** GATT calls */
+
+static uint32_t sim_ble_gattc_primary_services_discover(adapter_t* adapter, uint16_t conn_handle, uint16_t start_handle, ble_uuid_t const* p_srvc_uuid)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_gattc_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	bool by_uuid = (p_srvc_uuid != NULL);
+	uint16_t uuid = by_uuid ? p_srvc_uuid->uuid : 0;
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, start_handle, by_uuid, uuid](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		conn->gattc_busy = false;
+
+		// Find By Type Value response has 4 bytes per service, Read By Group Type one has 6
+		auto p = &m_peripherals[conn->peripheral];
+		size_t max = (conn->mtu - 2) / (by_uuid ? 4 : 6);
+		std::vector<ble_gattc_service_t> services;
+		for (uint16_t h = std::max<uint16_t>(start_handle, 1); h <= p->attrs.size() && services.size() < max; h++) {
+			auto attr = &p->attrs[h - 1];
+			if (attr->uuid != BLE_UUID_SERVICE_PRIMARY)
+				continue;
+			uint16_t srvc_uuid = (uint16_t)(attr->value[0] | (attr->value[1] << 8));
+			if (by_uuid && srvc_uuid != uuid)
+				continue;
+			ble_gattc_service_t service = { { srvc_uuid, BLE_UUID_TYPE_BLE }, { h, sim_service_end(p, h) } };
+			services.push_back(service);
+		}
+
+		uint16_t gatt_status = services.empty() ? BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND : BLE_GATT_STATUS_SUCCESS;
+		auto p_gattc_evt = sim_gattc_evt(evts, BLE_GATTC_EVT_PRIM_SRVC_DISC_RSP, conn_handle, gatt_status,
+			services.empty() ? start_handle : 0, services.size() * sizeof(ble_gattc_service_t));
+		p_gattc_evt->params.prim_srvc_disc_rsp.count = (uint16_t)services.size();
+		for (size_t i = 0; i < services.size(); i++)
+			p_gattc_evt->params.prim_srvc_disc_rsp.services[i] = services[i];
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gattc_characteristics_discover(adapter_t* adapter, uint16_t conn_handle, ble_gattc_handle_range_t const* p_handle_range)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (p_handle_range == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_gattc_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	ble_gattc_handle_range_t range = *p_handle_range;
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, range](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		conn->gattc_busy = false;
+
+		// Read By Type response has 7 bytes per characteristic declaration of 16-bit UUID
+		auto p = &m_peripherals[conn->peripheral];
+		size_t max = (conn->mtu - 2) / 7;
+		std::vector<ble_gattc_char_t> chars;
+		for (uint16_t h = std::max<uint16_t>(range.start_handle, 1); h <= std::min<size_t>(range.end_handle, p->attrs.size()) && chars.size() < max; h++) {
+			auto attr = &p->attrs[h - 1];
+			if (attr->uuid != BLE_UUID_CHARACTERISTIC)
+				continue;
+			ble_gattc_char_t c = { 0 };
+			uint8_t props = attr->value[0];
+			c.uuid.uuid = (uint16_t)(attr->value[3] | (attr->value[4] << 8));
+			c.uuid.type = BLE_UUID_TYPE_BLE;
+			c.char_props.read = (props & SIM_PROP_READ) ? 1 : 0;
+			c.char_props.write_wo_resp = (props & SIM_PROP_WRITE_WO_RESP) ? 1 : 0;
+			c.char_props.write = (props & SIM_PROP_WRITE) ? 1 : 0;
+			c.char_props.notify = (props & SIM_PROP_NOTIFY) ? 1 : 0;
+			c.handle_decl = h;
+			c.handle_value = (uint16_t)(attr->value[1] | (attr->value[2] << 8));
+			chars.push_back(c);
+		}
+
+		uint16_t gatt_status = chars.empty() ? BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND : BLE_GATT_STATUS_SUCCESS;
+		auto p_gattc_evt = sim_gattc_evt(evts, BLE_GATTC_EVT_CHAR_DISC_RSP, conn_handle, gatt_status,
+			chars.empty() ? range.start_handle : 0, chars.size() * sizeof(ble_gattc_char_t));
+		p_gattc_evt->params.char_disc_rsp.count = (uint16_t)chars.size();
+		for (size_t i = 0; i < chars.size(); i++)
+			p_gattc_evt->params.char_disc_rsp.chars[i] = chars[i];
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gattc_descriptors_discover(adapter_t* adapter, uint16_t conn_handle, ble_gattc_handle_range_t const* p_handle_range)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (p_handle_range == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_gattc_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	ble_gattc_handle_range_t range = *p_handle_range;
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, range](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		conn->gattc_busy = false;
+
+		// Find Information response has 4 bytes per attribute of 16-bit UUID
+		auto p = &m_peripherals[conn->peripheral];
+		size_t max = (conn->mtu - 2) / 4;
+		std::vector<ble_gattc_desc_t> descs;
+		for (uint16_t h = std::max<uint16_t>(range.start_handle, 1); h <= std::min<size_t>(range.end_handle, p->attrs.size()) && descs.size() < max; h++) {
+			ble_gattc_desc_t desc = { h, { p->attrs[h - 1].uuid, BLE_UUID_TYPE_BLE } };
+			descs.push_back(desc);
+		}
+
+		uint16_t gatt_status = descs.empty() ? BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND : BLE_GATT_STATUS_SUCCESS;
+		auto p_gattc_evt = sim_gattc_evt(evts, BLE_GATTC_EVT_DESC_DISC_RSP, conn_handle, gatt_status,
+			descs.empty() ? range.start_handle : 0, descs.size() * sizeof(ble_gattc_desc_t));
+		p_gattc_evt->params.desc_disc_rsp.count = (uint16_t)descs.size();
+		for (size_t i = 0; i < descs.size(); i++)
+			p_gattc_evt->params.desc_disc_rsp.descs[i] = descs[i];
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gattc_read(adapter_t* adapter, uint16_t conn_handle, uint16_t handle, uint16_t offset)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_gattc_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, handle, offset](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		conn->gattc_busy = false;
+
+		auto attr = sim_attr_find(&m_peripherals[conn->peripheral], handle);
+		uint16_t gatt_status = BLE_GATT_STATUS_SUCCESS;
+		if (attr == NULL)
+			gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_HANDLE;
+		else if ((attr->perm & SIM_PROP_READ) == 0)
+			gatt_status = BLE_GATT_STATUS_ATTERR_READ_NOT_PERMITTED;
+		else if (offset > attr->value.size())
+			gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_OFFSET;
+		else if (offset > 0 && attr->value.size() <= (size_t)(conn->mtu - 1))
+			gatt_status = BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_LONG;
+
+		uint16_t len = (gatt_status == BLE_GATT_STATUS_SUCCESS) ?
+			(uint16_t)std::min<size_t>(attr->value.size() - offset, conn->mtu - 1) : 0;
+		// error response carries the handle in error_handle only, read_rsp is left zero as by SoftDevice
+		auto p_gattc_evt = sim_gattc_evt(evts, BLE_GATTC_EVT_READ_RSP, conn_handle, gatt_status,
+			gatt_status == BLE_GATT_STATUS_SUCCESS ? 0 : handle, len);
+		if (gatt_status != BLE_GATT_STATUS_SUCCESS)
+			return;
+		p_gattc_evt->params.read_rsp.handle = handle;
+		p_gattc_evt->params.read_rsp.offset = offset;
+		p_gattc_evt->params.read_rsp.len = len;
+		if (len > 0)
+			memcpy(p_gattc_evt->params.read_rsp.data, &attr->value[offset], len);
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gattc_char_values_read(adapter_t* adapter, uint16_t conn_handle, uint16_t const* p_handles, uint16_t handle_count)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (p_handles == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_gattc_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	std::vector<uint16_t> handles(p_handles, p_handles + handle_count);
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, handles](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		conn->gattc_busy = false;
+
+		// Read Multiple response concatenates values up to ATT MTU - 1
+		auto p = &m_peripherals[conn->peripheral];
+		std::vector<uint8_t> values;
+		uint16_t gatt_status = BLE_GATT_STATUS_SUCCESS;
+		uint16_t error_handle = 0;
+		for (auto handle : handles) {
+			auto attr = sim_attr_find(p, handle);
+			if (attr == NULL || (attr->perm & SIM_PROP_READ) == 0) {
+				gatt_status = (attr == NULL) ? BLE_GATT_STATUS_ATTERR_INVALID_HANDLE : BLE_GATT_STATUS_ATTERR_READ_NOT_PERMITTED;
+				error_handle = handle;
+				values.clear();
+				break;
+			}
+			values.insert(values.end(), attr->value.begin(), attr->value.end());
+		}
+		if (values.size() > (size_t)(conn->mtu - 1))
+			values.resize(conn->mtu - 1);
+
+		auto p_gattc_evt = sim_gattc_evt(evts, BLE_GATTC_EVT_CHAR_VALS_READ_RSP, conn_handle, gatt_status, error_handle, values.size());
+		p_gattc_evt->params.char_vals_read_rsp.len = (uint16_t)values.size();
+		if (values.size() > 0)
+			memcpy(p_gattc_evt->params.char_vals_read_rsp.values, values.data(), values.size());
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gattc_char_value_by_uuid_read(adapter_t* adapter, uint16_t conn_handle, ble_uuid_t const* p_uuid, ble_gattc_handle_range_t const* p_handle_range)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (p_uuid == NULL || p_handle_range == NULL)
+		return NRF_ERROR_INVALID_ADDR;
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_gattc_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	uint16_t uuid = p_uuid->uuid;
+	ble_gattc_handle_range_t range = *p_handle_range;
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, uuid, range](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		conn->gattc_busy = false;
+
+		// Read By Type response has pairs of the same length, the first value decides it
+		auto p = &m_peripherals[conn->peripheral];
+		std::vector<uint8_t> pairs;
+		uint16_t count = 0;
+		size_t value_len = 0;
+		for (uint16_t h = std::max<uint16_t>(range.start_handle, 1); h <= std::min<size_t>(range.end_handle, p->attrs.size()); h++) {
+			auto attr = &p->attrs[h - 1];
+			if (attr->uuid != uuid || (attr->perm & SIM_PROP_READ) == 0)
+				continue;
+			size_t len = std::min<size_t>(attr->value.size(), conn->mtu - 4);
+			if (count == 0)
+				value_len = len;
+			else if (len != value_len || pairs.size() + 2 + value_len > (size_t)(conn->mtu - 2))
+				break;
+			pairs.push_back((uint8_t)h);
+			pairs.push_back((uint8_t)(h >> 8));
+			pairs.insert(pairs.end(), attr->value.begin(), attr->value.begin() + value_len);
+			count++;
+		}
+
+		uint16_t gatt_status = (count == 0) ? BLE_GATT_STATUS_ATTERR_ATTRIBUTE_NOT_FOUND : BLE_GATT_STATUS_SUCCESS;
+		auto p_gattc_evt = sim_gattc_evt(evts, BLE_GATTC_EVT_CHAR_VAL_BY_UUID_READ_RSP, conn_handle, gatt_status,
+			count == 0 ? range.start_handle : 0, pairs.size());
+		p_gattc_evt->params.char_val_by_uuid_read_rsp.count = count;
+		p_gattc_evt->params.char_val_by_uuid_read_rsp.value_len = (uint16_t)value_len;
+		if (pairs.size() > 0)
+			memcpy(p_gattc_evt->params.char_val_by_uuid_read_rsp.handle_value, pairs.data(), pairs.size());
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gattc_write(adapter_t* adapter, uint16_t conn_handle, ble_gattc_write_params_t const* p_write_params)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (p_write_params == NULL || (p_write_params->len > 0 && p_write_params->p_value == NULL))
+		return NRF_ERROR_INVALID_ADDR;
+
+	sim_conn_t* conn = NULL;
+	bool command = (p_write_params->write_op == BLE_GATT_OP_WRITE_CMD);
+	// write command goes to tx queue and does not block other procedures
+	uint32_t err_code = command ? sim_conn_request(conn_handle, &conn) : sim_gattc_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	ble_gattc_write_params_t params = *p_write_params;
+	std::vector<uint8_t> data(params.p_value, params.p_value + params.len);
+	uint64_t generation = conn->generation;
+	sim_schedule(m_config.latency_us, [conn_handle, generation, params, data](std::vector<sim_evt_t>& evts) {
+		auto conn = sim_conn_find(conn_handle, generation);
+		if (conn == NULL)
+			return;
+		auto p = &m_peripherals[conn->peripheral];
+		auto attr = sim_attr_find(p, params.handle);
+		uint8_t perm = (params.write_op == BLE_GATT_OP_WRITE_CMD) ? SIM_PROP_WRITE_WO_RESP : SIM_PROP_WRITE;
+
+		if (params.write_op == BLE_GATT_OP_WRITE_CMD) {
+			if (attr != NULL && (attr->perm & perm) && data.size() <= SIM_ATT_VALUE_MAX_LEN)
+				attr->value = data;
+			sim_gattc_evt(evts, BLE_GATTC_EVT_WRITE_CMD_TX_COMPLETE, conn_handle, BLE_GATT_STATUS_SUCCESS, 0)->params.write_cmd_tx_complete.count = 1;
+			return;
+		}
+		conn->gattc_busy = false;
+
+		uint16_t gatt_status = BLE_GATT_STATUS_SUCCESS;
+		uint16_t rsp_handle = params.handle;
+		if (params.write_op == BLE_GATT_OP_EXEC_WRITE_REQ) {
+			// queued parts are written in order, or dropped by cancel
+			if (params.flags == BLE_GATT_EXEC_WRITE_FLAG_PREPARED_WRITE) {
+				for (auto& part : conn->prep_writes) {
+					auto value = &p->attrs[part.handle - 1].value;
+					if (value->size() < part.offset + part.data.size())
+						value->resize(part.offset + part.data.size());
+					std::copy(part.data.begin(), part.data.end(), value->begin() + part.offset);
+				}
+			}
+			rsp_handle = conn->prep_writes.empty() ? 0 : conn->prep_writes.front().handle;
+			conn->prep_writes.clear();
+		}
+		else if (attr == NULL)
+			gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_HANDLE;
+		else if ((attr->perm & perm) == 0)
+			gatt_status = BLE_GATT_STATUS_ATTERR_WRITE_NOT_PERMITTED;
+		else if (params.offset + data.size() > SIM_ATT_VALUE_MAX_LEN)
+			gatt_status = BLE_GATT_STATUS_ATTERR_INVALID_ATT_VAL_LENGTH;
+		else if (params.write_op == BLE_GATT_OP_PREP_WRITE_REQ) {
+			sim_prep_write_t part = { params.handle, params.offset, data };
+			conn->prep_writes.push_back(part);
+		}
+		else {
+			attr->value = data;
+			if (attr->uuid == BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG)
+				sim_cccd_written(conn, conn_handle, params.handle);
+		}
+
+		// write response, prepare write response echoes the part
+		bool echo = (params.write_op == BLE_GATT_OP_PREP_WRITE_REQ && gatt_status == BLE_GATT_STATUS_SUCCESS);
+		auto p_gattc_evt = sim_gattc_evt(evts, BLE_GATTC_EVT_WRITE_RSP, conn_handle, gatt_status,
+			gatt_status == BLE_GATT_STATUS_SUCCESS ? 0 : params.handle, echo ? data.size() : 0);
+		p_gattc_evt->params.write_rsp.handle = (gatt_status == BLE_GATT_STATUS_SUCCESS) ? rsp_handle : 0;
+		p_gattc_evt->params.write_rsp.write_op = params.write_op;
+		p_gattc_evt->params.write_rsp.offset = params.offset;
+		p_gattc_evt->params.write_rsp.len = echo ? (uint16_t)data.size() : 0;
+		if (echo && data.size() > 0)
+			memcpy(p_gattc_evt->params.write_rsp.data, data.data(), data.size());
+	});
+	return NRF_SUCCESS;
+}
+
+static uint32_t sim_ble_gatts_exchange_mtu_reply(adapter_t* adapter, uint16_t conn_handle, uint16_t server_rx_mtu)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+	if (server_rx_mtu < BLE_GATT_ATT_MTU_DEFAULT)
+		return NRF_ERROR_INVALID_PARAM;
+	conn->mtu = std::min<uint16_t>(server_rx_mtu, SIM_ATT_MTU_MAX);
+	return NRF_SUCCESS;
+}
+
+#pragma endregion
+
+static const sd_api_t m_sim_api = {
+	sim_rpc_open,
+	sim_rpc_close,
+	sim_rpc_conn_reset,
+	sim_rpc_log_handler_severity_filter_set,
+
+	sim_ble_enable,
+	sim_ble_opt_set,
+	sim_ble_version_get,
+	sim_ble_cfg_set,
+
+	sim_ble_gap_addr_get,
+	sim_ble_gap_scan_start,
+	sim_ble_gap_scan_stop,
+	sim_ble_gap_connect,
+	sim_ble_gap_connect_cancel,
+	sim_ble_gap_disconnect,
+	sim_ble_gap_conn_param_update,
+	sim_ble_gap_data_length_update,
+	sim_ble_gap_phy_update,
+	sim_ble_gap_authenticate,
+	sim_ble_gap_sec_params_reply,
+	sim_ble_gap_auth_key_reply,
+	sim_ble_gap_lesc_dhkey_reply,
+	sim_ble_gap_lesc_oob_data_set,
+	sim_ble_gap_encrypt,
+	sim_ble_gap_conn_sec_get,
+
+	sim_ble_gattc_primary_services_discover,
+	sim_ble_gattc_characteristics_discover,
+	sim_ble_gattc_descriptors_discover,
+	sim_ble_gattc_read,
+	sim_ble_gattc_char_values_read,
+	sim_ble_gattc_char_value_by_uuid_read,
+	sim_ble_gattc_write,
+	sim_ble_gatts_exchange_mtu_reply,
+};
+
+uint32_t sim_configure(const sim_config_t* config)
+{
+	if (config == NULL)
+		return NRF_ERROR_NULL;
+	if (config->peripheral_count == 0 || config->peripheral_count > SIM_PERIPHERAL_MAX ||
+		config->adv_interval_ms < 20 || config->adv_interval_ms > 10240 ||
+		config->notify_len == 0 || config->notify_len > SIM_ATT_MTU_MAX - 3 ||
+		config->rssi_min > config->rssi_max)
+		return NRF_ERROR_INVALID_PARAM;
+
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (m_opened)
+		return NRF_ERROR_INVALID_STATE;
+
+	m_config = *config;
+	m_stats = { 0 };
+	m_rng = m_config.seed;
+	m_seq = 0;
+	m_own_addr = { 0 };
+	m_own_addr.addr_type = BLE_GAP_ADDR_TYPE_RANDOM_STATIC;
+	sim_random_fill(&m_rng, m_own_addr.addr, BLE_GAP_ADDR_LEN);
+	m_own_addr.addr[BLE_GAP_ADDR_LEN - 1] |= 0xC0;
+
+	m_peripherals.assign(m_config.peripheral_count, sim_peripheral_t());
+	for (uint32_t i = 0; i < m_peripherals.size(); i++)
+		sim_peripheral_build(&m_peripherals[i], i);
+	sim_state_reset();
+	return NRF_SUCCESS;
+}
+
+const sd_api_t* sim_api()
+{
+	return &m_sim_api;
+}
+
+
+adapter_t* sim_adapter()
+{
+	return (adapter_t*)m_adapter;
+}
+
+void sim_stats_get(sim_stats_t* stats)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	if (stats)
+		*stats = m_stats;
+}
+
+uint32_t sim_disconnect(uint16_t conn_handle, uint8_t reason)
+{
+	std::lock_guard<std::mutex> lck(m_mtx);
+	sim_conn_t* conn = NULL;
+	uint32_t err_code = sim_conn_request(conn_handle, &conn);
+	if (err_code != NRF_SUCCESS)
+		return err_code;
+
+	conn->disconnecting = true;
+	uint64_t generation = conn->generation;
+	sim_schedule(0, [conn_handle, generation, reason](std::vector<sim_evt_t>& evts) {
+		sim_conn_close(evts, conn_handle, generation, reason);
+	});
+	return NRF_SUCCESS;
+}
+
+uint32_t sim_transport_error(sd_rpc_app_status_t code)
+{
+	sd_rpc_status_handler_t status_handler = NULL;
+	{
+		std::lock_guard<std::mutex> lck(m_mtx);
+		if (!m_opened)
+			return NRF_ERROR_INVALID_STATE;
+		// firmware behind the broken transport loses its links without events
+		sim_state_reset();
+		status_handler = m_status_handler;
+	}
+	if (status_handler)
+		status_handler((adapter_t*)m_adapter, code, "simulated transport error");
+	return NRF_SUCCESS;
+}
+
+#else
+
+uint32_t sim_configure(const sim_config_t* config)
+{
+	return NRF_ERROR_NOT_SUPPORTED;
+}
+
+const sd_api_t* sim_api()
+{
+	return NULL;
+}
+
+adapter_t* sim_adapter()
+{
+	return NULL;
+}
+
+void sim_stats_get(sim_stats_t* stats)
+{
+}
+
+uint32_t sim_disconnect(uint16_t conn_handle, uint8_t reason)
+{
+	return NRF_ERROR_NOT_SUPPORTED;
+}
+
+uint32_t sim_transport_error(sd_rpc_app_status_t code)
+{
+	return NRF_ERROR_NOT_SUPPORTED;
+}
+
+#endif
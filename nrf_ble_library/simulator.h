@@ -0,0 +1,37 @@
+#pragma once
+#include "sd_api.h"
+
+// simulated connectivity backend for benchmarking without dongle, synthetic peripherals named "SIM-nn"
+// advertise GAP, battery and HID services, events are generated by one scheduler thread after
+// link latency of each request, peripherals, their keys and event order are decided by seed
+
+typedef struct _sim_config_t {
+	uint32_t seed;
+	uint16_t peripheral_count;
+	uint32_t adv_interval_ms; /* advertising interval of each peripheral, plus 0-10ms advDelay */
+	uint32_t notify_interval_ms; /* interval of notifications of each enabled CCCD, 0 disables */
+	uint16_t notify_len; /* length of HID input report, notifications are truncated to ATT MTU - 3 */
+	uint32_t latency_us; /* from a request to its response event */
+	int8_t rssi_min;
+	int8_t rssi_max;
+} sim_config_t;
+
+/* counters since sim_configure */
+typedef struct _sim_stats_t {
+	uint32_t events; /* events delivered to the event handler of sd_rpc_open */
+	uint32_t adv_reports;
+	uint32_t notifications;
+	uint64_t notified_bytes;
+	uint32_t requests; /* SoftDevice calls accepted */
+} sim_stats_t;
+
+// apply config before rpc_open of sim_api, return NRF_ERROR_INVALID_STATE if opened
+uint32_t sim_configure(const sim_config_t* config);
+// call table of simulator and the adapter to pass to its calls
+const sd_api_t* sim_api();
+adapter_t* sim_adapter();
+void sim_stats_get(sim_stats_t* stats);
+// peer terminated connection or link lost by reason(HCI status code), e.g. 0x08 supervision timeout
+uint32_t sim_disconnect(uint16_t conn_handle, uint8_t reason);
+// serial transport failed, links are dropped without events and status handler of rpc_open gets code
+uint32_t sim_transport_error(sd_rpc_app_status_t code);
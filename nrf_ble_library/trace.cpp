@@ -0,0 +1,424 @@
+#include "trace.h"
+#include "platform.h"
+
+#include <string.h>
+#include <stdio.h>
+
+#include <vector>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <chrono>
+
+/*
+file layout: "NBLT" magic, u16 version, u8 SoftDevice API version, u8 pointer size, u16 sizeof(ble_evt_t),
+then records: varint microseconds since previous record, varint event length, event bytes without
+trailing zeros, varint length of pointed data, pointed data,
+events are raw structs so a trace is replayed only by builds of the same API version and layout
+*/
+#define TRACE_MAGIC "NBLT"
+#define TRACE_VERSION 1
+#define TRACE_HEADER_LEN 10
+#define TRACE_RECORD_MAX (2 * 5 + TRACE_EVT_LEN_MAX + TRACE_EXT_LEN_MAX)
+#define TRACE_FILE_BUFFER 0x10000
+
+typedef std::chrono::steady_clock trace_clock_t;
+
+static std::mutex m_trace_mtx;
+static std::atomic<bool> m_recording(false);
+static FILE* m_record_file = NULL;
+static trace_clock_t::time_point m_record_last;
+static uint32_t m_record_events = 0;
+static uint64_t m_record_bytes = 0;
+static std::vector<uint8_t> m_record_buf;
+
+static std::vector<uint8_t> m_replay_data; /* loaded trace file */
+static std::atomic<bool> m_opened(false);
+static sd_rpc_evt_handler_t m_evt_handler = NULL;
+static std::map<uint16_t, trace_handler_stats_t> m_handler_stats; /*evt id, latency*/
+alignas(8) static uint8_t m_adapter[64] = { 0 }; /* only its address is used to identify adapter */
+
+#pragma region /** Encoding */
+
+static void trace_header_build(uint8_t header[TRACE_HEADER_LEN])
+{
+	memcpy(header, TRACE_MAGIC, 4);
+	header[4] = TRACE_VERSION & 0xFF;
+	header[5] = (TRACE_VERSION >> 8) & 0xFF;
+	header[6] = NRF_SD_BLE_API;
+	header[7] = sizeof(void*);
+	header[8] = sizeof(ble_evt_t) & 0xFF;
+	header[9] = (sizeof(ble_evt_t) >> 8) & 0xFF;
+}
+
+static void varint_put(std::vector<uint8_t>& buf, uint64_t value)
+{
+	while (value >= 0x80) {
+		buf.push_back((uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+	buf.push_back((uint8_t)value);
+}
+
+/* return 0 if truncated or longer than 64 bits */
+static int varint_get(const uint8_t* data, size_t size, size_t* pos, uint64_t* value)
+{
+	*value = 0;
+	for (int shift = 0; shift < 64 && *pos < size; shift += 7) {
+		uint8_t b = data[(*pos)++];
+		*value |= (uint64_t)(b & 0x7F) << shift;
+		if ((b & 0x80) == 0)
+			return 1;
+	}
+	return 0;
+}
+
+/* data referred by pointer of event, recorded after event bytes since the pointer is meaningless in a file */
+static const uint8_t* trace_ext_get(const ble_evt_t* p_ble_evt, size_t* len)
+{
+	*len = 0;
+	switch (p_ble_evt->header.evt_id)
+	{
+#if NRF_SD_BLE_API >= 6
+	case BLE_GAP_EVT_ADV_REPORT:
+		*len = p_ble_evt->evt.gap_evt.params.adv_report.data.len;
+		return p_ble_evt->evt.gap_evt.params.adv_report.data.p_data;
+#endif
+	case BLE_GAP_EVT_LESC_DHKEY_REQUEST:
+		if (p_ble_evt->evt.gap_evt.params.lesc_dhkey_request.p_pk_peer == NULL)
+			return NULL;
+		*len = sizeof(ble_gap_lesc_p256_pk_t);
+		return (const uint8_t*)p_ble_evt->evt.gap_evt.params.lesc_dhkey_request.p_pk_peer;
+	default:
+		return NULL;
+	}
+}
+
+/* point event to its replayed data, or NULL if none was recorded */
+static void trace_ext_set(ble_evt_t* p_ble_evt, uint8_t* data, size_t len)
+{
+	switch (p_ble_evt->header.evt_id)
+	{
+#if NRF_SD_BLE_API >= 6
+	case BLE_GAP_EVT_ADV_REPORT:
+		p_ble_evt->evt.gap_evt.params.adv_report.data.p_data = len > 0 ? data : NULL;
+		p_ble_evt->evt.gap_evt.params.adv_report.data.len = (uint16_t)len;
+		break;
+#endif
+	case BLE_GAP_EVT_LESC_DHKEY_REQUEST:
+		p_ble_evt->evt.gap_evt.params.lesc_dhkey_request.p_pk_peer = len > 0 ? (ble_gap_lesc_p256_pk_t*)data : NULL;
+		break;
+	default:
+		break;
+	}
+}
+
+#pragma endregion
+
+#pragma region /** Recorder */
+
+uint32_t trace_record_start(const char* path)
+{
+	if (path == NULL)
+		return NRF_ERROR_NULL;
+
+	std::lock_guard<std::mutex> lck(m_trace_mtx);
+	if (m_recording)
+		return NRF_ERROR_INVALID_STATE;
+
+	FILE* f = NULL;
+	if (fopen_s(&f, path, "wb") != 0 || f == NULL)
+		return NRF_ERROR_INTERNAL;
+	// records are small, write them in large chunks out of event thread's way
+	setvbuf(f, NULL, _IOFBF, TRACE_FILE_BUFFER);
+
+	uint8_t header[TRACE_HEADER_LEN];
+	trace_header_build(header);
+	if (fwrite(header, 1, sizeof(header), f) != sizeof(header)) {
+		fclose(f);
+		return NRF_ERROR_INTERNAL;
+	}
+
+	m_record_file = f;
+	m_record_events = 0;
+	m_record_bytes = sizeof(header);
+	m_record_buf.reserve(TRACE_RECORD_MAX);
+	m_record_last = trace_clock_t::now();
+	m_recording = true;
+	return NRF_SUCCESS;
+}
+
+void trace_record(const ble_evt_t* p_ble_evt)
+{
+	if (!m_recording || p_ble_evt == NULL)
+		return;
+
+	auto now = trace_clock_t::now();
+	std::lock_guard<std::mutex> lck(m_trace_mtx);
+	if (!m_recording)
+		return;
+
+	// evt_len includes header, fixed size events may leave it unset
+	size_t len = p_ble_evt->header.evt_len >= sizeof(ble_evt_hdr_t) ? p_ble_evt->header.evt_len : sizeof(ble_evt_t);
+	if (len > TRACE_EVT_LEN_MAX)
+		len = TRACE_EVT_LEN_MAX;
+	auto bytes = (const uint8_t*)p_ble_evt;
+	while (len > sizeof(ble_evt_hdr_t) && bytes[len - 1] == 0)
+		len--;
+	size_t ext_len = 0;
+	auto ext = trace_ext_get(p_ble_evt, &ext_len);
+	if (ext == NULL || ext_len > TRACE_EXT_LEN_MAX)
+		ext_len = 0;
+
+	m_record_buf.clear();
+	varint_put(m_record_buf, std::chrono::duration_cast<std::chrono::microseconds>(now - m_record_last).count());
+	varint_put(m_record_buf, len);
+	m_record_buf.insert(m_record_buf.end(), bytes, bytes + len);
+	varint_put(m_record_buf, ext_len);
+	if (ext_len > 0)
+		m_record_buf.insert(m_record_buf.end(), ext, ext + ext_len);
+	m_record_last = now;
+
+	if (fwrite(m_record_buf.data(), 1, m_record_buf.size(), m_record_file) != m_record_buf.size())
+		return;
+	m_record_events++;
+	m_record_bytes += m_record_buf.size();
+}
+
+uint32_t trace_record_stop(uint32_t* events, uint64_t* bytes)
+{
+	std::lock_guard<std::mutex> lck(m_trace_mtx);
+	if (!m_recording)
+		return NRF_ERROR_INVALID_STATE;
+
+	m_recording = false;
+	bool ok = fclose(m_record_file) == 0;
+	m_record_file = NULL;
+	if (events)
+		*events = m_record_events;
+	if (bytes)
+		*bytes = m_record_bytes;
+	return ok ? NRF_SUCCESS : NRF_ERROR_INTERNAL;
+}
+
+#pragma endregion
+
+#pragma region /** Replay */
+
+/* walk records of loaded trace, return 0 at end of data or on a malformed record */
+static int trace_next(size_t* pos, uint64_t* delta_us, const uint8_t** evt, size_t* len, const uint8_t** ext, size_t* ext_len)
+{
+	const uint8_t* data = m_replay_data.data();
+	size_t size = m_replay_data.size();
+	uint64_t value = 0;
+	if (!varint_get(data, size, pos, delta_us))
+		return 0;
+	if (!varint_get(data, size, pos, &value) || value < sizeof(ble_evt_hdr_t) || value > TRACE_EVT_LEN_MAX || size - *pos < value)
+		return 0;
+	*evt = &data[*pos];
+	*len = (size_t)value;
+	*pos += *len;
+	if (!varint_get(data, size, pos, &value) || value > TRACE_EXT_LEN_MAX || size - *pos < value)
+		return 0;
+	*ext = &data[*pos];
+	*ext_len = (size_t)value;
+	*pos += *ext_len;
+	return 1;
+}
+
+uint32_t trace_replay_load(const char* path)
+{
+	if (path == NULL)
+		return NRF_ERROR_NULL;
+	if (m_opened)
+		return NRF_ERROR_INVALID_STATE;
+
+	FILE* f = NULL;
+	if (fopen_s(&f, path, "rb") != 0 || f == NULL)
+		return NRF_ERROR_NOT_FOUND;
+	std::vector<uint8_t> data;
+	uint8_t chunk[TRACE_FILE_BUFFER];
+	size_t read = 0;
+	while ((read = fread(chunk, 1, sizeof(chunk), f)) > 0)
+		data.insert(data.end(), chunk, chunk + read);
+	fclose(f);
+
+	uint8_t header[TRACE_HEADER_LEN];
+	trace_header_build(header);
+	if (data.size() < TRACE_HEADER_LEN || memcmp(data.data(), header, TRACE_HEADER_LEN) != 0)
+		return NRF_ERROR_INVALID_DATA;
+
+	// validated here so a replay measures handlers instead of parsing errors
+	m_replay_data.swap(data);
+	size_t pos = TRACE_HEADER_LEN;
+	uint64_t delta_us = 0;
+	const uint8_t* evt = NULL, * ext = NULL;
+	size_t len = 0, ext_len = 0;
+	while (pos < m_replay_data.size()) {
+		if (!trace_next(&pos, &delta_us, &evt, &len, &ext, &ext_len)) {
+			m_replay_data.clear();
+			return NRF_ERROR_INVALID_DATA;
+		}
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t trace_replay_run(float speed, trace_replay_stats_t* stats)
+{
+	if (speed < 0)
+		return NRF_ERROR_INVALID_PARAM;
+	if (!m_opened || m_evt_handler == NULL)
+		return NRF_ERROR_INVALID_STATE;
+
+	{
+		std::lock_guard<std::mutex> lck(m_trace_mtx);
+		m_handler_stats.clear();
+	}
+
+	// event buffer of SoftDevice is 8-byte aligned, pointed data follows the event
+	std::vector<uint64_t> buf((TRACE_EVT_LEN_MAX + TRACE_EXT_LEN_MAX) / 8);
+	auto p_ble_evt = (ble_evt_t*)buf.data();
+	auto ext_buf = (uint8_t*)buf.data() + TRACE_EVT_LEN_MAX;
+	std::map<uint16_t, trace_handler_stats_t> handler_stats;
+	uint32_t events = 0;
+	uint64_t trace_us = 0;
+	size_t pos = TRACE_HEADER_LEN;
+	uint64_t delta_us = 0;
+	const uint8_t* evt = NULL, * ext = NULL;
+	size_t len = 0, ext_len = 0;
+
+	auto start = trace_clock_t::now();
+	while (m_opened && trace_next(&pos, &delta_us, &evt, &len, &ext, &ext_len)) {
+		trace_us += delta_us;
+		if (speed > 0)
+			std::this_thread::sleep_until(start + std::chrono::microseconds((uint64_t)(trace_us / speed)));
+
+		// trailing zeros were trimmed
+		memset(buf.data(), 0, len < sizeof(ble_evt_t) ? sizeof(ble_evt_t) : len);
+		memcpy(p_ble_evt, evt, len);
+		memcpy(ext_buf, ext, ext_len);
+		trace_ext_set(p_ble_evt, ext_buf, ext_len);
+		uint16_t evt_id = p_ble_evt->header.evt_id;
+
+		auto handled = trace_clock_t::now();
+		m_evt_handler((adapter_t*)m_adapter, p_ble_evt);
+		uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(trace_clock_t::now() - handled).count();
+		events++;
+
+		auto& latency = handler_stats[evt_id];
+		latency.evt_id = evt_id;
+		latency.count++;
+		latency.total_ns += ns;
+		if (ns > latency.max_ns)
+			latency.max_ns = ns;
+	}
+
+	{
+		std::lock_guard<std::mutex> lck(m_trace_mtx);
+		m_handler_stats.swap(handler_stats);
+	}
+	if (stats) {
+		stats->events = events;
+		stats->elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(trace_clock_t::now() - start).count();
+		stats->trace_us = trace_us;
+	}
+	return NRF_SUCCESS;
+}
+
+uint32_t trace_handler_stats_get(trace_handler_stats_t* stats, uint32_t max)
+{
+	std::lock_guard<std::mutex> lck(m_trace_mtx);
+	uint32_t count = 0;
+	for (auto& latency : m_handler_stats) {
+		if (stats == NULL || count >= max)
+			break;
+		stats[count++] = latency.second;
+	}
+	return stats == NULL ? (uint32_t)m_handler_stats.size() : count;
+}
+
+#pragma endregion
+
+#pragma region /** Backend */
+
+static uint32_t trace_rpc_open(adapter_t* adapter, sd_rpc_status_handler_t status_handler, sd_rpc_evt_handler_t event_handler, sd_rpc_log_handler_t log_handler)
+{
+	if (m_opened || event_handler == NULL)
+		return NRF_ERROR_INVALID_STATE;
+	m_evt_handler = event_handler;
+	m_opened = true;
+	return NRF_SUCCESS;
+}
+
+static uint32_t trace_rpc_close(adapter_t* adapter)
+{
+	if (!m_opened)
+		return NRF_ERROR_INVALID_STATE;
+	// a replay in progress stops before next event
+	m_opened = false;
+	return NRF_SUCCESS;
+}
+
+/* any other call, the response of the captured one is in the trace */
+template <typename... Args>
+static uint32_t trace_call(adapter_t* adapter, Args... args)
+{
+	return NRF_SUCCESS;
+}
+
+static const sd_api_t m_trace_api = {
+	trace_rpc_open,
+	trace_rpc_close,
+	trace_call,
+	trace_call,
+
+	trace_call,
+	trace_call,
+	trace_call,
+#if NRF_SD_BLE_API >= 5
+	trace_call,
+#endif
+
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+#if NRF_SD_BLE_API >= 5
+	trace_call,
+	trace_call,
+#endif
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+	trace_call,
+#if NRF_SD_BLE_API >= 3
+	trace_call,
+#endif
+};
+
+const sd_api_t* trace_api()
+{
+	return &m_trace_api;
+}
+
+adapter_t* trace_adapter()
+{
+	return (adapter_t*)m_adapter;
+}
+
+#pragma endregion
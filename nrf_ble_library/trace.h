@@ -0,0 +1,43 @@
+#pragma once
+#include "sd_api.h"
+
+// capture of BLE events given to the event handler into a compact binary trace file, and a replay
+// backend feeding a trace to the handler of its rpc_open, SoftDevice calls made by handlers during
+// replay succeed without effect since their responses are events of the trace
+
+#define TRACE_EVT_LEN_MAX 2048 /* ble_evt_t with its variable length data, longer events are truncated */
+#define TRACE_EXT_LEN_MAX 2048 /* data referred by pointer of event, v6 advertising data or LESC peer key */
+
+/* handler latency of one event id in a replay */
+typedef struct _trace_handler_stats_t {
+	uint16_t evt_id;
+	uint32_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+} trace_handler_stats_t;
+
+typedef struct _trace_replay_stats_t {
+	uint32_t events; /* events given to the event handler */
+	uint64_t elapsed_us; /* wall time of replay */
+	uint64_t trace_us; /* captured duration of the events */
+} trace_replay_stats_t;
+
+// create trace file, return NRF_ERROR_INVALID_STATE if recording, NRF_ERROR_INTERNAL if file can not be opened
+uint32_t trace_record_start(const char* path);
+// write event with time since previous one, no-op unless recording, called before dispatching
+void trace_record(const ble_evt_t* p_ble_evt);
+// flush and close trace file, output events and bytes written
+uint32_t trace_record_stop(uint32_t* events, uint64_t* bytes);
+
+// load and validate trace before rpc_open of trace_api, NRF_ERROR_INVALID_DATA if captured by
+// other build of different SoftDevice API or event layout
+uint32_t trace_replay_load(const char* path);
+// give loaded events to the event handler in caller thread, speed 1 as captured, 2 twice as fast,
+// 0 as fast as possible, return when all events are handled or backend is closed
+uint32_t trace_replay_run(float speed, trace_replay_stats_t* stats);
+// handler latency of the last replay ordered by event id, up to max, return count of event ids
+uint32_t trace_handler_stats_get(trace_handler_stats_t* stats, uint32_t max);
+
+// call table of replay backend and the adapter to pass to its calls
+const sd_api_t* trace_api();
+adapter_t* trace_adapter();
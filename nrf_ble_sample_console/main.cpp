@@ -5,6 +5,7 @@
 #include <mutex>
 
 #include "dongle.h"
+#include "platform.h"
 
 bool discovered = false;
 // argv[3]
@@ -186,6 +187,29 @@ void parse_read_command(std::vector<std::string> split_cmd) {
 	printf("\n");
 }
 
+void parse_bench_command(std::vector<std::string> split_cmd) {
+	uint32_t iterations = 100;
+	if (split_cmd.size() >= 2) {
+		iterations = strtoul(split_cmd[1].c_str(), nullptr, 10);
+	}
+
+	for (uint8_t backend = 0; backend < 2; backend++) {
+		float keygen_ops = 0, ecdh_ops = 0;
+		uint32_t err = ecc_benchmark(backend, iterations, &keygen_ops, &ecdh_ops);
+		printf("[main] ecc backend:%d code:%d keygen:%.1f ops/s ecdh:%.1f ops/s\n", backend, err, keygen_ops, ecdh_ops);
+		float pairing_us = 0;
+		err = ecc_selftest(backend, iterations, &pairing_us);
+		printf("[main] ecc backend:%d selftest code:%d pairing crypto:%.1f us\n", backend, err, pairing_us);
+	}
+
+	uint32_t request_sizes[] = { 16, 32, 64, 1024 };
+	for (auto request_size : request_sizes) {
+		float bytes_per_sec = 0;
+		uint32_t err = rng_benchmark(request_size, 1024 * 1024, &bytes_per_sec);
+		printf("[main] rng request:%d bytes code:%d %.1f MB/s\n", request_size, err, bytes_per_sec / (1024 * 1024));
+	}
+}
+
 void print_usage() {
 	printf("[main] supported input command:\n" \
 		"    help        :Show this message\n" \
@@ -193,6 +217,7 @@ void print_usage() {
 		"    disconnect  :Disconnect current connected device\n" \
 		"    write xx xx yy yy  :Write data to report characteristic by report reference\n" \
 		"    read xx xx         :Read data from report characteristic by report reference\n" \
+		"    bench [n]   :Self test and measure ECC key pair generation and DHKey in n iterations, and RNG throughput\n" \
 		"    q(or Q)     :Quit app\n");
 }
 
@@ -207,6 +232,9 @@ void parse_input_command(std::string &line) {
 	else if (sp[0].compare("disconnect") == 0) {
 		dongle_disconnect();
 	}
+	else if (sp[0].compare("bench") == 0) {
+		parse_bench_command(sp);
+	}
 	else if (sp[0].compare("scan") == 0) {
 		scan_start(200, 50, true, 0);
 	}
@@ -218,9 +246,9 @@ void parse_input_command(std::string &line) {
 // establish central and peripheral communication by given address/rssi with thread blocked timeout
 uint32_t sync_type_start(std::string addr_str, int8_t rssi, uint16_t timeout) {
 
-	callback_add(FN_ON_DISCONNECTED, &on_dev_disconnected);
-	callback_add(FN_ON_FAILED, &on_dev_failed);
-	callback_add(FN_ON_DATA_RECEIVED, &on_dev_data_received);
+	callback_add(FN_ON_DISCONNECTED, (void*)&on_dev_disconnected);
+	callback_add(FN_ON_FAILED, (void*)&on_dev_failed);
+	callback_add(FN_ON_DATA_RECEIVED, (void*)&on_dev_data_received);
 
 	printf("[main] ======== sync type start ========\n");
 	uint8_t* addr = NULL;
@@ -239,32 +267,53 @@ uint32_t sync_type_start(std::string addr_str, int8_t rssi, uint16_t timeout) {
 // establish central and peripheral communication by callback with target_addr/target_rssi
 int async_type_start() {
 
-	callback_add(FN_ON_DISCOVERED, &on_dev_discovered);
-	callback_add(FN_ON_CONNECTED, &on_dev_connected);
-	callback_add(FN_ON_PASSKEY_REQUIRED, &on_dev_passkey_required);
-	callback_add(FN_ON_AUTHENTICATED, &on_dev_authenticated);
-	callback_add(FN_ON_SERVICE_DISCOVERED, &on_dev_service_discovered);
-	callback_add(FN_ON_SERVICE_ENABLED, &on_dev_service_enabled);
-	callback_add(FN_ON_DISCONNECTED, &on_dev_disconnected);
-	callback_add(FN_ON_FAILED, &on_dev_failed);
-	callback_add(FN_ON_DATA_RECEIVED, &on_dev_data_received);
+	callback_add(FN_ON_DISCOVERED, (void*)&on_dev_discovered);
+	callback_add(FN_ON_CONNECTED, (void*)&on_dev_connected);
+	callback_add(FN_ON_PASSKEY_REQUIRED, (void*)&on_dev_passkey_required);
+	callback_add(FN_ON_AUTHENTICATED, (void*)&on_dev_authenticated);
+	callback_add(FN_ON_SERVICE_DISCOVERED, (void*)&on_dev_service_discovered);
+	callback_add(FN_ON_SERVICE_ENABLED, (void*)&on_dev_service_enabled);
+	callback_add(FN_ON_DISCONNECTED, (void*)&on_dev_disconnected);
+	callback_add(FN_ON_FAILED, (void*)&on_dev_failed);
+	callback_add(FN_ON_DATA_RECEIVED, (void*)&on_dev_data_received);
 
 	uint32_t error_code = scan_start(200, 50, true, 0);
 	return error_code;
 }
 
+// round trip and event rate of each retransmission interval with and without flow control, to pick a stable one for the dongle,
+// UART baud rate of connectivity firmware is fixed at build time, only the given rate it is built with responds
+int transport_sweep(char* serial_port, uint32_t baud_rate) {
+	uint32_t retransmission_intervals[] = { 100, 250, 500 };
+	for (auto retransmission_interval : retransmission_intervals) {
+		for (int flow_control = 0; flow_control < 2; flow_control++) {
+			uint32_t error_code = dongle_init_ex(serial_port, baud_rate, flow_control == 1, retransmission_interval, 1500);
+			float rtt_avg = 0, rtt_max = 0, events_per_sec = 0;
+			if (error_code == 0)
+				error_code = link_benchmark(200, 3000, &rtt_avg, &rtt_max, &events_per_sec);
+			printf("[main] baud:%d retransmission:%d ms flow control:%d code:%d rtt avg:%.1f us max:%.1f us events:%.1f/s\n",
+				baud_rate, retransmission_interval, flow_control, error_code, rtt_avg, rtt_max, events_per_sec);
+			dongle_reset();
+		}
+	}
+	return 0;
+}
+
 int main(int argc, char * argv[])
 {	
 	uint32_t error_code;
-	char     serial_port[10] = "COM3";
+	char     serial_port[64] = "COM3"; /* or device path on Linux, e.g. /dev/ttyACM0 */
 	uint32_t baud_rate = 1000000;
 
-	// given serial port string
+	// given serial port string, or "auto" to find attached dongle
 	if (argc > 1)
 		strcpy_s(serial_port, argv[1]);
 	// given baud rate
 	if (argc > 2)
 		baud_rate = atoi(argv[2]);
+	// "transport" measures transport settings instead of connecting a peripheral
+	if (argc > 3 && strcmp(argv[3], "transport") == 0)
+		return transport_sweep(serial_port, baud_rate);
 	// given address hex string(upper case) for peripheral connection
 	if (argc > 3)
 		target_addr = std::string(argv[3]);
@@ -272,7 +321,11 @@ int main(int argc, char * argv[])
 	if (argc > 4)
 		target_rssi = atoi(argv[4]);
 
-	error_code = dongle_init(serial_port, baud_rate);
+	// "auto" takes the first responding dongle attached
+	if (strcmp(serial_port, "auto") == 0)
+		error_code = dongle_init_auto(baud_rate, NULL, serial_port);
+	else
+		error_code = dongle_init(serial_port, baud_rate);
 
 	error_code = sync_type_start(target_addr, target_rssi, 30000);
 	//error_code = async_type_start();
@@ -291,19 +344,8 @@ int main(int argc, char * argv[])
 		//if (c == 'q' || c == 'Q')
 		if (line.compare("q") == 0 || line.compare("Q") == 0)
 		{
-			scan_stop();
-
-			uint32_t err = 0;
-			if (connected) {
-				err = dongle_disconnect();
-				// if success, wait until dongle_disconnect() finished;
-				if (err == 0) {
-					std::unique_lock<std::mutex> lck{ mtx };
-					cond.wait(lck);
-				}
-			}
-			
-			dongle_reset();
+			// stops scanning, disconnects and waits for disconnected event before closing adapter
+			dongle_shutdown(3000, NULL);
 
 			return 0;
 		}
@@ -0,0 +1,90 @@
+#include "aes.h"
+#include "irk.h"
+#include "check.h"
+
+#include <string.h>
+
+// AES-128, AES-CMAC and the security functions built on them against the spec vectors:
+// FIPS-197 C.1, RFC 4493 (Core Spec Vol 3 Part H D.1), f4 of D.2 and ah of D.7
+
+static const char* m_cmac_key = "2b7e151628aed2a6abf7158809cf4f3c";
+static const char* m_cmac_message =
+	"6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+	"30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+static const struct {
+	uint32_t len;
+	const char* mac;
+} m_cmac_vectors[] = {
+	{ 0, "bb1d6929e95937287fa37d129b756746" },
+	{ 16, "070a16b46b4d4144f79bdd9dd04a287c" },
+	{ 40, "dfa66747de9ae63030ca32611497c827" },
+	{ 64, "51f0bebf7e3b9d92fc49741779363cfe" },
+};
+
+static void test_aes_encrypt() {
+	uint8_t k[AES_BLOCK_LEN], in[AES_BLOCK_LEN], expected[AES_BLOCK_LEN], out[AES_BLOCK_LEN];
+	hex_to_bytes("000102030405060708090a0b0c0d0e0f", k, AES_BLOCK_LEN);
+	hex_to_bytes("00112233445566778899aabbccddeeff", in, AES_BLOCK_LEN);
+	hex_to_bytes("69c4e0d86a7b0430d8cdb78070b4c55a", expected, AES_BLOCK_LEN);
+	aes_key_t key;
+	aes_expand_key(&key, k);
+	aes_encrypt(&key, in, out);
+	CHECK(memcmp(out, expected, AES_BLOCK_LEN) == 0);
+}
+
+static void test_aes_cmac() {
+	uint8_t k[AES_BLOCK_LEN], m[64], expected[AES_BLOCK_LEN], mac[AES_BLOCK_LEN];
+	hex_to_bytes(m_cmac_key, k, AES_BLOCK_LEN);
+	hex_to_bytes(m_cmac_message, m, sizeof(m));
+	for (auto& v : m_cmac_vectors) {
+		hex_to_bytes(v.mac, expected, AES_BLOCK_LEN);
+		aes_cmac(k, m, v.len, mac);
+		CHECK(memcmp(mac, expected, AES_BLOCK_LEN) == 0);
+	}
+}
+
+// f4(U, V, X, Z) = AES-CMAC_X(U || V || Z)
+static void test_f4() {
+	uint8_t m[65], x[AES_BLOCK_LEN], expected[AES_BLOCK_LEN], mac[AES_BLOCK_LEN];
+	hex_to_bytes(
+		"20b003d2f297be2c5e2c83a7e9f9a5b9eff49111acf4fddbcc0301480e359de6"
+		"55188b3d32f6bb9a900afcfbeed4e72a59cb9ac2f19d7cfb6b4fdd49f47fc5fd00", m, sizeof(m));
+	hex_to_bytes("d5cb8454d177733effffb2ec712baeab", x, AES_BLOCK_LEN);
+	hex_to_bytes("f2c916f107a9bd1cf1eda1bea974872d", expected, AES_BLOCK_LEN);
+	aes_cmac(x, m, sizeof(m), mac);
+	CHECK(memcmp(mac, expected, AES_BLOCK_LEN) == 0);
+}
+
+// ah(IRK, prand) = 0x0dfbaa of prand 0x708194, address and IRK little endian as SoftDevice
+static void test_ah() {
+	uint8_t irk[IRK_LEN];
+	hex_to_le_bytes("ec0234a357c8ad05341010a60a397d9b", irk, IRK_LEN);
+	uint8_t addr[6] = { 0xaa, 0xfb, 0x0d, 0x94, 0x81, 0x70 };
+	CHECK(irk_is_resolvable(addr) == 1);
+	CHECK(irk_ah_match(irk, addr) == 1);
+
+	uint8_t other[6];
+	memcpy(other, addr, sizeof(other));
+	other[0] ^= 0x01;
+	CHECK(irk_ah_match(irk, other) == 0);
+
+	// resolved through the table, then from the cache of the same address
+	uint64_t id = 0;
+	irk_table_clear();
+	CHECK(irk_table_add(0x1234, irk) == 1);
+	CHECK(irk_resolve(addr, &id) == 1 && id == 0x1234);
+	id = 0;
+	CHECK(irk_resolve(addr, &id) == 1 && id == 0x1234);
+	CHECK(irk_resolve(other, &id) == 0);
+	CHECK(irk_table_remove(0x1234) == 1);
+	CHECK(irk_resolve(addr, &id) == 0);
+	CHECK(irk_table_size() == 0);
+}
+
+int main() {
+	test_aes_encrypt();
+	test_aes_cmac();
+	test_f4();
+	test_ah();
+	return check_result("aes_vectors");
+}
@@ -0,0 +1,189 @@
+#include "bond.h"
+#include "check.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// bond store persistence: reload, delete, truncated and corrupted tail, compaction,
+// interrupted compaction and an unrecognized file, in the working directory of ctest
+
+#define BOND_TEST_PATH "bond_store_test.bin"
+
+static void remove_files() {
+	remove(BOND_TEST_PATH);
+	remove(BOND_TEST_PATH ".tmp");
+	remove(BOND_TEST_PATH ".bad");
+}
+
+static long file_size(const char* path) {
+	FILE* f = fopen(path, "rb");
+	if (f == NULL)
+		return -1;
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fclose(f);
+	return len;
+}
+
+static void append_bytes(const char* path, const uint8_t* p, size_t len) {
+	FILE* f = fopen(path, "ab");
+	if (f == NULL)
+		return;
+	fwrite(p, 1, len, f);
+	fclose(f);
+}
+
+static bond_data_t make_bond(uint8_t seed) {
+	bond_data_t data;
+	data.flags = BOND_FLAG_OWN_ENC | BOND_FLAG_PEER_ENC | BOND_FLAG_PEER_ID;
+	data.addr_type = 1;
+	for (int i = 0; i < BOND_ADDR_LEN; i++)
+		data.addr[i] = (uint8_t)(seed + i);
+	memset(data.own_enc.ltk, seed, BOND_KEY_LEN);
+	data.own_enc.ltk_len = BOND_KEY_LEN;
+	data.own_enc.lesc = 1;
+	memset(data.peer_enc.ltk, seed ^ 0xFF, BOND_KEY_LEN);
+	data.peer_enc.ediv = (uint16_t)(seed * 257);
+	memset(data.peer_irk, seed + 1, BOND_KEY_LEN);
+	memset(data.peer_pk, seed + 2, BOND_PK_LEN);
+	data.gatt.assign(20 + seed % 8, seed);
+	return data;
+}
+
+/* fields one by one, the struct has padding */
+static bool same_enc_key(const bond_enc_key_t& a, const bond_enc_key_t& b) {
+	return memcmp(a.ltk, b.ltk, BOND_KEY_LEN) == 0 && a.ltk_len == b.ltk_len && a.auth == b.auth &&
+		a.lesc == b.lesc && a.ediv == b.ediv && memcmp(a.rand, b.rand, BOND_RAND_LEN) == 0;
+}
+
+static bool same_bond(const bond_data_t& a, const bond_data_t& b) {
+	return a.flags == b.flags && a.addr_type == b.addr_type && memcmp(a.addr, b.addr, BOND_ADDR_LEN) == 0 &&
+		same_enc_key(a.own_enc, b.own_enc) && same_enc_key(a.peer_enc, b.peer_enc) &&
+		a.peer_id_addr_type == b.peer_id_addr_type && memcmp(a.peer_id_addr, b.peer_id_addr, BOND_ADDR_LEN) == 0 &&
+		memcmp(a.peer_irk, b.peer_irk, BOND_KEY_LEN) == 0 && memcmp(a.peer_csrk, b.peer_csrk, BOND_KEY_LEN) == 0 &&
+		memcmp(a.own_pk, b.own_pk, BOND_PK_LEN) == 0 && memcmp(a.peer_pk, b.peer_pk, BOND_PK_LEN) == 0 &&
+		a.gatt == b.gatt;
+}
+
+static bool stored(uint64_t addr_num, uint8_t seed) {
+	bond_data_t data;
+	return bond_get(addr_num, &data) == 1 && same_bond(data, make_bond(seed));
+}
+
+static void test_reload() {
+	remove_files();
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	CHECK(bond_list(NULL, 0) == 0);
+	bond_data_t a = make_bond(1), b = make_bond(2);
+	CHECK(bond_put(0x10, &a) == 1);
+	CHECK(bond_put(0x20, &b) == 1);
+	uint8_t sk[BOND_SK_LEN], pk[BOND_PK_LEN];
+	memset(sk, 0x5A, sizeof(sk));
+	memset(pk, 0xA5, sizeof(pk));
+	bond_local_key_set(sk, pk);
+	bond_store_close();
+	CHECK(bond_get(0x10, &a) == 0);
+
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	uint64_t addr_nums[4] = { 0 };
+	CHECK(bond_list(addr_nums, 4) == 2 && addr_nums[0] == 0x10 && addr_nums[1] == 0x20);
+	CHECK(stored(0x10, 1));
+	CHECK(stored(0x20, 2));
+	uint8_t sk2[BOND_SK_LEN], pk2[BOND_PK_LEN];
+	CHECK(bond_local_key_get(sk2, pk2) == 1);
+	CHECK(memcmp(sk, sk2, BOND_SK_LEN) == 0 && memcmp(pk, pk2, BOND_PK_LEN) == 0);
+
+	CHECK(bond_delete(0x10) == 1);
+	CHECK(bond_delete(0x10) == 0);
+	bond_store_close();
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	CHECK(bond_list(NULL, 0) == 1);
+	CHECK(stored(0x20, 2));
+	bond_store_close();
+}
+
+// tail of an interrupted write is cut at open, records appended after it stay readable
+static void test_truncated() {
+	long len = file_size(BOND_TEST_PATH);
+	uint8_t partial[9] = { 1, 0x30, 0, 0, 0, 0, 0, 0, 0 };
+	append_bytes(BOND_TEST_PATH, partial, sizeof(partial));
+	CHECK(file_size(BOND_TEST_PATH) == len + (long)sizeof(partial));
+
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	CHECK(bond_list(NULL, 0) == 1);
+	CHECK(stored(0x20, 2));
+	bond_data_t c = make_bond(3);
+	CHECK(bond_put(0x30, &c) == 1);
+	bond_store_close();
+
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	CHECK(stored(0x20, 2));
+	CHECK(stored(0x30, 3));
+	bond_store_close();
+
+	// corrupted crc of the last record drops it only
+	FILE* f = fopen(BOND_TEST_PATH, "r+b");
+	CHECK(f != NULL);
+	if (f != NULL) {
+		fseek(f, -1, SEEK_END);
+		int last = fgetc(f);
+		fseek(f, -1, SEEK_END);
+		fputc(last ^ 0xFF, f);
+		fclose(f);
+	}
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	CHECK(stored(0x20, 2));
+	CHECK(bond_get(0x30, &c) == 0);
+	bond_store_close();
+}
+
+// rewrites of the same record are compacted by the writer, the last one is kept
+static void test_compaction() {
+	remove_files();
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	for (uint8_t i = 0; i < 200; i++) {
+		bond_data_t data = make_bond(i);
+		CHECK(bond_put(0x40, &data) == 1);
+		if (i % 10 == 0)
+			bond_store_flush();
+	}
+	bond_store_close();
+	// 200 entries of ~280 bytes take ~55 KB without compaction, the threshold keeps up to ~40
+	CHECK(file_size(BOND_TEST_PATH) > 0 && file_size(BOND_TEST_PATH) < 50 * 300);
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	CHECK(bond_list(NULL, 0) == 1);
+	CHECK(stored(0x40, 199));
+	bond_store_close();
+
+	// interrupted compaction, the new file was written but not renamed yet
+	CHECK(rename(BOND_TEST_PATH, BOND_TEST_PATH ".tmp") == 0);
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	CHECK(stored(0x40, 199));
+	bond_store_close();
+	CHECK(file_size(BOND_TEST_PATH ".tmp") < 0);
+}
+
+// unrecognized file is kept aside as .bad, a new store is started
+static void test_unrecognized() {
+	remove_files();
+	const uint8_t garbage[] = "not a bond store";
+	append_bytes(BOND_TEST_PATH, garbage, sizeof(garbage));
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	CHECK(bond_list(NULL, 0) == 0);
+	CHECK(file_size(BOND_TEST_PATH ".bad") == (long)sizeof(garbage));
+	bond_data_t d = make_bond(4);
+	CHECK(bond_put(0x50, &d) == 1);
+	bond_store_close();
+	CHECK(bond_store_open(BOND_TEST_PATH) == 1);
+	CHECK(stored(0x50, 4));
+	bond_store_close();
+	remove_files();
+}
+
+int main() {
+	test_reload();
+	test_truncated();
+	test_compaction();
+	test_unrecognized();
+	return check_result("bond_store");
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <stdio.h>
+#include <stdint.h>
+
+// assertions of ctest programs, failures are counted and printed, main returns the count
+
+static int m_check_failed = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("FAILED %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		m_check_failed++; \
+	} \
+} while (0)
+
+/* big endian hex as the spec prints it into bytes in the same order */
+static inline void hex_to_bytes(const char* hex, uint8_t* bytes, uint32_t len) {
+	for (uint32_t i = 0; i < len; i++) {
+		unsigned int v = 0;
+		sscanf(&hex[i * 2], "%2x", &v);
+		bytes[i] = (uint8_t)v;
+	}
+}
+
+/* big endian hex into little endian bytes as SoftDevice */
+static inline void hex_to_le_bytes(const char* hex, uint8_t* bytes, uint32_t len) {
+	for (uint32_t i = 0; i < len; i++) {
+		unsigned int v = 0;
+		sscanf(&hex[i * 2], "%2x", &v);
+		bytes[len - 1 - i] = (uint8_t)v;
+	}
+}
+
+static inline int check_result(const char* name) {
+	printf("[test] %s: %d failed\n", name, m_check_failed);
+	return m_check_failed == 0 ? 0 : 1;
+}
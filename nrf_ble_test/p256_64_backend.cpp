@@ -0,0 +1,23 @@
+#include "ecc_p256.h"
+#include "uECC/uECC.h"
+
+// uECC test programs rebuilt against the 64-bit limbs backend, their uECC_* calls are renamed
+// to these by CMake, other curves than secp256r1 stay on micro-ecc
+
+extern "C" int p256_64_test_make_key(uint8_t* public_key, uint8_t* private_key, uECC_Curve curve) {
+	if (curve != uECC_secp256r1())
+		return uECC_make_key(public_key, private_key, curve);
+	return p256_64_make_key(public_key, private_key);
+}
+
+extern "C" int p256_64_test_compute_public_key(const uint8_t* private_key, uint8_t* public_key, uECC_Curve curve) {
+	if (curve != uECC_secp256r1())
+		return uECC_compute_public_key(private_key, public_key, curve);
+	return p256_64_compute_public_key(private_key, public_key);
+}
+
+extern "C" int p256_64_test_shared_secret(const uint8_t* public_key, const uint8_t* private_key, uint8_t* secret, uECC_Curve curve) {
+	if (curve != uECC_secp256r1())
+		return uECC_shared_secret(public_key, private_key, secret, curve);
+	return p256_64_shared_secret(public_key, private_key, secret);
+}
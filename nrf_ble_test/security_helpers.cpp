@@ -0,0 +1,198 @@
+#include "security.h"
+#include "aes.h"
+#include "check.h"
+
+#include <string.h>
+#include <vector>
+
+// secure helpers, key pairs, little endian wrappers of the ECC backend in build, self test of
+// both backends, LESC OOB confirm value and batch functions
+
+/* 2G of secp256r1 in big endian hex, x then y */
+static const char* m_pk_of_2 =
+	"7CF27B188D034F7E8A52380304B51AC3C08969E277F21B35A60B48FC47669978"
+	"07775510DB8ED040293D9AC69F7430DBBA7DADE63CE982299E04B79D227873D1";
+/* NIST CAVS ECC CDH P-256 COUNT 0, own private key d, peer public key, shared secret Z */
+static const char* m_cdh_d = "7D7DC5F71EB29DDAF80D6214632EEAE03D9058AF1FB6D22ED80BADB62BC1A534";
+static const char* m_cdh_peer =
+	"700C48F77F56584C5CC632CA65640DB91B6BACCE3A4DF6B42CE7CC838833D287"
+	"DB71E509E3FD9B060DDB20BA5C51DCC5948D46FBF640DFE0441782CAB85FA4AC";
+static const char* m_cdh_z = "46FC62106420FF012E54A434FBDD2D25CCC5852060561E68040DD7778997BD7B";
+
+/* P-256 public key hex into x and y little endian as SoftDevice */
+static void pk_hex_to_le(const char* hex, uint8_t* pk) {
+	hex_to_le_bytes(hex, pk, ECC_P256_SK_LEN);
+	hex_to_le_bytes(&hex[ECC_P256_SK_LEN * 2], &pk[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
+}
+
+static bool all_zero(const void* p, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		if (((const uint8_t*)p)[i] != 0)
+			return false;
+	}
+	return true;
+}
+
+static void test_secure_helpers() {
+	uint8_t a[32], b[32];
+	memset(a, 0xA5, sizeof(a));
+	memcpy(b, a, sizeof(b));
+	CHECK(secure_compare(a, b, sizeof(a)) == 1);
+	CHECK(secure_compare(a, b, 0) == 1);
+	b[0] ^= 0x01;
+	CHECK(secure_compare(a, b, sizeof(a)) == 0);
+	b[0] ^= 0x01;
+	b[31] ^= 0x80;
+	CHECK(secure_compare(a, b, sizeof(a)) == 0);
+
+	secure_zero(a, sizeof(a));
+	CHECK(all_zero(a, sizeof(a)));
+	secure_zero(NULL, sizeof(a));
+}
+
+static void test_keypair() {
+	ecc_init();
+	ecc_keypair_t keypair;
+	memset(&keypair, 0xFF, sizeof(keypair));
+	CHECK(ecc_keypair_generate(&keypair) == 1);
+	CHECK(ecc_p256_valid_public_key(keypair.pk) == 1);
+
+	uint8_t pk[ECC_P256_PK_LEN];
+	CHECK(ecc_p256_compute_pubkey(keypair.sk, pk) == 1);
+	CHECK(memcmp(pk, keypair.pk, ECC_P256_PK_LEN) == 0);
+
+	// two key pairs agree on the shared secret
+	ecc_keypair_t peer;
+	CHECK(ecc_keypair_generate(&peer) == 1);
+	uint8_t ss[ECC_P256_SK_LEN], peer_ss[ECC_P256_SK_LEN];
+	CHECK(ecc_p256_compute_sharedsecret(keypair.sk, peer.pk, ss) == 1);
+	CHECK(ecc_p256_compute_sharedsecret(peer.sk, keypair.pk, peer_ss) == 1);
+	CHECK(memcmp(ss, peer_ss, ECC_P256_SK_LEN) == 0);
+
+	ecc_keypair_clear(&keypair);
+	ecc_keypair_clear(&peer);
+	CHECK(all_zero(&keypair, sizeof(keypair)));
+	CHECK(all_zero(&peer, sizeof(peer)));
+	CHECK(ecc_keypair_generate(NULL) == 0);
+}
+
+// keys are little endian at the API, big endian to the backend
+static void test_le_wrappers() {
+	uint8_t sk[ECC_P256_SK_LEN] = { 2 };
+	uint8_t pk[ECC_P256_PK_LEN], expected[ECC_P256_PK_LEN];
+	pk_hex_to_le(m_pk_of_2, expected);
+	CHECK(ecc_p256_compute_pubkey(sk, pk) == 1);
+	CHECK(memcmp(pk, expected, ECC_P256_PK_LEN) == 0);
+	CHECK(ecc_p256_valid_public_key(pk) == 1);
+	pk[0] ^= 0x01;
+	CHECK(ecc_p256_valid_public_key(pk) == 0);
+
+	// zero is out of range
+	memset(sk, 0, sizeof(sk));
+	CHECK(ecc_p256_compute_pubkey(sk, pk) == 0);
+	CHECK(ecc_p256_compute_pubkey(NULL, pk) == 0);
+	CHECK(ecc_p256_valid_public_key(NULL) == 0);
+
+	uint8_t peer_pk[ECC_P256_PK_LEN], ss[ECC_P256_SK_LEN], z[ECC_P256_SK_LEN];
+	hex_to_le_bytes(m_cdh_d, sk, ECC_P256_SK_LEN);
+	pk_hex_to_le(m_cdh_peer, peer_pk);
+	hex_to_le_bytes(m_cdh_z, z, ECC_P256_SK_LEN);
+	CHECK(ecc_p256_compute_sharedsecret(sk, peer_pk, ss) == 1);
+	CHECK(memcmp(ss, z, ECC_P256_SK_LEN) == 0);
+	CHECK(ecc_p256_compute_sharedsecret(NULL, peer_pk, ss) == 0);
+}
+
+static void test_selftest() {
+	float pairing_us = 0;
+	CHECK(ecc_p256_selftest(ECC_BACKEND_UECC, 2, &pairing_us) == 1);
+	// the 64-bit limbs backend is built on 64-bit hosts only
+	int ret = ecc_p256_selftest(ECC_BACKEND_P256_64, 2, &pairing_us);
+	CHECK(ret == 1 || (ret == -1 && sizeof(void*) < 8));
+	CHECK(ecc_p256_selftest(ECC_BACKEND_P256_64 + 1, 0, NULL) == -1);
+}
+
+// c = f4(PKx, PKx, r, 0), all little endian at the API
+static void test_lesc_oob() {
+	uint8_t pk[ECC_P256_PK_LEN], r[LESC_OOB_LEN], c[LESC_OOB_LEN];
+	pk_hex_to_le(m_pk_of_2, pk);
+	hex_to_le_bytes("d5cb8454d177733effffb2ec712baeab", r, LESC_OOB_LEN);
+	CHECK(lesc_oob_confirm(pk, r, c) == 1);
+
+	uint8_t m[ECC_P256_SK_LEN * 2 + 1] = { 0 };
+	uint8_t x[AES_BLOCK_LEN], mac[AES_BLOCK_LEN], expected[LESC_OOB_LEN];
+	hex_to_bytes(m_pk_of_2, &m[0], ECC_P256_SK_LEN);
+	hex_to_bytes(m_pk_of_2, &m[ECC_P256_SK_LEN], ECC_P256_SK_LEN);
+	hex_to_bytes("d5cb8454d177733effffb2ec712baeab", x, AES_BLOCK_LEN);
+	aes_cmac(x, m, sizeof(m), mac);
+	for (int i = 0; i < LESC_OOB_LEN; i++)
+		expected[i] = mac[LESC_OOB_LEN - 1 - i];
+	CHECK(memcmp(c, expected, LESC_OOB_LEN) == 0);
+
+	uint8_t r2[LESC_OOB_LEN], c2[LESC_OOB_LEN];
+	CHECK(lesc_oob_generate(pk, r2, c2) == 1);
+	CHECK(lesc_oob_confirm(pk, r2, c) == 1);
+	CHECK(memcmp(c, c2, LESC_OOB_LEN) == 0);
+	CHECK(lesc_oob_confirm(NULL, r, c) == 0);
+}
+
+static void test_batches() {
+	const uint32_t count = 8;
+	std::vector<uint8_t> sks(count * ECC_P256_SK_LEN);
+	std::vector<uint8_t> pks(count * ECC_P256_PK_LEN);
+	for (uint32_t i = 0; i < count; i++)
+		CHECK(ecc_p256_gen_keypair(&sks[i * ECC_P256_SK_LEN], &pks[i * ECC_P256_PK_LEN]) == 1);
+	// odd keys off the curve
+	for (uint32_t i = 1; i < count; i += 2)
+		pks[i * ECC_P256_PK_LEN] ^= 0x01;
+
+	std::vector<uint8_t> results(count);
+	for (uint32_t threads : { 0u, 1u, 3u }) {
+		CHECK(ecc_p256_valid_public_key_batch(pks.data(), count, results.data(), threads, NULL) == (int)count / 2);
+		for (uint32_t i = 0; i < count; i++)
+			CHECK(results[i] == (i % 2 == 0 ? 1 : 0));
+	}
+
+	// one own key with each peer key, compared with single calls
+	std::vector<uint8_t> ss(count * ECC_P256_SK_LEN, 0xFF);
+	float ops_per_sec = 0;
+	CHECK(ecc_p256_compute_sharedsecret_batch(sks.data(), 1, pks.data(), count, ss.data(), results.data(), 0, &ops_per_sec) == (int)count / 2);
+	CHECK(ops_per_sec > 0);
+	for (uint32_t i = 0; i < count; i++) {
+		uint8_t expected[ECC_P256_SK_LEN] = { 0 };
+		if (i % 2 == 0)
+			CHECK(ecc_p256_compute_sharedsecret(&sks[0], &pks[i * ECC_P256_PK_LEN], expected) == 1);
+		CHECK(results[i] == (i % 2 == 0 ? 1 : 0));
+		CHECK(memcmp(&ss[i * ECC_P256_SK_LEN], expected, ECC_P256_SK_LEN) == 0);
+	}
+
+	// own key per peer key
+	CHECK(ecc_p256_compute_sharedsecret_batch(sks.data(), count, pks.data(), count, ss.data(), results.data(), 2, NULL) == (int)count / 2);
+	uint8_t expected[ECC_P256_SK_LEN];
+	CHECK(ecc_p256_compute_sharedsecret(&sks[2 * ECC_P256_SK_LEN], &pks[2 * ECC_P256_PK_LEN], expected) == 1);
+	CHECK(memcmp(&ss[2 * ECC_P256_SK_LEN], expected, ECC_P256_SK_LEN) == 0);
+	CHECK(ecc_p256_compute_sharedsecret_batch(sks.data(), 2, pks.data(), count, ss.data(), results.data(), 0, NULL) == 0);
+	ecc_pool_stop();
+
+	// key pool hands out valid key pairs, and generates them in caller thread once stopped
+	uint8_t sk[ECC_P256_SK_LEN], pk[ECC_P256_PK_LEN];
+	ecc_keypool_start(2);
+	for (int i = 0; i < 4; i++) {
+		CHECK(ecc_keypool_take(sk, pk) == 1);
+		CHECK(ecc_p256_valid_public_key(pk) == 1);
+	}
+	ecc_keypool_stop();
+	CHECK(ecc_keypool_take(sk, pk) == 1);
+	CHECK(ecc_keypool_take(NULL, pk) == 0);
+	secure_zero(sks.data(), sks.size());
+	secure_zero(sk, sizeof(sk));
+}
+
+int main() {
+	test_secure_helpers();
+	test_keypair();
+	test_le_wrappers();
+	test_selftest();
+	test_lesc_oob();
+	test_batches();
+	return check_result("security_helpers");
+}